@@ -0,0 +1,55 @@
+#include "ack_peers.h"
+#include <string.h>
+
+void AckPeerTable::reset() {
+  count = 0;
+  clock = 0;
+  evictions = 0;
+}
+
+int AckPeerTable::find(const uint8_t* mac) const {
+  for (int i = 0; i < count; i++) {
+    if (memcmp(macs[i], mac, ACK_PEER_MAC_SIZE) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+AckPeerResult AckPeerTable::use(const uint8_t* mac, uint8_t* evicted) {
+  clock++;
+  int i = find(mac);
+  if (i >= 0) {
+    lastUsed[i] = clock;
+    return ACK_PEER_KNOWN;
+  }
+
+  if (count < ACK_PEER_SLOTS) {
+    i = count++;
+    memcpy(macs[i], mac, ACK_PEER_MAC_SIZE);
+    lastUsed[i] = clock;
+    return ACK_PEER_ADDED;
+  }
+
+  // Full: the slot used longest ago (ages compare across clock wrap)
+  i = 0;
+  for (int j = 1; j < count; j++) {
+    if (clock - lastUsed[j] > clock - lastUsed[i]) {
+      i = j;
+    }
+  }
+  memcpy(evicted, macs[i], ACK_PEER_MAC_SIZE);
+  memcpy(macs[i], mac, ACK_PEER_MAC_SIZE);
+  lastUsed[i] = clock;
+  evictions++;
+  return ACK_PEER_REPLACED;
+}
+
+void AckPeerTable::forget(const uint8_t* mac) {
+  int i = find(mac);
+  if (i >= 0) {
+    count--;
+    memcpy(macs[i], macs[count], ACK_PEER_MAC_SIZE);
+    lastUsed[i] = lastUsed[count];
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef ACK_PEERS_H
+#define ACK_PEERS_H
+
+#include <stdint.h>
+
+#define ACK_PEER_MAC_SIZE 6
+#define ACK_PEER_SLOTS 16  // Under ESP-NOW's 20-peer limit (ESP_NOW_MAX_TOTAL_PEER_NUM)
+
+enum AckPeerResult {
+  ACK_PEER_KNOWN,    // Already a peer
+  ACK_PEER_ADDED,    // New, into a free slot: add it to the radio
+  ACK_PEER_REPLACED  // New, in place of the least recently used: remove that one, then add
+};
+
+// Receiver side of the acknowledgements: which nodes are ESP-NOW peers.
+// Unicast needs the destination in the radio's peer list, which holds
+// fewer entries than the nodes one auditor hears, so the table keeps the
+// most recently acknowledged ACK_PEER_SLOTS nodes and names the least
+// recently used one to remove when a new node needs a slot. A node that
+// went quiet is re-added on its next frame.
+//
+// Plain C++ with no Arduino dependencies.
+class AckPeerTable {
+private:
+  uint8_t macs[ACK_PEER_SLOTS][ACK_PEER_MAC_SIZE];
+  uint32_t lastUsed[ACK_PEER_SLOTS];
+  uint8_t count;
+  uint32_t clock;  // Counts use() calls, orders the slots by recency
+  uint32_t evictions;
+
+  int find(const uint8_t* mac) const;
+
+public:
+  AckPeerTable() { reset(); }
+  void reset();
+
+  // Make mac the most recently used peer; on ACK_PEER_REPLACED, evicted
+  // holds the MAC that left the table
+  AckPeerResult use(const uint8_t* mac, uint8_t* evicted);
+  // Drop a peer the radio refused to add
+  void forget(const uint8_t* mac);
+
+  bool contains(const uint8_t* mac) const { return find(mac) >= 0; }
+  uint8_t size() const { return count; }
+  uint32_t evictionCount() const { return evictions; }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "sequence_tracker.h"
+
+void SequenceTracker::reset() {
+  started = false;
+  highest = 0;
+  seen = 0;
+  span = 0;
+  received = 0;
+  duplicates = 0;
+  missing = 0;
+  late = 0;
+  restarts = 0;
+}
+
+SequenceResult SequenceTracker::observe(uint16_t sequence) {
+  int16_t ahead = (int16_t)(uint16_t)(sequence - highest);
+  if (started && ahead > 0 && ahead <= SEQUENCE_RESTART_GAP) {
+    // Numbers leaving the window unfilled stay counted as missing
+    seen = ahead >= SEQUENCE_WINDOW ? 0 : seen << ahead;
+    seen |= 1;
+    missing += ahead - 1;
+    span = span + ahead > SEQUENCE_WINDOW ? SEQUENCE_WINDOW : span + ahead;
+    highest = sequence;
+    received++;
+    return SEQUENCE_NEW;
+  }
+
+  if (started && ahead <= 0 && -ahead < SEQUENCE_WINDOW) {
+    uint8_t back = -ahead;
+    uint64_t bit = (uint64_t)1 << back;
+    if (seen & bit) {
+      duplicates++;
+      return SEQUENCE_DUPLICATE;
+    }
+    seen |= bit;
+    received++;
+    if (back < span) {
+      missing--;
+      late++;
+    } else {
+      // Older than the first number seen: widen the window over it
+      missing += back - span;
+      span = back + 1;
+    }
+    return SEQUENCE_LATE;
+  }
+
+  bool restarted = started;
+  started = true;
+  highest = sequence;
+  seen = 1;
+  span = 1;
+  received++;
+  if (restarted) {
+    restarts++;
+    return SEQUENCE_RESTART;
+  }
+  return SEQUENCE_NEW;
+}
+
+float SequenceTracker::lossRate() const {
+  if (span == 0) {
+    return 0;
+  }
+  uint64_t window = span >= SEQUENCE_WINDOW ? ~(uint64_t)0 : ((uint64_t)1 << span) - 1;
+  return 1.0f - (float)__builtin_popcountll(seen & window) / span;
+}
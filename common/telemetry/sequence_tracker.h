@@ -0,0 +1,54 @@
+#ifndef SEQUENCE_TRACKER_H
+#define SEQUENCE_TRACKER_H
+
+#include <stdint.h>
+
+#define SEQUENCE_WINDOW 64         // Recent sequence numbers remembered
+#define SEQUENCE_RESTART_GAP 1024  // A jump further ahead than this is a restart
+
+enum SequenceResult {
+  SEQUENCE_NEW,        // Ahead of everything seen (any gap is counted missing)
+  SEQUENCE_LATE,       // Fills an earlier gap (reordered or resent)
+  SEQUENCE_DUPLICATE,  // Already seen
+  SEQUENCE_RESTART     // Far from the window: the sender restarted, counting begins again
+};
+
+// Receiver side of a 16-bit wrapping sequence stream: gap and duplicate
+// detection over a sliding window of the last SEQUENCE_WINDOW numbers.
+// A number that jumps ahead leaves its skipped predecessors missing until
+// they turn up late; anything behind the window, or too far ahead of it,
+// is taken as the sender restarting (senders start at a random number, so
+// a restart rarely lands inside the window).
+//
+// Plain C++ with no Arduino dependencies.
+class SequenceTracker {
+private:
+  bool started;
+  uint16_t highest;   // Newest number seen
+  uint64_t seen;      // Bit k: highest - k received
+  uint8_t span;       // Numbers the window covers since the (re)start
+  uint32_t received;  // Distinct numbers
+  uint32_t duplicates;
+  uint32_t missing;   // Skipped and not (yet) filled in
+  uint32_t late;
+  uint32_t restarts;
+
+public:
+  SequenceTracker() { reset(); }
+  void reset();
+
+  SequenceResult observe(uint16_t sequence);
+
+  bool hasSequence() const { return started; }
+  uint16_t lastSequence() const { return highest; }
+  uint32_t receivedCount() const { return received; }
+  uint32_t duplicateCount() const { return duplicates; }
+  uint32_t missingCount() const { return missing; }
+  uint32_t lateCount() const { return late; }
+  uint32_t restartCount() const { return restarts; }
+
+  // Fraction of the window's numbers not received (0 when empty)
+  float lossRate() const;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "telemetry_frame.h"
+
+static void put16(uint8_t* p, uint16_t value) {
+  p[0] = value & 0xFF;
+  p[1] = (value >> 8) & 0xFF;
+}
+
+static void put32(uint8_t* p, uint32_t value) {
+  put16(p, value & 0xFFFF);
+  put16(p + 2, value >> 16);
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+uint16_t TelemetryCodec::crc16(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t j = 0; j < 8; j++) {
+      if (crc & 0x0001) {
+        crc = (crc >> 1) ^ 0xA001;
+      } else {
+        crc >>= 1;
+      }
+    }
+  }
+  return crc;
+}
+
+uint32_t TelemetryCodec::hashNodeId(const char* id) {
+  // FNV-1a
+  uint32_t hash = 2166136261UL;
+  while (*id) {
+    hash ^= (uint8_t)*id++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+size_t TelemetryCodec::frameSize(uint8_t flags, uint8_t batchCount) {
+  size_t size = TELEMETRY_FRAME_SIZE;
+  if (flags & TELEMETRY_FLAG_VOLTAGE) {
+    size += 4;
+  }
+  if (flags & TELEMETRY_FLAG_HARMONICS) {
+    size += 12;
+  }
+  if (flags & TELEMETRY_FLAG_LINK) {
+    size += 2;
+  }
+  if (flags & TELEMETRY_FLAG_BATCH) {
+    size += 1 + batchCount * TELEMETRY_RECORD_SIZE;
+  }
+  return size;
+}
+
+size_t TelemetryCodec::encode(const TelemetryFrame& frame, uint8_t* buffer, size_t capacity) {
+  bool batched = frame.flags & TELEMETRY_FLAG_BATCH;
+  if (batched && frame.batchCount > TELEMETRY_BATCH_MAX) {
+    return 0;
+  }
+  size_t size = frameSize(frame.flags, batched ? frame.batchCount : 0);
+  if (capacity < size) {
+    return 0;
+  }
+  
+  buffer[0] = TELEMETRY_MAGIC;
+  buffer[1] = TELEMETRY_VERSION;
+  buffer[2] = frame.flags;
+  buffer[3] = frame.powerFactor;
+  put32(buffer + 4, frame.nodeHash);
+  put16(buffer + 8, frame.sequence);
+  put32(buffer + 10, frame.currentMa);
+  put32(buffer + 14, frame.powerDeciWatts);
+  
+  uint8_t* p = buffer + 18;
+  if (frame.flags & TELEMETRY_FLAG_VOLTAGE) {
+    put16(p, frame.voltageDeciVolts);
+    put16(p + 2, frame.frequencyCentiHz);
+    p += 4;
+  }
+  if (frame.flags & TELEMETRY_FLAG_HARMONICS) {
+    put32(p, frame.fundamentalMa);
+    for (int i = 0; i < 3; i++) {
+      put16(p + 4 + 2 * i, frame.harmonicPermille[i]);
+    }
+    put16(p + 10, frame.thdPermille);
+    p += 12;
+  }
+  if (frame.flags & TELEMETRY_FLAG_LINK) {
+    put16(p, frame.transmission);
+    p += 2;
+  }
+  if (batched) {
+    *p++ = frame.batchCount;
+    for (uint8_t i = 0; i < frame.batchCount; i++) {
+      const TelemetryRecord& record = frame.batch[i];
+      put16(p, record.ageDeciSeconds);
+      p[2] = record.powerFactor;
+      put32(p + 3, record.currentMa);
+      put32(p + 7, record.powerDeciWatts);
+      p += TELEMETRY_RECORD_SIZE;
+    }
+  }
+  put16(p, crc16(buffer, p - buffer));
+  
+  return size;
+}
+
+bool TelemetryCodec::decode(const uint8_t* data, size_t len, TelemetryFrame& frame) {
+  if (len < TELEMETRY_FRAME_SIZE || data[0] != TELEMETRY_MAGIC || data[1] < 1 || data[1] > TELEMETRY_VERSION) {
+    return false;
+  }
+  
+  // Version 1 had no sections, whatever the flags say. The batch length
+  // sits after the fixed-size sections
+  uint8_t flags = data[2];
+  uint8_t batchCount = 0;
+  size_t size = TELEMETRY_FRAME_SIZE;
+  if (data[1] > 1) {
+    size = frameSize(flags & ~TELEMETRY_FLAG_BATCH);
+    if (flags & TELEMETRY_FLAG_BATCH) {
+      if (len < size + 1) {
+        return false;
+      }
+      batchCount = data[size - 2];
+      if (batchCount > TELEMETRY_BATCH_MAX) {
+        return false;
+      }
+      size = frameSize(flags, batchCount);
+    }
+  }
+  if (len != size || get16(data + size - 2) != crc16(data, size - 2)) {
+    return false;
+  }
+  
+  frame.flags = flags;
+  frame.powerFactor = data[3];
+  frame.nodeHash = get32(data + 4);
+  frame.sequence = get16(data + 8);
+  frame.currentMa = get32(data + 10);
+  frame.powerDeciWatts = get32(data + 14);
+  
+  const uint8_t* p = data + 18;
+  if (data[1] > 1 && (flags & TELEMETRY_FLAG_VOLTAGE)) {
+    frame.voltageDeciVolts = get16(p);
+    frame.frequencyCentiHz = get16(p + 2);
+    p += 4;
+  } else {
+    frame.flags &= ~TELEMETRY_FLAG_VOLTAGE;
+    frame.voltageDeciVolts = 0;
+    frame.frequencyCentiHz = 0;
+  }
+  if (data[1] > 1 && (flags & TELEMETRY_FLAG_HARMONICS)) {
+    frame.fundamentalMa = get32(p);
+    for (int i = 0; i < 3; i++) {
+      frame.harmonicPermille[i] = get16(p + 4 + 2 * i);
+    }
+    frame.thdPermille = get16(p + 10);
+    p += 12;
+  } else {
+    frame.flags &= ~TELEMETRY_FLAG_HARMONICS;
+    frame.fundamentalMa = 0;
+    for (int i = 0; i < 3; i++) {
+      frame.harmonicPermille[i] = 0;
+    }
+    frame.thdPermille = 0;
+  }
+  if (data[1] > 1 && (flags & TELEMETRY_FLAG_LINK)) {
+    frame.transmission = get16(p);
+    p += 2;
+  } else {
+    frame.flags &= ~TELEMETRY_FLAG_LINK;
+    frame.transmission = 0;
+  }
+  frame.batchCount = 0;
+  if (data[1] > 1 && (flags & TELEMETRY_FLAG_BATCH)) {
+    frame.batchCount = *p++;
+    for (uint8_t i = 0; i < frame.batchCount; i++) {
+      TelemetryRecord& record = frame.batch[i];
+      record.ageDeciSeconds = get16(p);
+      record.powerFactor = p[2];
+      record.currentMa = get32(p + 3);
+      record.powerDeciWatts = get32(p + 7);
+      p += TELEMETRY_RECORD_SIZE;
+    }
+  } else {
+    frame.flags &= ~TELEMETRY_FLAG_BATCH;
+  }
+  
+  return true;
+}
+
+size_t TelemetryCodec::encodeAck(const TelemetryAck& ack, uint8_t* buffer, size_t capacity) {
+  if (capacity < TELEMETRY_ACK_SIZE) {
+    return 0;
+  }
+  buffer[0] = TELEMETRY_ACK_MAGIC;
+  buffer[1] = TELEMETRY_VERSION;
+  put32(buffer + 2, ack.nodeHash);
+  put16(buffer + 6, ack.sequence);
+  put16(buffer + 8, crc16(buffer, 8));
+  return TELEMETRY_ACK_SIZE;
+}
+
+bool TelemetryCodec::decodeAck(const uint8_t* data, size_t len, TelemetryAck& ack) {
+  if (len != TELEMETRY_ACK_SIZE || data[0] != TELEMETRY_ACK_MAGIC || data[1] != TELEMETRY_VERSION ||
+      get16(data + 8) != crc16(data, 8)) {
+    return false;
+  }
+  ack.nodeHash = get32(data + 2);
+  ack.sequence = get16(data + 6);
+  return true;
+}
+
+bool TelemetryCodec::sampleAt(const TelemetryFrame& frame, uint8_t index, uint32_t receivedAtMs, TelemetrySample& sample) {
+  if (index > frame.batchCount) {
+    return false;
+  }
+  sample.newest = index == frame.batchCount;
+  sample.sequence = frame.sequence - (frame.batchCount - index);
+  if (sample.newest) {
+    sample.timestamp = receivedAtMs;
+    sample.powerFactor = frame.powerFactor;
+    sample.currentMa = frame.currentMa;
+    sample.powerDeciWatts = frame.powerDeciWatts;
+    return true;
+  }
+  
+  const TelemetryRecord& record = frame.batch[index];
+  uint32_t age = record.ageDeciSeconds * 100UL;
+  if (age > receivedAtMs) {
+    return false;
+  }
+  sample.timestamp = receivedAtMs - age;
+  sample.powerFactor = record.powerFactor;
+  sample.currentMa = record.currentMa;
+  sample.powerDeciWatts = record.powerDeciWatts;
+  return true;
+}
@@ -0,0 +1,142 @@
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary ESP-NOW telemetry frame shared by the wireless node and the main
+// auditor. All multi-byte fields are little-endian; the frame ends with a
+// CRC-16/MODBUS over every preceding byte.
+//
+//  off size field
+//    0    1 magic (TELEMETRY_MAGIC)
+//    1    1 version (TELEMETRY_VERSION)
+//    2    1 flags (TELEMETRY_FLAG_*)
+//    3    1 power factor, 0.01
+//    4    4 node ID hash (FNV-1a of NODE_ID)
+//    8    2 sequence number
+//   10    4 RMS current, 1mA
+//   14    4 power, 0.1W
+//  then the optional sections whose flags are set, in this order:
+//         4 TELEMETRY_FLAG_VOLTAGE: RMS voltage 0.1V (2), frequency 0.01Hz (2)
+//        12 TELEMETRY_FLAG_HARMONICS: fundamental current 1mA (4), 3rd, 5th
+//           and 7th harmonic current (2 each) and THD (2), 0.1% of the
+//           fundamental
+//         2 TELEMETRY_FLAG_LINK: transmission counter, one per frame sent
+//  1+11n TELEMETRY_FLAG_BATCH: n earlier samples from a low-power node,
+//           oldest first, each: age 0.1s (2), power factor 0.01 (1), RMS
+//           current 1mA (4), power 0.1W (4)
+//  and the CRC (2). Version 1 frames are the same without sections.
+//
+//  The header fields are the newest sample. A batch is sent when the node
+//  wakes its radio; sample i of n has sequence number sequence - (n - i),
+//  and was taken age before the frame was sent.
+//
+//  Sample sequence numbers and the transmission counter start at random
+//  values when a node powers on, so a restarted node is not mistaken for
+//  repeats of what it sent before. A node that resends unacknowledged
+//  samples does so in the batch of a later frame; the transmission counter
+//  still advances, so gaps in it measure frames lost on air.
+//
+// Acknowledgement, main auditor to node, for every valid telemetry frame:
+//
+//    0    1 magic (TELEMETRY_ACK_MAGIC)
+//    1    1 version (TELEMETRY_VERSION)
+//    2    4 node ID hash
+//    6    2 sequence number of the frame's header sample
+//    8    2 CRC-16/MODBUS
+//
+//  It covers the header sample and every sample the frame carried.
+
+#define TELEMETRY_MAGIC 0xEA
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_FRAME_SIZE 20  // Without optional sections
+#define TELEMETRY_BATCH_MAX 15   // Earlier samples per frame
+#define TELEMETRY_RECORD_SIZE 11
+#define TELEMETRY_FRAME_MAX (39 + TELEMETRY_BATCH_MAX * TELEMETRY_RECORD_SIZE)  // With every section
+#define TELEMETRY_ACK_MAGIC 0xEB
+#define TELEMETRY_ACK_SIZE 10
+
+// Flags
+#define TELEMETRY_FLAG_PF_ESTIMATED 0x01  // PF is an estimate, not measured
+#define TELEMETRY_FLAG_VOLTAGE 0x02       // Voltage section present (measured V, Hz, PF)
+#define TELEMETRY_FLAG_HARMONICS 0x04     // Harmonics section present
+#define TELEMETRY_FLAG_BATCH 0x08         // Earlier samples follow
+#define TELEMETRY_FLAG_LINK 0x10          // Transmission counter present
+
+// One earlier sample in a batch
+struct TelemetryRecord {
+  uint16_t ageDeciSeconds;  // Before the frame was sent, 0.1s (saturates)
+  uint8_t powerFactor;      // 0.01
+  uint32_t currentMa;       // 1mA
+  uint32_t powerDeciWatts;  // 0.1W
+};
+
+struct TelemetryFrame {
+  uint8_t flags;
+  uint8_t powerFactor;  // 0.01
+  uint32_t nodeHash;
+  uint16_t sequence;
+  uint32_t currentMa;       // 1mA
+  uint32_t powerDeciWatts;  // 0.1W
+  
+  // TELEMETRY_FLAG_VOLTAGE
+  uint16_t voltageDeciVolts;  // 0.1V
+  uint16_t frequencyCentiHz;  // 0.01Hz
+  
+  // TELEMETRY_FLAG_HARMONICS
+  uint32_t fundamentalMa;         // 1mA
+  uint16_t harmonicPermille[3];   // 3rd, 5th, 7th; 0.1% of the fundamental
+  uint16_t thdPermille;           // 0.1%
+  
+  // TELEMETRY_FLAG_LINK
+  uint16_t transmission;  // Frames sent by the node, wrapping
+  
+  // TELEMETRY_FLAG_BATCH
+  uint8_t batchCount;
+  TelemetryRecord batch[TELEMETRY_BATCH_MAX];  // Oldest first
+};
+
+struct TelemetryAck {
+  uint32_t nodeHash;
+  uint16_t sequence;  // Header sample of the acknowledged frame
+};
+
+// One sample of a decoded frame, with its time on the receiver's clock
+struct TelemetrySample {
+  uint16_t sequence;
+  uint32_t timestamp;  // Receive time minus age (ms)
+  uint8_t powerFactor;
+  uint32_t currentMa;
+  uint32_t powerDeciWatts;
+  bool newest;  // The header sample; only it has the optional sections
+};
+
+class TelemetryCodec {
+public:
+  // Returns bytes written (frameSize(frame.flags, frame.batchCount)), or 0
+  // if the buffer is too small or the batch too long
+  static size_t encode(const TelemetryFrame& frame, uint8_t* buffer, size_t capacity);
+  
+  // Validates magic, version, length and CRC; no allocation. Fields of
+  // absent sections are zeroed.
+  static bool decode(const uint8_t* data, size_t len, TelemetryFrame& frame);
+  
+  // Unbatching: a frame holds batchCount + 1 samples, index 0 the oldest
+  // and the header sample last. False if the sample would predate the
+  // receiver's clock (taken before it booted).
+  static uint8_t sampleCount(const TelemetryFrame& frame) { return frame.batchCount + 1; }
+  static bool sampleAt(const TelemetryFrame& frame, uint8_t index, uint32_t receivedAtMs, TelemetrySample& sample);
+  
+  // Acknowledgements: TELEMETRY_ACK_SIZE bytes, 0 if the buffer is too small
+  static size_t encodeAck(const TelemetryAck& ack, uint8_t* buffer, size_t capacity);
+  static bool decodeAck(const uint8_t* data, size_t len, TelemetryAck& ack);
+  
+  // Encoded length for a set of flags (and batch length with TELEMETRY_FLAG_BATCH)
+  static size_t frameSize(uint8_t flags, uint8_t batchCount = 0);
+  
+  static uint32_t hashNodeId(const char* id);
+  static uint16_t crc16(const uint8_t* data, size_t len);
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Host build of the Arduino core subset the auditor firmware uses.
+// Time is virtual: millis() only moves when delay() (or the simulator)
+// advances it, so runs are deterministic and can go faster than real time.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+using std::isnan;
+using std::isinf;
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define memcpy_P memcpy
+
+// Virtual clock
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void halAdvanceMicros(uint64_t us);  // Simulator: move time forward without looping
+
+class StringSumHelper;
+
+class String {
+private:
+  std::string text;
+
+public:
+  String() {}
+  String(const char* value) : text(value ? value : "") {}
+  String(const std::string& value) : text(value) {}
+  String(char c) : text(1, c) {}
+  String(int value) : text(std::to_string(value)) {}
+  String(unsigned int value) : text(std::to_string(value)) {}
+  String(long value) : text(std::to_string(value)) {}
+  String(unsigned long value) : text(std::to_string(value)) {}
+  String(float value, unsigned int decimals = 2);
+  String(double value, unsigned int decimals = 2);
+
+  const char* c_str() const { return text.c_str(); }
+  unsigned int length() const { return text.length(); }
+  bool reserve(unsigned int size) { text.reserve(size); return true; }
+  char operator[](unsigned int index) const { return index < text.length() ? text[index] : 0; }
+
+  bool concat(const char* value) { text += value; return true; }
+  bool concat(const String& value) { text += value.text; return true; }
+  bool concat(char c) { text += c; return true; }
+  String& operator+=(const String& value) { concat(value); return *this; }
+  String& operator+=(const char* value) { concat(value); return *this; }
+  String& operator+=(char c) { concat(c); return *this; }
+
+  bool operator==(const String& other) const { return text == other.text; }
+  bool operator==(const char* other) const { return text == (other ? other : ""); }
+  bool operator!=(const String& other) const { return text != other.text; }
+  bool operator!=(const char* other) const { return !(*this == other); }
+  bool operator<(const String& other) const { return text < other.text; }
+
+  bool startsWith(const String& prefix) const { return text.compare(0, prefix.text.length(), prefix.text) == 0; }
+  bool endsWith(const String& suffix) const;
+  int indexOf(char c) const;
+  int lastIndexOf(char c) const;
+  String substring(unsigned int from, unsigned int to = (unsigned int)-1) const;
+  void trim();
+
+  friend StringSumHelper operator+(const String& lhs, const String& rhs);
+};
+
+// Arduino's type for temporary concatenations (ArduinoJson adapts it too)
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String& value) : String(value) {}
+};
+
+inline StringSumHelper operator+(const String& lhs, const String& rhs) {
+  String result(lhs);
+  result += rhs;
+  return StringSumHelper(result);
+}
+
+// Minimal ESP object
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+};
+extern EspClass ESP;
+
+#include "HardwareSerial.h"
+
+#endif
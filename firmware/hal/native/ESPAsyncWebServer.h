@@ -0,0 +1,192 @@
+#ifndef NATIVE_ESP_ASYNC_WEB_SERVER_H
+#define NATIVE_ESP_ASYNC_WEB_SERVER_H
+
+// Host build of the ESPAsyncWebServer 1.2.x API used by the auditor.
+// There is no socket: the simulator builds requests, dispatches them
+// through the registered handlers (same matching rules as the library,
+// including ASYNCWEBSERVER_REGEX routes) and drains the responses.
+
+#include "Arduino.h"
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+#define SSE_MAX_QUEUED_MESSAGES 32
+
+class AsyncWebServerRequest;
+class AsyncEventSourceClient;
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+
+class AsyncWebParameter {
+private:
+  String paramName;
+  String paramValue;
+  bool post;
+
+public:
+  AsyncWebParameter(const String& name, const String& value, bool isPost) : paramName(name), paramValue(value), post(isPost) {}
+  const String& name() const { return paramName; }
+  const String& value() const { return paramValue; }
+  bool isPost() const { return post; }
+};
+
+class AsyncWebServerResponse {
+private:
+  int statusCode;
+  String type;
+  std::vector<std::pair<String, String>> headerList;
+  std::string body;           // Fixed content (basic and PROGMEM responses)
+  AwsResponseFiller filler;   // Chunked responses
+  size_t sent;
+  bool done;
+
+public:
+  AsyncWebServerResponse(int code, const String& contentType) : statusCode(code), type(contentType), sent(0), done(false) {}
+
+  void addHeader(const String& name, const String& value) { headerList.emplace_back(name, value); }
+
+  int code() const { return statusCode; }
+  const String& contentType() const { return type; }
+  const std::vector<std::pair<String, String>>& headers() const { return headerList; }
+  String header(const char* name) const;
+
+  void setBody(const uint8_t* data, size_t len) { body.assign((const char*)data, len); }
+  void setFiller(AwsResponseFiller callback) { filler = callback; }
+  bool isChunked() const { return (bool)filler; }
+
+  // Simulator side: pull up to maxLen bytes as the TCP stack would;
+  // returns 0 once the response is complete
+  size_t read(uint8_t* buffer, size_t maxLen);
+  size_t drain(std::string& out, size_t chunkSize = 1024);
+};
+
+class AsyncWebServerRequest {
+private:
+  WebRequestMethod requestMethod;
+  String requestUrl;
+  std::vector<AsyncWebParameter> params;
+  std::vector<std::pair<String, String>> headerList;
+  std::vector<String> pathParams;
+  std::unique_ptr<AsyncWebServerResponse> sentResponse;
+  AsyncEventSourceClient* eventClient;
+
+public:
+  AsyncWebServerRequest(WebRequestMethod method, const String& url) : requestMethod(method), requestUrl(url), eventClient(nullptr) {}
+
+  WebRequestMethod method() const { return requestMethod; }
+  const String& url() const { return requestUrl; }
+
+  // Parameters, headers and regex captures
+  void addParam(const String& name, const String& value, bool isPost = false) { params.emplace_back(name, value, isPost); }
+  void addHeader(const String& name, const String& value) { headerList.emplace_back(name, value); }
+  void addPathParam(const String& value) { pathParams.push_back(value); }
+  void clearPathParams() { pathParams.clear(); }
+
+  bool hasParam(const String& name, bool post = false) const { return getParam(name, post) != nullptr; }
+  AsyncWebParameter* getParam(const String& name, bool post = false) const;
+  const String& pathArg(size_t i) const;
+  bool hasHeader(const String& name) const;
+  String header(const String& name) const;
+
+  // Responses
+  AsyncWebServerResponse* beginResponse(int code, const String& contentType = String(), const String& content = String());
+  AsyncWebServerResponse* beginResponse_P(int code, const String& contentType, const uint8_t* content, size_t len);
+  AsyncWebServerResponse* beginChunkedResponse(const String& contentType, AwsResponseFiller callback);
+  void send(AsyncWebServerResponse* response) { sentResponse.reset(response); }
+  void send(int code, const String& contentType = String(), const String& content = String()) { send(beginResponse(code, contentType, content)); }
+
+  // Simulator side
+  AsyncWebServerResponse* response() const { return sentResponse.get(); }
+  void attachEventClient(AsyncEventSourceClient* client) { eventClient = client; }
+  AsyncEventSourceClient* eventSourceClient() const { return eventClient; }
+};
+
+class AsyncWebHandler {
+public:
+  virtual ~AsyncWebHandler() {}
+  virtual bool canHandle(AsyncWebServerRequest* request) = 0;
+  virtual void handleRequest(AsyncWebServerRequest* request) = 0;
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+private:
+  String uri;
+  WebRequestMethodComposite methods;
+  ArRequestHandlerFunction onRequest;
+  bool isRegex;
+
+public:
+  AsyncCallbackWebHandler(const String& path, WebRequestMethodComposite method, ArRequestHandlerFunction callback);
+  bool canHandle(AsyncWebServerRequest* request) override;
+  void handleRequest(AsyncWebServerRequest* request) override { onRequest(request); }
+};
+
+// Server-sent events client; the simulator consumes queued messages at
+// whatever rate it models the browser (and network) reading them
+class AsyncEventSourceClient {
+private:
+  std::deque<std::string> queue;
+  bool open;
+  uint32_t dropped;
+
+public:
+  AsyncEventSourceClient() : open(true), dropped(0) {}
+
+  void send(const char* message, const char* event, uint32_t id, uint32_t reconnect);
+  size_t packetsWaiting() const { return queue.size(); }
+  bool connected() const { return open; }
+
+  // Simulator side
+  bool takeMessage(std::string& message);
+  uint32_t droppedCount() const { return dropped; }
+  void close() { open = false; }
+};
+
+class AsyncEventSource : public AsyncWebHandler {
+private:
+  String url;
+  std::vector<std::unique_ptr<AsyncEventSourceClient>> clients;
+
+  void removeClosed();
+
+public:
+  AsyncEventSource(const String& path) : url(path) {}
+
+  size_t count() const;
+  size_t avgPacketsWaiting() const;
+  void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+
+  bool canHandle(AsyncWebServerRequest* request) override;
+  void handleRequest(AsyncWebServerRequest* request) override;
+};
+
+class AsyncWebServer {
+private:
+  std::vector<AsyncWebHandler*> handlers;
+  std::vector<std::unique_ptr<AsyncCallbackWebHandler>> callbackHandlers;
+
+public:
+  AsyncWebServer(uint16_t port) {}
+
+  AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+  AsyncWebHandler& addHandler(AsyncWebHandler* handler);
+  void begin() {}
+
+  // Simulator side: route a request to the first matching handler (404
+  // otherwise), as the library does when a request has been parsed
+  void dispatch(AsyncWebServerRequest* request);
+};
+
+#endif
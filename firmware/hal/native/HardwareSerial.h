@@ -0,0 +1,75 @@
+#ifndef NATIVE_HARDWARE_SERIAL_H
+#define NATIVE_HARDWARE_SERIAL_H
+
+#include "Arduino.h"
+#include <deque>
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial;
+
+// Simulated device on the far end of a UART (e.g. a PZEM-004T model)
+class SerialPeer {
+public:
+  virtual ~SerialPeer() {}
+  virtual void onHostWrite(HardwareSerial& port, const uint8_t* data, size_t len) = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  
+  size_t print(const char* text);
+  size_t print(const String& text) { return print(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value) { return print((long)value); }
+  size_t print(unsigned int value) { return print((unsigned long)value); }
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t print(double value, int digits = 2);
+  
+  template<typename T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+  size_t println(double value, int digits) { size_t n = print(value, digits); return n + println(); }
+  size_t println() { return print("\r\n"); }
+};
+
+// UART 0 is the console (stdout); other ports talk to an attached peer.
+// Bytes injected by the peer become readable once virtual time reaches
+// their arrival time.
+class HardwareSerial : public Print {
+private:
+  struct RxByte {
+    unsigned long availableAt;
+    uint8_t value;
+  };
+  
+  int uart;
+  SerialPeer* peer;
+  std::deque<RxByte> rx;
+  
+  static bool consoleEnabled;
+  
+public:
+  HardwareSerial(int uartNum) : uart(uartNum), peer(nullptr) {}
+  
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {}
+  void end() {}
+  int available();
+  int read();
+  void flush() {}
+  
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  
+  // Simulator side
+  void attach(SerialPeer* device) { peer = device; }
+  void inject(const uint8_t* data, size_t len, unsigned long latencyMs);
+  static void setConsoleEnabled(bool enabled) { consoleEnabled = enabled; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
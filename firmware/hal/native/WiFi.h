@@ -0,0 +1,33 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include "Arduino.h"
+
+typedef enum { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+
+class IPAddress {
+private:
+  uint8_t octets[4];
+  
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} {}
+  String toString() const;
+  operator String() const { return toString(); }
+};
+
+// Access point that always comes up; no radio behind it
+class WiFiClass {
+private:
+  wifi_mode_t currentMode;
+  
+public:
+  WiFiClass() : currentMode(WIFI_OFF) {}
+  bool mode(wifi_mode_t mode) { currentMode = mode; return true; }
+  bool softAP(const char* ssid, const char* password = nullptr, int channel = 1, int hidden = 0, int maxConnections = 4) { return true; }
+  IPAddress softAPIP() const { return IPAddress(192, 168, 4, 1); }
+  String macAddress() const { return "24:0A:C4:00:00:01"; }
+};
+
+extern WiFiClass WiFi;
+
+#endif
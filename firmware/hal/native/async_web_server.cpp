@@ -0,0 +1,245 @@
+#include "ESPAsyncWebServer.h"
+
+#ifdef ASYNCWEBSERVER_REGEX
+#include <regex>
+#endif
+
+static bool equalsIgnoreCase(const String& a, const String& b) {
+  if (a.length() != b.length()) {
+    return false;
+  }
+  for (unsigned int i = 0; i < a.length(); i++) {
+    if (tolower(a[i]) != tolower(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+String AsyncWebServerResponse::header(const char* name) const {
+  for (const auto& entry : headerList) {
+    if (equalsIgnoreCase(entry.first, name)) {
+      return entry.second;
+    }
+  }
+  return String();
+}
+
+size_t AsyncWebServerResponse::read(uint8_t* buffer, size_t maxLen) {
+  if (done) {
+    return 0;
+  }
+  
+  size_t len;
+  if (filler) {
+    len = filler(buffer, maxLen, sent);
+  } else {
+    len = min(maxLen, body.size() - sent);
+    memcpy(buffer, body.data() + sent, len);
+  }
+  
+  sent += len;
+  done = len == 0;
+  return len;
+}
+
+size_t AsyncWebServerResponse::drain(std::string& out, size_t chunkSize) {
+  std::vector<uint8_t> buffer(chunkSize);
+  size_t total = 0;
+  size_t len;
+  while ((len = read(buffer.data(), buffer.size())) > 0) {
+    out.append((const char*)buffer.data(), len);
+    total += len;
+  }
+  return total;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post) const {
+  for (const AsyncWebParameter& param : params) {
+    if (param.name() == name && param.isPost() == post) {
+      return const_cast<AsyncWebParameter*>(&param);
+    }
+  }
+  return nullptr;
+}
+
+const String& AsyncWebServerRequest::pathArg(size_t i) const {
+  static const String empty;
+  return i < pathParams.size() ? pathParams[i] : empty;
+}
+
+bool AsyncWebServerRequest::hasHeader(const String& name) const {
+  for (const auto& entry : headerList) {
+    if (equalsIgnoreCase(entry.first, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+String AsyncWebServerRequest::header(const String& name) const {
+  for (const auto& entry : headerList) {
+    if (equalsIgnoreCase(entry.first, name)) {
+      return entry.second;
+    }
+  }
+  return String();
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const String& contentType, const String& content) {
+  AsyncWebServerResponse* response = new AsyncWebServerResponse(code, contentType);
+  response->setBody((const uint8_t*)content.c_str(), content.length());
+  return response;
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse_P(int code, const String& contentType, const uint8_t* content, size_t len) {
+  AsyncWebServerResponse* response = new AsyncWebServerResponse(code, contentType);
+  response->setBody(content, len);
+  return response;
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginChunkedResponse(const String& contentType, AwsResponseFiller callback) {
+  AsyncWebServerResponse* response = new AsyncWebServerResponse(200, contentType);
+  response->setFiller(callback);
+  return response;
+}
+
+AsyncCallbackWebHandler::AsyncCallbackWebHandler(const String& path, WebRequestMethodComposite method, ArRequestHandlerFunction callback)
+  : uri(path), methods(method), onRequest(callback), isRegex(false) {
+#ifdef ASYNCWEBSERVER_REGEX
+  isRegex = uri.startsWith("^") && uri.endsWith("$");
+#endif
+}
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest* request) {
+  // Same rules as ESPAsyncWebServer 1.2.x: a plain URI also matches any
+  // path below it ("/api/devices" accepts "/api/devices/x")
+  if (!onRequest || !(methods & request->method())) {
+    return false;
+  }
+  
+  const String& url = request->url();
+  if (isRegex) {
+#ifdef ASYNCWEBSERVER_REGEX
+    std::regex pattern(uri.c_str());
+    std::cmatch matches;
+    if (!std::regex_search(url.c_str(), matches, pattern)) {
+      return false;
+    }
+    request->clearPathParams();
+    for (size_t i = 1; i < matches.size(); i++) {
+      request->addPathParam(matches[i].str());
+    }
+#endif
+  } else if (uri.length() && uri.startsWith("/*.")) {
+    if (!url.endsWith(uri.substring(uri.lastIndexOf('.')))) {
+      return false;
+    }
+  } else if (uri.length() && uri.endsWith("*")) {
+    if (!url.startsWith(uri.substring(0, uri.length() - 1))) {
+      return false;
+    }
+  } else if (uri.length() && uri != url && !url.startsWith(uri + "/")) {
+    return false;
+  }
+  return true;
+}
+
+void AsyncEventSourceClient::send(const char* message, const char* event, uint32_t id, uint32_t reconnect) {
+  if (!open) {
+    return;
+  }
+  if (queue.size() >= SSE_MAX_QUEUED_MESSAGES) {
+    dropped++;  // The library drops (and logs) once its queue is full
+    return;
+  }
+  
+  std::string frame;
+  if (reconnect) {
+    frame += "retry: " + std::to_string(reconnect) + "\r\n";
+  }
+  if (id) {
+    frame += "id: " + std::to_string(id) + "\r\n";
+  }
+  if (event) {
+    frame += std::string("event: ") + event + "\r\n";
+  }
+  if (message) {
+    frame += std::string("data: ") + message + "\r\n";
+  }
+  frame += "\r\n";
+  queue.push_back(frame);
+}
+
+bool AsyncEventSourceClient::takeMessage(std::string& message) {
+  if (queue.empty()) {
+    return false;
+  }
+  message = queue.front();
+  queue.pop_front();
+  return true;
+}
+
+void AsyncEventSource::removeClosed() {
+  clients.erase(std::remove_if(clients.begin(), clients.end(),
+    [](const std::unique_ptr<AsyncEventSourceClient>& client) { return !client->connected(); }), clients.end());
+}
+
+size_t AsyncEventSource::count() const {
+  size_t n = 0;
+  for (const auto& client : clients) {
+    n += client->connected() ? 1 : 0;
+  }
+  return n;
+}
+
+size_t AsyncEventSource::avgPacketsWaiting() const {
+  size_t total = 0;
+  size_t n = 0;
+  for (const auto& client : clients) {
+    if (client->connected()) {
+      total += client->packetsWaiting();
+      n++;
+    }
+  }
+  return n ? (total + n - 1) / n : 0;  // Rounded up, like the library
+}
+
+void AsyncEventSource::send(const char* message, const char* event, uint32_t id, uint32_t reconnect) {
+  removeClosed();
+  for (auto& client : clients) {
+    client->send(message, event, id, reconnect);
+  }
+}
+
+bool AsyncEventSource::canHandle(AsyncWebServerRequest* request) {
+  return request->method() == HTTP_GET && request->url() == url;
+}
+
+void AsyncEventSource::handleRequest(AsyncWebServerRequest* request) {
+  removeClosed();
+  clients.emplace_back(new AsyncEventSourceClient());
+  request->attachEventClient(clients.back().get());
+  request->send(200, "text/event-stream");
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+  callbackHandlers.emplace_back(new AsyncCallbackWebHandler(uri, method, onRequest));
+  handlers.push_back(callbackHandlers.back().get());
+  return *callbackHandlers.back();
+}
+
+AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler) {
+  handlers.push_back(handler);
+  return *handler;
+}
+
+void AsyncWebServer::dispatch(AsyncWebServerRequest* request) {
+  for (AsyncWebHandler* handler : handlers) {
+    if (handler->canHandle(request)) {
+      handler->handleRequest(request);
+      return;
+    }
+  }
+  request->send(404);
+}
@@ -0,0 +1,40 @@
+#ifndef NATIVE_ESP_NOW_H
+#define NATIVE_ESP_NOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_wifi.h"
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_NOW_MAX_DATA_LEN 250
+#define ESP_NOW_ETH_ALEN 6
+#define ESP_NOW_MAX_TOTAL_PEER_NUM 20
+
+typedef struct {
+  uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+  uint8_t lmk[16];
+  uint8_t channel;
+  wifi_interface_t ifidx;
+  bool encrypt;
+  void* priv;
+} esp_now_peer_info_t;
+
+typedef void (*esp_now_recv_cb_t)(const uint8_t* mac, const uint8_t* data, int len);
+
+esp_err_t esp_now_init();
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t callback);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer);
+esp_err_t esp_now_del_peer(const uint8_t* mac);
+bool esp_now_is_peer_exist(const uint8_t* mac);
+esp_err_t esp_now_send(const uint8_t* mac, const uint8_t* data, size_t len);
+
+// Simulator side: deliver a frame as the Wi-Fi task would (promiscuous
+// callback with its RSSI first, then the ESP-NOW one)
+bool halEspNowDeliver(const uint8_t* mac, const uint8_t* data, int len, int8_t rssi = -60);
+
+// Simulator side: frames the firmware sends (to peers only)
+typedef void (*HalEspNowSendHook)(const uint8_t* mac, const uint8_t* data, int len);
+void halEspNowOnSend(HalEspNowSendHook hook);
+
+#endif
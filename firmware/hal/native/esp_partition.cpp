@@ -0,0 +1,177 @@
+#include "Arduino.h"
+#include "esp_partition.h"
+#include <unistd.h>
+#include <vector>
+
+// Typical SPI NOR figures (page program ~0.7 ms per 256 bytes, 4 KB
+// sector erase ~45 ms, quad reads ~20 MB/s)
+#define FLASH_WRITE_SETUP_US 20
+#define FLASH_ERASE_SECTOR_US 45000
+
+static esp_partition_t partition;
+static bool attached = false;
+static FILE* file = nullptr;
+static std::vector<uint8_t> image;  // Mirror of the file
+static std::vector<uint32_t> sectorErases;
+static HalFlashStats stats;
+static long powerBudget = -1;
+static bool powerLost = false;
+
+static void busy(uint64_t us) {
+  stats.busyMicros += us;
+  halAdvanceMicros(us);
+}
+
+static void persist(size_t offset, size_t size) {
+  if (size > 0 && pwrite(fileno(file), image.data() + offset, size, offset) != (ssize_t)size) {
+    fprintf(stderr, "flash emulator: write to backing file failed\n");
+  }
+}
+
+// Bytes the power budget allows for the next operation (all of them if no cut is pending)
+static size_t allowance(size_t size) {
+  if (powerBudget < 0) {
+    return size;
+  }
+  size_t allowed = (size_t)powerBudget < size ? (size_t)powerBudget : size;
+  powerBudget -= allowed;
+  if (allowed < size) {
+    powerLost = true;
+  }
+  return allowed;
+}
+
+static bool inRange(const esp_partition_t* p, size_t offset, size_t size) {
+  return attached && p == &partition && offset <= partition.size && size <= partition.size - offset;
+}
+
+bool halFlashAttach(const char* path, uint32_t size, const char* label, uint8_t subtype) {
+  halFlashDetach();
+  if (size == 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+    return false;
+  }
+
+  bool fresh = true;
+  if (path) {
+    file = fopen(path, "r+b");
+    fresh = file == nullptr;
+    if (!file) {
+      file = fopen(path, "w+b");
+    }
+  } else {
+    file = tmpfile();
+  }
+  if (!file) {
+    return false;
+  }
+
+  image.assign(size, 0xFF);
+  if (!fresh && pread(fileno(file), image.data(), size, 0) != (ssize_t)size) {
+    fresh = true;  // Wrong size: start over erased
+    image.assign(size, 0xFF);
+  }
+  if (fresh) {
+    persist(0, size);
+  }
+
+  partition = esp_partition_t();
+  partition.type = ESP_PARTITION_TYPE_DATA;
+  partition.subtype = (esp_partition_subtype_t)subtype;
+  partition.size = size;
+  strncpy(partition.label, label, sizeof(partition.label) - 1);
+  sectorErases.assign(size / SPI_FLASH_SEC_SIZE, 0);
+  stats = HalFlashStats();
+  powerBudget = -1;
+  powerLost = false;
+  attached = true;
+  return true;
+}
+
+void halFlashDetach() {
+  if (file) {
+    fclose(file);
+    file = nullptr;
+  }
+  attached = false;
+}
+
+void halFlashCutPowerAfter(long bytes) {
+  powerBudget = bytes;
+  powerLost = false;
+}
+
+uint8_t* halFlashImage() { return attached ? image.data() : nullptr; }
+
+const HalFlashStats& halFlashStats() { return stats; }
+
+uint32_t halFlashSectorErases(uint32_t sector) { return sector < sectorErases.size() ? sectorErases[sector] : 0; }
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+  if (!attached || type != partition.type ||
+      (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != partition.subtype) ||
+      (label && strcmp(label, partition.label) != 0)) {
+    return nullptr;
+  }
+  return &partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* p, size_t src_offset, void* dst, size_t size) {
+  if (!inRange(p, src_offset, size)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memcpy(dst, image.data() + src_offset, size);
+  stats.reads++;
+  stats.bytesRead += size;
+  busy(1 + size / 20);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* p, size_t dst_offset, const void* src, size_t size) {
+  if (!inRange(p, dst_offset, size)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (powerLost) {
+    return ESP_FAIL;
+  }
+
+  const uint8_t* data = (const uint8_t*)src;
+  uint8_t* target = image.data() + dst_offset;
+  size_t programmed = allowance(size);
+  for (size_t i = 0; i < programmed; i++) {
+    if (data[i] & ~target[i]) {
+      stats.overwrites++;
+    }
+    target[i] &= data[i];  // Programming only clears bits
+  }
+  if (programmed < size) {
+    target[programmed] &= data[programmed] | 0xF0;  // Cut mid-byte
+  }
+  persist(dst_offset, programmed < size ? programmed + 1 : size);
+
+  stats.writes++;
+  stats.bytesWritten += programmed;
+  busy(FLASH_WRITE_SETUP_US + programmed * 11 / 4);
+  return powerLost ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* p, size_t offset, size_t size) {
+  if (!inRange(p, offset, size)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (powerLost) {
+    return ESP_FAIL;
+  }
+
+  size_t erased = allowance(size);
+  memset(image.data() + offset, 0xFF, erased);
+  persist(offset, erased);
+  for (size_t sector = offset / SPI_FLASH_SEC_SIZE; sector < (offset + size) / SPI_FLASH_SEC_SIZE; sector++) {
+    sectorErases[sector]++;
+    stats.erases++;
+  }
+  busy((uint64_t)FLASH_ERASE_SECTOR_US * (size / SPI_FLASH_SEC_SIZE));
+  return powerLost ? ESP_FAIL : ESP_OK;
+}
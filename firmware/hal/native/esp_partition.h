@@ -0,0 +1,61 @@
+#ifndef NATIVE_ESP_PARTITION_H
+#define NATIVE_ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum { ESP_PARTITION_TYPE_APP = 0x00, ESP_PARTITION_TYPE_DATA = 0x01 } esp_partition_type_t;
+typedef enum { ESP_PARTITION_SUBTYPE_ANY = 0xff } esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
+
+// Simulator side: one data partition emulated as SPI NOR flash in a file
+// (a temporary one if path is null). Erase sets a sector to 0xFF, a write
+// can only clear bits, and each operation advances the virtual clock by
+// typical SPI NOR timings. A new file starts erased; an existing one is
+// reopened as it was left, which is how a simulated reboot finds its data.
+bool halFlashAttach(const char* path, uint32_t size, const char* label, uint8_t subtype);
+void halFlashDetach();
+
+// Power loss: after this many more bytes programmed or erased, the
+// operation in progress stops short (a byte cut mid-program keeps only
+// some of its bits) and every later write or erase fails until the next
+// call (negative: never).
+void halFlashCutPowerAfter(long bytes);
+
+// Raw access for corrupting data behind the firmware's back
+uint8_t* halFlashImage();
+
+struct HalFlashStats {
+  uint32_t reads;
+  uint64_t bytesRead;
+  uint32_t writes;
+  uint64_t bytesWritten;
+  uint32_t erases;
+  uint32_t overwrites;  // Writes that tried to set a programmed bit (a firmware bug)
+  uint64_t busyMicros;  // Modelled time spent in flash operations
+};
+const HalFlashStats& halFlashStats();
+uint32_t halFlashSectorErases(uint32_t sector);
+
+#endif
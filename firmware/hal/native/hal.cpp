@@ -0,0 +1,248 @@
+#include "Arduino.h"
+#include "WiFi.h"
+#include "esp_now.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+// Virtual clock (microseconds since boot)
+static uint64_t clockMicros = 0;
+
+unsigned long millis() { return (unsigned long)(clockMicros / 1000); }
+unsigned long micros() { return (unsigned long)clockMicros; }
+void delay(unsigned long ms) { clockMicros += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { clockMicros += us; }
+void yield() { clockMicros += 100; }  // Busy-wait loops must still see time pass
+void halAdvanceMicros(uint64_t us) { clockMicros += us; }
+
+// String
+static std::string formatFloat(double value, unsigned int decimals) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, value);
+  return buffer;
+}
+
+String::String(float value, unsigned int decimals) : text(formatFloat(value, decimals)) {}
+String::String(double value, unsigned int decimals) : text(formatFloat(value, decimals)) {}
+
+bool String::endsWith(const String& suffix) const {
+  return text.length() >= suffix.text.length() &&
+         text.compare(text.length() - suffix.text.length(), suffix.text.length(), suffix.text) == 0;
+}
+
+int String::indexOf(char c) const {
+  size_t pos = text.find(c);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t pos = text.rfind(c);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from >= text.length() || to <= from) {
+    return String();
+  }
+  return String(text.substr(from, to - from));
+}
+
+void String::trim() {
+  size_t start = text.find_first_not_of(" \t\r\n");
+  size_t end = text.find_last_not_of(" \t\r\n");
+  text = start == std::string::npos ? std::string() : text.substr(start, end - start + 1);
+}
+
+// Heap figures from the host allocator, relative to the ESP32's ~320 KB
+static const uint32_t SIMULATED_HEAP_SIZE = 320 * 1024;
+static uint32_t minFreeHeap = SIMULATED_HEAP_SIZE;
+
+uint32_t EspClass::getFreeHeap() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  size_t used = mallinfo2().uordblks;
+  uint32_t freeHeap = used < SIMULATED_HEAP_SIZE ? SIMULATED_HEAP_SIZE - used : 0;
+#else
+  uint32_t freeHeap = SIMULATED_HEAP_SIZE;
+#endif
+  minFreeHeap = min(minFreeHeap, freeHeap);
+  return freeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  getFreeHeap();
+  return minFreeHeap;
+}
+
+EspClass ESP;
+
+// Print
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(const char* text) {
+  return write((const uint8_t*)text, strlen(text));
+}
+
+size_t Print::print(long value) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%ld", value);
+  return print(buffer);
+}
+
+size_t Print::print(unsigned long value) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%lu", value);
+  return print(buffer);
+}
+
+size_t Print::print(double value, int digits) {
+  return print(formatFloat(value, digits).c_str());
+}
+
+// HardwareSerial
+bool HardwareSerial::consoleEnabled = true;
+HardwareSerial Serial(0);
+
+int HardwareSerial::available() {
+  int n = 0;
+  for (const RxByte& b : rx) {
+    if ((long)(millis() - b.availableAt) < 0) {
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+int HardwareSerial::read() {
+  if (!available()) {
+    return -1;
+  }
+  uint8_t value = rx.front().value;
+  rx.pop_front();
+  return value;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (uart == 0) {
+    if (consoleEnabled) {
+      fwrite(buffer, 1, size, stdout);
+    }
+  } else if (peer) {
+    peer->onHostWrite(*this, buffer, size);
+  }
+  return size;
+}
+
+void HardwareSerial::inject(const uint8_t* data, size_t len, unsigned long latencyMs) {
+  unsigned long at = millis() + latencyMs;
+  for (size_t i = 0; i < len; i++) {
+    rx.push_back(RxByte{at, data[i]});
+  }
+}
+
+// WiFi
+WiFiClass WiFi;
+
+String IPAddress::toString() const {
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+  return buffer;
+}
+
+// ESP-NOW
+static esp_now_recv_cb_t receiveCallback = nullptr;
+static HalEspNowSendHook sendHook = nullptr;
+static uint8_t peers[ESP_NOW_MAX_TOTAL_PEER_NUM][ESP_NOW_ETH_ALEN];
+static int peerCount = 0;
+
+static int findPeer(const uint8_t* mac) {
+  for (int i = 0; i < peerCount; i++) {
+    if (memcmp(peers[i], mac, ESP_NOW_ETH_ALEN) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+esp_err_t esp_now_init() { return ESP_OK; }
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t callback) {
+  receiveCallback = callback;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer) {
+  if (findPeer(peer->peer_addr) >= 0 || peerCount == ESP_NOW_MAX_TOTAL_PEER_NUM) {
+    return ESP_FAIL;
+  }
+  memcpy(peers[peerCount++], peer->peer_addr, ESP_NOW_ETH_ALEN);
+  return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t* mac) {
+  int i = findPeer(mac);
+  if (i < 0) {
+    return ESP_FAIL;
+  }
+  memcpy(peers[i], peers[--peerCount], ESP_NOW_ETH_ALEN);
+  return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t* mac) { return findPeer(mac) >= 0; }
+
+esp_err_t esp_now_send(const uint8_t* mac, const uint8_t* data, size_t len) {
+  if (findPeer(mac) < 0 || len > ESP_NOW_MAX_DATA_LEN) {
+    return ESP_FAIL;
+  }
+  if (sendHook) {
+    sendHook(mac, data, len);
+  }
+  return ESP_OK;
+}
+
+void halEspNowOnSend(HalEspNowSendHook hook) { sendHook = hook; }
+
+// Wi-Fi promiscuous mode
+static wifi_promiscuous_cb_t promiscuousCallback = nullptr;
+static bool promiscuous = false;
+
+esp_err_t esp_wifi_set_promiscuous(bool enable) {
+  promiscuous = enable;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t callback) {
+  promiscuousCallback = callback;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t* filter) { return ESP_OK; }
+
+bool halEspNowDeliver(const uint8_t* mac, const uint8_t* data, int len, int8_t rssi) {
+  if (!receiveCallback) {
+    return false;
+  }
+  if (promiscuous && promiscuousCallback) {
+    // Vendor-specific action frame header: 24-byte MAC header, category
+    // 127; the ESP-NOW payload itself is not needed here
+    struct {
+      wifi_promiscuous_pkt_t packet;
+      uint8_t header[25];
+    } frame = {};
+    frame.packet.rx_ctrl.rssi = rssi;
+    frame.packet.rx_ctrl.sig_len = sizeof(frame.header) + len;
+    frame.header[0] = 0xD0;
+    memcpy(frame.header + 10, mac, ESP_NOW_ETH_ALEN);
+    frame.header[24] = 0x7F;
+    promiscuousCallback(&frame, WIFI_PKT_MGMT);
+  }
+  receiveCallback(mac, data, len);
+  return true;
+}
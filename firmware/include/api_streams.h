@@ -0,0 +1,73 @@
+#ifndef API_STREAMS_H
+#define API_STREAMS_H
+
+#include <memory>
+#include "json_stream.h"
+#include "device_registry.h"
+#include "device_snapshot.h"
+#include "energy_account.h"
+#include "history_query.h"
+
+// GET /api/devices: one device object per chunk, read from the published
+// snapshot (pinned only while a record is formatted). Snapshots list
+// devices in slot order and each chunk resumes after the last slot
+// written, so a device added or removed meanwhile never makes another one
+// repeat or go missing
+class DeviceListStream : public JsonChunkSource {
+private:
+  SnapshotPublisher& snapshots;
+  int16_t lastHandle;  // Slot of the last device written; -1 before the first
+  bool opened;
+  
+protected:
+  bool nextChunk(JsonText& out) override;
+  
+public:
+  DeviceListStream(SnapshotPublisher& publisher) : snapshots(publisher), lastHandle(-1), opened(false) {}
+  static void writeDevice(JsonText& out, const DeviceSnapshot& device);
+};
+
+// GET /api/devices/<id>: a HistoryQuery over the raw ring or a rollup
+// tier, one point per chunk, thinned to the query's budget. The response
+// ends early if the device leaves its slot mid-stream
+class HistoryStream : public JsonChunkSource {
+private:
+  std::unique_ptr<HistorySeries> series;  // nullptr if the device was not found
+  std::unique_ptr<HistoryDecimator> decimator;
+  DeviceSlot slot;
+  uint8_t fields;
+  uint32_t written;
+  bool opened;
+  
+protected:
+  bool nextChunk(JsonText& out) override;
+  
+public:
+  HistoryStream(const HistoryBuffer* history, const DeviceRollups* rollups, const HistoryQuery& query,
+                const DeviceSlot& device = DeviceSlot());
+  static void writePoint(JsonText& out, const HistoryPoint& point, uint8_t fields);
+};
+
+// GET /api/energy/<id>: the tariff's 24 hourly rates, then a device's
+// hourly and daily buckets (energy, cost, coverage), one bucket per chunk;
+// ends early if the device leaves its slot mid-stream
+class EnergyStream : public JsonChunkSource {
+private:
+  const EnergyAccount* account;  // nullptr if the device was not found
+  DeviceSlot slot;
+  const Tariff& tariff;
+  int tier;
+  EnergyReadState state;
+  uint32_t written;
+  bool opened;
+  
+protected:
+  bool nextChunk(JsonText& out) override;
+  
+public:
+  EnergyStream(const EnergyAccount* source, const Tariff& prices, const DeviceSlot& device = DeviceSlot())
+    : account(source), slot(device), tariff(prices), tier(ENERGY_HOUR), written(0), opened(false) {}
+  static void writeBucket(JsonText& out, const EnergyPoint& point, int tier);
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "device_registry.h"
+#include "flash_log.h"
+
+#define AUDIT_ID_MAX 16  // Longer device IDs are not persisted
+
+// Device record flags
+#define AUDIT_DEVICE_WIRELESS 0x01
+#define AUDIT_DEVICE_REMOVED 0x02
+
+enum AuditRecordType : uint8_t {
+  AUDIT_RECORD_CLOCK = 0x01,   // Audit clock when a segment was started
+  AUDIT_RECORD_DEVICE = 0x02,  // Device added (or removed), with its energy total
+  AUDIT_RECORD_SAMPLE = 0x03   // Latest reading and energy total of one device
+};
+
+// One log record, unpacked. On flash (22 bytes, little-endian):
+//   clock:  type, 3 zero bytes, time u32
+//   device: type, flags, totalEnergy f32, id (NUL padded to 16)
+//   sample: type, pf (0.01), voltage u16 (0.1V), deviceHash u32, time u32,
+//           current u24 (1mA), power u24 (0.1W), totalEnergy f32
+struct AuditRecord {
+  AuditRecordType type;
+  uint32_t time;        // Audit clock, s
+  uint32_t deviceHash;  // DeviceRegistry::hashId
+  uint8_t flags;        // Device records
+  char id[AUDIT_ID_MAX + 1];  // Device records
+  float totalEnergy;    // kWh
+  DeviceReading reading;  // Sample records: voltage, current, power, powerFactor
+
+  static void encode(const AuditRecord& record, uint8_t* payload);
+  static bool decode(const uint8_t* payload, AuditRecord& record);
+};
+
+// A device as the last run left it in the log
+struct AuditDeviceState {
+  char id[AUDIT_ID_MAX + 1];
+  bool wireless;
+  float totalEnergy;  // kWh
+  uint32_t lastLogged;  // Audit clock, s
+};
+
+// Device history kept across reboots in a FlashLog on the "auditlog"
+// partition: a sample record per device per AUDIT_LOG_SAMPLE_MS, device
+// records as devices come and go, and a checkpoint (clock, every device
+// and its energy total) at the start of each segment.
+//
+// Timestamps use an audit clock: seconds of logged operation, carried
+// over from the newest record at boot. There is no RTC, so time spent
+// powered off does not count. clockOffset() reads the clock from other
+// tasks under a sequence lock bumped around every move of it.
+class AuditLog {
+private:
+  FlashLog log;
+  const DeviceRegistry* devices;
+  uint32_t clockSeconds;
+  unsigned long clockMillis;  // millis() at the last whole second counted
+  std::atomic<uint32_t> clockSeq;  // Odd while the clock is being moved
+  unsigned long lastSample;
+  unsigned long lastFlush;
+  uint32_t loggedAppended[MAX_DEVICES];  // history.totalAppended() at the last sample record
+  AuditDeviceState restoredDevices[MAX_DEVICES];
+  int restoredTotal;
+
+  static void restoreRecord(const uint8_t* payload, void* context);
+  static void writeCheckpoint(FlashLog& log, void* context);
+  void appendDevice(const DeviceInfo& device, uint8_t flags);
+  void tick(unsigned long now);
+  void beginClockWrite();
+  void endClockWrite();
+
+public:
+  AuditLog();
+
+  // Find the partition and read back what the last run logged; false
+  // (and logging disabled) without one. Call before adding devices
+  bool begin(const DeviceRegistry& registry);
+  bool isReady() const { return log.isReady(); }
+
+  int restoredCount() const { return restoredTotal; }
+  const AuditDeviceState& restored(int i) const { return restoredDevices[i]; }
+
+  void deviceAdded(DeviceHandle handle, const DeviceInfo& device);
+  void deviceRemoved(const DeviceInfo& device);
+
+  // From loop(): sample devices with new readings, flush when due
+  void update(unsigned long now);
+
+  uint32_t clock() const { return clockSeconds; }
+
+  // Audit clock (ms) minus millis(): maps reading timestamps onto the
+  // clock of the logged records. Safe from other tasks
+  int64_t clockOffset() const;
+
+  // Audit clock (ms) of a recent millis() timestamp; unlike adding
+  // clockOffset(), right across millis() wrapping. Owner task only
+  uint64_t timeOf(unsigned long timestamp) const;
+
+  // The log itself, for readers on other tasks (FlashLog::read)
+  const FlashLog& records() const { return log; }
+  size_t pending() const { return log.pending(); }
+  const FlashLogStats& stats() const { return log.stats(); }
+};
+
+#endif
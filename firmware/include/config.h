@@ -10,6 +10,19 @@
 // ESP-NOW Configuration
 #define ESP_NOW_CHANNEL 1
 #define ESP_NOW_ENCRYPT false
+#define ESPNOW_RX_QUEUE_SIZE 16  // Raw frames buffered from the Wi-Fi callback (power of two)
+#define ESPNOW_RX_BATCH 8        // Frames processed per loop() iteration
+#define ESPNOW_RX_FRAME_MAX 250  // ESP_NOW_MAX_DATA_LEN
+
+// Device Activity: inactive after this long without a reading, or after
+// several missed reports from a node that reports less often
+#define DEVICE_TIMEOUT_MS 30000
+#define DEVICE_TIMEOUT_INTERVALS 3
+#define ACTIVITY_CHECK_INTERVAL_MS 1000
+
+// Line assumed for wireless nodes without voltage sense
+#define ASSUMED_LINE_VOLTAGE 230.0  // V
+#define ASSUMED_LINE_FREQUENCY 50.0  // Hz
 
 // PZEM-004T Configuration (2 wired loads)
 #define PZEM1_RX_PIN 16
@@ -21,18 +34,64 @@
 #define PZEM2_ADDR 0x02
 
 // Data Storage
-#define MAX_DEVICES 10
-#define MAX_HISTORY_ENTRIES 1000
-#define HISTORY_INTERVAL_MS 5000  // Store reading every 5 seconds
+#ifndef MAX_DEVICES
+#define MAX_DEVICES 10  // Registry slots (the load generator builds with more)
+#endif
+#define MAX_HISTORY_ENTRIES 360  // Raw ring: 30 minutes at HISTORY_INTERVAL_MS (12 bytes each)
+#define HISTORY_INTERVAL_MS 5000  // Raw ring keeps a reading about every 5 s; rollups and energy get all
+#define HISTORY_ANCHOR_INTERVAL 32  // Absolute time kept every N samples (timestamp search)
+#define DEVICE_COMMAND_QUEUE_SIZE 8  // Pending rename/delete requests (power of two)
+
+// History Rollups (aggregate tiers behind the raw ring, see rollup_tiers.h)
+#define ROLLUP_MINUTE_BUCKETS 120   // 1-minute buckets: 2 hours
+#define ROLLUP_QUARTER_BUCKETS 96   // 15-minute buckets: 1 day
+#define ROLLUP_HOUR_BUCKETS 168     // Hourly buckets: 1 week
+#define HISTORY_DEFAULT_POINTS MAX_HISTORY_ENTRIES  // /api/devices/<id> point budget
+
+// Energy Accounting (per-device totals and buckets, see energy_account.h)
+#define ENERGY_HOUR_BUCKETS 48               // Hourly energy and cost: 2 days
+#define ENERGY_DAY_BUCKETS 31                // Daily energy and cost: a month
+#define ENERGY_MAX_GAP_MS 60000              // Longer silences are not integrated
+#define ENERGY_METER_MAX_POWER 26000.0       // W; larger counter steps are glitches (PZEM: 100A at 260V)
+#define ENERGY_METER_ROLLOVER_WH 10000000UL  // PZEM-004T v3 counter starts over after 9999.99 kWh
+
+// Tariff: price per kWh by hour of day (bands wrap past midnight)
+#define TARIFF_STANDARD_RATE 0.15
+#define TARIFF_PEAK_RATE 0.30
+#define TARIFF_PEAK_START 17      // Hour of day, first charged at the peak rate
+#define TARIFF_PEAK_END 21        // Hour of day, first back at the standard rate
+#define TARIFF_OFFPEAK_RATE 0.08
+#define TARIFF_OFFPEAK_START 23
+#define TARIFF_OFFPEAK_END 7
+#define TARIFF_CLOCK_HOUR 0       // Hour of day when the audit clock read 0 (no RTC)
+
+// Persistent Audit Log (raw flash partition, see partitions.csv)
+#define AUDIT_LOG_PARTITION "auditlog"
+#define AUDIT_LOG_SUBTYPE 0x40          // Custom data partition subtype
+#define AUDIT_LOG_SAMPLE_MS 60000       // One record per reporting device per minute
+#define AUDIT_LOG_FLUSH_MS 300000       // Buffered records programmed every 5 minutes
+#define AUDIT_LOG_BUFFER_RECORDS 64     // RAM buffer; flushed early when 3/4 full
+
+// Running Statistics (sliding windows over the history ring)
+#define STATS_SAMPLE_WINDOW 100          // Last N stored readings (avgPower, usage anomaly)
+#define STATS_TIME_WINDOW_MS 300000      // Last 5 minutes
+#define STATS_WINDOW_MAX_SAMPLES 256     // Upper bound on samples in any window
 
 // Waste Detection Thresholds
 #define STANDBY_CURRENT_THRESHOLD 0.2  // Amps
 #define LOW_PF_THRESHOLD 0.7
+#define ALWAYS_ON_POWER_THRESHOLD 1.0  // W
 #define ANOMALY_CHECK_INTERVAL_MS 60000  // Check every minute
 
 // Web Server
 #define WEB_SERVER_PORT 80
 
+// Live Updates (Server-Sent Events on /events)
+#define LIVE_PUSH_INTERVAL_MS 500  // At most one update frame per interval
+#define LIVE_MAX_BACKLOG 4         // Hold pushes while clients average this many queued frames
+#define LIVE_FRAME_MAX 2048        // One update frame (JSON array of device deltas)
+#define LIVE_DELTA_MAX 384         // Room reserved per device delta
+
 // Device IDs
 #define WIRED_LOAD_1_ID "WIRED_01"
 #define WIRED_LOAD_2_ID "WIRED_02"
@@ -2,15 +2,33 @@
 #define DEVICE_DATA_H
 
 #include <Arduino.h>
+#include "config.h"
+#include "energy_account.h"
+#include "history_buffer.h"
+#include "link_stats.h"
+#include "rollup_tiers.h"
+#include "window_stats.h"
+
+// Current harmonics reported by a wireless node
+struct HarmonicReading {
+  bool valid = false;
+  float fundamental;  // A RMS
+  float orders[3];    // 3rd, 5th, 7th; % of the fundamental
+  float thd;          // %
+};
 
 struct DeviceReading {
   float voltage;      // V
   float current;      // A
   float power;        // W
-  float energy;       // kWh
+  float energy;       // kWh, meter's counter (wired only)
   float frequency;    // Hz
   float powerFactor;  // 0.0 - 1.0
   unsigned long timestamp;
+  bool powerFactorEstimated = false;  // Node without voltage sense: PF (and V, Hz) assumed
+  bool metered = false;  // meterWh holds the meter's energy counter
+  uint32_t meterWh = 0;  // Wh, as counted by the meter (energy is for display)
+  HarmonicReading harmonics;  // Latest from the node; not kept in history
 };
 
 struct DeviceInfo {
@@ -19,10 +37,11 @@ struct DeviceInfo {
   String customName;  // User-defined name (empty if not set)
   String type;  // "wired" or "wireless"
   DeviceReading currentReading;
-  DeviceReading history[MAX_HISTORY_ENTRIES];
-  int historyCount;
+  HistoryBuffer history;  // Packed fixed-point ring (see history_buffer.h)
+  DeviceRollups rollups;  // Minute/quarter/hour aggregates, about a week deep
   unsigned long lastSeen;
-  bool isActive;
+  bool isActive;  // Seen within link.activityTimeout()
+  LinkStats link;  // Wireless only
   
   // Waste detection flags
   bool standbyWaste;
@@ -30,10 +49,13 @@ struct DeviceInfo {
   bool efficiencyIssue;
   
   // Statistics
+  EnergyAccount energyAccount;  // Hourly/daily energy and cost, owns totalEnergy
   float totalEnergy;  // kWh
-  float avgPower;     // W
+  float avgPower;     // W (mean of recentStats)
   float maxPower;     // W
   unsigned long uptime;  // seconds
+  WindowStats recentStats = WindowStats(STATS_SAMPLE_WINDOW, 0);  // Last N readings
+  WindowStats timedStats = WindowStats(STATS_WINDOW_MAX_SAMPLES, STATS_TIME_WINDOW_MS);  // Last T ms
   
   // Get display name (custom name if set, otherwise default name)
   String getDisplayName() {
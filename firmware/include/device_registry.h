@@ -0,0 +1,90 @@
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "device_data.h"
+
+typedef int16_t DeviceHandle;
+static const DeviceHandle INVALID_DEVICE = -1;
+
+// Smallest power of two >= 2n (index load factor <= 0.5)
+static constexpr uint16_t registryIndexSize(uint16_t n, uint16_t size = 8) {
+  return size >= 2 * n ? size : registryIndexSize(n, size * 2);
+}
+
+// Fixed-capacity device table with a hash index on device ID.
+// Devices live in stable slots (a handle stays valid until the device is
+// removed), lookups go through an open-addressing index (linear probing,
+// FNV-1a over the ID) and removal is O(1): the slot is returned to a free
+// list and nothing is shifted, so history buffers never move.
+//
+// A DeviceInfo is about 13 KB, so slots are allocated from the heap when
+// first used rather than reserved in .dram0.bss: only devices actually
+// seen cost RAM. A slot's DeviceInfo is kept for the next device once
+// allocated (readers on other tasks may still hold it). Each slot also
+// counts the devices removed from it, so such a reader can tell when the
+// slot has moved on to another device (see DeviceSlot).
+class DeviceRegistry {
+private:
+  struct IndexEntry {
+    uint32_t hash;
+    DeviceHandle slot;  // INVALID_DEVICE = empty
+  };
+  
+  static const uint16_t INDEX_SIZE = registryIndexSize(MAX_DEVICES);
+  static const uint16_t INDEX_MASK = INDEX_SIZE - 1;
+  
+  DeviceInfo* slots[MAX_DEVICES];  // nullptr until first used
+  bool used[MAX_DEVICES];
+  IndexEntry index[INDEX_SIZE];
+  DeviceHandle freeSlots[MAX_DEVICES];
+  std::atomic<uint32_t> generations[MAX_DEVICES];  // Bumped when the slot's device is removed
+  int freeCount;
+  int deviceCount;
+  
+  int findIndexPosition(const char* id, uint32_t hash) const;
+  
+public:
+  static uint32_t hashId(const char* id);
+  
+  DeviceRegistry();
+  ~DeviceRegistry();
+  DeviceRegistry(const DeviceRegistry&) = delete;
+  DeviceRegistry& operator=(const DeviceRegistry&) = delete;
+  void clear();
+  
+  DeviceHandle find(const String& id) const;
+  DeviceHandle insert(const String& id);  // INVALID_DEVICE if full, out of memory or already present
+  bool remove(DeviceHandle handle);
+  
+  bool isValid(DeviceHandle handle) const { return handle >= 0 && handle < MAX_DEVICES && used[handle]; }
+  DeviceInfo& operator[](DeviceHandle handle) { return *slots[handle]; }
+  const DeviceInfo& operator[](DeviceHandle handle) const { return *slots[handle]; }
+  int count() const { return deviceCount; }
+  // Safe from any task: unchanged for as long as the slot holds one device
+  uint32_t generation(DeviceHandle handle) const { return generations[handle].load(); }
+  bool isFull() const { return freeCount == 0; }
+  
+  // Iteration in slot order: for (h = first(); h != INVALID_DEVICE; h = next(h))
+  DeviceHandle first() const { return next(-1); }
+  DeviceHandle next(DeviceHandle handle) const;
+};
+
+// A device found by another task (through the published snapshot): still
+// in its slot while the slot's generation is the one taken with it. Check
+// before and after reading the device, since the owner task may remove
+// it and reuse the slot at any time
+struct DeviceSlot {
+  const DeviceRegistry* registry;  // nullptr: nothing to check
+  DeviceHandle handle;
+  uint32_t generation;
+  
+  DeviceSlot() : registry(nullptr), handle(INVALID_DEVICE), generation(0) {}
+  DeviceSlot(const DeviceRegistry& devices, DeviceHandle slot, uint32_t taken)
+    : registry(&devices), handle(slot), generation(taken) {}
+  bool current() const { return !registry || registry->generation(handle) == generation; }
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef DEVICE_SNAPSHOT_H
+#define DEVICE_SNAPSHOT_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "device_data.h"
+
+#define DEVICE_ID_MAX 24
+#define DEVICE_NAME_MAX 51  // 50 chars + NUL (rename limit)
+#define DEVICE_TYPE_MAX 10
+
+// Immutable, allocation-free copy of one device for HTTP readers
+struct DeviceSnapshot {
+  int16_t handle;  // Registry slot on the owner task
+  uint32_t generation;  // DeviceRegistry::generation(handle) when captured
+  uint32_t idHash;
+  char id[DEVICE_ID_MAX];
+  char name[DEVICE_NAME_MAX];
+  char customName[DEVICE_NAME_MAX];
+  char type[DEVICE_TYPE_MAX];
+  DeviceReading currentReading;
+  unsigned long lastSeen;
+  bool isActive;
+  LinkSummary link;
+  bool standbyWaste;
+  bool usageAnomaly;
+  bool efficiencyIssue;
+  float totalEnergy;
+  EnergySummary energy;  // Current hour and day, tariff priced
+  float avgPower;
+  float maxPower;
+  
+  // Time-window statistics
+  unsigned long windowSeconds;
+  uint16_t windowSamples;
+  float windowAvgPower;
+  float windowMinPower;
+  float windowMaxPower;
+  float windowStdDevPower;
+  float windowEnergy;
+  
+  const char* getDisplayName() const { return customName[0] ? customName : name; }
+  void capture(const DeviceInfo& device);
+};
+
+struct DeviceTableSnapshot {
+  uint32_t version;
+  unsigned long publishedAt;
+  uint16_t count;
+  DeviceSnapshot devices[MAX_DEVICES];
+  
+  const DeviceSnapshot* find(const char* id) const;
+};
+
+// Double-buffered snapshot publication without blocking either side.
+// The owner task writes the back buffer and publishes it by flipping an
+// index; readers pin the front buffer with a reader count and serialize
+// straight from it. The writer skips a cycle (rather than waiting) if a
+// slow reader still holds the back buffer.
+class SnapshotPublisher {
+private:
+  DeviceTableSnapshot buffers[2];
+  std::atomic<uint8_t> front;
+  std::atomic<uint16_t> readers[2];
+  uint32_t version;
+  uint32_t skipped;
+  
+public:
+  SnapshotPublisher() : front(0), version(0), skipped(0) {
+    readers[0] = 0;
+    readers[1] = 0;
+    buffers[0].version = 0;
+    buffers[0].publishedAt = 0;
+    buffers[0].count = 0;
+  }
+  
+  // Writer (owner task only): nullptr if the back buffer is still pinned
+  DeviceTableSnapshot* beginWrite();
+  void publish();
+  uint32_t skippedPublishes() const { return skipped; }
+  
+  // Readers (any task)
+  const DeviceTableSnapshot* acquire();
+  void release(const DeviceTableSnapshot* snapshot);
+};
+
+// Scoped reader pin
+class SnapshotReader {
+private:
+  SnapshotPublisher& publisher;
+  const DeviceTableSnapshot* snapshot;
+  
+public:
+  SnapshotReader(SnapshotPublisher& pub) : publisher(pub), snapshot(pub.acquire()) {}
+  ~SnapshotReader() { publisher.release(snapshot); }
+  const DeviceTableSnapshot* operator->() const { return snapshot; }
+  const DeviceTableSnapshot& operator*() const { return *snapshot; }
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef ENERGY_ACCOUNT_H
+#define ENERGY_ACCOUNT_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+struct DeviceReading;
+
+enum EnergyTierIndex {
+  ENERGY_HOUR = 0,
+  ENERGY_DAY = 1,
+  ENERGY_TIER_COUNT = 2
+};
+
+// How the last interval of a device was accounted
+enum EnergyMethod : uint8_t {
+  ENERGY_NONE = 0,       // No interval yet
+  ENERGY_METER = 1,      // Counter delta of the meter (PZEM)
+  ENERGY_TRAPEZOID = 2,  // Power integrated between readings
+  ENERGY_GAP = 3         // Silence longer than ENERGY_MAX_GAP_MS, not counted
+};
+
+// Price per kWh for each hour of the day. Time of use in hour steps, set
+// up from the TARIFF_* settings
+class Tariff {
+private:
+  float rates[24];
+
+public:
+  Tariff();
+
+  // Charge `rate` from hour `from` up to hour `to`; wraps past midnight
+  void setRate(int from, int to, float rate);
+  float rate(int hour) const { return rates[hour]; }
+};
+
+// One hourly or daily bucket (12 bytes)
+struct EnergyBucket {
+  float energy;        // kWh
+  float cost;          // Tariff currency
+  uint32_t coveredMs;  // Part of the bucket accounted for
+};
+
+// A bucket as handed to readers
+struct EnergyPoint {
+  uint32_t index;  // Local hours (or days) since audit clock 0
+  int64_t start;   // Audit clock, ms
+  uint32_t coveredMs;
+  float energy;  // kWh
+  float cost;
+};
+
+// Progress of a concurrent reader (see EnergyAccount::readBatch)
+struct EnergyReadState {
+  bool started;
+  uint32_t next;  // Index of the next bucket to read
+
+  EnergyReadState() : started(false), next(0) {}
+};
+
+// Ring state of one tier; its buckets are a slice of EnergyAccount::buckets
+struct EnergyTier {
+  uint16_t offset;  // First slot of the slice
+  uint16_t capacity;
+  uint16_t head;    // Slot of the oldest bucket
+  uint16_t count;
+  uint32_t newest;     // Index of the newest bucket
+  double openEnergy;   // Exact sums of the newest bucket
+  double openCost;
+};
+
+// Latest hour and day of a device, for the snapshot
+struct EnergySummary {
+  EnergyMethod method;
+  float hourEnergy;   // kWh, current hour
+  float hourCost;
+  float todayEnergy;  // kWh, current day
+  float todayCost;
+  uint32_t gaps;      // Silences left out of the total
+  uint32_t counterResets;
+  uint32_t counterRollovers;
+  uint32_t counterGlitches;  // Implausible steps, integrated instead
+};
+
+// Energy accounting of one device: the running total (kWh) and its split
+// into hourly and daily buckets, each priced at the tariff of its hour.
+//
+// Readings carrying the meter's counter (wired PZEM loads) are accounted
+// by counter deltas, which stay exact across missed polls. A counter that
+// went backwards either wrapped at ENERGY_METER_ROLLOVER_WH or was reset
+// (energy since then is its value); a step no load could have made in
+// the time (ENERGY_METER_MAX_POWER) is a glitch and is integrated
+// instead. Other readings (wireless nodes) are integrated as trapezoids,
+// except across silences longer than ENERGY_MAX_GAP_MS, which are counted
+// as gaps and left out rather than guessed.
+//
+// Buckets are on the audit clock (see AuditLog) shifted by
+// TARIFF_CLOCK_HOUR: without an RTC, hour of day is only as right as that
+// setting, and time spent powered off does not count.
+//
+// The owner task adds; other tasks may only use readBatch(), which is
+// guarded by a sequence lock bumped around every modification.
+class EnergyAccount {
+private:
+  EnergyBucket buckets[ENERGY_HOUR_BUCKETS + ENERGY_DAY_BUCKETS];
+  EnergyTier tiers[ENERGY_TIER_COUNT];
+  double total;  // kWh
+  bool started;
+  uint64_t lastClock;  // Audit clock of the last reading, ms
+  float lastPower;     // W
+  bool counterValid;
+  uint32_t lastCounter;  // Wh
+  EnergyMethod method;
+  uint32_t gaps;
+  uint32_t counterResets;
+  uint32_t counterRollovers;
+  uint32_t counterGlitches;
+  std::atomic<uint32_t> writeSeq;  // Odd while a modification is in progress
+
+  void beginWrite();
+  void endWrite();
+  EnergyBucket& at(const EnergyTier& tier, int i) { return buckets[tier.offset + (tier.head + i) % tier.capacity]; }
+  const EnergyBucket& at(const EnergyTier& tier, int i) const { return buckets[tier.offset + (tier.head + i) % tier.capacity]; }
+  EnergyBucket& advance(EnergyTier& tier, uint32_t index);
+  void addTier(EnergyTier& tier, uint32_t index, uint32_t ms, double energy, double cost);
+  void spread(uint64_t from, uint64_t to, float powerFrom, float powerTo, const Tariff& tariff);
+  bool meterEnergy(uint32_t counter, uint64_t elapsed, uint32_t& wattHours);
+
+public:
+  EnergyAccount();
+  void clear();
+
+  // Total carried over from the audit log (kWh)
+  void restore(double kWh);
+
+  // Account the interval from the previous reading to this one, which
+  // is at `clock` (audit clock, ms). False if nothing was accounted: a
+  // first reading, one not after the previous, or a gap
+  bool add(const DeviceReading& reading, uint64_t clock, const Tariff& tariff);
+
+  double totalEnergy() const { return total; }
+  bool hasReading() const { return started; }
+  uint64_t lastTime() const { return lastClock; }  // Audit clock of the last reading
+  EnergySummary summary() const;
+
+  // Safe from any task: up to max buckets of one tier, oldest first,
+  // from state.next on. Returns 0 when done
+  int readBatch(int tier, EnergyReadState& state, EnergyPoint* out, int max) const;
+
+  int size(int tier) const { return tiers[tier].count; }
+  int capacity(int tier) const { return tiers[tier].capacity; }
+
+  // Local hour (or day) of an audit clock time, and back
+  static uint32_t indexOf(int tier, uint64_t clock);
+  static int64_t startOf(int tier, uint32_t index);
+  static const char* methodName(EnergyMethod method);
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef ESPNOW_QUEUE_H
+#define ESPNOW_QUEUE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "spsc_queue.h"
+
+// Raw ESP-NOW frame as copied out of the Wi-Fi receive callback; decoded
+// later by loop()
+struct EspNowFrame {
+  uint8_t mac[6];
+  uint8_t len;
+  int8_t rssi;  // dBm, 0 if unknown
+  uint8_t data[ESPNOW_RX_FRAME_MAX];
+  unsigned long receivedAt;
+};
+
+typedef SpscQueue<EspNowFrame, ESPNOW_RX_QUEUE_SIZE> EspNowQueue;
+
+#endif
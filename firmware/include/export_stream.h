@@ -0,0 +1,128 @@
+#ifndef EXPORT_STREAM_H
+#define EXPORT_STREAM_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "device_registry.h"
+#include "device_snapshot.h"
+#include "flash_log.h"
+#include "history_query.h"
+#include "json_stream.h"
+
+#define EXPORT_MAGIC "EAEX"
+#define EXPORT_VERSION 1
+#define EXPORT_BATCH 16                  // Records copied out of a store per read
+#define EXPORT_NAMES (2 * MAX_DEVICES)   // Device IDs remembered for logged records
+
+enum ExportFormat : uint8_t {
+  EXPORT_CSV,
+  EXPORT_BINARY
+};
+
+// Record kinds of the binary format. Each record is its kind byte and
+// then its fields, little-endian, as described by the schema header
+enum ExportRecordKind : uint8_t {
+  EXPORT_RECORD_DEVICE = 1,  // device I, flags B (AUDIT_DEVICE_*), id s
+  EXPORT_RECORD_RAW = 2,     // device I, time_ms Q, voltage f, current f, power f, power_factor f
+  EXPORT_RECORD_ROLLUP = 3,  // device I, tier B, time_ms Q, power f, min_power f, max_power f,
+                             // energy_kwh f, coverage_s f
+  EXPORT_RECORD_LOGGED = 4,  // device I, time_ms Q, voltage f, current f, power f, power_factor f,
+                             // total_kwh f
+  EXPORT_RECORD_END = 5      // records I (all records before this one)
+};
+
+// GET /api/export: every device's history for offline analysis, oldest
+// first: the flash log, then per device the hourly, 15-minute and 1-minute
+// rollups and the raw ring. One record per chunk, so memory stays at one
+// batch per store however much is exported.
+//
+// CSV has one row per reading or bucket:
+//   source,device,time_ms,voltage,current,power,power_factor,
+//   min_power,max_power,energy_kwh,coverage_s,total_kwh
+// with source one of log, hour, quarter, minute, raw and empty cells for
+// fields the source lacks. The binary format starts with "EAEX", a
+// version byte and a schema (per record kind: name and typed field list),
+// then records as in ExportRecordKind; devices are referred to by
+// DeviceRegistry::hashId and named by device records.
+//
+// All times are on the audit clock (ms of logged operation, see
+// AuditLog), so logged and in-RAM history line up across reboots.
+class ExportStream : public JsonChunkSource {
+private:
+  struct Device {
+    DeviceHandle handle;
+    uint32_t generation;  // Slot generation when listed (DeviceSlot)
+    uint32_t hash;
+    bool wireless;
+    char id[DEVICE_ID_MAX];
+  };
+
+  struct Name {
+    uint32_t hash;
+    char id[DEVICE_ID_MAX];
+  };
+
+  enum Stage {
+    STAGE_HEADER,
+    STAGE_DEVICES,
+    STAGE_LOG,
+    STAGE_HISTORY,
+    STAGE_END,
+    STAGE_DONE
+  };
+
+  const DeviceRegistry& registry;
+  const FlashLog* log;  // nullptr without a flash log
+  int64_t clockOffset;  // Audit clock minus millis(), ms
+  ExportFormat format;
+
+  Device devices[MAX_DEVICES];  // As listed when the export started
+  int deviceCount;
+  Name names[EXPORT_NAMES];     // ID of each device hash seen so far
+  int nameCount;
+  int nameNext;                 // Replaced next once full
+
+  Stage stage;
+  int device;  // STAGE_DEVICES, STAGE_HISTORY: index into devices
+  int tier;    // STAGE_HISTORY: a RollupTierIndex, or HISTORY_TIER_RAW
+  uint32_t records;
+
+  FlashLogReadState logState;
+  HistoryReadState historyState;
+  RollupReadState rollupState;
+  union Batch {
+    uint8_t logged[EXPORT_BATCH][FLASH_LOG_PAYLOAD_SIZE];
+    DeviceReading readings[EXPORT_BATCH];
+    RollupPoint buckets[EXPORT_BATCH];
+
+    Batch() {}
+  } batch;  // One store is read at a time
+  int batchCount;
+  int batchPos;
+
+  void remember(uint32_t hash, const char* id);
+  const char* nameOf(uint32_t hash, char* fallback) const;
+  uint64_t auditTime(unsigned long timestamp) const;
+  bool nextLogged(JsonText& out);
+  bool nextHistory(JsonText& out);
+  void nextSource();
+
+  void writeHeader(JsonText& out);
+  void writeDevice(JsonText& out, uint32_t hash, uint8_t flags, const char* id);
+  void writeLogged(JsonText& out, const uint8_t* payload);
+  void writeReading(JsonText& out, const Device& source, const DeviceReading& reading);
+  void writeBucket(JsonText& out, const Device& source, const RollupPoint& bucket);
+
+protected:
+  bool nextChunk(JsonText& out) override;
+
+public:
+  // Call with the snapshot pinned; the log and registry are read
+  // concurrently with their owner as the response is sent
+  ExportStream(const DeviceRegistry& source, const DeviceTableSnapshot& snapshot, const FlashLog* records,
+               int64_t offset, ExportFormat exportFormat);
+
+  const char* contentType() const { return format == EXPORT_CSV ? "text/csv" : "application/octet-stream"; }
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "config.h"
+
+#define FLASH_LOG_SEGMENT_SIZE 4096  // One erase sector
+#define FLASH_LOG_SLOT_SIZE 24       // Fixed-size record: payload, then CRC-16
+#define FLASH_LOG_PAYLOAD_SIZE (FLASH_LOG_SLOT_SIZE - 2)
+#define FLASH_LOG_SLOTS (FLASH_LOG_SEGMENT_SIZE / FLASH_LOG_SLOT_SIZE)  // Slot 0 holds the segment header
+#define FLASH_LOG_MAGIC 0x474F4C41UL  // "ALOG"
+
+struct FlashLogStats {
+  uint32_t segments;     // In the partition
+  uint32_t generation;   // Of the segment being written
+  uint32_t appended;     // Records since boot
+  uint32_t written;      // Records programmed since boot
+  uint32_t flushes;
+  uint32_t erases;
+  uint32_t dropped;      // Appended while the RAM buffer was full
+  uint32_t writeErrors;
+  uint32_t recovered;    // Valid records in the tail segment at boot
+  uint32_t torn;         // Unreadable slots skipped there (writes cut short)
+  uint32_t recoveryMicros;
+  uint32_t maxFlushMicros;
+};
+
+// Progress of a reader walking the log (see FlashLog::read)
+struct FlashLogReadState {
+  bool started;
+  uint32_t generation;  // Segment being read
+  uint32_t slot;        // Next slot in it
+
+  FlashLogReadState() : started(false), generation(0), slot(0) {}
+};
+
+// Append-only log of fixed-size records on a raw flash partition.
+//
+// The partition is a ring of segments of one erase sector each. Slot 0 of
+// a segment is a header carrying a generation number one above the
+// previous segment's; records fill the remaining slots in order, each
+// with its own CRC. A full log rotates into the next segment (erasing the
+// oldest), so every sector is erased equally often.
+//
+// Appends only go to a RAM buffer; flush() programs everything buffered
+// at once, so flash sees few large writes. Nothing is ever rewritten: a
+// write cut short by power loss leaves a slot that fails its CRC, which
+// recovery skips. begin() reads the segment headers to find the newest
+// segment and scans only that one for the end of the log; a checkpoint
+// hook writes whatever state must survive at the start of each segment,
+// so the tail segment alone is enough to restore it.
+class FlashLog {
+public:
+  typedef void (*Visitor)(const uint8_t* payload, void* context);
+  typedef void (*Checkpoint)(FlashLog& log, void* context);
+
+  FlashLog();
+
+  // Recover from the partition, passing each valid record of the tail
+  // segment to restore (oldest first). False without a usable partition,
+  // after which the log stays disabled
+  bool begin(const esp_partition_t* partition, Visitor restore = nullptr, void* context = nullptr);
+  bool isReady() const { return partition != nullptr; }
+
+  // Called after each rotation; it writes records with checkpoint()
+  void setCheckpoint(Checkpoint hook, void* context);
+
+  // Buffer one record (FLASH_LOG_PAYLOAD_SIZE bytes); false if the buffer is full
+  bool append(const uint8_t* payload);
+  size_t pending() const { return pendingCount; }
+
+  // Program the buffer, rotating as segments fill
+  bool flush();
+
+  // Only from the checkpoint hook: program one record right away
+  bool checkpoint(const uint8_t* payload);
+
+  // Safe from another task while the owner appends: up to max records
+  // (FLASH_LOG_PAYLOAD_SIZE bytes each, into out) from the oldest segment
+  // on flash to the last one programmed. Segments rotated away under the
+  // reader are skipped. Returns 0 once caught up with the writer
+  int read(FlashLogReadState& state, uint8_t* out, int max) const;
+
+  const FlashLogStats& stats() const { return counters; }
+
+private:
+  const esp_partition_t* partition;
+  uint32_t segments;
+  uint32_t tail;       // Segment being written
+  uint32_t nextSlot;   // In the tail segment
+  uint32_t generation;
+  uint32_t segmentBase;  // Segment of generation g: (segmentBase + g) % segments
+  Checkpoint checkpointHook;
+  void* checkpointContext;
+  bool inCheckpoint;
+
+  uint8_t buffer[AUDIT_LOG_BUFFER_RECORDS][FLASH_LOG_SLOT_SIZE];
+  size_t pendingCount;
+  FlashLogStats counters;
+
+  static void seal(uint8_t* slot);
+  static bool isSealed(const uint8_t* slot);
+  static bool isErased(const uint8_t* slot);
+
+  uint32_t slotOffset(uint32_t segment, uint32_t slot) const {
+    return segment * FLASH_LOG_SEGMENT_SIZE + slot * FLASH_LOG_SLOT_SIZE;
+  }
+  bool readHeader(uint32_t segment, uint32_t& segmentGeneration) const;
+  uint32_t scanTail(Visitor restore, void* context);
+  bool rotate();
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef HISTORY_BUFFER_H
+#define HISTORY_BUFFER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+struct DeviceReading;
+
+// Packed history sample (12 bytes vs 28 for a full DeviceReading).
+// Values are stored as scaled integers at the PZEM-004T's native
+// resolution; 24-bit fields are little-endian byte triplets.
+//
+// The delta to the previous sample is a full 32 bits, so timestamps stay
+// exact across any gap: its top byte lives in bits the values never reach
+// (PF <= 100, voltage <= 409.5 V, current <= 2097 A).
+struct HistorySample {
+  uint8_t dt[3];       // ms since previous sample, bits 0-23
+  uint8_t pf;          // 0.01; bit 7 is delta bit 24
+  uint16_t voltage;    // 0.1V; bits 12-15 are delta bits 25-28
+  uint8_t current[3];  // 1mA; bits 21-23 are delta bits 29-31
+  uint8_t power[3];    // 0.1W
+  
+  static const uint32_t MAX_24BIT = 0xFFFFFF;
+  static const uint32_t MAX_VOLTAGE = 0x0FFF;
+  static const uint32_t MAX_CURRENT = 0x1FFFFF;
+  
+  uint32_t deltaMs() const {
+    return get24(dt) | (uint32_t)(pf >> 7) << 24 | (uint32_t)(voltage >> 12) << 25 | (get24(current) >> 21) << 29;
+  }
+  uint32_t pfHundredths() const { return pf & 0x7F; }
+  uint32_t voltageDeciVolts() const { return voltage & MAX_VOLTAGE; }
+  uint32_t currentMa() const { return get24(current) & MAX_CURRENT; }
+  uint32_t powerDeciWatts() const { return get24(power); }
+  
+  static HistorySample encode(const DeviceReading& reading, uint32_t deltaMs);
+  void decode(DeviceReading& reading, unsigned long timestamp) const;
+  
+private:
+  static uint32_t get24(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+  }
+  static void set24(uint8_t* p, uint32_t value);
+};
+
+// Progress of a concurrent reader (see HistoryBuffer::readBatch)
+struct HistoryReadState {
+  bool started;
+  uint32_t nextSeq;          // Next sequence number to read
+  uint32_t endSeq;           // Stop here (newest sample when reading started)
+  unsigned long timestamp;   // Absolute time of sample nextSeq - 1
+  
+  HistoryReadState() : started(false), nextSeq(0), endSeq(0), timestamp(0) {}
+};
+
+// Extent of the ring as one consistent read (see HistoryBuffer::bounds)
+struct HistoryBounds {
+  int count;
+  unsigned long first;  // Oldest sample's time
+  unsigned long last;   // Newest sample's time
+};
+
+#define HISTORY_ANCHORS (MAX_HISTORY_ENTRIES / HISTORY_ANCHOR_INTERVAL + 2)
+
+// Fixed-capacity ring of packed samples. Timestamps are reconstructed from
+// per-sample deltas while iterating from oldest to newest; the absolute
+// time of every HISTORY_ANCHOR_INTERVAL-th sample is kept as well, so a
+// timestamp is found by binary search over those anchors and a short scan.
+//
+// The owner task appends; other tasks may only use readBatch(), seek(),
+// readFrom() and bounds(), which are guarded by a sequence lock bumped around
+// every modification.
+class HistoryBuffer {
+private:
+  HistorySample samples[MAX_HISTORY_ENTRIES];
+  uint16_t head;   // Slot of the oldest sample
+  uint16_t count;
+  uint32_t appended;  // Total samples ever appended
+  unsigned long oldestTimestamp;
+  unsigned long newestTimestamp;
+  unsigned long anchors[HISTORY_ANCHORS];  // By sequence / HISTORY_ANCHOR_INTERVAL
+  std::atomic<uint32_t> writeSeq;  // Odd while a modification is in progress
+  
+  void beginWrite();
+  void endWrite();
+  unsigned long timestampOf(uint32_t seq) const;
+  uint32_t search(unsigned long timestamp, bool after) const;
+  
+public:
+  class Cursor {
+  private:
+    const HistoryBuffer* buffer;
+    int index;
+    unsigned long timestamp;
+    
+  public:
+    Cursor(const HistoryBuffer* buf) : buffer(buf), index(0), timestamp(buf->oldestTimestamp) {}
+    bool next(DeviceReading& reading);
+    int position() const { return index; }
+  };
+  
+  HistoryBuffer() : writeSeq(0) { clear(); }
+  void clear();
+  void append(const DeviceReading& reading);
+  
+  // Safe from any task: decode up to max samples (oldest first) into out.
+  // Samples evicted since the last call are skipped. Returns 0 when the
+  // reader has caught up with state.endSeq or the buffer was cleared.
+  int readBatch(HistoryReadState& state, DeviceReading* out, int max) const;
+  
+  // Safe from any task: sequence number of the first sample at (or, with
+  // after, past) timestamp; totalAppended() if there is none
+  uint32_t seek(unsigned long timestamp, bool after = false) const;
+  
+  // Safe from any task: a reader positioned at sequence seq (or the oldest
+  // sample, if seq has been evicted) that stops before endSeq
+  HistoryReadState readFrom(uint32_t seq, uint32_t endSeq) const;
+  
+  // Safe from any task: sample count and oldest/newest times, taken
+  // together. The accessors below are for the owner task
+  HistoryBounds bounds() const;
+  
+  int size() const { return count; }
+  int capacity() const { return MAX_HISTORY_ENTRIES; }
+  bool isEmpty() const { return count == 0; }
+  uint32_t totalAppended() const { return appended; }
+  uint32_t firstSequence() const { return appended - count; }  // Sequence number of at(0)
+  unsigned long firstTimestamp() const { return oldestTimestamp; }
+  unsigned long lastTimestamp() const { return newestTimestamp; }
+  
+  // i = 0 is the oldest sample
+  const HistorySample& at(int i) const { return samples[(head + i) % MAX_HISTORY_ENTRIES]; }
+  const HistorySample& bySequence(uint32_t seq) const { return at(seq - firstSequence()); }
+  Cursor cursor() const { return Cursor(this); }
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef HISTORY_QUERY_H
+#define HISTORY_QUERY_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "device_data.h"
+
+#define HISTORY_QUERY_BATCH 16  // Points copied out of a ring per lock
+#define HISTORY_TIER_RAW -1     // HistoryQuery::tier for the raw ring
+
+// Fields a history query can return (besides the timestamp)
+enum HistoryField : uint8_t {
+  HISTORY_FIELD_VOLTAGE = 0x01,
+  HISTORY_FIELD_CURRENT = 0x02,
+  HISTORY_FIELD_POWER = 0x04,         // Raw: the reading; rollups: bucket mean
+  HISTORY_FIELD_POWER_FACTOR = 0x08,
+  HISTORY_FIELD_MIN_POWER = 0x10,
+  HISTORY_FIELD_MAX_POWER = 0x20,
+  HISTORY_FIELD_ENERGY = 0x40,        // kWh within the bucket
+  HISTORY_FIELD_COVERAGE = 0x80       // s of the bucket with readings
+};
+
+#define HISTORY_RAW_FIELDS (HISTORY_FIELD_VOLTAGE | HISTORY_FIELD_CURRENT | HISTORY_FIELD_POWER | HISTORY_FIELD_POWER_FACTOR)
+#define HISTORY_ROLLUP_FIELDS (HISTORY_FIELD_POWER | HISTORY_FIELD_MIN_POWER | HISTORY_FIELD_MAX_POWER | \
+                               HISTORY_FIELD_ENERGY | HISTORY_FIELD_COVERAGE)
+
+// How a range holding more points than the budget is thinned
+enum HistoryDecimation : uint8_t {
+  HISTORY_LTTB,    // Largest-Triangle-Three-Buckets on power: the chart's shape
+  HISTORY_MINMAX   // Lowest and highest power of each bucket: every peak
+};
+
+// One point of either store. Raw readings have min = max = power and no
+// energy; rollup buckets have no voltage, current or power factor
+struct HistoryPoint {
+  unsigned long timestamp;
+  float voltage;
+  float current;
+  float power;
+  float powerFactor;
+  float minPower;
+  float maxPower;
+  float energy;
+  float coverage;
+};
+
+// Query of GET /api/devices/<id>: a time range (ms, the auditor's clock),
+// a point budget and the fields to return
+struct HistoryQuery {
+  unsigned long from;
+  unsigned long to;
+  uint32_t points;
+  uint8_t fields;  // HistoryField bits; 0 = the source's defaults
+  HistoryDecimation decimation;
+  int tier;  // HISTORY_TIER_RAW or a RollupTierIndex
+  int64_t clockOffset;  // Audit clock minus millis(), ms: where the rollups are
+
+  HistoryQuery()
+    : from(0), to(0), points(HISTORY_DEFAULT_POINTS), fields(0), decimation(HISTORY_LTTB), tier(HISTORY_TIER_RAW),
+      clockOffset(0) {}
+
+  // Finest store that reaches back to `from` within the point budget;
+  // failing that, the one reaching furthest back within it. Safe from the
+  // HTTP task: reads both stores through their bounds()
+  void selectTier(const HistoryBuffer& history, const DeviceRollups& rollups);
+
+  // Comma-separated field names as in the JSON ("power,voltage"); 0 if
+  // none is known
+  static uint8_t parseFields(const char* list);
+};
+
+// Points of one store addressed by a position: history sequence numbers
+// for the raw ring, bucket numbers (start / width) for a rollup tier.
+// Timestamps in and out are millis(), whichever clock the store keeps
+class HistorySeries {
+public:
+  virtual ~HistorySeries() {}
+
+  // First position at or after `timestamp`, and past every point up to it
+  virtual uint32_t lowerBound(unsigned long timestamp) const = 0;
+  virtual uint32_t upperBound(unsigned long timestamp) const = 0;
+
+  // Up to max points from `position` (oldest first) and before `end`;
+  // advances position past them. Returns 0 when there are none left
+  virtual int read(uint32_t& position, uint32_t end, HistoryPoint* out, int max) const = 0;
+};
+
+class RawSeries : public HistorySeries {
+private:
+  const HistoryBuffer& history;
+  mutable HistoryReadState cursor;  // Reused while reads follow each other
+  mutable DeviceReading batch[HISTORY_QUERY_BATCH];
+
+public:
+  RawSeries(const HistoryBuffer& buffer) : history(buffer) {}
+  uint32_t lowerBound(unsigned long timestamp) const override { return history.seek(timestamp); }
+  uint32_t upperBound(unsigned long timestamp) const override { return history.seek(timestamp, true); }
+  int read(uint32_t& position, uint32_t end, HistoryPoint* out, int max) const override;
+};
+
+class RollupSeries : public HistorySeries {
+private:
+  const DeviceRollups& rollups;
+  int tier;
+  int64_t clockOffset;  // Audit clock minus millis(), ms
+  mutable RollupPoint batch[HISTORY_QUERY_BATCH];
+
+public:
+  RollupSeries(const DeviceRollups& source, int tierIndex, int64_t offset = 0)
+    : rollups(source), tier(tierIndex), clockOffset(offset) {}
+  uint32_t lowerBound(unsigned long timestamp) const override;
+  uint32_t upperBound(unsigned long timestamp) const override;
+  int read(uint32_t& position, uint32_t end, HistoryPoint* out, int max) const override;
+};
+
+// Streams the points of a series between two positions, thinned to the
+// query's budget in one forward pass and constant memory: LTTB reads each
+// bucket twice (once for the next bucket's mean), min/max once. Buckets
+// split the positions evenly, so empty rollup buckets only thin the result.
+class HistoryDecimator {
+private:
+  const HistorySeries& series;
+  uint32_t begin;
+  uint32_t end;
+  uint32_t points;
+  HistoryDecimation decimation;
+
+  bool decimating;
+  uint32_t position;  // Pass-through: next position to read
+  uint32_t buckets;
+  uint32_t stage;     // Next bucket; LTTB: 0 is the first point, buckets + 1 the last
+  HistoryPoint selected;  // LTTB: last point emitted
+  HistoryPoint pending;   // Min/max: second point of the bucket
+  bool hasPending;
+  HistoryPoint batch[HISTORY_QUERY_BATCH];
+  int batchCount;
+  int batchPos;
+
+  uint32_t bucketStart(uint32_t i) const;
+  bool firstIn(uint32_t from, uint32_t stop, HistoryPoint& out);
+  bool lastIn(uint32_t from, uint32_t stop, HistoryPoint& out);
+  bool nextLttb(HistoryPoint& out);
+  bool nextMinMax(HistoryPoint& out);
+
+public:
+  HistoryDecimator(const HistorySeries& source, const HistoryQuery& query);
+  bool next(HistoryPoint& out);
+  bool isDecimating() const { return decimating; }
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <Arduino.h>
+
+#define JSON_STREAM_RECORD_MAX 1664  // Largest single record: a device object takes up to 1616 bytes
+
+// Minimal JSON text builder over a caller-provided buffer. Numbers,
+// strings and booleans are formatted exactly like ArduinoJson 6 (doubles
+// with up to 9 significant decimals, same escaping), so streamed output
+// matches the documents it replaces.
+class JsonText {
+private:
+  char* buffer;
+  size_t capacity;
+  size_t len;
+  bool overflowed;
+  
+  void writeDecimals(uint32_t value, int8_t width);
+  
+public:
+  JsonText(char* buf, size_t cap) : buffer(buf), capacity(cap), len(0), overflowed(false) {}
+  
+  void raw(char c);
+  void raw(const char* text);
+  void string(const char* text);
+  void key(const char* name);  // Writes "name":
+  void number(double value);
+  void number(unsigned long value);
+  void boolean(bool value) { raw(value ? "true" : "false"); }
+  
+  size_t length() const { return len; }
+  bool overflow() const { return overflowed; }
+};
+
+// Pull-based chunked JSON source. Subclasses emit one record of text per
+// nextChunk() call; fill() hands it out in pieces of whatever size the
+// transport asks for, so memory stays at one record regardless of how
+// long the document is. Plugs into AsyncWebServer's chunked responses.
+class JsonChunkSource {
+private:
+  char staging[JSON_STREAM_RECORD_MAX];
+  size_t pendingLen;
+  size_t pendingPos;
+  bool finished;
+  
+protected:
+  // Append the next piece of text to out; return false after the last one
+  virtual bool nextChunk(JsonText& out) = 0;
+  
+public:
+  JsonChunkSource() : pendingLen(0), pendingPos(0), finished(false) {}
+  virtual ~JsonChunkSource() {}
+  
+  // Returns bytes written, 0 once the document is complete
+  size_t fill(uint8_t* buffer, size_t maxLen);
+};
+
+#endif
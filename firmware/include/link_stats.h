@@ -0,0 +1,48 @@
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "sequence_tracker.h"
+#include "telemetry_frame.h"
+
+// Link quality of one wireless device, as published to HTTP readers
+struct LinkSummary {
+  bool valid;  // A telemetry frame has been received
+  int8_t rssi;  // dBm of the last frame, 0 if unknown
+  uint16_t lastSequence;  // Newest sample number
+  float lossRate;  // Frames lost on air over the last SEQUENCE_WINDOW transmissions
+  uint32_t frames;
+  uint32_t framesLost;
+  uint32_t samples;  // Distinct samples received
+  uint32_t samplesMissed;  // Never arrived, even resent
+  uint32_t duplicates;  // Repeats dropped
+  uint32_t restarts;  // Node restarts seen
+  unsigned long frameInterval;  // ms
+};
+
+// Receive side of the acknowledged telemetry link (see telemetry_frame.h).
+// The transmission counter measures the radio (frames lost on air, which
+// the node makes up by resending); sample numbers catch repeats and what
+// was lost for good. Nodes without the counter fall back to sample numbers.
+struct LinkStats {
+  SequenceTracker frames;
+  SequenceTracker samples;
+  uint8_t mac[6] = {0};
+  int8_t rssi = 0;
+  unsigned long lastFrameAt = 0;
+  unsigned long frameInterval = 0;  // ms between transmissions, smoothed
+  
+  void reset() { *this = LinkStats(); }
+  
+  // A valid frame arrived (repeats included: they still show the node is up)
+  void frameReceived(const uint8_t* source, int8_t frameRssi, unsigned long receivedAt, const TelemetryFrame& frame);
+  
+  // Silence after which the device counts as inactive: DEVICE_TIMEOUT_MS,
+  // or longer for a node that reports less often
+  unsigned long activityTimeout() const;
+  
+  LinkSummary summary() const;
+};
+
+#endif
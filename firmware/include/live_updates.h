@@ -0,0 +1,46 @@
+#ifndef LIVE_UPDATES_H
+#define LIVE_UPDATES_H
+
+#include <Arduino.h>
+#include <bitset>
+#include "config.h"
+#include "device_registry.h"
+#include "json_stream.h"
+
+// Change tracking for /events clients. loop() marks devices as readings
+// arrive and periodically turns the dirty set into one frame of compact
+// per-device deltas. A device that changes again before it is pushed just
+// stays dirty, so a slow client gets the newest reading instead of a queue
+// of stale ones.
+class LiveUpdates {
+private:
+  std::bitset<MAX_DEVICES> dirty;  // One bit per registry slot
+  bool structureChanged;   // Device added, removed or renamed
+  unsigned long lastPush;
+  uint32_t framesSent;
+  uint32_t framesDeferred;
+  
+public:
+  LiveUpdates() : structureChanged(false), lastPush(0), framesSent(0), framesDeferred(0) {}
+  
+  void markDevice(DeviceHandle handle);
+  void markStructure() { structureChanged = true; }
+  void clear();
+  
+  bool due(unsigned long now) const;
+  bool hasDeltas() const { return dirty.any(); }
+  bool takeStructureChange();
+  
+  // Write a JSON array of deltas for dirty devices into buffer (null
+  // terminated); devices that don't fit stay dirty for the next frame
+  size_t buildFrame(const DeviceRegistry& devices, char* buffer, size_t capacity);
+  
+  void sent(unsigned long now) { lastPush = now; framesSent++; }
+  void deferred(unsigned long now) { lastPush = now; framesDeferred++; }
+  uint32_t sentCount() const { return framesSent; }
+  uint32_t deferredCount() const { return framesDeferred; }
+  
+  static void writeDelta(JsonText& out, const DeviceInfo& device);
+};
+
+#endif
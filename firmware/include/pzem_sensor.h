@@ -12,27 +12,56 @@ private:
   String deviceId;
   String deviceName;
   
+  // Asynchronous poll state (request -> await -> parse)
+  enum PollState { STATE_IDLE, STATE_AWAITING, STATE_PARSING };
+
   // PZEM-004T Modbus commands
   static const uint8_t READ_REGISTER_CMD = 0x04;
-  static const uint16_t VOLTAGE_REG = 0x0000;
-  static const uint16_t CURRENT_REG = 0x0001;
-  static const uint16_t POWER_REG = 0x0002;
-  static const uint16_t ENERGY_REG = 0x0003;
-  static const uint16_t FREQUENCY_REG = 0x0004;
-  static const uint16_t PF_REG = 0x0005;
-  
-  uint16_t calculateCRC(uint8_t* data, uint8_t len);
+  static const uint8_t ERROR_FLAG = 0x80;
+  
+  // PZEM-004T v3 input register map (all read in a single transaction)
+  static const uint16_t VOLTAGE_REG = 0x0000;    // 0.1V
+  static const uint16_t CURRENT_REG = 0x0001;    // 0.001A, low/high words
+  static const uint16_t POWER_REG = 0x0003;      // 0.1W, low/high words
+  static const uint16_t ENERGY_REG = 0x0005;     // 1Wh, low/high words
+  static const uint16_t FREQUENCY_REG = 0x0007;  // 0.1Hz
+  static const uint16_t PF_REG = 0x0008;         // 0.01
+  static const uint16_t REGISTER_COUNT = 10;     // Includes alarm status (0x0009)
+  
+  // addr + func + byte count + data + CRC
+  static const uint8_t RESPONSE_LENGTH = 3 + REGISTER_COUNT * 2 + 2;
+  static const uint8_t ERROR_RESPONSE_LENGTH = 5;
+  static const unsigned long RESPONSE_TIMEOUT_MS = 100;
+  
+  PollState state;
+  uint8_t rxBuffer[RESPONSE_LENGTH];
+  uint8_t rxCount;
+  unsigned long requestTime;
+  
+  static uint16_t calculateCRC(const uint8_t* data, uint8_t len);
+  static uint16_t registerAt(const uint8_t* frame, uint16_t reg);
+  static uint32_t registerPairAt(const uint8_t* frame, uint16_t reg);
   bool sendCommand(uint8_t cmd, uint16_t reg, uint16_t value = 0);
-  uint16_t readRegister(uint16_t reg);
+  bool receiveAvailable();
   
 public:
+  enum PollResult { POLL_IDLE, POLL_BUSY, POLL_READY, POLL_FAILED };
+  
   PZEMSensor(HardwareSerial* serialPort, uint8_t addr, String id, String name);
   bool begin();
-  bool readData(DeviceReading& reading);
+  bool readData(DeviceReading& reading);  // Blocking: request + poll until done
+  
+  // Non-blocking polling: requestData() starts a transaction, poll() must be
+  // called every loop() iteration and never waits on the UART
+  bool requestData();
+  PollResult poll(DeviceReading& reading);
+  bool isBusy() { return state != STATE_IDLE; }
+  
+  // Decode a complete 0x04 response frame (all REGISTER_COUNT registers)
+  static bool parseResponse(const uint8_t* frame, uint8_t len, uint8_t addr, DeviceReading& reading);
+  
   String getId() { return deviceId; }
   String getName() { return deviceName; }
 };
 
 #endif
-
-
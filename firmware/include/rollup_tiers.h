@@ -0,0 +1,118 @@
+#ifndef ROLLUP_TIERS_H
+#define ROLLUP_TIERS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+enum RollupTierIndex {
+  ROLLUP_MINUTE = 0,
+  ROLLUP_QUARTER = 1,
+  ROLLUP_HOUR = 2,
+  ROLLUP_TIER_COUNT = 3
+};
+
+// One aggregate bucket (12 bytes). Power at the history's 0.1W
+// resolution; a bucket nothing was added to has min > max.
+struct RollupBucket {
+  uint8_t minPower[3];  // 0.1W
+  uint8_t maxPower[3];  // 0.1W
+  uint16_t covered;     // 0.1s of the bucket with readings
+  float energy;         // kWh
+};
+
+// A bucket as handed to readers
+struct RollupPoint {
+  uint64_t timestamp;  // Bucket start, audit clock
+  unsigned long coveredMs;
+  float minPower;  // W
+  float maxPower;  // W
+  float avgPower;  // W, time-weighted over the covered part
+  float energy;    // kWh
+};
+
+// Progress of a concurrent reader (see DeviceRollups::readBatch)
+struct RollupReadState {
+  bool started;
+  uint64_t next;  // Start of the next bucket to read
+  uint64_t end;   // Stop after the bucket holding this time
+
+  RollupReadState() : started(false), next(0), end(0) {}
+  RollupReadState(uint64_t from, uint64_t to) : started(false), next(from), end(to) {}
+};
+
+// Extent of every tier as one consistent read (see DeviceRollups::bounds)
+struct RollupBounds {
+  uint64_t firstReading;
+  int count[ROLLUP_TIER_COUNT];
+  uint64_t first[ROLLUP_TIER_COUNT];  // Start of the oldest bucket
+  uint64_t last[ROLLUP_TIER_COUNT];   // Start of the newest bucket
+  unsigned long width[ROLLUP_TIER_COUNT];
+
+  bool isEmpty() const { return count[ROLLUP_HOUR] == 0; }
+};
+
+// Ring state of one tier; its buckets are a slice of DeviceRollups::buckets
+struct RollupTier {
+  unsigned long widthMs;
+  uint16_t offset;    // First slot of the slice
+  uint16_t capacity;
+  uint16_t head;      // Slot of the oldest bucket
+  uint16_t count;
+  uint64_t newestStart;    // Start of the newest bucket
+  uint32_t openCoveredMs;  // Exact coverage of the newest bucket
+};
+
+// Per-device aggregates behind the raw history ring: 1-minute, 15-minute
+// and hourly buckets (min/max/mean power and energy) in fixed rings, so
+// a week of history costs a few KB per device.
+//
+// Every tier is fed the same integration segments as the device's energy
+// total, split at bucket boundaries, so each tier's energy adds up to the
+// integrated energy over the span it still holds. Bucket times are implied
+// by the newest bucket's start; gaps without readings are empty buckets.
+// Times are on the 64-bit audit clock (see AuditLog), like the energy
+// buckets, so nothing wraps with millis() after 49.7 days.
+//
+// The owner task adds; other tasks may only use readBatch() and bounds(),
+// which are guarded by a sequence lock bumped around every modification.
+class DeviceRollups {
+private:
+  RollupBucket buckets[ROLLUP_MINUTE_BUCKETS + ROLLUP_QUARTER_BUCKETS + ROLLUP_HOUR_BUCKETS];
+  RollupTier tiers[ROLLUP_TIER_COUNT];
+  uint64_t since;  // First reading added since the last clear()
+  std::atomic<uint32_t> writeSeq;  // Odd while a modification is in progress
+
+  void beginWrite();
+  void endWrite();
+  RollupBucket& at(const RollupTier& tier, int i) { return buckets[tier.offset + (tier.head + i) % tier.capacity]; }
+  const RollupBucket& at(const RollupTier& tier, int i) const { return buckets[tier.offset + (tier.head + i) % tier.capacity]; }
+  RollupBucket& advance(RollupTier& tier, uint64_t start);
+  void addTier(RollupTier& tier, uint64_t from, uint64_t to, float power, uint32_t deciWatts);
+
+public:
+  DeviceRollups();
+  void clear();
+
+  // Account for `power` held from `from` to `to` (audit clock, ms). A
+  // zero-length segment (a device's first reading) only marks min/max
+  void add(uint64_t from, uint64_t to, float power);
+
+  // Safe from any task: up to max non-empty buckets of one tier, oldest
+  // first, from state.next through state.end. Returns 0 when done
+  int readBatch(int tier, RollupReadState& state, RollupPoint* out, int max) const;
+
+  // Safe from any task: every tier's extent, taken together. The
+  // accessors below are for the owner task
+  RollupBounds bounds() const;
+
+  unsigned long width(int tier) const { return tiers[tier].widthMs; }
+  int size(int tier) const { return tiers[tier].count; }
+  int capacity(int tier) const { return tiers[tier].capacity; }
+  bool isEmpty() const { return tiers[ROLLUP_HOUR].count == 0; }
+  uint64_t firstTimestamp(int tier) const;  // Start of the oldest bucket
+  uint64_t lastTimestamp(int tier) const { return tiers[tier].newestStart; }
+  uint64_t firstReading() const { return since; }
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free single-producer/single-consumer ring.
+// One task (or ISR/callback) may call push(), one other task may call
+// pop(); no other synchronization is needed. Capacity must be a power of
+// two. Head/tail are free-running counters, so all N slots are usable.
+template <typename T, size_t N>
+class SpscQueue {
+private:
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+  
+  T items[N];
+  std::atomic<uint32_t> head;  // Next slot to write (producer)
+  std::atomic<uint32_t> tail;  // Next slot to read (consumer)
+  
+  // Statistics (written by the producer only)
+  std::atomic<uint32_t> dropCount;
+  std::atomic<uint32_t> highWaterMark;
+  
+public:
+  SpscQueue() : head(0), tail(0), dropCount(0), highWaterMark(0) {}
+  
+  // Producer: reserve the next slot, fill it, then commit(). Returns
+  // nullptr (and counts a drop) when the queue is full.
+  T* reserve() {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= N) {
+      dropCount.store(dropCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &items[h & (N - 1)];
+  }
+  
+  void commit() {
+    uint32_t h = head.load(std::memory_order_relaxed) + 1;
+    head.store(h, std::memory_order_release);
+    
+    uint32_t depth = h - tail.load(std::memory_order_relaxed);
+    if (depth > highWaterMark.load(std::memory_order_relaxed)) {
+      highWaterMark.store(depth, std::memory_order_relaxed);
+    }
+  }
+  
+  bool push(const T& item) {
+    T* slot = reserve();
+    if (!slot) {
+      return false;
+    }
+    *slot = item;
+    commit();
+    return true;
+  }
+  
+  // Consumer: peek at the oldest item, then release() it when done
+  const T* front() {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &items[t & (N - 1)];
+  }
+  
+  void release() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+  
+  bool pop(T& item) {
+    const T* slot = front();
+    if (!slot) {
+      return false;
+    }
+    item = *slot;
+    release();
+    return true;
+  }
+  
+  size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+  size_t capacity() const { return N; }
+  uint32_t drops() const { return dropCount.load(std::memory_order_relaxed); }
+  uint32_t highWater() const { return highWaterMark.load(std::memory_order_relaxed); }
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+
+// Dashboard file embedded in flash, pre-gzipped at build time by
+// scripts/embed_web_assets.py from the sources in web/
+struct WebAsset {
+  const char* path;         // Request path ("/" for index.html)
+  const char* contentType;
+  const uint8_t* data;      // Gzip body (PROGMEM)
+  size_t length;
+  const char* etag;         // Quoted content hash
+};
+
+extern const WebAsset WEB_ASSETS[];
+extern const size_t WEB_ASSET_COUNT;
+
+#endif
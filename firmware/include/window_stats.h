@@ -0,0 +1,68 @@
+#ifndef WINDOW_STATS_H
+#define WINDOW_STATS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "history_buffer.h"
+
+// Exact sliding-window power statistics over a HistoryBuffer.
+// The window covers the newest samples bounded by a sample count and/or an
+// age limit. Each add() is O(1) amortized: sums are kept as 64-bit integers
+// at the history's 0.1W resolution (so removal is exact), and min/max come
+// from monotonic queues of history sequence numbers.
+class WindowStats {
+private:
+  // Queue of history sequence numbers, stored as 16-bit offsets. One
+  // slot more than the window: add() pushes before it evicts
+  struct SequenceQueue {
+    static const int CAPACITY = STATS_WINDOW_MAX_SAMPLES + 1;
+    uint16_t items[CAPACITY];
+    uint16_t head;
+    uint16_t size;
+    
+    void clear() { head = 0; size = 0; }
+    uint16_t front() const { return items[head]; }
+    uint16_t back() const { return items[(head + size - 1) % CAPACITY]; }
+    void popFront() { head = (head + 1) % CAPACITY; size--; }
+    void popBack() { size--; }
+    void pushBack(uint16_t seq) { items[(head + size++) % CAPACITY] = seq; }
+  };
+  
+  uint16_t maxSamples;
+  unsigned long maxAgeMs;  // 0 = no age limit
+  
+  uint32_t startSeq;  // Oldest sample in the window
+  uint32_t endSeq;    // One past the newest sample
+  unsigned long startTimestamp;
+  unsigned long endTimestamp;
+  
+  uint64_t sum;          // 0.1W
+  uint64_t sumSquares;   // (0.1W)^2
+  uint64_t energySum;    // 0.1W * ms
+  uint16_t activeCount;  // Samples above ALWAYS_ON_POWER_THRESHOLD
+  
+  SequenceQueue minQueue;
+  SequenceQueue maxQueue;
+  
+  uint32_t expand(uint16_t stored) const { return startSeq + (uint16_t)(stored - (uint16_t)startSeq); }
+  void evictOldest(const HistoryBuffer& history);
+  
+public:
+  WindowStats(uint16_t samples, unsigned long ageMs);
+  void reset();
+  
+  // Account for the sample just appended to history
+  void add(const HistoryBuffer& history);
+  
+  uint16_t count() const { return endSeq - startSeq; }
+  unsigned long spanMs() const { return count() > 0 ? endTimestamp - startTimestamp : 0; }
+  float mean() const;
+  float minimum(const HistoryBuffer& history) const;
+  float maximum(const HistoryBuffer& history) const;
+  float variance() const;
+  float stdDev() const { return sqrt(variance()); }
+  float energyKWh() const { return energySum / 36000000000.0; }  // 0.1W*ms -> kWh
+  uint16_t active() const { return activeCount; }
+};
+
+#endif
@@ -0,0 +1,134 @@
+# Host-side decoder for the binary format of GET /api/export?format=binary
+# (see include/export_stream.h). Reads the schema header, so it keeps
+# working when record kinds gain fields, and writes the same columns as
+# the CSV export, ready for pandas.read_csv.
+#
+#   curl -o audit.bin "http://192.168.4.1/api/export?format=binary"
+#   python scripts/decode_export.py audit.bin [audit.csv]
+#
+# Or from Python: for kind, fields in records(open("audit.bin", "rb")): ...
+
+import csv
+import struct
+import sys
+
+MAGIC = b"EAEX"
+VERSION = 1
+TIERS = ["minute", "quarter", "hour"]
+COLUMNS = [
+    "source", "device", "time_ms", "voltage", "current", "power", "power_factor",
+    "min_power", "max_power", "energy_kwh", "coverage_s", "total_kwh",
+]
+# Decimals the firmware prints in its CSV; rollup power is a mean
+DECIMALS = {
+    "voltage": 1, "current": 3, "power": 1, "power_factor": 2, "min_power": 1,
+    "max_power": 1, "energy_kwh": 6, "coverage_s": 1, "total_kwh": 6,
+}
+
+
+class ExportError(Exception):
+    pass
+
+
+def _read(stream, size):
+    data = stream.read(size)
+    if len(data) != size:
+        raise ExportError("export cut short")
+    return data
+
+
+def _string(stream):
+    return _read(stream, _read(stream, 1)[0]).decode("utf-8", "replace")
+
+
+def read_schema(stream):
+    if _read(stream, 4) != MAGIC:
+        raise ExportError("not an energy audit export")
+    version, kinds = struct.unpack("<BB", _read(stream, 2))
+    if version != VERSION:
+        raise ExportError("unsupported export version %d" % version)
+    schema = {}
+    for _ in range(kinds):
+        kind = _read(stream, 1)[0]
+        name = _string(stream)
+        fields = []
+        for _ in range(_read(stream, 1)[0]):
+            field = _string(stream)
+            fields.append((field, chr(_read(stream, 1)[0])))
+        schema[kind] = (name, fields)
+    return schema
+
+
+def records(stream):
+    """Yields (kind name, {field: value}) for every record, the end record last."""
+    schema = read_schema(stream)
+    count = 0
+    while True:
+        head = stream.read(1)
+        if not head:
+            raise ExportError("export cut short after %d records" % count)
+        if head[0] not in schema:
+            raise ExportError("unknown record kind %d" % head[0])
+        name, fields = schema[head[0]]
+        values = {}
+        for field, code in fields:
+            if code == "s":
+                values[field] = _string(stream)
+            else:
+                values[field] = struct.unpack("<" + code, _read(stream, struct.calcsize(code)))[0]
+        yield name, values
+        if name == "end":
+            if values["records"] != count:
+                raise ExportError("%d records, the export counted %d" % (count, values["records"]))
+            return
+        count += 1
+
+
+def rows(stream):
+    """The export as CSV rows (dicts keyed by COLUMNS), devices named."""
+    names = {}
+    for kind, values in records(stream):
+        if kind == "device":
+            names[values["device"]] = values["id"]
+            continue
+        if kind == "end":
+            return
+        row = dict(values)
+        row["source"] = TIERS[values["tier"]] if kind == "rollup" else ("log" if kind == "logged" else kind)
+        row["device"] = names.get(values["device"], "#%08x" % values["device"])
+        yield row
+
+
+def format_row(row):
+    cells = []
+    for column in COLUMNS:
+        value = row.get(column)
+        if value is None:
+            cells.append("")
+        elif column in DECIMALS:
+            decimals = 2 if column == "power" and row["source"] in TIERS else DECIMALS[column]
+            cells.append("%.*f" % (decimals, value))
+        else:
+            cells.append(value)
+    return cells
+
+
+def main(argv):
+    if len(argv) not in (2, 3):
+        sys.stderr.write("usage: decode_export.py EXPORT.bin [OUT.csv]\n")
+        return 2
+    out = open(argv[2], "w", newline="") if len(argv) == 3 else sys.stdout
+    writer = csv.writer(out, lineterminator="\n")
+    writer.writerow(COLUMNS)
+    with open(argv[1], "rb") as stream:
+        try:
+            for row in rows(stream):
+                writer.writerow(format_row(row))
+        except ExportError as error:
+            sys.stderr.write("decode_export: %s\n" % error)
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,84 @@
+# Pre-build step for the firmware env: gzip the dashboard assets in web/
+# and emit them as PROGMEM byte arrays (web_assets_data.h) with an ETag
+# per asset. Included by src/web_assets.cpp.
+#
+# Also runs standalone: python scripts/embed_web_assets.py [output_dir]
+
+import gzip
+import hashlib
+import os
+import sys
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+    ".svg": "image/svg+xml",
+}
+
+
+def asset_path(name):
+    return "/" if name == "index.html" else "/" + name
+
+
+def generate(project_dir, output_dir):
+    web_dir = os.path.join(project_dir, "web")
+    names = sorted(n for n in os.listdir(web_dir) if os.path.splitext(n)[1] in CONTENT_TYPES)
+
+    lines = [
+        "// Generated by scripts/embed_web_assets.py from web/ - do not edit",
+        "#include <Arduino.h>",
+        "",
+    ]
+    table = []
+    raw_total = 0
+    gz_total = 0
+
+    for i, name in enumerate(names):
+        with open(os.path.join(web_dir, name), "rb") as f:
+            raw = f.read()
+        # mtime=0 keeps the output (and ETag) identical across builds
+        data = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = hashlib.sha1(data).hexdigest()[:16]
+        raw_total += len(raw)
+        gz_total += len(data)
+        print("web: %-12s %6d -> %6d bytes gzip" % (name, len(raw), len(data)))
+
+        lines.append("// %s" % name)
+        lines.append("static const uint8_t WEB_ASSET_%d[] PROGMEM = {" % i)
+        for offset in range(0, len(data), 16):
+            chunk = data[offset:offset + 16]
+            lines.append("  " + ", ".join("0x%02x" % b for b in chunk) + ",")
+        lines.append("};")
+        lines.append("")
+        table.append('  {"%s", "%s", WEB_ASSET_%d, sizeof(WEB_ASSET_%d), "\\"%s\\""},'
+                     % (asset_path(name), CONTENT_TYPES[os.path.splitext(name)[1]], i, i, etag))
+
+    lines.append("const WebAsset WEB_ASSETS[] = {")
+    lines.extend(table)
+    lines.append("};")
+    lines.append("const size_t WEB_ASSET_COUNT = %d;" % len(names))
+    lines.append("")
+    print("web: total        %6d -> %6d bytes gzip" % (raw_total, gz_total))
+
+    # Only touch the header when it changes so builds stay incremental
+    os.makedirs(output_dir, exist_ok=True)
+    output = os.path.join(output_dir, "web_assets_data.h")
+    text = "\n".join(lines)
+    if not os.path.exists(output) or open(output).read() != text:
+        with open(output, "w") as f:
+            f.write(text)
+
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO/SCons)
+except NameError:
+    env = None
+
+if env is not None:
+    generated_dir = os.path.join(env.subst("$BUILD_DIR"), "web")
+    generate(env.subst("$PROJECT_DIR"), generated_dir)
+    env.Append(CPPPATH=[generated_dir])
+elif __name__ == "__main__":
+    project = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    generate(project, sys.argv[1] if len(sys.argv) > 1 else os.path.join(project, ".pio", "web"))
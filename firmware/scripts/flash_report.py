@@ -0,0 +1,88 @@
+# Post-build step for the firmware env: flash and static RAM use of the
+# image by section, the bytes the embedded dashboard takes, and, given a
+# baseline ELF, the delta per section and the symbols that grew or shrank
+# the most. Build the baseline commit first and keep its ELF:
+#
+#   git checkout <before> && pio run && cp .pio/build/esp32dev/firmware.elf /tmp/before.elf
+#   git checkout <after> && FLASH_REPORT_BASELINE=/tmp/before.elf pio run
+#
+# Also runs standalone (SIZETOOL and NM default to the xtensa binutils):
+#
+#   python scripts/flash_report.py firmware.elf [baseline.elf]
+
+import os
+import re
+import subprocess
+import sys
+
+# Same split as PlatformIO's size summary for espressif32
+FLASH_SECTIONS = [".iram0.vectors", ".iram0.text", ".dram0.data", ".flash.text", ".flash.rodata"]
+RAM_SECTIONS = [".dram0.data", ".dram0.bss", ".noinit"]
+ASSET_SYMBOL = re.compile(r"^WEB_ASSETS?(_\d+)?$")
+
+
+def sections(sizetool, elf, tool_env=None):
+    output = subprocess.check_output([sizetool, "-A", elf], env=tool_env).decode()
+    sizes = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0].startswith(".") and fields[1].isdigit():
+            sizes[fields[0]] = int(fields[1])
+    return sizes
+
+
+def symbols(nm, elf, tool_env=None):
+    output = subprocess.check_output([nm, "-S", "-C", "--size-sort", elf], env=tool_env).decode()
+    sizes = {}
+    for line in output.splitlines():
+        fields = line.split(None, 3)
+        if len(fields) == 4:
+            sizes[fields[3]] = sizes.get(fields[3], 0) + int(fields[1], 16)
+    return sizes
+
+
+def totals(sizes):
+    return sum(sizes.get(s, 0) for s in FLASH_SECTIONS), sum(sizes.get(s, 0) for s in RAM_SECTIONS)
+
+
+def report(elf, baseline=None, sizetool="xtensa-esp32-elf-size", nm="xtensa-esp32-elf-nm", tool_env=None):
+    now = sections(sizetool, elf, tool_env)
+    now_symbols = symbols(nm, elf, tool_env)
+    flash, ram = totals(now)
+    assets = sum(size for name, size in now_symbols.items() if ASSET_SYMBOL.match(name))
+    print("flash: image %d bytes, static RAM %d bytes (.dram0.bss %d), dashboard assets %d bytes"
+          % (flash, ram, now.get(".dram0.bss", 0), assets))
+    if not baseline:
+        return
+
+    before = sections(sizetool, baseline, tool_env)
+    before_symbols = symbols(nm, baseline, tool_env)
+    before_flash, before_ram = totals(before)
+    print("flash: against %s: image %+d bytes (%d -> %d), static RAM %+d bytes"
+          % (os.path.basename(baseline), flash - before_flash, before_flash, flash, ram - before_ram))
+    for name in FLASH_SECTIONS + [".dram0.bss"]:
+        if now.get(name, 0) != before.get(name, 0):
+            print("flash:   %-16s %+8d" % (name, now.get(name, 0) - before.get(name, 0)))
+    changes = [(now_symbols.get(n, 0) - before_symbols.get(n, 0), n) for n in set(now_symbols) | set(before_symbols)]
+    changes = sorted((c for c in changes if c[0]), key=lambda c: -abs(c[0]))
+    for delta, name in changes[:15]:
+        print("flash:   %+8d  %s" % (delta, name[:90]))
+
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO/SCons)
+except NameError:
+    env = None
+
+if env is not None:
+    def after_link(source, target, env):
+        sizetool = env.subst("$SIZETOOL")
+        nm = re.sub(r"size$", "nm", sizetool)
+        report(str(target[0]), os.environ.get("FLASH_REPORT_BASELINE"), sizetool, nm, env["ENV"])
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", after_link)
+elif __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: flash_report.py firmware.elf [baseline.elf]")
+    report(sys.argv[1], sys.argv[2] if len(sys.argv) > 2 else None,
+           os.environ.get("SIZETOOL", "xtensa-esp32-elf-size"), os.environ.get("NM", "xtensa-esp32-elf-nm"))
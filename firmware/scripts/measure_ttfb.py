@@ -0,0 +1,82 @@
+# Time to first byte of the dashboard and API, measured against a running
+# auditor (default: the EnergyAudit-AP address). Sends each request over a
+# fresh connection, times connect, first response byte and last byte, and
+# repeats the asset requests with If-None-Match to time a 304. Run it once
+# per firmware to compare builds:
+#
+#   python scripts/measure_ttfb.py [host[:port]] [--count N]
+
+import socket
+import statistics
+import sys
+import time
+
+PATHS = ["/", "/chart.js", "/api/devices", "/api/status"]
+
+
+def fetch(host, path, etag=None):
+    address, _, port = host.partition(":")
+    headers = "GET %s HTTP/1.1\r\nHost: %s\r\nAccept-Encoding: gzip\r\nConnection: close\r\n" % (path, host)
+    if etag:
+        headers += "If-None-Match: %s\r\n" % etag
+    start = time.perf_counter()
+    conn = socket.create_connection((address, int(port or 80)), timeout=10)
+    connected = time.perf_counter()
+    conn.sendall((headers + "\r\n").encode())
+    data = conn.recv(65536)
+    first = time.perf_counter()
+    chunks = [data]
+    while data:
+        data = conn.recv(65536)
+        chunks.append(data)
+    done = time.perf_counter()
+    conn.close()
+
+    response = b"".join(chunks)
+    head = response.split(b"\r\n\r\n", 1)[0].decode("latin-1").split("\r\n")
+    status = int(head[0].split()[1]) if head and len(head[0].split()) > 1 else 0
+    tag = None
+    for line in head[1:]:
+        name, _, value = line.partition(":")
+        if name.strip().lower() == "etag":
+            tag = value.strip()
+    return {
+        "status": status, "etag": tag, "bytes": len(response),
+        "connect": connected - start, "ttfb": first - connected, "total": done - start,
+    }
+
+
+def summary(samples, key):
+    values = sorted(s[key] * 1000 for s in samples)
+    p90 = values[min(len(values) - 1, int(len(values) * 0.9))]
+    return "%7.1f / %7.1f" % (statistics.median(values), p90)
+
+
+def main(argv):
+    host, count = "192.168.4.1", 20
+    args = list(argv)
+    while args:
+        arg = args.pop(0)
+        if arg == "--count" and args:
+            count = int(args.pop(0))
+        elif not arg.startswith("-"):
+            host = arg
+        else:
+            sys.exit("usage: measure_ttfb.py [host[:port]] [--count N]")
+
+    print("%d requests each to %s, milliseconds as median / p90" % (count, host))
+    print("%-22s %6s %8s %17s %17s %17s" % ("request", "status", "bytes", "connect", "first byte", "total"))
+    for path in PATHS:
+        runs = [("", None)]
+        first = fetch(host, path)
+        if first["etag"]:
+            runs.append((" (If-None-Match)", first["etag"]))
+        for label, etag in runs:
+            samples = [fetch(host, path, etag) for _ in range(count)]
+            print("%-22s %6d %8d %17s %17s %17s" % (path + label, samples[-1]["status"], samples[-1]["bytes"],
+                                                   summary(samples, "connect"), summary(samples, "ttfb"),
+                                                   summary(samples, "total")))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,412 @@
+// Native check of the energy accounting (pio run -e native_energy).
+//
+// Feeds EnergyAccount (src/energy_account.cpp) synthetic load profiles
+// the way updateDeviceHistory does: a wireless node (trapezoids, silences
+// left out) checked against a naive replay of the same readings, and a
+// wired load whose simulated PZEM counter is missed, wraps, is reset and
+// glitches, checked against the energy the load really drew. Every
+// hourly and daily bucket is checked against brute force, and its cost
+// against the tariff of its hour. Exits non-zero on any failure.
+//
+//   .pio/build/native_energy/program [--seed N] [--days N]
+
+#include <Arduino.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+#include "config.h"
+#include "device_data.h"
+#include "energy_account.h"
+
+#define CHECK_BATCH 16
+#define HOUR_MS 3600000ULL
+#define DAY_MS 86400000ULL
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  int days = 3;
+};
+
+// One reading as the account sees it
+struct Sample {
+  uint64_t clock;  // Audit clock, ms
+  float power;     // W
+  bool metered;
+  uint32_t meterWh;
+};
+
+// Expected energy and cost of one bucket
+struct Expected {
+  double energy = 0;
+  double cost = 0;
+  uint64_t coveredMs = 0;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool close(double a, double b, double tolerance) {
+  return fabs(a - b) <= tolerance * max(fabs(a), fabs(b)) + 1e-9;
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--days") && hasValue) options.days = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--days N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static int addAll(EnergyAccount& account, const std::vector<Sample>& samples, const Tariff& tariff) {
+  int counted = 0;
+  for (const Sample& sample : samples) {
+    DeviceReading reading = {};
+    reading.power = sample.power;
+    reading.metered = sample.metered;
+    reading.meterWh = sample.meterWh;
+    counted += account.add(reading, sample.clock, tariff);
+  }
+  return counted;
+}
+
+static std::vector<EnergyPoint> readTier(const EnergyAccount& account, int tier) {
+  std::vector<EnergyPoint> points;
+  EnergyReadState state;
+  EnergyPoint batch[CHECK_BATCH];
+  int n;
+  while ((n = account.readBatch(tier, state, batch, CHECK_BATCH)) > 0) {
+    points.insert(points.end(), batch, batch + n);
+  }
+  return points;
+}
+
+// Power of a load that steps between levels, with short spikes
+class StepLoad {
+private:
+  std::mt19937& rng;
+  float level;
+
+public:
+  StepLoad(std::mt19937& generator) : rng(generator), level(120.0f) {}
+
+  float next() {
+    const float levels[] = {0.0f, 0.8f, 45.0f, 120.0f, 1800.0f, 2400.0f};
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    if (unit(rng) < 0.01f) {
+      level = levels[rng() % 6];
+    }
+    float power = level * (0.95f + 0.1f * unit(rng));
+    if (unit(rng) < 0.002f) {
+      power = 3500.0f;  // Inrush spike
+    }
+    return roundf(power * 10.0f) / 10.0f;
+  }
+};
+
+// Brute force: a trapezoid split by hand at the hours it crosses, each
+// piece priced at its hour's rate (independently of EnergyAccount::spread)
+static void expectSegment(std::map<uint32_t, Expected> (&buckets)[ENERGY_TIER_COUNT], const Tariff& tariff,
+                          uint64_t from, uint64_t to, double powerFrom, double powerTo) {
+  uint64_t shift = (uint64_t)TARIFF_CLOCK_HOUR * HOUR_MS;
+  uint64_t cursor = from;
+  while (cursor < to) {
+    uint64_t local = cursor + shift;
+    uint64_t boundary = (local / HOUR_MS + 1) * HOUR_MS - shift;
+    uint64_t end = min(to, boundary);
+    double a = powerFrom + (powerTo - powerFrom) * (double)(cursor - from) / (double)(to - from);
+    double b = powerFrom + (powerTo - powerFrom) * (double)(end - from) / (double)(to - from);
+    double energy = (a + b) / 2 * (double)(end - cursor) / 3.6e9;
+    uint32_t hour = local / HOUR_MS;
+    double cost = energy * tariff.rate(hour % 24);
+    Expected& h = buckets[ENERGY_HOUR][hour];
+    h.energy += energy;
+    h.cost += cost;
+    h.coveredMs += end - cursor;
+    Expected& d = buckets[ENERGY_DAY][hour / 24];
+    d.energy += energy;
+    d.cost += cost;
+    d.coveredMs += end - cursor;
+    cursor = end;
+  }
+}
+
+static void checkBuckets(const EnergyAccount& account, std::map<uint32_t, Expected> (&expected)[ENERGY_TIER_COUNT]) {
+  const char* names[ENERGY_TIER_COUNT] = {"hourly", "daily"};
+  for (int tier = 0; tier < ENERGY_TIER_COUNT; tier++) {
+    std::vector<EnergyPoint> points = readTier(account, tier);
+    int matched = 0;
+    double energy = 0;
+    double cost = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+      const EnergyPoint& point = points[i];
+      expect(i == 0 || point.index == points[i - 1].index + 1, "buckets are consecutive");
+      expect(point.start == EnergyAccount::startOf(tier, point.index), "bucket start");
+      const Expected& want = expected[tier][point.index];
+      bool ok = close(point.energy, want.energy, 1e-5) && close(point.cost, want.cost, 1e-5) &&
+                point.coveredMs == want.coveredMs;
+      expect(ok, "bucket energy, cost and coverage match brute force");
+      matched += ok;
+      energy += point.energy;
+      cost += point.cost;
+    }
+    expect(!points.empty() && points.back().index == expected[tier].rbegin()->first, "newest bucket is the last one");
+    printf("  %-6s %3d buckets match (%zu held of %zu), %9.4f kWh, cost %8.4f\n", names[tier], matched,
+           points.size(), expected[tier].size(), energy, cost);
+  }
+}
+
+static void checkConstant(const Tariff& tariff) {
+  // 150 W for exactly four hours from a whole hour, every 5 s
+  printf("Constant 150 W for 4 h (wireless):\n");
+  static EnergyAccount account;
+  std::vector<Sample> samples;
+  uint64_t start = 10 * HOUR_MS - (uint64_t)TARIFF_CLOCK_HOUR * HOUR_MS;
+  for (uint64_t t = start; t <= start + 4 * HOUR_MS; t += 5000) {
+    samples.push_back({t, 150.0f, false, 0});
+  }
+  int counted = addAll(account, samples, tariff);
+  expect(counted == (int)samples.size() - 1, "every interval after the first is counted");
+  expect(close(account.totalEnergy(), 0.6, 1e-9), "0.6 kWh");
+
+  std::vector<EnergyPoint> hours = readTier(account, ENERGY_HOUR);
+  double cost = 0;
+  for (int hour = 10; hour < 14; hour++) {
+    cost += 0.15 * tariff.rate(hour);
+  }
+  expect(hours.size() == 4, "four hourly buckets");
+  for (const EnergyPoint& point : hours) {
+    expect(close(point.energy, 0.15, 1e-6) && point.coveredMs == HOUR_MS, "0.15 kWh in each full hour");
+  }
+  EnergySummary summary = account.summary();
+  expect(summary.method == ENERGY_TRAPEZOID && summary.gaps == 0, "integrated, no gaps");
+  expect(close(summary.todayCost, cost, 1e-6), "day cost is the hours' cost");
+  printf("  %.6f kWh in %zu hours, cost %.4f (expected 0.6 kWh, %.4f)\n", account.totalEnergy(), hours.size(),
+         summary.todayCost, cost);
+}
+
+static void checkRamp(const Tariff& tariff) {
+  // 0 to 3 kW over 30 minutes across an hour boundary, every 7 s: the
+  // trapezoid rule is exact for a linear load
+  printf("Ramp 0-3 kW over 30 min (wireless): ");
+  static EnergyAccount account;
+  std::vector<Sample> samples;
+  uint64_t start = 5 * HOUR_MS - 17 * 60000ULL;
+  uint64_t span = 30 * 60000ULL;
+  for (uint64_t t = 0; t <= span; t += 7000) {
+    samples.push_back({start + t, (float)(3000.0 * t / span), false, 0});
+  }
+  uint64_t last = samples.back().clock - start;
+  addAll(account, samples, tariff);
+  double exact = 3000.0 * last / span / 2 * last / 3.6e9;
+  expect(close(account.totalEnergy(), exact, 1e-6), "exact for a linear load");
+  std::vector<EnergyPoint> hours = readTier(account, ENERGY_HOUR);
+  expect(hours.size() == 2 && close(hours[0].energy + hours[1].energy, exact, 1e-5), "split across the boundary");
+  printf("%.6f kWh (exact %.6f), %.6f + %.6f kWh either side of the hour\n", account.totalEnergy(), exact,
+         hours.size() == 2 ? hours[0].energy : 0, hours.size() == 2 ? hours[1].energy : 0);
+}
+
+static void checkWireless(std::mt19937& rng, const Tariff& tariff, int days) {
+  // Reports every 5-10 s, now and then a lost frame or two (bridged) and
+  // now and then the node offline for minutes to hours (left out)
+  printf("Step load with gaps for %d days (wireless):\n", days);
+  static EnergyAccount account;
+  std::map<uint32_t, Expected> expected[ENERGY_TIER_COUNT];
+  std::uniform_int_distribution<int> interval(5000, 10000);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  StepLoad load(rng);
+
+  std::vector<Sample> samples;
+  uint64_t now = 123456789;
+  uint64_t end = now + days * DAY_MS;
+  double naive = 0;
+  int gaps = 0;
+  samples.push_back({now, load.next(), false, 0});
+  while (now < end) {
+    float chance = unit(rng);
+    if (chance < 0.0005f) {
+      now += 60000ULL * (2 + rng() % 240);  // Offline
+    } else if (chance < 0.02f) {
+      now += interval(rng) * (2 + rng() % 3);  // Lost frames
+    } else {
+      now += interval(rng);
+    }
+    Sample sample = {now, load.next(), false, 0};
+    const Sample& previous = samples.back();
+    uint64_t elapsed = now - previous.clock;
+    if (elapsed <= ENERGY_MAX_GAP_MS) {
+      naive += ((double)previous.power + sample.power) / 2 * (double)elapsed / 3.6e9;
+      expectSegment(expected, tariff, previous.clock, now, previous.power, sample.power);
+    } else {
+      gaps++;
+    }
+    samples.push_back(sample);
+  }
+  addAll(account, samples, tariff);
+  EnergySummary summary = account.summary();
+  expect(close(account.totalEnergy(), naive, 1e-9), "total equals the naive trapezoid replay");
+  expect(summary.gaps == (uint32_t)gaps, "every long silence is a gap");
+  printf("  %zu readings, %.4f kWh (naive %.4f), %lu gaps left out\n", samples.size(), account.totalEnergy(), naive,
+         (unsigned long)summary.gaps);
+  checkBuckets(account, expected);
+}
+
+static void checkMeter(std::mt19937& rng, const Tariff& tariff, int days) {
+  // A PZEM polled every 2 s: its counter is the true energy in whole Wh.
+  // Polls are sometimes missed for minutes (the counter keeps counting);
+  // partway the counter wraps, later it is reset, and one frame carries
+  // a nonsense counter
+  printf("Step load on a PZEM for %d days (wired):\n", days);
+  static EnergyAccount account;
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  StepLoad load(rng);
+
+  std::vector<Sample> samples;
+  uint64_t now = 987654321;
+  uint64_t end = now + days * DAY_MS;
+  double trueWh = ENERGY_METER_ROLLOVER_WH - 3000.5;  // A few hours from wrapping
+  double counterBase = 0;  // Energy at the last reset
+  uint64_t resetAt = now + days * DAY_MS / 2;
+  uint64_t glitchAt = now + days * DAY_MS * 3 / 4;
+  bool reset = false;
+  bool glitched = false;
+  double startWh = trueWh;
+  float power = load.next();
+  samples.push_back({now, power, true, (uint32_t)trueWh});
+  while (now < end) {
+    // Polls around the reset and the glitch all answered: what a reset
+    // erases and what an integrated glitch misses stay under 2 s of load
+    bool calm = (now + HOUR_MS > resetAt && now < resetAt + HOUR_MS) ||
+                (now + HOUR_MS > glitchAt && now < glitchAt + HOUR_MS);
+    uint64_t step = !calm && unit(rng) < 0.0005f ? 60000ULL * (2 + rng() % 30) : 2000;
+    for (uint64_t t = 0; t < step; t += 2000) {
+      trueWh += power * 2000 / 3.6e6;  // The load between polls
+      power = load.next();
+    }
+    now += step;
+    if (!reset && now >= resetAt) {
+      counterBase = trueWh;  // Energy reset command
+      reset = true;
+    }
+    double counted = trueWh - counterBase;
+    uint32_t counter = (uint32_t)fmod(counted, (double)ENERGY_METER_ROLLOVER_WH);
+    if (!glitched && now >= glitchAt) {
+      counter ^= 0x00F00000;  // Corrupt but CRC-valid
+      glitched = true;
+    }
+    samples.push_back({now, power, true, counter});
+  }
+  addAll(account, samples, tariff);
+  EnergySummary summary = account.summary();
+  double drawn = (trueWh - startWh) / 1000.0;
+  expect(summary.counterRollovers == 1, "one rollover");
+  expect(summary.counterResets == 1, "one reset");
+  expect(summary.counterGlitches >= 1 && summary.counterGlitches <= 2, "the nonsense counter is a glitch");
+  expect(summary.gaps == 0, "missed polls are not gaps for a meter");
+  expect(summary.method == ENERGY_METER, "accounted by the meter");
+  // Whole-Wh counter, a reset losing under 1 Wh, the glitch integrated
+  expect(fabs(account.totalEnergy() - drawn) < 0.02, "total is what the load drew");
+  printf("  %zu readings, %.4f kWh accounted, %.4f kWh drawn (%+.1f Wh), %lu rollover, %lu reset, %lu glitches\n",
+         samples.size(), account.totalEnergy(), drawn, (account.totalEnergy() - drawn) * 1000,
+         (unsigned long)summary.counterRollovers, (unsigned long)summary.counterResets,
+         (unsigned long)summary.counterGlitches);
+
+  // The buckets hold every kWh the total has, priced hour by hour
+  std::vector<EnergyPoint> dayPoints = readTier(account, ENERGY_DAY);
+  double daily = 0;
+  for (const EnergyPoint& point : dayPoints) {
+    daily += point.energy;
+  }
+  std::vector<EnergyPoint> hours = readTier(account, ENERGY_HOUR);
+  uint32_t spanned = EnergyAccount::indexOf(ENERGY_HOUR, now) - EnergyAccount::indexOf(ENERGY_HOUR, samples[0].clock) + 1;
+  expect(hours.size() == min<size_t>(account.capacity(ENERGY_HOUR), spanned), "hourly ring holds the newest hours");
+  for (const EnergyPoint& point : hours) {
+    expect(close(point.cost, point.energy * tariff.rate(point.index % 24), 1e-5), "hour priced at its rate");
+  }
+  if (account.size(ENERGY_DAY) < account.capacity(ENERGY_DAY)) {
+    expect(close(daily, account.totalEnergy(), 1e-6), "daily buckets add up to the total");
+  }
+  printf("  %zu days add up to %.4f kWh\n", dayPoints.size(), daily);
+}
+
+static void checkTariff() {
+  printf("Tariff: ");
+  Tariff tariff;
+  expect(tariff.rate(TARIFF_PEAK_START) == (float)TARIFF_PEAK_RATE, "peak starts");
+  expect(tariff.rate((TARIFF_PEAK_END + 23) % 24) == (float)TARIFF_PEAK_RATE, "peak lasts");
+  expect(tariff.rate(TARIFF_OFFPEAK_START) == (float)TARIFF_OFFPEAK_RATE, "off-peak starts");
+  expect(tariff.rate(0) == (float)TARIFF_OFFPEAK_RATE, "off-peak wraps past midnight");
+
+  Tariff custom;
+  custom.setRate(0, 0, 1.0f);
+  custom.setRate(22, 2, 0.5f);
+  int half = 0;
+  for (int hour = 0; hour < 24; hour++) {
+    half += custom.rate(hour) == 0.5f;
+    printf("%s%.2f", hour ? " " : "", tariff.rate(hour));
+  }
+  expect(half == 4 && custom.rate(22) == 0.5f && custom.rate(1) == 0.5f && custom.rate(2) == 1.0f, "wrapping band");
+  printf("\n");
+}
+
+static void benchmark(std::mt19937& rng, const Tariff& tariff) {
+  static EnergyAccount account;
+  StepLoad load(rng);
+  const int readings = 1000000;
+  DeviceReading reading = {};
+  reading.metered = true;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 1; i <= readings; i++) {
+    reading.power = load.next();
+    reading.meterWh = i / 10;
+    account.add(reading, 1000 + (uint64_t)i * 2000, tariff);
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("Update: %.0f ns per reading on the host (%d readings)\n", wall * 1e9 / readings, readings);
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  std::mt19937 rng(options.seed);
+  Tariff tariff;
+
+  printf("=== Energy accounting (EnergyAccount <-> naive replay) ===\n");
+  printf("%d hourly and %d daily buckets, %zu bytes per device\n\n", ENERGY_HOUR_BUCKETS, ENERGY_DAY_BUCKETS,
+         sizeof(EnergyAccount));
+
+  checkTariff();
+  checkConstant(tariff);
+  checkRamp(tariff);
+  checkWireless(rng, tariff, options.days);
+  checkMeter(rng, tariff, options.days);
+
+  static EnergyAccount cleared;
+  DeviceReading reading = {};
+  reading.power = 100;
+  cleared.add(reading, 1000, tariff);
+  cleared.add(reading, 6000, tariff);
+  cleared.clear();
+  expect(cleared.totalEnergy() == 0 && readTier(cleared, ENERGY_HOUR).empty(), "clear empties the account");
+  expect(!cleared.add(reading, 7000, tariff), "nothing to integrate after a clear");
+  printf("\n");
+  benchmark(rng, tariff);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,698 @@
+// Native check and benchmark of the bulk export (pio run -e native_export).
+//
+// Runs devices through the history ring, the rollup tiers and the audit
+// log on the file-backed flash emulator (the log wrapping several times,
+// a device removed near the end), then exports everything as CSV and as binary
+// and decodes both: the binary schema-driven, as a host tool would. Every
+// record must round-trip against a naive read of the same stores (the
+// flash image decoded segment by segment), binary bit for bit and CSV to
+// its printed resolution, whatever the chunk sizes. An export racing the
+// writer must stay well-formed and never repeat or reorder a record, and
+// a device removed after the export listed it must not lend its name to
+// whichever device takes its slot.
+// Then measures export throughput on full-size stores. Exits non-zero on
+// any failure.
+//
+//   .pio/build/native_export/program [--seed N] [--out PREFIX]
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "audit_log.h"
+#include "config.h"
+#include "device_registry.h"
+#include "export_stream.h"
+#include "telemetry_frame.h"
+
+#define CHECK_SEGMENTS 24
+#define FULL_SIZE 0x170000  // The auditlog partition in partitions.csv
+#define STEP_MS 5000        // Reading interval of every device
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  const char* outPrefix = nullptr;  // Exports of the check run (.bin, .csv), for scripts/decode_export.py
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--out") && hasValue) options.outPrefix = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--out PREFIX]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// The auditor's stores, driven the way main.cpp drives them
+struct Fixture {
+  DeviceRegistry registry;
+  AuditLog audit;
+  std::mt19937 rng;
+  float level[MAX_DEVICES];
+
+  Fixture(uint32_t seed) : rng(seed) {
+    for (float& value : level) {
+      value = 0;
+    }
+  }
+
+  bool begin(uint32_t flashSize) {
+    return halFlashAttach(nullptr, flashSize, AUDIT_LOG_PARTITION, AUDIT_LOG_SUBTYPE) && audit.begin(registry);
+  }
+
+  DeviceHandle add(const char* id, const char* type) {
+    DeviceHandle h = registry.insert(id);
+    DeviceInfo& device = registry[h];
+    device.type = type;
+    device.history.clear();
+    device.rollups.clear();
+    device.totalEnergy = 0;
+    audit.deviceAdded(h, device);
+    return h;
+  }
+
+  void remove(DeviceHandle h) {
+    audit.deviceRemoved(registry[h]);
+    registry.remove(h);
+  }
+
+  void step() {
+    halAdvanceMicros(STEP_MS * 1000ULL);
+    unsigned long now = millis();
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (DeviceHandle h = registry.first(); h != INVALID_DEVICE; h = registry.next(h)) {
+      DeviceInfo& device = registry[h];
+      if (unit(rng) < 0.01f) {
+        level[h] = (float)(rng() % 2500);
+      }
+      DeviceReading reading = {};
+      reading.voltage = 225.0f + 10.0f * unit(rng);
+      reading.power = level[h] * (0.9f + 0.2f * unit(rng));
+      reading.current = reading.power / reading.voltage;
+      reading.powerFactor = 0.5f + 0.5f * unit(rng);
+      reading.timestamp = now;
+
+      unsigned long start = device.history.isEmpty() ? now : device.history.lastTimestamp();
+      device.totalEnergy += reading.power * (now - start) / 3600000.0f;
+      device.rollups.add(audit.timeOf(start), audit.timeOf(now), reading.power);
+      device.history.append(reading);
+      device.currentReading = reading;
+    }
+    audit.update(now);
+  }
+
+  DeviceTableSnapshot snapshot() const {
+    DeviceTableSnapshot table;
+    table.count = 0;
+    for (DeviceHandle h = registry.first(); h != INVALID_DEVICE; h = registry.next(h)) {
+      DeviceSnapshot& listed = table.devices[table.count++];
+      listed.handle = h;
+      listed.generation = registry.generation(h);
+      listed.idHash = DeviceRegistry::hashId(registry[h].id.c_str());
+      strncpy(listed.id, registry[h].id.c_str(), sizeof(listed.id));
+      strncpy(listed.type, registry[h].type.c_str(), sizeof(listed.type));
+    }
+    return table;
+  }
+};
+
+// One exported record, whichever format it came from. Fields a source
+// lacks are NaN
+struct Row {
+  int kind;
+  int tier;
+  uint32_t hash;
+  std::string id;
+  uint8_t flags;
+  uint64_t time;
+  float voltage, current, power, powerFactor, minPower, maxPower, energy, coverage, total;
+
+  Row() : kind(0), tier(-1), hash(0), flags(0), time(0) {
+    voltage = current = power = powerFactor = minPower = maxPower = energy = coverage = total = NAN;
+  }
+};
+
+// --- Reference: the stores read naively ---
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool sealed(const uint8_t* slot) {
+  uint16_t crc = TelemetryCodec::crc16(slot, FLASH_LOG_PAYLOAD_SIZE);
+  return slot[FLASH_LOG_PAYLOAD_SIZE] == (crc & 0xFF) && slot[FLASH_LOG_PAYLOAD_SIZE + 1] == (crc >> 8);
+}
+
+// Every record on flash, segments in generation order
+static std::vector<AuditRecord> logOnFlash(uint32_t flashSize) {
+  const uint8_t* image = halFlashImage();
+  std::vector<std::pair<uint32_t, uint32_t>> segments;  // generation, segment
+  for (uint32_t s = 0; s < flashSize / FLASH_LOG_SEGMENT_SIZE; s++) {
+    const uint8_t* header = image + s * FLASH_LOG_SEGMENT_SIZE;
+    if (sealed(header) && get32(header) == FLASH_LOG_MAGIC) {
+      segments.push_back({get32(header + 4), s});
+    }
+  }
+  std::sort(segments.begin(), segments.end());
+
+  std::vector<AuditRecord> records;
+  for (const auto& segment : segments) {
+    for (uint32_t slot = 1; slot < FLASH_LOG_SLOTS; slot++) {
+      const uint8_t* data = image + segment.second * FLASH_LOG_SEGMENT_SIZE + slot * FLASH_LOG_SLOT_SIZE;
+      AuditRecord record;
+      if (sealed(data) && AuditRecord::decode(data, record)) {
+        records.push_back(record);
+      }
+    }
+  }
+  return records;
+}
+
+static std::vector<Row> expectedRows(const Fixture& fixture, const DeviceTableSnapshot& table, uint32_t flashSize,
+                                     int64_t offset, bool binary) {
+  std::vector<Row> rows;
+  std::map<uint32_t, std::string> names;
+  for (int i = 0; i < table.count; i++) {
+    names[table.devices[i].idHash] = table.devices[i].id;
+    if (binary) {
+      Row row;
+      row.kind = EXPORT_RECORD_DEVICE;
+      row.hash = table.devices[i].idHash;
+      row.id = table.devices[i].id;
+      row.flags = strcmp(table.devices[i].type, "wireless") == 0 ? AUDIT_DEVICE_WIRELESS : 0;
+      rows.push_back(row);
+    }
+  }
+
+  for (const AuditRecord& record : logOnFlash(flashSize)) {
+    Row row;
+    row.hash = record.deviceHash;
+    if (record.type == AUDIT_RECORD_DEVICE) {
+      names.insert({record.deviceHash, record.id});
+      if (binary) {
+        row.kind = EXPORT_RECORD_DEVICE;
+        row.id = record.id;
+        row.flags = record.flags;
+        rows.push_back(row);
+      }
+    } else if (record.type == AUDIT_RECORD_SAMPLE) {
+      row.kind = EXPORT_RECORD_LOGGED;
+      if (!binary) {
+        char fallback[16];
+        snprintf(fallback, sizeof(fallback), "#%08lx", (unsigned long)record.deviceHash);
+        row.id = names.count(record.deviceHash) ? names[record.deviceHash] : fallback;
+      }
+      row.time = (uint64_t)record.time * 1000;
+      row.voltage = record.reading.voltage;
+      row.current = record.reading.current;
+      row.power = record.reading.power;
+      row.powerFactor = record.reading.powerFactor;
+      row.total = record.totalEnergy;
+      rows.push_back(row);
+    }
+  }
+
+  for (int i = 0; i < table.count; i++) {
+    const DeviceInfo& device = fixture.registry[table.devices[i].handle];
+    for (int tier = ROLLUP_HOUR; tier >= ROLLUP_MINUTE; tier--) {
+      RollupReadState state(0, UINT64_MAX);
+      RollupPoint bucket;
+      while (device.rollups.readBatch(tier, state, &bucket, 1) == 1) {
+        Row row;
+        row.kind = EXPORT_RECORD_ROLLUP;
+        row.tier = tier;
+        row.hash = table.devices[i].idHash;
+        row.id = binary ? "" : table.devices[i].id;
+        row.time = bucket.timestamp;
+        row.power = bucket.avgPower;
+        row.minPower = bucket.minPower;
+        row.maxPower = bucket.maxPower;
+        row.energy = bucket.energy;
+        row.coverage = bucket.coveredMs / 1000.0f;
+        rows.push_back(row);
+      }
+    }
+    HistoryBuffer::Cursor cursor = device.history.cursor();
+    DeviceReading reading;
+    while (cursor.next(reading)) {
+      Row row;
+      row.kind = EXPORT_RECORD_RAW;
+      row.hash = table.devices[i].idHash;
+      row.id = binary ? "" : table.devices[i].id;
+      row.time = reading.timestamp + offset;
+      row.voltage = reading.voltage;
+      row.current = reading.current;
+      row.power = reading.power;
+      row.powerFactor = reading.powerFactor;
+      rows.push_back(row);
+    }
+  }
+  return rows;
+}
+
+// --- Decoders ---
+
+static std::string drain(JsonChunkSource& source, std::mt19937* rng = nullptr) {
+  // Random chunk sizes when given a generator, else one TCP segment
+  std::string body;
+  uint8_t buffer[1436];
+  size_t len;
+  while ((len = source.fill(buffer, rng ? 1 + (*rng)() % sizeof(buffer) : sizeof(buffer))) > 0) {
+    body.append((const char*)buffer, len);
+  }
+  return body;
+}
+
+struct BinaryField {
+  std::string name;
+  char type;
+};
+
+// Schema-driven, like a host tool; false on anything malformed
+static bool decodeBinary(const std::string& body, std::vector<Row>& rows, uint32_t& endCount) {
+  size_t at = 0;
+  auto need = [&](size_t n) { return at + n <= body.size(); };
+  auto byte = [&]() { return (uint8_t)body[at++]; };
+  auto string = [&](std::string& out) {
+    if (!need(1)) return false;
+    size_t len = byte();
+    if (!need(len)) return false;
+    out = body.substr(at, len);
+    at += len;
+    return true;
+  };
+
+  if (!need(6) || body.compare(0, 4, EXPORT_MAGIC) != 0) {
+    return false;
+  }
+  at = 4;
+  if (byte() != EXPORT_VERSION) {
+    return false;
+  }
+  std::map<int, std::vector<BinaryField>> schema;
+  int kinds = byte();
+  for (int k = 0; k < kinds; k++) {
+    if (!need(1)) return false;
+    int kind = byte();
+    std::string name;
+    if (!string(name) || !need(1)) return false;
+    int count = byte();
+    for (int f = 0; f < count; f++) {
+      BinaryField field;
+      if (!string(field.name) || !need(1)) return false;
+      field.type = byte();
+      schema[kind].push_back(field);
+    }
+  }
+
+  while (need(1)) {
+    int kind = byte();
+    if (!schema.count(kind)) {
+      return false;
+    }
+    Row row;
+    row.kind = kind;
+    for (const BinaryField& field : schema[kind]) {
+      static const std::map<char, size_t> SIZES = {{'B', 1}, {'H', 2}, {'I', 4}, {'Q', 8}, {'f', 4}};
+      std::string text;
+      uint64_t value = 0;
+      if (field.type == 's') {
+        if (!string(text)) return false;
+      } else {
+        if (!SIZES.count(field.type) || !need(SIZES.at(field.type))) return false;
+        for (size_t i = 0; i < SIZES.at(field.type); i++) {
+          value |= (uint64_t)byte() << (8 * i);
+        }
+      }
+      uint32_t bits = (uint32_t)value;
+      float number;
+      memcpy(&number, &bits, sizeof(number));
+
+      if (field.name == "device") row.hash = value;
+      else if (field.name == "flags") row.flags = value;
+      else if (field.name == "id") row.id = text;
+      else if (field.name == "tier") row.tier = value;
+      else if (field.name == "time_ms") row.time = value;
+      else if (field.name == "voltage") row.voltage = number;
+      else if (field.name == "current") row.current = number;
+      else if (field.name == "power") row.power = number;
+      else if (field.name == "power_factor") row.powerFactor = number;
+      else if (field.name == "min_power") row.minPower = number;
+      else if (field.name == "max_power") row.maxPower = number;
+      else if (field.name == "energy_kwh") row.energy = number;
+      else if (field.name == "coverage_s") row.coverage = number;
+      else if (field.name == "total_kwh") row.total = number;
+      else if (field.name == "records") endCount = value;
+    }
+    if (kind == EXPORT_RECORD_END) {
+      return at == body.size();
+    }
+    rows.push_back(row);
+  }
+  return false;  // No end record: cut short
+}
+
+static bool decodeCsv(const std::string& body, std::vector<Row>& rows) {
+  static const char* HEADER =
+    "source,device,time_ms,voltage,current,power,power_factor,min_power,max_power,energy_kwh,coverage_s,total_kwh";
+  size_t at = body.find('\n');
+  if (at == std::string::npos || body.compare(0, at, HEADER) != 0) {
+    return false;
+  }
+  at++;
+  while (at < body.size()) {
+    size_t end = body.find('\n', at);
+    if (end == std::string::npos) {
+      return false;
+    }
+    std::vector<std::string> cells;
+    size_t start = at;
+    for (size_t i = at; i <= end; i++) {
+      if (i == end || body[i] == ',') {
+        cells.push_back(body.substr(start, i - start));
+        start = i + 1;
+      }
+    }
+    at = end + 1;
+    if (cells.size() != 12) {
+      return false;
+    }
+
+    Row row;
+    static const char* const SOURCES[] = {"minute", "quarter", "hour"};
+    if (cells[0] == "raw") row.kind = EXPORT_RECORD_RAW;
+    else if (cells[0] == "log") row.kind = EXPORT_RECORD_LOGGED;
+    for (int tier = 0; tier < ROLLUP_TIER_COUNT; tier++) {
+      if (cells[0] == SOURCES[tier]) {
+        row.kind = EXPORT_RECORD_ROLLUP;
+        row.tier = tier;
+      }
+    }
+    if (row.kind == 0) {
+      return false;
+    }
+    row.id = cells[1];
+    row.time = strtoull(cells[2].c_str(), nullptr, 10);
+    float* numbers[] = {&row.voltage, &row.current, &row.power, &row.powerFactor, &row.minPower,
+                        &row.maxPower, &row.energy, &row.coverage, &row.total};
+    for (int i = 0; i < 9; i++) {
+      *numbers[i] = cells[3 + i].empty() ? NAN : strtof(cells[3 + i].c_str(), nullptr);
+    }
+    rows.push_back(row);
+  }
+  return true;
+}
+
+// --- Comparison ---
+
+static bool close(float actual, float expected, double resolution) {
+  if (std::isnan(actual) || std::isnan(expected)) {
+    return std::isnan(actual) && std::isnan(expected);
+  }
+  // Printed to `resolution`, then parsed back into a float
+  return fabs((double)actual - expected) <= resolution / 2 + fabs(expected) * 1.2e-7;
+}
+
+static bool sameRow(const Row& a, const Row& b, bool exact) {
+  if (a.kind != b.kind || a.tier != b.tier || a.time != b.time || a.id != b.id) {
+    return false;
+  }
+  if (exact) {
+    if (a.hash != b.hash || a.flags != b.flags) {
+      return false;
+    }
+    const float* x = &a.voltage;
+    const float* y = &b.voltage;
+    for (int i = 0; i < 9; i++) {
+      if (memcmp(&x[i], &y[i], sizeof(float)) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+  // CSV: the decimals export_stream.cpp prints
+  bool bucket = a.kind == EXPORT_RECORD_ROLLUP;
+  return close(a.voltage, b.voltage, 0.1) && close(a.current, b.current, 0.001) &&
+         close(a.power, b.power, bucket ? 0.01 : 0.1) && close(a.powerFactor, b.powerFactor, 0.01) &&
+         close(a.minPower, b.minPower, 0.1) && close(a.maxPower, b.maxPower, 0.1) &&
+         close(a.energy, b.energy, 1e-6) && close(a.coverage, b.coverage, 0.1) && close(a.total, b.total, 1e-6);
+}
+
+static size_t compareRows(const std::vector<Row>& actual, const std::vector<Row>& expected, bool exact) {
+  size_t matched = 0;
+  while (matched < actual.size() && matched < expected.size() && sameRow(actual[matched], expected[matched], exact)) {
+    matched++;
+  }
+  return matched;
+}
+
+static void countKinds(const std::vector<Row>& rows, int* counts) {
+  for (int i = 0; i <= EXPORT_RECORD_END; i++) {
+    counts[i] = 0;
+  }
+  for (const Row& row : rows) {
+    counts[row.kind]++;
+  }
+}
+
+static void save(const CheckOptions& options, const char* suffix, const std::string& body) {
+  if (!options.outPrefix) {
+    return;
+  }
+  std::string path = std::string(options.outPrefix) + suffix;
+  FILE* out = fopen(path.c_str(), "wb");
+  if (out) {
+    fwrite(body.data(), 1, body.size(), out);
+    fclose(out);
+  }
+}
+
+static void checkRoundTrip(Fixture& fixture, uint32_t flashSize, const std::string& removedId,
+                           const CheckOptions& options) {
+  DeviceTableSnapshot table = fixture.snapshot();
+  int64_t offset = fixture.audit.clockOffset();
+
+  printf("Binary: ");
+  ExportStream binary(fixture.registry, table, &fixture.audit.records(), offset, EXPORT_BINARY);
+  std::string body = drain(binary);
+  std::vector<Row> rows;
+  uint32_t endCount = 0;
+  expect(decodeBinary(body, rows, endCount), "binary export decodes");
+  expect(endCount == rows.size(), "end record counts every record");
+  std::vector<Row> reference = expectedRows(fixture, table, flashSize, offset, true);
+  size_t matched = compareRows(rows, reference, true);
+  expect(matched == reference.size() && rows.size() == reference.size(), "binary round-trips bit for bit");
+  int counts[EXPORT_RECORD_END + 1];
+  countKinds(rows, counts);
+  printf("%zu bytes, %zu records (%d device, %d logged, %d rollup, %d raw), %zu/%zu match\n", body.size(),
+         rows.size(), counts[EXPORT_RECORD_DEVICE], counts[EXPORT_RECORD_LOGGED], counts[EXPORT_RECORD_ROLLUP],
+         counts[EXPORT_RECORD_RAW], matched, reference.size());
+  save(options, ".bin", body);
+
+  // Same bytes whatever sizes the transport asks for
+  ExportStream chunked(fixture.registry, table, &fixture.audit.records(), offset, EXPORT_BINARY);
+  expect(drain(chunked, &fixture.rng) == body, "binary independent of chunk sizes");
+
+  printf("CSV:    ");
+  ExportStream csv(fixture.registry, table, &fixture.audit.records(), offset, EXPORT_CSV);
+  std::string text = drain(csv, &fixture.rng);
+  rows.clear();
+  expect(decodeCsv(text, rows), "CSV parses: header and 12 cells per row");
+  reference = expectedRows(fixture, table, flashSize, offset, false);
+  matched = compareRows(rows, reference, false);
+  expect(matched == reference.size() && rows.size() == reference.size(), "CSV round-trips to its resolution");
+  size_t removedRows = 0;
+  for (const Row& row : rows) {
+    removedRows += row.id == removedId;
+  }
+  expect(removedRows > 0, "logged records of the removed device named from the log");
+  printf("%zu bytes, %zu rows, %zu/%zu match\n", text.size(), rows.size(), matched, reference.size());
+  save(options, ".csv", text);
+}
+
+static void checkConcurrent(Fixture& fixture) {
+  // The writer keeps logging (and rotating) while the export is sent
+  printf("Racing the writer: ");
+  DeviceTableSnapshot table = fixture.snapshot();
+  ExportStream binary(fixture.registry, table, &fixture.audit.records(), fixture.audit.clockOffset(), EXPORT_BINARY);
+  uint32_t rotations = fixture.audit.stats().erases;
+  std::string body;
+  uint8_t buffer[512];
+  size_t len;
+  while ((len = binary.fill(buffer, sizeof(buffer))) > 0) {
+    body.append((const char*)buffer, len);
+    for (int i = 0; i < 12; i++) {
+      fixture.step();
+    }
+  }
+  rotations = fixture.audit.stats().erases - rotations;
+
+  std::vector<Row> rows;
+  uint32_t endCount = 0;
+  expect(decodeBinary(body, rows, endCount) && endCount == rows.size(), "export racing the writer decodes");
+  std::map<uint32_t, uint64_t> lastTime;
+  bool ordered = true;
+  size_t logged = 0;
+  for (const Row& row : rows) {
+    if (row.kind != EXPORT_RECORD_LOGGED) {
+      continue;
+    }
+    // At most one record per device per sample period, in order
+    ordered = ordered && (!lastTime.count(row.hash) || row.time > lastTime[row.hash]);
+    lastTime[row.hash] = row.time;
+    logged++;
+  }
+  expect(ordered, "no logged record repeated or out of order");
+  printf("%zu logged records across %u rotations, %s\n", logged, rotations, ordered ? "in order" : "REORDERED");
+}
+
+static void checkSlotReuse(Fixture& fixture) {
+  // Listed, then removed and its slot handed to a new device before the
+  // export reaches it
+  printf("Slot reused mid-export: ");
+  DeviceTableSnapshot table = fixture.snapshot();
+  const DeviceSnapshot& gone = table.devices[table.count - 1];
+  ExportStream binary(fixture.registry, table, &fixture.audit.records(), fixture.audit.clockOffset(), EXPORT_BINARY);
+  fixture.remove(gone.handle);
+  DeviceHandle reused = fixture.add("NODE_REPLACEMENT", "wireless");
+  expect(reused == gone.handle, "new device takes the freed slot");
+  for (int i = 0; i < 120; i++) {
+    fixture.step();
+  }
+
+  std::vector<Row> rows;
+  uint32_t endCount = 0;
+  expect(decodeBinary(drain(binary), rows, endCount) && endCount == rows.size(), "export across the removal decodes");
+  size_t borrowed = 0;
+  for (const Row& row : rows) {
+    borrowed += row.hash == gone.idHash && (row.kind == EXPORT_RECORD_RAW || row.kind == EXPORT_RECORD_ROLLUP);
+  }
+  expect(borrowed == 0, "no history of the slot's new device exported under the removed one");
+  printf("%zu records, %zu under the removed device's name from its slot\n", rows.size(), borrowed);
+}
+
+template <typename F>
+static double timeSeconds(F body) {
+  auto start = std::chrono::steady_clock::now();
+  body();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchmark(uint32_t seed) {
+  // Full-size partition wrapped, MAX_DEVICES devices with a week of history
+  std::unique_ptr<Fixture> owned(new Fixture(seed));
+  Fixture& fixture = *owned;
+  if (!fixture.begin(FULL_SIZE)) {
+    expect(false, "full-size flash attached");
+    return;
+  }
+  for (int i = 0; i < MAX_DEVICES; i++) {
+    char id[DEVICE_ID_MAX];
+    snprintf(id, sizeof(id), "NODE_%08X", 0x5EED0000 + i);
+    fixture.add(id, i < 2 ? "wired" : "wireless");
+  }
+  for (unsigned long t = 0; t < 7UL * 24 * 3600 * 1000; t += STEP_MS) {
+    fixture.step();
+  }
+  DeviceTableSnapshot table = fixture.snapshot();
+  printf("%d devices, a week of readings every %d s; log %u segments, generation %u\n", MAX_DEVICES,
+         STEP_MS / 1000, fixture.audit.stats().segments, fixture.audit.stats().generation);
+
+  const ExportFormat formats[] = {EXPORT_CSV, EXPORT_BINARY};
+  for (ExportFormat format : formats) {
+    size_t bytes = 0;
+    uint64_t flashBefore = halFlashStats().busyMicros;
+    double seconds = timeSeconds([&]() {
+      ExportStream stream(fixture.registry, table, &fixture.audit.records(), fixture.audit.clockOffset(), format);
+      uint8_t buffer[1436];
+      size_t len;
+      while ((len = stream.fill(buffer, sizeof(buffer))) > 0) {
+        bytes += len;
+      }
+    });
+    double flashMs = (halFlashStats().busyMicros - flashBefore) / 1000.0;
+    printf("%-7s %8.2f MB in %6.1f ms: %6.1f MB/s on the host; modelled flash reads %.0f ms\n",
+           format == EXPORT_CSV ? "CSV:" : "Binary:", bytes / 1e6, seconds * 1000, bytes / 1e6 / seconds, flashMs);
+  }
+  printf("Stream state: %zu bytes per export\n", sizeof(ExportStream));
+  halFlashDetach();
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Bulk export (ExportStream <-> naive store reads) ===\n");
+  uint32_t flashSize = CHECK_SEGMENTS * FLASH_LOG_SEGMENT_SIZE;
+  static Fixture fixture(options.seed);
+  if (!fixture.begin(flashSize)) {
+    printf("flash emulator unavailable\n");
+    return 1;
+  }
+  DeviceHandle removed = INVALID_DEVICE;
+  std::string removedId;
+  const char* const TYPES[] = {"wired", "wired", "wireless", "wireless", "wireless", "wireless"};
+  for (int i = 0; i < 6; i++) {
+    char id[DEVICE_ID_MAX];
+    // Named as main.cpp names them
+    if (i < 2) {
+      snprintf(id, sizeof(id), "%s", i == 0 ? WIRED_LOAD_1_ID : WIRED_LOAD_2_ID);
+    } else {
+      snprintf(id, sizeof(id), "NODE_%08X", 0xC0DE0000 + i);
+    }
+    DeviceHandle h = fixture.add(id, TYPES[i]);
+    if (i == 3) {
+      removed = h;
+      removedId = id;
+    }
+  }
+
+  // Two days; the log wraps several times. One device goes three hours
+  // before the end, so only older checkpoints on flash still name it
+  const unsigned long steps = 2UL * 24 * 3600 * 1000 / STEP_MS;
+  for (unsigned long i = 0; i < steps; i++) {
+    if (i == steps - 3UL * 3600 * 1000 / STEP_MS) {
+      fixture.remove(removed);
+    }
+    fixture.step();
+  }
+  halAdvanceMicros(AUDIT_LOG_FLUSH_MS * 1000ULL);  // Program what is buffered
+  fixture.audit.update(millis());
+  printf("%d segments, generation %u; audit clock %u s\n\n", CHECK_SEGMENTS, fixture.audit.stats().generation,
+         fixture.audit.clock());
+
+  checkRoundTrip(fixture, flashSize, removedId, options);
+  checkConcurrent(fixture);
+  checkSlotReuse(fixture);
+  halFlashDetach();
+
+  printf("\n");
+  benchmark(options.seed);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,348 @@
+// Native check and benchmark of the flash log (pio run -e native_flash).
+//
+// Drives FlashLog (src/flash_log.cpp) against the file-backed NOR flash
+// emulator in hal/native: records survive a reboot in order, segments
+// rotate and wear evenly, power cut at every point of a flush (mid-record,
+// mid-erase, mid-header) never loses a record that was fully programmed,
+// never resurrects a partial one and never makes the log program over
+// data, and a corrupted record is skipped on its own. Then measures
+// append+flush throughput on the host and on modelled flash timings, and
+// boot recovery time on a full-size partition. Exits non-zero on any
+// failure.
+//
+//   .pio/build/native_flash/program [--seed N] [--flash FILE]
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "config.h"
+#include "flash_log.h"
+
+#define CHECK_SUBTYPE 0x40
+#define CHECK_RECORD 0x7E      // Numbered test record
+#define CHECK_CHECKPOINT 0x7C  // Written by the checkpoint hook
+#define CHECK_SEGMENTS 8
+#define FULL_SIZE 0x170000     // The auditlog partition in partitions.csv
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  const char* flashPath = nullptr;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--flash") && hasValue) options.flashPath = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--flash FILE]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void makeRecord(uint8_t* payload, uint8_t type, uint32_t number) {
+  memset(payload, 0, FLASH_LOG_PAYLOAD_SIZE);
+  payload[0] = type;
+  memcpy(payload + 1, &number, sizeof(number));
+  for (int i = 5; i < FLASH_LOG_PAYLOAD_SIZE; i++) {
+    payload[i] = (uint8_t)(number * 31 + i);  // Filler that changes every record
+  }
+}
+
+// What recovery handed back
+struct Recovered {
+  std::vector<uint32_t> records;
+  int checkpoints = 0;
+  int garbage = 0;  // Passed the CRC but not something we wrote
+};
+
+static void collect(const uint8_t* payload, void* context) {
+  Recovered& out = *(Recovered*)context;
+  uint32_t number;
+  memcpy(&number, payload + 1, sizeof(number));
+  uint8_t expected[FLASH_LOG_PAYLOAD_SIZE];
+  makeRecord(expected, payload[0], number);
+  if ((payload[0] != CHECK_RECORD && payload[0] != CHECK_CHECKPOINT) || memcmp(payload, expected, sizeof(expected))) {
+    out.garbage++;
+  } else if (payload[0] == CHECK_CHECKPOINT) {
+    out.checkpoints++;
+  } else {
+    out.records.push_back(number);
+  }
+}
+
+static void writeCheckpoint(FlashLog& log, void* context) {
+  uint8_t payload[FLASH_LOG_PAYLOAD_SIZE];
+  for (uint32_t i = 0; i < 3; i++) {
+    makeRecord(payload, CHECK_CHECKPOINT, i);
+    log.checkpoint(payload);
+  }
+}
+
+static const esp_partition_t* partitionOf(uint32_t size) {
+  halFlashAttach(nullptr, size, "check", CHECK_SUBTYPE);
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)CHECK_SUBTYPE, "check");
+}
+
+// Reboot: a fresh FlashLog recovering from whatever is on flash
+static void reboot(FlashLog& log, Recovered& out, bool checkpoints = true) {
+  out = Recovered();
+  log = FlashLog();
+  log.begin(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)CHECK_SUBTYPE, "check"),
+            collect, &out);
+  if (checkpoints) {
+    log.setCheckpoint(writeCheckpoint, nullptr);
+  }
+}
+
+static void appendRange(FlashLog& log, uint32_t from, uint32_t to) {
+  uint8_t payload[FLASH_LOG_PAYLOAD_SIZE];
+  for (uint32_t n = from; n < to; n++) {
+    makeRecord(payload, CHECK_RECORD, n);
+    log.append(payload);
+  }
+}
+
+// Append and flush as often as the RAM buffer needs
+static void writeRange(FlashLog& log, uint32_t from, uint32_t to) {
+  for (uint32_t n = from; n < to; n += AUDIT_LOG_BUFFER_RECORDS) {
+    appendRange(log, n, min<uint32_t>(n + AUDIT_LOG_BUFFER_RECORDS, to));
+    log.flush();
+  }
+}
+
+static bool contiguous(const std::vector<uint32_t>& records) {
+  for (size_t i = 1; i < records.size(); i++) {
+    if (records[i] != records[i - 1] + 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void checkReboot() {
+  printf("Reboot: ");
+  partitionOf(CHECK_SEGMENTS * FLASH_LOG_SEGMENT_SIZE);
+  static FlashLog log;
+  Recovered out;
+  reboot(log, out, false);
+  expect(log.isReady() && out.records.empty() && log.stats().recovered == 0, "blank partition recovers nothing");
+
+  appendRange(log, 0, 50);
+  expect(log.pending() == 50 && halFlashStats().writes == 0, "appends stay in RAM until flushed");
+  expect(log.flush() && log.pending() == 0, "flush");
+  reboot(log, out, false);
+  expect(out.records.size() == 50 && out.records.front() == 0 && contiguous(out.records), "50 records back in order");
+
+  appendRange(log, 50, 60);
+  appendRange(log, 60, 60 + AUDIT_LOG_BUFFER_RECORDS);  // Overflows the buffer
+  expect(log.stats().dropped == 10 && log.pending() == AUDIT_LOG_BUFFER_RECORDS, "full buffer drops appends");
+  log.flush();
+  reboot(log, out, false);
+  expect(out.records.size() == 50 + AUDIT_LOG_BUFFER_RECORDS && contiguous(out.records), "appended after the reboot");
+  expect(halFlashStats().overwrites == 0, "never programs over data");
+  printf("%zu records recovered, %lu writes\n", out.records.size(), (unsigned long)halFlashStats().writes);
+}
+
+static void checkRotation() {
+  printf("Rotation: ");
+  partitionOf(CHECK_SEGMENTS * FLASH_LOG_SEGMENT_SIZE);
+  static FlashLog log;
+  Recovered out;
+  reboot(log, out);
+
+  // Three times round the ring, rebooting between flushes
+  const uint32_t total = CHECK_SEGMENTS * (FLASH_LOG_SLOTS - 4) * 3 + 37;
+  uint32_t next = 0;
+  int bad = 0;
+  while (next < total) {
+    uint32_t batch = min<uint32_t>(40, total - next);
+    appendRange(log, next, next + batch);
+    log.flush();
+    next += batch;
+    reboot(log, out);
+    if (out.checkpoints != 3 || out.garbage || out.records.empty() || out.records.back() != next - 1 ||
+        !contiguous(out.records)) {
+      bad++;
+    }
+  }
+  expect(bad == 0, "tail segment holds the checkpoint and the newest records after every flush");
+
+  uint32_t least = UINT32_MAX;
+  uint32_t most = 0;
+  for (uint32_t sector = 0; sector < CHECK_SEGMENTS; sector++) {
+    least = min(least, halFlashSectorErases(sector));
+    most = max(most, halFlashSectorErases(sector));
+  }
+  expect(most - least <= 1, "every sector erased equally often");
+  expect(log.stats().generation > 3 * CHECK_SEGMENTS, "generations keep counting past the wrap");
+  expect(halFlashStats().overwrites == 0, "never programs over data");
+  printf("%lu records, generation %lu, erases per sector %lu..%lu\n", (unsigned long)total,
+         (unsigned long)log.stats().generation, (unsigned long)least, (unsigned long)most);
+}
+
+static void checkPowerCut() {
+  // A flush of 20 records starting 10 slots before the end of a segment:
+  // a write, a sector erase, a header, the checkpoint and another write.
+  // Cut power after every possible byte count and reboot
+  printf("Power cut: ");
+  const uint32_t flushBytes = 20 * FLASH_LOG_SLOT_SIZE + FLASH_LOG_SEGMENT_SIZE + 4 * FLASH_LOG_SLOT_SIZE;
+  int cuts = 0;
+  int tornTotal = 0;
+  int bad = 0;
+  for (uint32_t cut = 0; cut <= flushBytes + FLASH_LOG_SLOT_SIZE; cut += (cut < 600 || cut > 4400) ? 1 : 97) {
+    partitionOf(4 * FLASH_LOG_SEGMENT_SIZE);
+    static FlashLog log;
+    Recovered out;
+    reboot(log, out);
+    const uint32_t before = FLASH_LOG_SLOTS - 1 - 3 - 10;  // After the first checkpoint
+    writeRange(log, 0, before);
+
+    appendRange(log, before, before + 20);
+    halFlashCutPowerAfter(cut);
+    log.flush();
+    halFlashCutPowerAfter(-1);
+    reboot(log, out);
+
+    // Every record fully programmed before the cut is in the tail (unless
+    // the new segment's header made it, then only those after it are);
+    // nothing partial is. A cut in a record's last byte may still leave
+    // it whole, if that byte's remaining bits were already 1
+    const uint32_t firstRun = 10 * FLASH_LOG_SLOT_SIZE;
+    const uint32_t headerDone = firstRun + FLASH_LOG_SEGMENT_SIZE + FLASH_LOG_SLOT_SIZE;
+    const uint32_t checkpointDone = headerDone + 3 * FLASH_LOG_SLOT_SIZE;
+    uint32_t programmed = cut < firstRun ? cut / FLASH_LOG_SLOT_SIZE
+                          : cut < checkpointDone ? 10
+                          : min<uint32_t>(20, 10 + (cut - checkpointDone) / FLASH_LOG_SLOT_SIZE);
+    uint32_t inTail = cut >= headerDone ? programmed - 10 : programmed;
+    uint32_t found = out.records.empty() ? 0 : out.records.back() + 1 - before - (cut >= headerDone ? 10 : 0);
+    bool lastByte = (cut < checkpointDone ? cut : cut - checkpointDone) % FLASH_LOG_SLOT_SIZE == FLASH_LOG_SLOT_SIZE - 1;
+    bool ok = out.garbage == 0 && contiguous(out.records) && log.stats().torn <= 1 &&
+              (found == inTail || (lastByte && found == inTail + 1));
+    tornTotal += log.stats().torn;
+
+    // The log carries on after it
+    appendRange(log, 1000, 1030);
+    log.flush();
+    reboot(log, out);
+    ok = ok && out.garbage == 0 && !out.records.empty() && out.records.back() == 1029 && halFlashStats().overwrites == 0;
+    if (!ok) {
+      bad++;
+      if (bad <= 3) {
+        printf("[cut at %lu bytes] ", (unsigned long)cut);
+      }
+    }
+    cuts++;
+  }
+  expect(bad == 0, "every power cut recovers to a clean prefix and the log continues");
+  printf("%d cut points, %d torn slots skipped\n", cuts, tornTotal);
+}
+
+static void checkCorruption(uint32_t seed) {
+  printf("Corruption: ");
+  partitionOf(CHECK_SEGMENTS * FLASH_LOG_SEGMENT_SIZE);
+  static FlashLog log;
+  Recovered out;
+  reboot(log, out);
+  appendRange(log, 0, 40);
+  log.flush();
+
+  // Flip one bit in a record in the middle of the tail segment (segment 0)
+  std::mt19937 rng(seed);
+  uint32_t slot = 10 + rng() % 20;
+  uint32_t byte = rng() % FLASH_LOG_SLOT_SIZE;
+  halFlashImage()[slot * FLASH_LOG_SLOT_SIZE + byte] ^= 1 << (rng() % 8);
+  reboot(log, out);
+  expect(out.records.size() == 39 && log.stats().torn == 1 && out.garbage == 0, "only the corrupted record is lost");
+
+  // Garbage everywhere: no valid header, so the log starts over
+  uint8_t* image = halFlashImage();
+  for (uint32_t i = 0; i < CHECK_SEGMENTS * FLASH_LOG_SEGMENT_SIZE; i++) {
+    image[i] = rng();
+  }
+  reboot(log, out);
+  appendRange(log, 0, 10);
+  log.flush();
+  reboot(log, out);
+  expect(out.records.size() == 10 && out.garbage == 0, "a foreign partition is taken over");
+  printf("bit flip at slot %lu byte %lu skipped\n", (unsigned long)slot, (unsigned long)byte);
+}
+
+static void benchmark(const CheckOptions& options) {
+  // Full-size partition, records in flushes of 3/4 of the buffer, twice round
+  halFlashAttach(options.flashPath, FULL_SIZE, "check", CHECK_SUBTYPE);
+  static FlashLog log;
+  Recovered out;
+  reboot(log, out);
+
+  const uint32_t batch = AUDIT_LOG_BUFFER_RECORDS * 3 / 4;
+  const uint32_t total = 2 * (FULL_SIZE / FLASH_LOG_SEGMENT_SIZE) * FLASH_LOG_SLOTS;
+  uint64_t busyBefore = halFlashStats().busyMicros;
+  uint32_t flushes = 0;
+  uint32_t worst = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < total; n += batch) {
+    appendRange(log, n, min(n + batch, total));
+    unsigned long before = micros();
+    log.flush();
+    worst = max(worst, (uint32_t)(micros() - before));
+    flushes++;
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double bytes = (double)log.stats().written * FLASH_LOG_SLOT_SIZE;
+  double busy = (halFlashStats().busyMicros - busyBefore) / 1e6;
+  printf("Throughput: %lu records (%.1f MB) in %lu flushes of %lu\n", (unsigned long)log.stats().written,
+         bytes / 1e6, (unsigned long)flushes, (unsigned long)batch);
+  printf("  host:      %.1f MB/s, %.2f us per record (append, CRC, flush to file)\n", bytes / 1e6 / wall,
+         wall * 1e6 / log.stats().written);
+  printf("  modelled:  %.1f KB/s of flash time, %.1f ms per flush (worst %.1f ms, with a sector erase)\n",
+         bytes / 1e3 / busy, busy * 1e3 / flushes, worst / 1000.0);
+
+  unsigned long before = micros();
+  reboot(log, out);
+  unsigned long recovery = micros() - before;
+  expect(out.records.back() == total - 1 && contiguous(out.records), "full-size log recovers its tail");
+  printf("Recovery:  %lu segments, %lu records in the tail, %.1f ms modelled (headers + one segment)\n",
+         (unsigned long)log.stats().segments, (unsigned long)log.stats().recovered, recovery / 1000.0);
+
+  double perDay = 24.0 * 3600 * 1000 / AUDIT_LOG_SAMPLE_MS * MAX_DEVICES;
+  double capacity = (double)(FULL_SIZE / FLASH_LOG_SEGMENT_SIZE - 1) * (FLASH_LOG_SLOTS - 2 - MAX_DEVICES);
+  printf("Capacity:  %.0f records, %.1f days at one record per minute for %d devices (one erase per sector per wrap)\n",
+         capacity, capacity / perDay, MAX_DEVICES);
+  halFlashDetach();
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Flash log (FlashLog <-> emulated SPI NOR) ===\n");
+  printf("%d-byte records, %d per %d-byte segment, %d-record RAM buffer\n\n", FLASH_LOG_SLOT_SIZE,
+         FLASH_LOG_SLOTS - 1, FLASH_LOG_SEGMENT_SIZE, AUDIT_LOG_BUFFER_RECORDS);
+  checkReboot();
+  checkRotation();
+  checkPowerCut();
+  checkCorruption(options.seed);
+  printf("\n");
+  benchmark(options);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+// Native check and benchmark of the packed history ring
+// (pio run -e native_history).
+//
+// Feeds HistoryBuffer (src/history_buffer.cpp) irregular readings until
+// it has wrapped several times and checks every retained sample against
+// the readings themselves: values within half a step of their fixed-point
+// resolution, timestamps exact, the same through Cursor and readBatch().
+// Gaps far past the 24-bit delta field (hours to weeks) must keep every
+// later timestamp exact, and seek() must agree with a scan.
+// Then reports bytes per sample and append/iterate throughput next to the
+// full-float DeviceReading array the ring replaced. Exits non-zero on any
+// failure.
+//
+//   .pio/build/native_history/program [--seed N]
+
+#include <Arduino.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "config.h"
+#include "device_data.h"
+#include "history_buffer.h"
+
+#define CHECK_BATCH 37  // Odd size so batches straddle the anchors
+
+struct CheckOptions {
+  uint32_t seed = 1;
+};
+
+// The ring's element before it was packed: a full-float DeviceReading
+// (28 bytes on the ESP32)
+struct FloatReading {
+  float voltage;
+  float current;
+  float power;
+  float energy;
+  float frequency;
+  float powerFactor;
+  uint32_t timestamp;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else {
+      fprintf(stderr, "usage: %s [--seed N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Readings every 0.5-8 s, now and then an hour's gap, across the PZEM's
+// ranges
+static std::vector<DeviceReading> makeReadings(std::mt19937& rng, int count, unsigned long start) {
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<DeviceReading> readings;
+  unsigned long now = start;
+  for (int i = 0; i < count; i++) {
+    now += unit(rng) < 0.002f ? 3600000UL + rng() % 600000UL : 500 + rng() % 7500;
+    DeviceReading r = {};
+    r.voltage = 200.0f + 60.0f * unit(rng);
+    r.current = unit(rng) < 0.1f ? 0.0f : 100.0f * unit(rng) * unit(rng);
+    r.powerFactor = unit(rng);
+    r.power = r.voltage * r.current * r.powerFactor;
+    r.timestamp = now;
+    readings.push_back(r);
+  }
+  return readings;
+}
+
+static bool matches(const DeviceReading& got, const DeviceReading& want) {
+  // Half a step of each stored resolution, plus float rounding
+  return got.timestamp == want.timestamp && fabs(got.voltage - want.voltage) <= 0.05f + 1e-4f &&
+         fabs(got.current - want.current) <= 0.0005f + 1e-5f && fabs(got.power - want.power) <= 0.05f + 1e-3f &&
+         fabs(got.powerFactor - want.powerFactor) <= 0.005f + 1e-5f;
+}
+
+static void checkRoundTrip(std::mt19937& rng) {
+  printf("Round trip through a wrapped ring:\n");
+  static HistoryBuffer history;
+  std::vector<DeviceReading> readings = makeReadings(rng, 3 * MAX_HISTORY_ENTRIES + 123, 10000);
+  for (const DeviceReading& r : readings) {
+    history.append(r);
+  }
+  expect(history.size() == MAX_HISTORY_ENTRIES, "ring is full");
+  expect(history.totalAppended() == readings.size(), "every append counted");
+  size_t first = readings.size() - MAX_HISTORY_ENTRIES;
+  expect(history.firstTimestamp() == readings[first].timestamp, "oldest timestamp follows eviction");
+  expect(history.lastTimestamp() == readings.back().timestamp, "newest timestamp");
+
+  // Cursor from the oldest
+  int cursorMatched = 0;
+  HistoryBuffer::Cursor cursor = history.cursor();
+  DeviceReading got;
+  for (size_t i = first; cursor.next(got); i++) {
+    cursorMatched += i < readings.size() && matches(got, readings[i]);
+  }
+  expect(cursorMatched == MAX_HISTORY_ENTRIES, "cursor returns every retained reading");
+
+  // readBatch in odd-sized batches
+  int batchMatched = 0;
+  HistoryReadState state;
+  DeviceReading batch[CHECK_BATCH];
+  size_t i = first;
+  int n;
+  while ((n = history.readBatch(state, batch, CHECK_BATCH)) > 0) {
+    for (int k = 0; k < n; k++, i++) {
+      batchMatched += i < readings.size() && matches(batch[k], readings[i]);
+    }
+  }
+  expect(batchMatched == MAX_HISTORY_ENTRIES, "readBatch returns every retained reading");
+
+  // Positioned reads agree with the scan
+  int positioned = 0;
+  for (int k = 0; k < 200; k++) {
+    uint32_t seq = history.firstSequence() + rng() % history.size();
+    HistoryReadState from = history.readFrom(seq, history.totalAppended());
+    positioned += history.readBatch(from, batch, 1) == 1 && matches(batch[0], readings[seq]);
+  }
+  expect(positioned == 200, "readFrom() starts at the right sample and time");
+  printf("  %d of %zu readings retained: cursor %d, readBatch %d, readFrom %d/200 match\n", history.size(),
+         readings.size(), cursorMatched, batchMatched, positioned);
+}
+
+static void checkLongGaps(std::mt19937& rng) {
+  printf("\nGaps past the 24-bit delta (%.1f h):\n", HistorySample::MAX_24BIT / 3600000.0);
+  const uint32_t gaps[] = {HistorySample::MAX_24BIT, HistorySample::MAX_24BIT + 1, 5 * 3600000UL, 2 * 86400000UL,
+                           30 * 86400000UL, 0x80000000UL, 0xFFFFFFFFUL};
+
+  // Every delta bit survives next to full-scale values
+  DeviceReading full = {};
+  full.voltage = 260.0f;
+  full.current = 100.0f;
+  full.power = 26000.0f;
+  full.powerFactor = 1.0f;
+  int exact = 0;
+  for (uint32_t gap : gaps) {
+    HistorySample sample = HistorySample::encode(full, gap);
+    DeviceReading back;
+    sample.decode(back, 0);
+    back.timestamp = full.timestamp;
+    exact += sample.deltaMs() == gap && matches(back, full);
+  }
+  expect(exact == 7, "delta and values both survive a full 32-bit delta");
+
+  // A ring whose readings straddle long silences (the audit clock keeps
+  // counting through them; a node may be off for days)
+  static HistoryBuffer history;
+  std::vector<DeviceReading> readings = makeReadings(rng, MAX_HISTORY_ENTRIES + 200, 5000);
+  unsigned long shift = 0;
+  for (size_t i = 0; i < readings.size(); i++) {
+    if (i % 97 == 50) {
+      shift += gaps[(i / 97) % 5 + 1];  // Past 24 bits, up to 30 days
+    }
+    readings[i].timestamp += shift;
+    history.append(readings[i]);
+  }
+  size_t first = readings.size() - history.size();
+  expect(history.firstTimestamp() == readings[first].timestamp, "oldest timestamp after a long gap is evicted");
+  expect(history.lastTimestamp() == readings.back().timestamp, "newest timestamp after long gaps");
+
+  int scanned = 0;
+  HistoryReadState state;
+  DeviceReading batch[CHECK_BATCH];
+  size_t i = first;
+  int n;
+  while ((n = history.readBatch(state, batch, CHECK_BATCH)) > 0) {
+    for (int k = 0; k < n; k++, i++) {
+      scanned += i < readings.size() && batch[k].timestamp == readings[i].timestamp;
+    }
+  }
+  expect(scanned == history.size(), "readBatch timestamps exact across long gaps");
+
+  // Positioned reads and seek() against the scan, at every sample
+  int positioned = 0, sought = 0;
+  for (uint32_t seq = history.firstSequence(); seq < history.totalAppended(); seq++) {
+    HistoryReadState from = history.readFrom(seq, history.totalAppended());
+    positioned += history.readBatch(from, batch, 1) == 1 && batch[0].timestamp == readings[seq].timestamp;
+    unsigned long t = readings[seq].timestamp;
+    sought += history.seek(t) == seq && history.seek(t - 1, true) == seq;
+  }
+  expect(positioned == history.size(), "readFrom() timestamps exact across long gaps");
+  expect(sought == history.size(), "seek() agrees with the scan across long gaps");
+  printf("  %d/7 full-scale deltas exact; %d samples: readBatch %d, readFrom %d, seek %d exact\n", exact,
+         history.size(), scanned, positioned, sought);
+}
+
+template <typename F>
+static double timeNanos(long repeats, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < repeats; i++) {
+    body(i);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / repeats;
+}
+
+static void benchmark(std::mt19937& rng) {
+  printf("\nFootprint and throughput (%d-sample ring):\n", MAX_HISTORY_ENTRIES);
+  std::vector<DeviceReading> readings = makeReadings(rng, 4096, 10000);
+  static HistoryBuffer history;
+  static FloatReading floats[MAX_HISTORY_ENTRIES];
+  volatile float sink = 0;
+
+  double perSample = (double)sizeof(HistoryBuffer) / MAX_HISTORY_ENTRIES;
+  printf("  bytes/sample: %zu packed (%.2f with ring state and anchors), %zu as floats\n", sizeof(HistorySample),
+         perSample, sizeof(FloatReading));
+  printf("  one ring: %zu bytes packed, %zu as floats (%.1fx the depth in the same RAM)\n", sizeof(HistoryBuffer),
+         sizeof(floats), sizeof(floats) / (double)sizeof(HistoryBuffer));
+
+  const long appends = 4000000;
+  double packedAppend = timeNanos(appends, [&](long i) {
+    DeviceReading r = readings[i & 4095];
+    r.timestamp = 10000 + (unsigned long)i * 2000;
+    history.append(r);
+  });
+  int head = 0;
+  double floatAppend = timeNanos(appends, [&](long i) {
+    const DeviceReading& r = readings[i & 4095];
+    floats[head] = FloatReading{r.voltage, r.current, r.power, r.energy, r.frequency, r.powerFactor,
+                                (uint32_t)(10000 + i * 2000)};
+    head = (head + 1) % MAX_HISTORY_ENTRIES;
+  });
+  printf("  append:  %6.1f ns/sample packed, %6.1f ns/sample as floats\n", packedAppend, floatAppend);
+
+  const long passes = 20000;
+  double cursorPass = timeNanos(passes, [&](long) {
+    HistoryBuffer::Cursor cursor = history.cursor();
+    DeviceReading r;
+    while (cursor.next(r)) {
+      sink = sink + r.power;
+    }
+  });
+  double batchPass = timeNanos(passes, [&](long) {
+    HistoryReadState state;
+    DeviceReading batch[32];
+    int n;
+    while ((n = history.readBatch(state, batch, 32)) > 0) {
+      sink = sink + batch[n - 1].power;
+    }
+  });
+  double floatPass = timeNanos(passes, [&](long) {
+    for (int k = 0; k < MAX_HISTORY_ENTRIES; k++) {
+      sink = sink + floats[(head + k) % MAX_HISTORY_ENTRIES].power;
+    }
+  });
+  printf("  iterate: %6.1f ns/sample by cursor, %6.1f by readBatch, %6.1f as floats\n",
+         cursorPass / MAX_HISTORY_ENTRIES, batchPass / MAX_HISTORY_ENTRIES, floatPass / MAX_HISTORY_ENTRIES);
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Packed history ring (HistoryBuffer) ===\n");
+  printf("%zu-byte samples, an anchor every %d samples\n\n", sizeof(HistorySample), HISTORY_ANCHOR_INTERVAL);
+  std::mt19937 rng(options.seed);
+  checkRoundTrip(rng);
+  checkLongGaps(rng);
+  benchmark(rng);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
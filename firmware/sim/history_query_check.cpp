@@ -0,0 +1,474 @@
+// Native check and benchmark of history queries (pio run -e native_query).
+//
+// Fills full history rings (wrapped several times, irregular intervals
+// and gaps) and checks the query engine (src/history_query.cpp) against a
+// naive scan of the same ring: timestamp search by anchors, pass-through
+// ranges, LTTB and min/max decimation against array implementations,
+// rollup tiers thinned to a budget, field selection and well-formed JSON,
+// also when the device leaves its registry slot mid-response.
+// Then measures query latency over full buffers next to the naive scan.
+// Exits non-zero on any failure.
+//
+//   .pio/build/native_query/program [--seed N]
+
+#include <Arduino.h>
+#include <chrono>
+#include <climits>
+#include <random>
+#include <string>
+#include <vector>
+#include "api_streams.h"
+#include "config.h"
+#include "device_registry.h"
+#include "history_query.h"
+#include "json_check.h"
+
+#define CHECK_QUERIES 2000
+
+struct CheckOptions {
+  uint32_t seed = 1;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else {
+      fprintf(stderr, "usage: %s [--seed N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Readings every 0.5-8 s with now and then a gap of up to an hour, the
+// way updateDeviceHistory feeds the ring and the rollups
+static void fill(HistoryBuffer& history, DeviceRollups& rollups, std::mt19937& rng, int samples) {
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  unsigned long now = history.isEmpty() ? 10000 : history.lastTimestamp();
+  float level = 60.0f;
+  for (int i = 0; i < samples; i++) {
+    now += unit(rng) < 0.003f ? 60000UL + rng() % 3540000UL : 500 + rng() % 7500;
+    if (unit(rng) < 0.02f) {
+      level = (float)(rng() % 2500);
+    }
+    DeviceReading reading = {};
+    reading.voltage = 228.0f + 4.0f * unit(rng);
+    reading.power = level * (0.9f + 0.2f * unit(rng));
+    reading.current = reading.power / reading.voltage;
+    reading.powerFactor = 0.5f + 0.5f * unit(rng);
+    reading.timestamp = now;
+    rollups.add(history.isEmpty() ? now : history.lastTimestamp(), now, reading.power);
+    history.append(reading);
+  }
+}
+
+// The naive scan: decode the whole ring from the oldest sample
+static std::vector<DeviceReading> scanAll(const HistoryBuffer& history) {
+  std::vector<DeviceReading> all;
+  HistoryBuffer::Cursor cursor = history.cursor();
+  DeviceReading reading;
+  while (cursor.next(reading)) {
+    all.push_back(reading);
+  }
+  return all;
+}
+
+static std::vector<HistoryPoint> run(const HistorySeries& series, const HistoryQuery& query) {
+  std::vector<HistoryPoint> points;
+  HistoryDecimator decimator(series, query);
+  HistoryPoint point;
+  while (decimator.next(point)) {
+    points.push_back(point);
+  }
+  return points;
+}
+
+// Reference LTTB over an array (Steinarsson's, integer bucket edges)
+static std::vector<size_t> lttb(const std::vector<DeviceReading>& data, size_t threshold) {
+  std::vector<size_t> chosen;
+  size_t n = data.size();
+  if (threshold >= n || threshold == 0) {
+    for (size_t i = 0; i < n && (threshold > 0 || i == 0); i++) {
+      chosen.push_back(i);
+    }
+    return chosen;
+  }
+  chosen.push_back(0);
+  if (threshold == 1) {
+    return chosen;
+  }
+  size_t buckets = threshold - 2;
+  size_t a = 0;
+  for (size_t i = 0; i < buckets; i++) {
+    size_t from = 1 + (n - 2) * i / buckets;
+    size_t to = 1 + (n - 2) * (i + 1) / buckets;
+    size_t nextFrom = i + 1 < buckets ? to : n - 1;
+    size_t nextTo = i + 1 < buckets ? 1 + (n - 2) * (i + 2) / buckets : n;
+    double meanTime = 0;
+    double meanPower = 0;
+    for (size_t k = nextFrom; k < nextTo; k++) {
+      meanTime += data[k].timestamp - data[a].timestamp;
+      meanPower += data[k].power;
+    }
+    meanTime /= nextTo - nextFrom;
+    meanPower /= nextTo - nextFrom;
+    double largest = -1;
+    size_t best = from;
+    for (size_t k = from; k < to; k++) {
+      double dt = (double)(data[k].timestamp - data[a].timestamp);
+      double area = fabs(dt * (meanPower - data[a].power) - meanTime * (data[k].power - data[a].power));
+      if (area > largest) {
+        largest = area;
+        best = k;
+      }
+    }
+    chosen.push_back(best);
+    a = best;
+  }
+  chosen.push_back(n - 1);
+  return chosen;
+}
+
+// Reference min/max: lowest and highest of each bucket, in time order
+static std::vector<size_t> minMax(const std::vector<DeviceReading>& data, size_t budget) {
+  std::vector<size_t> chosen;
+  size_t n = data.size();
+  size_t buckets = max(budget / 2, (size_t)1);
+  for (size_t i = 0; i < buckets; i++) {
+    size_t from = n * i / buckets;
+    size_t to = n * (i + 1) / buckets;
+    if (from == to) {
+      continue;
+    }
+    size_t lowest = from;
+    size_t highest = from;
+    for (size_t k = from; k < to; k++) {
+      if (data[k].power < data[lowest].power) lowest = k;
+      if (data[k].power > data[highest].power) highest = k;
+    }
+    if (budget < 2 || lowest == highest) {
+      chosen.push_back(highest);
+    } else {
+      chosen.push_back(min(lowest, highest));
+      chosen.push_back(max(lowest, highest));
+    }
+  }
+  return chosen;
+}
+
+static std::vector<DeviceReading> slice(const std::vector<DeviceReading>& all, unsigned long from, unsigned long to) {
+  std::vector<DeviceReading> range;
+  for (const DeviceReading& reading : all) {
+    if (reading.timestamp >= from && reading.timestamp <= to) {
+      range.push_back(reading);
+    }
+  }
+  return range;
+}
+
+static bool samePoints(const std::vector<HistoryPoint>& points, const std::vector<DeviceReading>& data,
+                       const std::vector<size_t>& chosen) {
+  if (points.size() != chosen.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < chosen.size(); i++) {
+    const DeviceReading& reading = data[chosen[i]];
+    if (points[i].timestamp != reading.timestamp || points[i].power != reading.power ||
+        points[i].voltage != reading.voltage || points[i].powerFactor != reading.powerFactor) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void checkSeek(const HistoryBuffer& history, const std::vector<DeviceReading>& all, std::mt19937& rng) {
+  printf("Seek: ");
+  uint32_t first = history.firstSequence();
+  unsigned long lo = all.front().timestamp - 5000;
+  unsigned long hi = all.back().timestamp + 5000;
+  int checked = 0;
+  for (int i = 0; i < CHECK_QUERIES; i++) {
+    // Exact sample times half of the time
+    unsigned long t = i % 2 ? all[rng() % all.size()].timestamp : lo + rng() % (hi - lo);
+    uint32_t lower = first;
+    while (lower - first < all.size() && all[lower - first].timestamp < t) lower++;
+    uint32_t upper = lower;
+    while (upper - first < all.size() && all[upper - first].timestamp <= t) upper++;
+    expect(history.seek(t) == lower, "seek matches a linear scan");
+    expect(history.seek(t, true) == upper, "seek past matches a linear scan");
+    checked++;
+  }
+
+  const uint32_t middle = MAX_HISTORY_ENTRIES / 2 + 17;  // Between anchors
+  HistoryReadState state = history.readFrom(first + middle, history.totalAppended());
+  DeviceReading reading;
+  expect(history.readBatch(state, &reading, 1) == 1 && reading.timestamp == all[middle].timestamp,
+         "reader positioned mid-ring decodes the right time");
+  printf("%d timestamps over %zu samples (sequences %lu..%lu)\n", checked, all.size(), (unsigned long)first,
+         (unsigned long)history.totalAppended());
+}
+
+static void checkRanges(const HistoryBuffer& history, const std::vector<DeviceReading>& all, std::mt19937& rng) {
+  printf("Ranges: ");
+  RawSeries series(history);
+  unsigned long lo = all.front().timestamp - 5000;
+  unsigned long hi = all.back().timestamp + 5000;
+  int lttbQueries = 0;
+  int minMaxQueries = 0;
+  for (int i = 0; i < CHECK_QUERIES / 4; i++) {
+    HistoryQuery query;
+    query.from = lo + rng() % (hi - lo);
+    query.to = query.from + rng() % (hi - query.from);
+    std::vector<DeviceReading> range = slice(all, query.from, query.to);
+
+    // Everything in range when it fits the budget
+    query.points = range.size() + rng() % 10;
+    std::vector<size_t> every;
+    for (size_t k = 0; k < range.size(); k++) {
+      every.push_back(k);
+    }
+    expect(samePoints(run(series, query), range, every), "range matches a naive scan");
+
+    // Thinned to a budget below the sample count
+    query.points = 1 + rng() % 300;
+    query.decimation = HISTORY_LTTB;
+    std::vector<HistoryPoint> points = run(series, query);
+    expect(samePoints(points, range, lttb(range, query.points)), "LTTB matches the array implementation");
+    expect(points.size() == min((size_t)query.points, range.size()), "LTTB returns exactly the budget");
+    lttbQueries += range.size() > query.points;
+
+    query.decimation = HISTORY_MINMAX;
+    points = run(series, query);
+    std::vector<size_t> reference = range.size() > query.points ? minMax(range, query.points) : every;
+    expect(samePoints(points, range, reference), "min/max matches the array implementation");
+    expect(points.size() <= max((uint32_t)2, query.points), "min/max stays within the budget");
+    minMaxQueries += range.size() > query.points;
+  }
+  printf("%d ranges, %d thinned by LTTB, %d by min/max\n", CHECK_QUERIES / 4, lttbQueries, minMaxQueries);
+}
+
+static void checkRollups(const DeviceRollups& rollups) {
+  printf("Rollups: ");
+  RollupSeries series(rollups, ROLLUP_HOUR);
+  HistoryQuery query;
+  query.tier = ROLLUP_HOUR;
+  query.from = 0;
+  query.to = ULONG_MAX;
+  query.points = 50;
+
+  std::vector<HistoryPoint> all;
+  RollupReadState state;
+  state.end = UINT64_MAX;
+  RollupPoint batch[HISTORY_QUERY_BATCH];
+  int n;
+  while ((n = rollups.readBatch(ROLLUP_HOUR, state, batch, HISTORY_QUERY_BATCH)) > 0) {
+    for (int i = 0; i < n; i++) {
+      HistoryPoint point = {};
+      point.timestamp = batch[i].timestamp;
+      point.power = batch[i].avgPower;
+      all.push_back(point);
+    }
+  }
+
+  std::vector<HistoryPoint> points = run(series, query);
+  expect(points.size() <= 50 && points.size() >= 45, "hourly tier thinned to the budget");
+  expect(!points.empty() && points.front().timestamp == all.front().timestamp &&
+         points.back().timestamp == all.back().timestamp, "first and last bucket kept");
+  query.decimation = HISTORY_MINMAX;
+  std::vector<HistoryPoint> peaks = run(series, query);
+  float highest = 0;
+  for (const HistoryPoint& point : peaks) {
+    highest = max(highest, point.maxPower);
+  }
+  float expected = 0;
+  RollupReadState again;
+  again.end = UINT64_MAX;
+  while ((n = rollups.readBatch(ROLLUP_HOUR, again, batch, HISTORY_QUERY_BATCH)) > 0) {
+    for (int i = 0; i < n; i++) {
+      expected = max(expected, batch[i].maxPower);
+    }
+  }
+  expect(highest == expected && peaks.size() <= 50, "min/max keeps the week's peak");
+  printf("%zu hourly buckets to %zu (LTTB) and %zu (min/max) points\n", all.size(), points.size(), peaks.size());
+}
+
+static std::string drain(JsonChunkSource& source) {
+  std::string body;
+  uint8_t buffer[1436];  // One TCP segment
+  size_t len;
+  while ((len = source.fill(buffer, sizeof(buffer))) > 0) {
+    body.append((const char*)buffer, len);
+  }
+  return body;
+}
+
+static void checkStream(const HistoryBuffer& history, const DeviceRollups& rollups) {
+  printf("Stream: ");
+  HistoryQuery query;
+  query.from = history.firstTimestamp();
+  query.to = history.lastTimestamp();
+  HistoryStream full(&history, &rollups, query);
+  std::string body = drain(full);
+  expect(isWellFormedJson(body), "full ring is well-formed JSON");
+  expect(body.find("\"powerFactor\"") != std::string::npos && body.find("\"energy\"") == std::string::npos,
+         "raw default fields");
+
+  query.points = 100;
+  query.fields = HistoryQuery::parseFields("power,bogus,voltage");
+  expect(query.fields == (HISTORY_FIELD_POWER | HISTORY_FIELD_VOLTAGE), "field list parsed");
+  HistoryStream thin(&history, &rollups, query);
+  std::string thinBody = drain(thin);
+  size_t count = 0;
+  for (size_t at = thinBody.find("timestamp"); at != std::string::npos; at = thinBody.find("timestamp", at + 1)) {
+    count++;
+  }
+  expect(isWellFormedJson(thinBody) && count == 100, "100 points");
+  expect(thinBody.find("\"current\"") == std::string::npos && thinBody.find("\"voltage\"") != std::string::npos,
+         "only the requested fields");
+
+  query.tier = ROLLUP_QUARTER;
+  query.fields = 0;
+  HistoryStream quarter(&history, &rollups, query);
+  std::string quarterBody = drain(quarter);
+  expect(isWellFormedJson(quarterBody) && quarterBody.find("\"minPower\"") != std::string::npos, "rollup fields");
+
+  HistoryStream missing(nullptr, nullptr, query);
+  expect(drain(missing) == "{\"error\":\"Device not found\"}", "unknown device");
+
+  // The device is removed and its slot reused after the first segment:
+  // the response stops there and stays well-formed
+  static DeviceRegistry registry;
+  DeviceHandle slot = registry.insert("GONE");
+  HistoryQuery raw;
+  raw.from = history.firstTimestamp();
+  raw.to = history.lastTimestamp();
+  HistoryStream moved(&history, &rollups, raw, DeviceSlot(registry, slot, registry.generation(slot)));
+  uint8_t segment[1436];
+  std::string movedBody((const char*)segment, moved.fill(segment, sizeof(segment)));
+  registry.remove(slot);
+  expect(registry.insert("TAKES_THE_SLOT") == slot, "slot reused");
+  movedBody += drain(moved);
+  expect(isWellFormedJson(movedBody) && movedBody.size() < 2 * sizeof(segment), "stream ends when the slot is reused");
+  printf("%zu bytes for the full ring, %zu for 100 points of power and voltage\n", body.size(), thinBody.size());
+}
+
+template <typename F>
+static double timeMicros(int repeats, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    body();
+  }
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repeats;
+}
+
+static void benchmark(const HistoryBuffer& history, const DeviceRollups& rollups, std::mt19937& rng) {
+  // Full ring: MAX_HISTORY_ENTRIES samples
+  volatile uint32_t sink = 0;
+  unsigned long lo = history.firstTimestamp();
+  unsigned long span = history.lastTimestamp() - lo;
+  std::vector<unsigned long> targets;
+  for (int i = 0; i < 1024; i++) {
+    targets.push_back(lo + rng() % span);
+  }
+
+  int next = 0;
+  double seek = timeMicros(100000, [&]() { sink += history.seek(targets[next++ & 1023]); });
+  next = 0;
+  double linear = timeMicros(2000, [&]() {
+    // What a search costs without anchors: decode deltas from the oldest
+    unsigned long t = history.firstTimestamp();
+    unsigned long target = targets[next++ & 1023];
+    uint32_t seq = history.firstSequence();
+    while (seq + 1 < history.totalAppended() && t < target) {
+      t += history.bySequence(++seq).deltaMs();
+    }
+    sink += seq;
+  });
+  printf("Seek:        %.3f us by anchors, %.3f us by linear scan (%d samples)\n", seek, linear, history.size());
+
+  RawSeries series(history);
+  HistoryQuery query;
+  query.from = lo;
+  query.to = history.lastTimestamp();
+  double scan = timeMicros(2000, [&]() { sink += scanAll(history).size(); });
+  double all = timeMicros(2000, [&]() { sink += run(series, query).size(); });
+  query.points = 200;
+  double thinned = timeMicros(2000, [&]() { sink += run(series, query).size(); });
+  query.decimation = HISTORY_MINMAX;
+  double peaks = timeMicros(2000, [&]() { sink += run(series, query).size(); });
+  query.decimation = HISTORY_LTTB;
+  query.from = lo + span / 2;
+  query.to = query.from + span / 10;
+  query.points = 50;
+  double narrow = timeMicros(20000, [&]() { sink += run(series, query).size(); });
+  printf("Raw query:   %.1f us naive full scan, %.1f us full range, %.1f us LTTB to 200, %.1f us min/max to 200\n",
+         scan, all, thinned, peaks);
+  printf("             %.1f us for a tenth of the range (search + %d samples)\n", narrow,
+         (int)run(series, query).size());
+
+  query = HistoryQuery();
+  query.from = lo;
+  query.to = history.lastTimestamp();
+  double json = timeMicros(500, [&]() {
+    HistoryStream stream(&history, &rollups, query);
+    sink += drain(stream).size();
+  });
+  query.points = 200;
+  double jsonThin = timeMicros(500, [&]() {
+    HistoryStream stream(&history, &rollups, query);
+    sink += drain(stream).size();
+  });
+  RollupSeries hours(rollups, ROLLUP_HOUR);
+  HistoryQuery week;
+  week.tier = ROLLUP_HOUR;
+  week.to = ULONG_MAX;
+  week.points = 50;
+  double rollup = timeMicros(2000, [&]() { sink += run(hours, week).size(); });
+  printf("JSON:        %.1f us whole ring, %.1f us LTTB to 200; week of hourly buckets to 50: %.1f us\n", json,
+         jsonThin, rollup);
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  std::mt19937 rng(options.seed);
+
+  printf("=== History queries (HistoryDecimator <-> naive scan) ===\n");
+  printf("%d-sample ring, an anchor every %d samples (%zu bytes)\n\n", MAX_HISTORY_ENTRIES,
+         HISTORY_ANCHOR_INTERVAL, sizeof(unsigned long) * HISTORY_ANCHORS);
+
+  static HistoryBuffer history;
+  static DeviceRollups rollups;
+  fill(history, rollups, rng, 3 * MAX_HISTORY_ENTRIES + 321);
+  std::vector<DeviceReading> all = scanAll(history);
+  expect(all.size() == MAX_HISTORY_ENTRIES, "ring is full");
+
+  checkSeek(history, all, rng);
+  checkRanges(history, all, rng);
+
+  // A week behind the raw ring for the rollup tiers
+  fill(history, rollups, rng, 8 * 24 * 3600 / 4);
+  all = scanAll(history);
+  checkSeek(history, all, rng);
+  checkRollups(rollups);
+  checkStream(history, rollups);
+  printf("\n");
+  benchmark(history, rollups, rng);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
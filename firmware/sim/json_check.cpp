@@ -0,0 +1,108 @@
+#include "json_check.h"
+#include <ctype.h>
+#include <string.h>
+
+// Recursive descent over the text; no allocation
+class JsonChecker {
+private:
+  const char* p;
+  const char* end;
+  int depth;
+  
+  void skipSpace() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+  }
+  
+  bool literal(const char* word) {
+    size_t len = strlen(word);
+    if ((size_t)(end - p) < len || strncmp(p, word, len) != 0) return false;
+    p += len;
+    return true;
+  }
+  
+  bool string() {
+    if (p >= end || *p != '"') return false;
+    for (p++; p < end; p++) {
+      unsigned char c = *p;
+      if (c == '"') { p++; return true; }
+      if (c < 0x20) return false;
+      if (c == '\\') {
+        if (++p >= end) return false;
+        if (*p == 'u') {
+          for (int i = 0; i < 4; i++) {
+            if (++p >= end || !isxdigit((unsigned char)*p)) return false;
+          }
+        } else if (!strchr("\"\\/bfnrt", *p)) {
+          return false;
+        }
+      }
+    }
+    return false;
+  }
+  
+  bool digits() {
+    const char* start = p;
+    while (p < end && isdigit((unsigned char)*p)) p++;
+    return p > start;
+  }
+  
+  bool number() {
+    if (p < end && *p == '-') p++;
+    if (p < end && *p == '0') p++;
+    else if (!digits()) return false;
+    if (p < end && *p == '.') { p++; if (!digits()) return false; }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      p++;
+      if (p < end && (*p == '+' || *p == '-')) p++;
+      if (!digits()) return false;
+    }
+    return true;
+  }
+  
+  bool container(char close, bool object) {
+    if (++depth > 64) return false;
+    p++;
+    skipSpace();
+    if (p < end && *p == close) { p++; depth--; return true; }
+    for (;;) {
+      skipSpace();
+      if (object) {
+        if (!string()) return false;
+        skipSpace();
+        if (p >= end || *p++ != ':') return false;
+      }
+      if (!value()) return false;
+      skipSpace();
+      if (p < end && *p == ',') { p++; continue; }
+      if (p < end && *p == close) { p++; depth--; return true; }
+      return false;
+    }
+  }
+  
+public:
+  JsonChecker(const std::string& text) : p(text.data()), end(text.data() + text.size()), depth(0) {}
+  
+  bool value() {
+    skipSpace();
+    if (p >= end) return false;
+    switch (*p) {
+      case '{': return container('}', true);
+      case '[': return container(']', false);
+      case '"': return string();
+      case 't': return literal("true");
+      case 'f': return literal("false");
+      case 'n': return literal("null");
+      default: return number();
+    }
+  }
+  
+  bool atEnd() {
+    skipSpace();
+    return p == end;
+  }
+};
+
+bool isWellFormedJson(const std::string& text) {
+  JsonChecker checker(text);
+  return checker.value() && checker.atEnd();
+}
@@ -0,0 +1,10 @@
+#ifndef JSON_CHECK_H
+#define JSON_CHECK_H
+
+#include <string>
+
+// Strict RFC 8259 syntax check, used to validate streamed API output.
+// Returns true if text is exactly one well-formed JSON value.
+bool isWellFormedJson(const std::string& text);
+
+#endif
@@ -0,0 +1,473 @@
+// Native check of the streamed JSON against ArduinoJson
+// (pio run -e native_json).
+//
+// Builds the same values into an ArduinoJson 6 document (the library the
+// streamed responses replaced, from lib_deps) and compares its
+// serializeJson() output byte for byte with JsonText (src/json_stream.cpp):
+// integers, floats and doubles across their range and at the rounding and
+// exponent edges, every byte value inside a string, and UTF-8. Then
+// publishes device tables with hostile names (quotes, backslashes, control
+// characters, UTF-8, full length) and extreme readings, and reads
+// DeviceListStream (src/api_streams.cpp) through fill() in pieces of 1 to
+// 7 bytes and of every fixed size, so chunk boundaries land inside keys,
+// escapes and numbers; the joined text must equal the document built the
+// way getAllDevicesJSON() built it. Devices added and removed in lower
+// slots between chunks must neither repeat nor drop another device.
+// Exits non-zero on any failure.
+//
+//   .pio/build/native_json/program [--seed N] [--values N]
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "api_streams.h"
+#include "config.h"
+#include "device_registry.h"
+#include "device_snapshot.h"
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  int values = 200000;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--values") && hasValue) options.values = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--values N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename TDocument>
+static std::string serialized(const TDocument& doc) {
+  std::vector<char> text(measureJson(doc) + 1);
+  size_t len = serializeJson(doc, text.data(), text.size());
+  return std::string(text.data(), len);
+}
+
+// Print where two texts first differ
+static void showDifference(const std::string& streamed, const std::string& expected, const char* what) {
+  size_t at = 0;
+  while (at < streamed.size() && at < expected.size() && streamed[at] == expected[at]) {
+    at++;
+  }
+  size_t from = at > 40 ? at - 40 : 0;
+  printf("  %s differs at byte %zu:\n    streamed:    ...%s\n    ArduinoJson: ...%s\n", what, at,
+         streamed.substr(from, 80).c_str(), expected.substr(from, 80).c_str());
+}
+
+static bool same(const std::string& streamed, const std::string& expected, const char* what) {
+  if (streamed != expected) {
+    showDifference(streamed, expected, what);
+    return false;
+  }
+  return true;
+}
+
+// One value per element, in a JSON array both ways
+template <typename T, typename F>
+static bool checkValues(const std::vector<T>& values, F write, const char* what) {
+  DynamicJsonDocument doc(64 + values.size() * 48);
+  JsonArray array = doc.to<JsonArray>();
+  for (const T& value : values) {
+    array.add(value);
+  }
+  expect(!doc.overflowed(), "reference document fits");
+  std::vector<char> buffer(16 + values.size() * 128);
+  JsonText out(buffer.data(), buffer.size());
+  out.raw('[');
+  for (size_t i = 0; i < values.size(); i++) {
+    if (i > 0) {
+      out.raw(',');
+    }
+    write(out, values[i]);
+  }
+  out.raw(']');
+  return !out.overflow() && same(std::string(buffer.data(), out.length()), serialized(doc), what);
+}
+
+static void checkNumbers(const CheckOptions& options) {
+  printf("Numbers (%d random values per kind, seed %u):\n", options.values, options.seed);
+  std::mt19937 rng(options.seed);
+
+  std::vector<unsigned long> integers = {0, 1, 9, 10, 99, 100, 65535, 65536, 4294967295UL};
+  for (int i = 0; i < options.values; i++) {
+    integers.push_back(rng() >> (rng() % 32));
+  }
+  expect(checkValues(integers, [](JsonText& out, unsigned long v) { out.number(v); }, "integers"),
+         "unsigned integers match");
+
+  // Edges: the 1e7 and 1e-5 exponent thresholds, rounding carries into the
+  // integral part and the exponent, 9-digit integral parts, tiny and huge
+  std::vector<double> doubles = {0.0, -0.0, 1.0, -1.0, 0.1, 0.5, 1.5, 9.9999999995, 9.99999999949, 99.9999999995,
+                                 0.00001, 0.0000099999, 0.000010001, 9999999.0, 9999999.5, 10000000.0, 123456789.0,
+                                 999999999.5, 4294967295.0, 4294967296.0, 1e9, 1.5e15, 1e-300, 2.2250738585072014e-308,
+                                 1.7976931348623157e308, 4.9e-324, 0.1 + 0.2, 230.1, 49.99, 1e16, 1e32, 1e-32, NAN,
+                                 INFINITY, -INFINITY};
+  std::vector<float> floats = {0.0f, 0.1f, 230.1f, 49.99f, 0.95f, 1e7f, 9999999.0f, 1e-5f, 3.4028235e38f,
+                               1.17549435e-38f, 1.4e-45f, -0.001f, 16777216.0f, NAN, INFINITY};
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  for (int i = 0; i < options.values; i++) {
+    // Uniform over the exponent so every magnitude is covered
+    double magnitude = std::pow(10.0, unit(rng) * 80.0 - 40.0);
+    doubles.push_back((rng() & 1 ? -1 : 1) * magnitude * unit(rng));
+    uint32_t bits = rng();
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    floats.push_back(f);  // Any bit pattern, NaN and infinities included
+    floats.push_back((float)(unit(rng) * 5000.0));  // Readings as the devices report them
+  }
+  expect(checkValues(doubles, [](JsonText& out, double v) { out.number(v); }, "doubles"), "doubles match");
+  // Floats are widened to double on both sides, as writeDevice() does
+  expect(checkValues(floats, [](JsonText& out, float v) { out.number(v); }, "floats"), "floats match");
+  printf("  %zu integers, %zu doubles, %zu floats compared\n", integers.size(), doubles.size(), floats.size());
+}
+
+static void checkStrings(const CheckOptions& options) {
+  printf("\nStrings:\n");
+  std::vector<std::string> texts = {"", "plain", "\"", "\\", "/", "\"quoted\"", "back\\slash", "tab\there",
+                                    "line\nbreak\r\n", "\b\f", "caf\xC3\xA9 \xE2\x9A\xA1 \xF0\x9F\x94\x8C"};
+  // Every byte value alone and between other text
+  for (int c = 1; c < 256; c++) {
+    texts.push_back(std::string(1, (char)c));
+    texts.push_back("a" + std::string(1, (char)c) + "\"b\\" + std::string(1, (char)c));
+  }
+  std::mt19937 rng(options.seed);
+  for (int i = 0; i < 2000; i++) {
+    std::string text;
+    int len = rng() % (DEVICE_NAME_MAX - 1);
+    for (int j = 0; j < len; j++) {
+      text += (char)(1 + rng() % 255);
+    }
+    texts.push_back(text);
+  }
+
+  // As values and as keys
+  std::vector<const char*> values;
+  for (const std::string& text : texts) {
+    values.push_back(text.c_str());
+  }
+  expect(checkValues(values, [](JsonText& out, const char* v) { out.string(v); }, "strings"), "strings match");
+
+  DynamicJsonDocument doc(texts.size() * 96);
+  std::vector<char> buffer(texts.size() * 256);
+  JsonText out(buffer.data(), buffer.size());
+  out.raw('{');
+  bool firstKey = true;
+  for (size_t i = 0; i < texts.size(); i++) {
+    if (doc.containsKey(texts[i].c_str())) {
+      continue;  // ArduinoJson keeps one member per key
+    }
+    doc[texts[i].c_str()] = (unsigned long)i;
+    if (!firstKey) {
+      out.raw(',');
+    }
+    firstKey = false;
+    out.key(texts[i].c_str());
+    out.number((unsigned long)i);
+  }
+  out.raw('}');
+  expect(!doc.overflowed(), "reference document fits");
+  expect(!out.overflow() && same(std::string(buffer.data(), out.length()), serialized(doc), "keys"), "keys match");
+  printf("  %zu strings (every byte value, escapes, UTF-8, random) as values and keys\n", texts.size());
+}
+
+// A name of `len` characters drawn from the ones that need escaping
+static void hostileName(char* out, size_t size, size_t len, std::mt19937& rng) {
+  static const char pool[] = "\"\\/\b\f\n\r\t\x01\x1F\x7F" "a\xC3\xA9";
+  len = min(len, size - 1);
+  for (size_t i = 0; i < len; i++) {
+    out[i] = pool[rng() % (sizeof(pool) - 1)];
+  }
+  out[len] = '\0';
+}
+
+static float anyFloat(std::mt19937& rng) {
+  static const float edges[] = {0.0f, 0.1f, 230.1f, 9999999.5f, 1e-5f, 3.4028235e38f, 1.4e-45f, NAN, INFINITY};
+  if (rng() % 3 == 0) {
+    return edges[rng() % (sizeof(edges) / sizeof(edges[0]))];
+  }
+  return (float)(std::uniform_real_distribution<double>(-1e4, 1e4)(rng));
+}
+
+static void fillDevice(DeviceSnapshot& d, int i, std::mt19937& rng, bool worst) {
+  d = DeviceSnapshot();
+  d.handle = i;
+  // Worst case: every name character doubled by escaping, full length
+  hostileName(d.id, sizeof(d.id), worst ? DEVICE_ID_MAX : rng() % DEVICE_ID_MAX, rng);
+  hostileName(d.name, sizeof(d.name), worst ? DEVICE_NAME_MAX : rng() % DEVICE_NAME_MAX, rng);
+  // No custom name a third of the time, so displayName falls back to name
+  hostileName(d.customName, sizeof(d.customName), worst ? DEVICE_NAME_MAX : rng() % 3 * DEVICE_NAME_MAX / 2, rng);
+  hostileName(d.type, sizeof(d.type), worst ? DEVICE_TYPE_MAX : rng() % DEVICE_TYPE_MAX, rng);
+  if (worst) {
+    for (char* s : {d.id, d.name, d.customName, d.type}) {
+      memset(s, '"', strlen(s));
+    }
+  }
+  d.idHash = DeviceRegistry::hashId(d.id);
+  d.isActive = rng() & 1;
+  d.lastSeen = worst ? 4294967295UL : rng();
+  d.standbyWaste = rng() & 1;
+  d.usageAnomaly = rng() & 1;
+  d.efficiencyIssue = rng() & 1;
+  float* floats[] = {&d.totalEnergy, &d.avgPower, &d.maxPower, &d.energy.hourEnergy, &d.energy.hourCost,
+                     &d.energy.todayEnergy, &d.energy.todayCost, &d.windowAvgPower, &d.windowMinPower,
+                     &d.windowMaxPower, &d.windowStdDevPower, &d.windowEnergy, &d.currentReading.voltage,
+                     &d.currentReading.current, &d.currentReading.power, &d.currentReading.energy,
+                     &d.currentReading.frequency, &d.currentReading.powerFactor,
+                     &d.currentReading.harmonics.fundamental, &d.currentReading.harmonics.orders[0],
+                     &d.currentReading.harmonics.orders[1], &d.currentReading.harmonics.orders[2],
+                     &d.currentReading.harmonics.thd, &d.link.lossRate};
+  for (float* f : floats) {
+    // Longest text a float can take: 9 digits then an exponent
+    *f = worst ? -1.23456789e-38f : anyFloat(rng);
+  }
+  d.energy.method = (EnergyMethod)(rng() % 4);
+  d.energy.gaps = worst ? 4294967295UL : rng() % 100;
+  d.energy.counterResets = worst ? 4294967295UL : rng() % 3;
+  d.energy.counterRollovers = worst ? 4294967295UL : rng() % 3;
+  d.energy.counterGlitches = worst ? 4294967295UL : rng() % 3;
+  d.windowSeconds = worst ? 4294967295UL : 60 * (1 + rng() % 60);
+  d.windowSamples = worst ? 65535 : rng() % STATS_WINDOW_MAX_SAMPLES;
+  d.currentReading.timestamp = worst ? 4294967295UL : rng();
+  d.currentReading.harmonics.valid = worst || rng() % 2;
+  d.link.valid = worst || rng() % 2;
+  d.link.rssi = worst ? -128 : -(int8_t)(rng() % 100);
+  d.link.lastSequence = worst ? 65535 : rng();
+  uint32_t* counters[] = {&d.link.frames, &d.link.framesLost, &d.link.samples, &d.link.samplesMissed,
+                          &d.link.duplicates, &d.link.restarts};
+  for (uint32_t* c : counters) {
+    *c = worst ? 4294967295UL : rng() % 100000;
+  }
+  d.link.frameInterval = worst ? 4294967295UL : 500 + rng() % 5000;
+}
+
+// The device list as getAllDevicesJSON() built it, with the fields added
+// since
+static std::string documentOf(const DeviceTableSnapshot& table) {
+  DynamicJsonDocument doc(65536);
+  JsonArray devicesArray = doc.to<JsonArray>();
+
+  for (uint16_t i = 0; i < table.count; i++) {
+    const DeviceSnapshot& d = table.devices[i];
+    JsonObject device = devicesArray.createNestedObject();
+    device["id"] = d.id;
+    device["name"] = d.name;
+    device["customName"] = d.customName;
+    device["displayName"] = d.getDisplayName();
+    device["type"] = d.type;
+    device["isActive"] = d.isActive;
+    device["lastSeen"] = d.lastSeen;
+    device["standbyWaste"] = d.standbyWaste;
+    device["usageAnomaly"] = d.usageAnomaly;
+    device["efficiencyIssue"] = d.efficiencyIssue;
+    device["totalEnergy"] = d.totalEnergy;
+    device["avgPower"] = d.avgPower;
+    device["maxPower"] = d.maxPower;
+
+    JsonObject energy = device.createNestedObject("energy");
+    energy["method"] = EnergyAccount::methodName(d.energy.method);
+    energy["hour"] = d.energy.hourEnergy;
+    energy["hourCost"] = d.energy.hourCost;
+    energy["today"] = d.energy.todayEnergy;
+    energy["todayCost"] = d.energy.todayCost;
+    energy["gaps"] = d.energy.gaps;
+    energy["counterResets"] = d.energy.counterResets;
+    energy["counterRollovers"] = d.energy.counterRollovers;
+    energy["counterGlitches"] = d.energy.counterGlitches;
+
+    JsonObject window = device.createNestedObject("window");
+    window["seconds"] = d.windowSeconds;
+    window["samples"] = d.windowSamples;
+    window["avgPower"] = d.windowAvgPower;
+    window["minPower"] = d.windowMinPower;
+    window["maxPower"] = d.windowMaxPower;
+    window["stdDevPower"] = d.windowStdDevPower;
+    window["energy"] = d.windowEnergy;
+
+    JsonObject reading = device.createNestedObject("currentReading");
+    reading["voltage"] = d.currentReading.voltage;
+    reading["current"] = d.currentReading.current;
+    reading["power"] = d.currentReading.power;
+    reading["energy"] = d.currentReading.energy;
+    reading["frequency"] = d.currentReading.frequency;
+    reading["powerFactor"] = d.currentReading.powerFactor;
+    reading["timestamp"] = d.currentReading.timestamp;
+
+    const HarmonicReading& harmonics = d.currentReading.harmonics;
+    if (harmonics.valid) {
+      JsonObject h = device.createNestedObject("harmonics");
+      h["fundamental"] = harmonics.fundamental;
+      h["h3"] = harmonics.orders[0];
+      h["h5"] = harmonics.orders[1];
+      h["h7"] = harmonics.orders[2];
+      h["thd"] = harmonics.thd;
+    } else {
+      device["harmonics"] = (char*)0;
+    }
+
+    if (d.link.valid) {
+      JsonObject link = device.createNestedObject("link");
+      link["rssi"] = d.link.rssi;
+      link["lastSequence"] = d.link.lastSequence;
+      link["lossRate"] = d.link.lossRate;
+      link["frames"] = d.link.frames;
+      link["framesLost"] = d.link.framesLost;
+      link["samples"] = d.link.samples;
+      link["samplesMissed"] = d.link.samplesMissed;
+      link["duplicates"] = d.link.duplicates;
+      link["restarts"] = d.link.restarts;
+      link["intervalMs"] = d.link.frameInterval;
+    } else {
+      device["link"] = (char*)0;
+    }
+  }
+  expect(!doc.overflowed(), "reference document fits");
+  return serialized(doc);
+}
+
+// Read a whole stream through fill() in pieces of `pieceSize` bytes, or of
+// 1 to 7 bytes at random when it is 0
+static std::string drain(JsonChunkSource& source, size_t pieceSize, std::mt19937& rng) {
+  std::string text;
+  uint8_t piece[64];
+  for (;;) {
+    size_t want = pieceSize ? pieceSize : 1 + rng() % 7;
+    size_t n = source.fill(piece, want);
+    if (n == 0) {
+      return text;
+    }
+    if (n > want) {
+      text += "<fill() overran its buffer>";
+      return text;
+    }
+    text.append((const char*)piece, n);
+  }
+}
+
+static void checkDeviceList(const CheckOptions& options) {
+  printf("\nDevice list (DeviceListStream, seed %u):\n", options.seed);
+  static SnapshotPublisher publisher;
+  std::mt19937 rng(options.seed);
+
+  // The longest record a device can take must fit the staging buffer
+  DeviceSnapshot worst;
+  fillDevice(worst, 0, rng, true);
+  char record[4 * JSON_STREAM_RECORD_MAX];
+  JsonText measured(record, sizeof(record));
+  DeviceListStream::writeDevice(measured, worst);
+  // With its leading ',' and the byte JsonText keeps free
+  printf("  longest device record %zu bytes (staging %d)\n", measured.length(), JSON_STREAM_RECORD_MAX);
+  expect(measured.length() + 2 <= JSON_STREAM_RECORD_MAX, "longest device record fits the staging buffer");
+
+  int tables = 0, reads = 0, mismatched = 0;
+  for (int round = 0; round < 40; round++) {
+    DeviceTableSnapshot* table = publisher.beginWrite();
+    table->count = round == 0 ? 0 : 1 + rng() % MAX_DEVICES;
+    for (uint16_t i = 0; i < table->count; i++) {
+      fillDevice(table->devices[i], i, rng, round == 1 || (round == 2 && i % 2));
+    }
+    publisher.publish();
+    tables++;
+
+    std::string expected;
+    {
+      SnapshotReader snapshot(publisher);
+      expected = documentOf(*snapshot);
+    }
+    // Random pieces several times, then every fixed size up to past a record
+    std::vector<size_t> sizes = {0, 0, 0, 0, 64};
+    for (size_t size = 1; size <= 13; size++) {
+      sizes.push_back(size);
+    }
+    for (size_t size : sizes) {
+      DeviceListStream stream(publisher);
+      std::string streamed = drain(stream, size, rng);
+      reads++;
+      if (streamed != expected && mismatched++ == 0) {
+        showDifference(streamed, expected, "device list");
+        printf("  (table %d, %s pieces)\n", round, size ? "fixed" : "random");
+      }
+    }
+  }
+  expect(mismatched == 0, "streamed device list matches ArduinoJson in any piece size");
+  printf("  %d tables (empty, worst case, random) read %d times: %d mismatched\n", tables, reads, mismatched);
+}
+
+// A table of the devices in these slots; a slot's device is the same in
+// every table
+static void fillTable(DeviceTableSnapshot& table, const std::vector<int>& handles) {
+  table.count = handles.size();
+  for (uint16_t i = 0; i < table.count; i++) {
+    std::mt19937 rng(handles[i]);
+    fillDevice(table.devices[i], handles[i], rng, false);
+  }
+}
+
+static void checkListChanges() {
+  // Slots 0 and 2 are written, then 0 and 2 leave and 1 and 8 arrive
+  // before the next chunk: 4 and 6 still follow once each, then 8
+  static SnapshotPublisher publisher;
+  fillTable(*publisher.beginWrite(), {0, 2, 4, 6});
+  publisher.publish();
+
+  // Up to the end of the second device
+  static DeviceTableSnapshot firstTwo;
+  fillTable(firstTwo, {0, 2});
+  size_t prefix = documentOf(firstTwo).size() - 1;
+  DeviceListStream stream(publisher);
+  std::string streamed;
+  uint8_t byte;
+  while (streamed.size() < prefix && stream.fill(&byte, 1) == 1) {
+    streamed += (char)byte;
+  }
+  fillTable(*publisher.beginWrite(), {1, 4, 6, 8});
+  publisher.publish();
+  std::mt19937 rng(1);
+  streamed += drain(stream, 7, rng);
+
+  static DeviceTableSnapshot expected;
+  fillTable(expected, {0, 2, 4, 6, 8});
+  bool same = streamed == documentOf(expected);
+  if (!same) {
+    showDifference(streamed, documentOf(expected), "changing device list");
+  }
+  expect(same, "devices added and removed mid-response neither repeat nor drop another");
+  printf("  slots changed between chunks: %s\n", same ? "each device once, in slot order" : "mismatch");
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Streamed JSON (JsonText, DeviceListStream) against ArduinoJson ===\n\n");
+  checkNumbers(options);
+  checkStrings(options);
+  checkDeviceList(options);
+  checkListChanges();
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
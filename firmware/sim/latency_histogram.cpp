@@ -0,0 +1,50 @@
+#include "latency_histogram.h"
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram() : total(0), maxValue(0), sum(0) {
+  memset(counts, 0, sizeof(counts));
+}
+
+int LatencyHistogram::bucketOf(uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return (int)value;  // Exact below 8 us
+  }
+  int msb = 63 - __builtin_clzll(value);
+  int sub = (int)((value >> (msb - 3)) & (SUB_BUCKETS - 1));
+  int bucket = (msb - 2) * SUB_BUCKETS + sub;
+  return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::upperBound(int bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  int msb = bucket / SUB_BUCKETS + 2;
+  uint64_t sub = bucket % SUB_BUCKETS;
+  return ((SUB_BUCKETS + sub + 1) << (msb - 3)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+  counts[bucketOf(micros)]++;
+  total++;
+  sum += micros;
+  if (micros > maxValue) {
+    maxValue = micros;
+  }
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+  if (!total) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p / 100.0 * (total - 1)) + 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      uint64_t bound = upperBound(i);
+      return bound < maxValue ? bound : maxValue;
+    }
+  }
+  return maxValue;
+}
@@ -0,0 +1,32 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear histogram of microsecond latencies: 8 sub-buckets per power
+// of two, so percentiles are within 12.5% with no allocation while
+// recording
+class LatencyHistogram {
+private:
+  static const int SUB_BUCKETS = 8;
+  static const int BUCKETS = 32 * SUB_BUCKETS;
+  
+  uint64_t counts[BUCKETS];
+  uint64_t total;
+  uint64_t maxValue;
+  double sum;
+  
+  static int bucketOf(uint64_t value);
+  static uint64_t upperBound(int bucket);
+  
+public:
+  LatencyHistogram();
+  
+  void record(uint64_t micros);
+  uint64_t count() const { return total; }
+  uint64_t maximum() const { return maxValue; }
+  double mean() const { return total ? sum / total : 0; }
+  uint64_t percentile(double p) const;  // p in [0, 100]; bucket upper bound
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "load_model.h"
+
+static uint32_t xorshift(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+LoadModel::LoadModel(const LoadProfile& loadProfile, uint32_t seed)
+  : profile(loadProfile), rng(seed ? seed : 0x9E3779B9) {
+  phaseMs = profile.periodMs ? xorshift(rng) % profile.periodMs : 0;
+}
+
+float LoadModel::random() {
+  return (xorshift(rng) >> 8) / 16777216.0f;
+}
+
+LoadSample LoadModel::sample(unsigned long now) {
+  bool running = true;
+  if (profile.periodMs) {
+    unsigned long position = (now + phaseMs) % profile.periodMs;
+    running = position < profile.dutyCycle * profile.periodMs;
+  }
+  
+  LoadSample s;
+  float jitter = 1.0f + profile.noise * (2.0f * random() - 1.0f);
+  // Mains drifts slowly around nominal
+  s.voltage = 230.0f + 3.0f * sinf(now / 600000.0f) + (random() - 0.5f);
+  s.frequency = 50.0f + 0.05f * sinf(now / 90000.0f);
+  s.power = max(0.0f, (running ? profile.onPower : profile.standbyPower) * jitter);
+  s.powerFactor = running ? profile.powerFactor : profile.standbyPowerFactor;
+  s.thd = running ? profile.thd : profile.standbyThd;
+  s.current = s.powerFactor > 0 ? s.power / (s.voltage * s.powerFactor) : 0;
+  return s;
+}
+
+LoadProfile LoadModel::randomProfile(uint32_t seed) {
+  static const LoadProfile MIX[] = {
+    // on W, standby W, PF, standby PF, period, duty, noise, THD, standby THD
+    {150.0f, 2.0f, 0.85f, 0.50f, 1200000, 0.40f, 0.05f, 0.08f, 1.10f},   // Fridge compressor
+    {1800.0f, 0.0f, 0.99f, 0.0f, 3600000, 0.10f, 0.02f, 0.02f, 0.0f},    // Water heater
+    {60.0f, 0.0f, 0.95f, 0.0f, 0, 1.0f, 0.10f, 0.15f, 0.0f},             // Router/PC (PFC supply), always on
+    {110.0f, 8.0f, 0.95f, 0.45f, 14400000, 0.25f, 0.08f, 0.20f, 1.30f},  // TV with standby
+    {900.0f, 3.0f, 0.62f, 0.50f, 2700000, 0.50f, 0.06f, 0.06f, 1.10f},   // Old motor, poor PF
+  };
+  const size_t count = sizeof(MIX) / sizeof(MIX[0]);
+  return MIX[seed % count];
+}
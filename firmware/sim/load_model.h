@@ -0,0 +1,44 @@
+#ifndef LOAD_MODEL_H
+#define LOAD_MODEL_H
+
+#include <Arduino.h>
+
+// Synthetic appliance: on/off cycling over a standby floor, with noise
+struct LoadProfile {
+  float onPower;             // W while running
+  float standbyPower;        // W while off
+  float powerFactor;         // While running
+  float standbyPowerFactor;  // While off
+  unsigned long periodMs;    // On/off cycle length (0 = always on)
+  float dutyCycle;           // Fraction of each period spent running
+  float noise;               // Relative jitter on each sample
+  float thd;                 // Current THD while running (ratio)
+  float standbyThd;          // While off
+};
+
+struct LoadSample {
+  float voltage;
+  float current;
+  float power;
+  float powerFactor;
+  float frequency;
+  float thd;
+};
+
+class LoadModel {
+private:
+  LoadProfile profile;
+  uint32_t rng;
+  unsigned long phaseMs;  // Offset so identical profiles don't switch in lockstep
+  
+public:
+  LoadModel(const LoadProfile& loadProfile, uint32_t seed);
+  
+  LoadSample sample(unsigned long now);
+  float random();  // Uniform in [0, 1)
+  
+  // A household-style mix, picked deterministically from seed
+  static LoadProfile randomProfile(uint32_t seed);
+};
+
+#endif
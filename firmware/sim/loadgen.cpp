@@ -0,0 +1,208 @@
+// ESP-NOW ingest load generator (pio run -e native_loadgen).
+//
+// Replays telemetry streams from N virtual wireless nodes into the
+// firmware's receive path (onESPNOWReceive -> SPSC queue -> loop() ->
+// addOrUpdateDevice) and reports sustained ingest rate, drops, per-packet
+// latency percentiles and memory high-water marks.
+//
+// Timing model: frames arrive at their scheduled virtual times, as the
+// Wi-Fi task would deliver them, while loop() runs on the virtual clock.
+// Each loop() iteration costs its delay(1) plus the host CPU time it
+// took multiplied by --cpu-scale (host-to-ESP32 slowdown), so work done
+// per frame shows up as queueing delay and, past saturation, as drops.
+// Latency runs from a frame's arrival until the end of the loop()
+// iteration that applied it. Frames from nodes the registry has no slot
+// for (they measure the reject path; the native_loadgen env raises
+// MAX_DEVICES) and acknowledgements the receive path failed to send both
+// fail the run (exit 1).
+//
+//   .pio/build/native_loadgen/program [--nodes N] [--rate HZ] [--jitter MS]
+//       [--seconds N] [--cpu-scale X] [--seed N]
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include <chrono>
+#include <queue>
+#include <vector>
+#include "config.h"
+#include "device_registry.h"
+#include "espnow_queue.h"
+#include "latency_histogram.h"
+#include "pzem_model.h"
+#include "virtual_node.h"
+
+// Firmware under test (src/main.cpp)
+void setup();
+void loop();
+extern HardwareSerial PZEM1Serial;
+extern HardwareSerial PZEM2Serial;
+extern DeviceRegistry devices;
+extern EspNowQueue espNowQueue;
+extern uint32_t framesRejected;
+extern uint32_t acksSent;
+extern uint32_t ackFailures;
+
+struct LoadOptions {
+  int nodes = 50;
+  double rateHz = 1.0;         // Frames per second per node
+  unsigned long jitterMs = 50;
+  unsigned long seconds = 60;
+  double cpuScale = 20.0;
+  uint32_t seed = 1;
+};
+
+static bool parseOptions(int argc, char** argv, LoadOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    String arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--nodes" && hasValue) options.nodes = atoi(argv[++i]);
+    else if (arg == "--rate" && hasValue) options.rateHz = atof(argv[++i]);
+    else if (arg == "--jitter" && hasValue) options.jitterMs = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--seconds" && hasValue) options.seconds = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--cpu-scale" && hasValue) options.cpuScale = atof(argv[++i]);
+    else if (arg == "--seed" && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else {
+      fprintf(stderr, "usage: %s [--nodes N] [--rate HZ] [--jitter MS] [--seconds N] [--cpu-scale X] [--seed N]\n", argv[0]);
+      return false;
+    }
+  }
+  return options.nodes > 0 && options.rateHz > 0;
+}
+
+// Arrival times of frames accepted into the queue but not yet applied.
+// The queue is FIFO, so frames are applied in exactly this order.
+class PendingFrames {
+private:
+  uint64_t arrivals[ESPNOW_RX_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+
+public:
+  PendingFrames() : head(0), tail(0) {}
+  void push(uint64_t arrivedAt) { arrivals[head++ % ESPNOW_RX_QUEUE_SIZE] = arrivedAt; }
+  uint64_t pop() { return arrivals[tail++ % ESPNOW_RX_QUEUE_SIZE]; }
+  uint32_t size() const { return head - tail; }
+};
+
+struct Arrival {
+  unsigned long at;
+  int node;
+  bool operator>(const Arrival& other) const { return at > other.at; }
+};
+
+int main(int argc, char** argv) {
+  LoadOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  HardwareSerial::setConsoleEnabled(false);
+
+  // Wired meters keep the PZEM path busy as in the field
+  PZEMModel meter1(PZEM1_ADDR, LoadModel(LoadModel::randomProfile(0), options.seed * 31 + 1));
+  PZEMModel meter2(PZEM2_ADDR, LoadModel(LoadModel::randomProfile(3), options.seed * 31 + 2));
+  PZEM1Serial.attach(&meter1);
+  PZEM2Serial.attach(&meter2);
+
+  setup();
+
+  unsigned long intervalMs = max(1UL, (unsigned long)lround(1000.0 / options.rateHz));
+  std::vector<VirtualNode> nodes;
+  nodes.reserve(options.nodes);
+  std::priority_queue<Arrival, std::vector<Arrival>, std::greater<Arrival>> schedule;
+  for (int i = 0; i < options.nodes; i++) {
+    LoadModel model(LoadModel::randomProfile(options.seed + i), options.seed * 1009 + i);
+    nodes.emplace_back(i, model, intervalMs, min(options.jitterMs, intervalMs / 2));
+    schedule.push(Arrival{nodes.back().nextSendTime(), i});
+  }
+
+  PendingFrames pending;
+  LatencyHistogram latency;
+  uint64_t offered = 0;
+  uint64_t dropped = 0;
+  uint64_t applied = 0;
+  uint64_t iterations = 0;
+  double loopCpuMicros = 0;
+
+  uint32_t baselineFree = ESP.getFreeHeap();
+  unsigned long startedAt = millis();
+  unsigned long endAt = startedAt + options.seconds * 1000UL;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  while ((long)(millis() - endAt) < 0) {
+    // Deliver everything that arrived while the last iteration ran
+    unsigned long now = millis();
+    while (!schedule.empty() && (long)(now - schedule.top().at) >= 0) {
+      Arrival arrival = schedule.top();
+      schedule.pop();
+
+      uint8_t frame[ESPNOW_RX_FRAME_MAX];
+      VirtualNode& node = nodes[arrival.node];
+      size_t len = node.encode(arrival.at, frame, sizeof(frame));
+
+      uint32_t dropsBefore = espNowQueue.drops();
+      halEspNowDeliver(node.macAddress(), frame, len);
+      offered++;
+      if (espNowQueue.drops() != dropsBefore) {
+        dropped++;
+      } else {
+        pending.push((uint64_t)arrival.at * 1000);
+      }
+      schedule.push(Arrival{node.nextSendTime(), arrival.node});
+    }
+
+    auto cpuStart = std::chrono::steady_clock::now();
+    loop();
+    double cpuMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - cpuStart).count();
+    loopCpuMicros += cpuMicros;
+    halAdvanceMicros((uint64_t)(cpuMicros * options.cpuScale));
+    iterations++;
+
+    // Frames that left the queue this iteration have been applied
+    uint64_t nowUs = (uint64_t)micros();
+    while (pending.size() > espNowQueue.size()) {
+      uint64_t arrivedAt = pending.pop();
+      latency.record(nowUs > arrivedAt ? nowUs - arrivedAt : 0);
+      applied++;
+    }
+
+    if (iterations % 1024 == 0) {
+      ESP.getFreeHeap();  // Updates the minimum-free watermark
+    }
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double simSeconds = (millis() - startedAt) / 1000.0;
+  uint32_t heapPeak = baselineFree > ESP.getMinFreeHeap() ? baselineFree - ESP.getMinFreeHeap() : 0;
+
+  printf("=== ESP-NOW ingest load ===\n");
+  printf("Load:     %d nodes x %.2f Hz (interval %lu ms, jitter +/-%lu ms), %.0f s simulated, cpu-scale %.1f\n",
+         options.nodes, options.rateHz, intervalMs, min(options.jitterMs, intervalMs / 2), simSeconds, options.cpuScale);
+  printf("Offered:  %llu frames (%.1f/s)\n", (unsigned long long)offered, offered / simSeconds);
+  uint64_t ingested = applied - min<uint64_t>(applied, framesRejected);
+  printf("Ingested: %llu frames (%.1f/s sustained)\n", (unsigned long long)ingested, ingested / simSeconds);
+  printf("Dropped:  %llu frames (%.3f%%) at the receive queue\n", (unsigned long long)dropped,
+         offered ? 100.0 * dropped / offered : 0.0);
+  printf("Latency:  p50 %.2f ms  p90 %.2f ms  p99 %.2f ms  p99.9 %.2f ms  max %.2f ms  mean %.2f ms\n",
+         latency.percentile(50) / 1000.0, latency.percentile(90) / 1000.0, latency.percentile(99) / 1000.0,
+         latency.percentile(99.9) / 1000.0, latency.maximum() / 1000.0, latency.mean() / 1000.0);
+  printf("Queue:    high-water %lu / %lu frames (%lu bytes per slot)\n", (unsigned long)espNowQueue.highWater(),
+         (unsigned long)espNowQueue.capacity(), (unsigned long)sizeof(EspNowFrame));
+  printf("Registry: %d / %d devices, %lu frames rejected from nodes without a slot\n", devices.count(), MAX_DEVICES,
+         (unsigned long)framesRejected);
+  printf("Acks:     %lu sent, %lu failed (%d-entry ESP-NOW peer list)\n", (unsigned long)acksSent,
+         (unsigned long)ackFailures, ESP_NOW_MAX_TOTAL_PEER_NUM);
+  printf("Heap:     peak %lu bytes above the post-setup baseline\n", (unsigned long)heapPeak);
+  printf("Host:     %.2f s wall, %.2f us CPU per loop(), %.0f frames/s wall-clock throughput\n",
+         wallSeconds, loopCpuMicros / max<uint64_t>(iterations, 1), ingested / max(wallSeconds, 1e-9));
+
+  if (ackFailures) {
+    printf("\nFAIL: %lu acknowledgements not sent\n", (unsigned long)ackFailures);
+    return 1;
+  }
+  if (framesRejected) {
+    printf("\nFAIL: %lu frames rejected: the registry is full; build with a MAX_DEVICES above --nodes plus the"
+           " wired loads\n", (unsigned long)framesRejected);
+    return 1;
+  }
+  return 0;
+}
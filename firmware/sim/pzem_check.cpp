@@ -0,0 +1,396 @@
+// Native check of the PZEM-004T Modbus client (pio run -e native_pzem).
+//
+// Feeds recorded 0x04 responses through PZEMSensor (src/pzem_sensor.cpp):
+// the one-transaction request is byte for byte the meter's documented
+// command, good frames decode to their register values (32-bit registers
+// low word first), and every truncation, bit flip, wrong address and
+// exception frame is rejected. Then replays the same frames over the
+// native HAL serial: through readData(), through the non-blocking
+// request/await/parse state machine on the virtual clock (byte-by-byte
+// arrival, the response timeout, late and exception replies), and in
+// loop()'s pattern with both meters in flight, measuring how long an
+// iteration spends on them against the blocking reads. Exits non-zero on
+// any failure.
+//
+//   .pio/build/native_pzem/program
+
+#include <Arduino.h>
+#include <HardwareSerial.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "device_data.h"
+#include "pzem_sensor.h"
+
+#define FRAME_LENGTH 25  // addr + func + count + 10 registers + CRC
+#define TIMEOUT_MS 100    // PZEMSensor::RESPONSE_TIMEOUT_MS
+#define READ_INTERVAL_MS 2000  // loop()'s PZEM_READ_INTERVAL
+
+// Read 10 input registers from 0x0000, as documented for the PZEM-004T v3
+static const uint8_t REQUEST_ADDR1[] = {0x01, 0x04, 0x00, 0x00, 0x00, 0x0A, 0x70, 0x0D};
+static const uint8_t REQUEST_ADDR2[] = {0x02, 0x04, 0x00, 0x00, 0x00, 0x0A, 0x70, 0x3E};
+
+// Response frames with their register values
+struct RecordedFrame {
+  const char* name;
+  uint8_t address;
+  uint8_t bytes[FRAME_LENGTH];
+  float voltage, current, power, frequency, powerFactor;
+  uint32_t meterWh;
+};
+
+static const RecordedFrame FRAMES[] = {
+  {"small load: 230.1 V, 0.456 A, 98.7 W, 1234 Wh, 50.0 Hz, PF 0.94", 0x01,
+   {0x01, 0x04, 0x14, 0x08, 0xFD, 0x01, 0xC8, 0x00, 0x00, 0x03, 0xDB, 0x00, 0x00,
+    0x04, 0xD2, 0x00, 0x00, 0x01, 0xF4, 0x00, 0x5E, 0x00, 0x00, 0x9D, 0xCD},
+   230.1f, 0.456f, 98.7f, 50.0f, 0.94f, 1234},
+  {"heavy load, high words set: 81.25 A, 18313 W, 9999873 Wh, alarm on", 0x02,
+   {0x02, 0x04, 0x14, 0x08, 0xCE, 0x3D, 0x62, 0x00, 0x01, 0xCB, 0x5A, 0x00, 0x02,
+    0x96, 0x01, 0x00, 0x98, 0x01, 0xF3, 0x00, 0x63, 0xFF, 0xFF, 0xBC, 0xB3},
+   225.4f, 81.25f, 18313.0f, 49.9f, 0.99f, 9999873},
+  {"mains off: all registers zero", 0x01,
+   {0x01, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x95, 0x81},
+   0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0},
+};
+
+// Exception reply to the same request: illegal data address
+static const uint8_t EXCEPTION_FRAME[] = {0x01, 0x84, 0x02, 0xC2, 0xC1};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool near(float a, float b) {
+  return fabs(a - b) <= 1e-4f * max(1.0f, fabs(b));
+}
+
+static bool matches(const DeviceReading& reading, const RecordedFrame& frame) {
+  return near(reading.voltage, frame.voltage) && near(reading.current, frame.current) &&
+         near(reading.power, frame.power) && near(reading.frequency, frame.frequency) &&
+         near(reading.powerFactor, frame.powerFactor) && reading.metered && reading.meterWh == frame.meterWh &&
+         near(reading.energy, frame.meterWh / 1000.0f);
+}
+
+// Meter on the far end of the UART answering each request with the next
+// recorded frame; silent once they run out. With trickle, bytes arrive
+// one per millisecond as they would at 9600 baud
+class ReplayPeer : public SerialPeer {
+public:
+  std::deque<std::vector<uint8_t>> responses;
+  std::vector<uint8_t> lastRequest;
+  unsigned long latencyMs = 40;
+  bool trickle = false;
+  int requests = 0;
+
+  void onHostWrite(HardwareSerial& port, const uint8_t* data, size_t len) override {
+    lastRequest.assign(data, data + len);
+    requests++;
+    if (responses.empty()) {
+      return;
+    }
+    const std::vector<uint8_t>& response = responses.front();
+    if (trickle) {
+      for (size_t i = 0; i < response.size(); i++) {
+        port.inject(&response[i], 1, latencyMs + i);
+      }
+    } else {
+      port.inject(response.data(), response.size(), latencyMs);
+    }
+    responses.pop_front();
+  }
+
+  void queue(const uint8_t* frame, size_t len) { responses.push_back(std::vector<uint8_t>(frame, frame + len)); }
+};
+
+static void checkParse() {
+  printf("Recorded frames through parseResponse():\n");
+  for (const RecordedFrame& frame : FRAMES) {
+    DeviceReading reading = {};
+    bool ok = PZEMSensor::parseResponse(frame.bytes, FRAME_LENGTH, frame.address, reading);
+    expect(ok && matches(reading, frame), "good frame decodes to its register values");
+    printf("  %-4s %s\n", ok && matches(reading, frame) ? "ok" : "BAD", frame.name);
+  }
+
+  const RecordedFrame& good = FRAMES[0];
+  DeviceReading reading = {};
+
+  // Short: every truncation, including one byte short of the CRC
+  int shortRejected = 0;
+  for (uint8_t len = 0; len < FRAME_LENGTH; len++) {
+    shortRejected += !PZEMSensor::parseResponse(good.bytes, len, good.address, reading);
+  }
+  expect(shortRejected == FRAME_LENGTH, "short frames are rejected");
+  printf("  %d/%d truncations rejected\n", shortRejected, FRAME_LENGTH);
+
+  // Bad CRC: every single-bit error anywhere in the frame
+  int flipsRejected = 0;
+  uint8_t corrupt[FRAME_LENGTH];
+  for (int bit = 0; bit < FRAME_LENGTH * 8; bit++) {
+    memcpy(corrupt, good.bytes, FRAME_LENGTH);
+    corrupt[bit / 8] ^= 1 << (bit % 8);
+    flipsRejected += !PZEMSensor::parseResponse(corrupt, FRAME_LENGTH, good.address, reading);
+  }
+  expect(flipsRejected == FRAME_LENGTH * 8, "bit errors are rejected");
+  printf("  %d/%d single-bit errors rejected\n", flipsRejected, FRAME_LENGTH * 8);
+
+  // CRC sent high byte first
+  memcpy(corrupt, good.bytes, FRAME_LENGTH);
+  corrupt[FRAME_LENGTH - 2] = good.bytes[FRAME_LENGTH - 1];
+  corrupt[FRAME_LENGTH - 1] = good.bytes[FRAME_LENGTH - 2];
+  expect(!PZEMSensor::parseResponse(corrupt, FRAME_LENGTH, good.address, reading), "swapped CRC bytes are rejected");
+
+  // Valid frame from another meter on the bus
+  expect(!PZEMSensor::parseResponse(good.bytes, FRAME_LENGTH, 0x02, reading), "other address is rejected");
+  expect(!PZEMSensor::parseResponse(EXCEPTION_FRAME, sizeof(EXCEPTION_FRAME), 0x01, reading),
+         "exception frame is rejected");
+
+  // Trailing bytes after a complete frame are not part of it
+  uint8_t longer[FRAME_LENGTH + 3];
+  memcpy(longer, good.bytes, FRAME_LENGTH);
+  memset(longer + FRAME_LENGTH, 0xAA, 3);
+  reading = DeviceReading();
+  expect(PZEMSensor::parseResponse(longer, sizeof(longer), good.address, reading) && matches(reading, good),
+         "trailing bytes are ignored");
+}
+
+static void checkSerial() {
+  printf("\nRecorded frames over the HAL serial through readData():\n");
+  HardwareSerial port(1);
+  ReplayPeer peer;
+  port.attach(&peer);
+  PZEMSensor meter1(&port, 0x01, "WIRED_01", "Wired Load 1");
+  PZEMSensor meter2(&port, 0x02, "WIRED_02", "Wired Load 2");
+
+  // The request is one 8-byte Modbus frame
+  DeviceReading reading = {};
+  peer.queue(FRAMES[0].bytes, FRAME_LENGTH);
+  unsigned long start = millis();
+  bool ok = meter1.readData(reading);
+  unsigned long took = millis() - start;
+  expect(peer.requests == 1, "one transaction per reading");
+  expect(peer.lastRequest == std::vector<uint8_t>(REQUEST_ADDR1, REQUEST_ADDR1 + sizeof(REQUEST_ADDR1)),
+         "request for address 1 is 01 04 00 00 00 0A 70 0D");
+  expect(ok && matches(reading, FRAMES[0]), "replayed frame decodes");
+  expect(took < peer.latencyMs + 5, "returns as soon as the frame is complete");
+  printf("  small load: %s in %lu ms (response after %lu ms)\n", ok ? "read" : "FAILED", took, peer.latencyMs);
+
+  peer.queue(FRAMES[1].bytes, FRAME_LENGTH);
+  ok = meter2.readData(reading);
+  expect(peer.lastRequest == std::vector<uint8_t>(REQUEST_ADDR2, REQUEST_ADDR2 + sizeof(REQUEST_ADDR2)),
+         "request for address 2 is 02 04 00 00 00 0A 70 3E");
+  expect(ok && matches(reading, FRAMES[1]), "replayed heavy-load frame decodes");
+  printf("  heavy load: %s\n", ok ? "read" : "FAILED");
+
+  // Stale bytes from an earlier, abandoned exchange are dropped before
+  // the request goes out
+  const uint8_t stale[] = {0x55, 0x01, 0x04};
+  port.inject(stale, sizeof(stale), 0);
+  peer.queue(FRAMES[2].bytes, FRAME_LENGTH);
+  ok = meter1.readData(reading);
+  expect(ok && matches(reading, FRAMES[2]), "stale bytes before the request are flushed");
+  printf("  after stale bytes: %s\n", ok ? "read" : "FAILED");
+
+  // A short reply is never complete: the read times out
+  peer.responses.push_back(std::vector<uint8_t>(FRAMES[0].bytes, FRAMES[0].bytes + FRAME_LENGTH - 4));
+  expect(!meter1.readData(reading), "short reply fails");
+
+  // A reply with a bad CRC fails; so does an exception
+  std::vector<uint8_t> badCrc(FRAMES[0].bytes, FRAMES[0].bytes + FRAME_LENGTH);
+  badCrc[FRAME_LENGTH - 1] ^= 0x01;
+  peer.responses.push_back(badCrc);
+  expect(!meter1.readData(reading), "bad CRC fails");
+  peer.queue(EXCEPTION_FRAME, sizeof(EXCEPTION_FRAME));
+  start = millis();
+  expect(!meter1.readData(reading), "exception fails");
+  expect(millis() - start < peer.latencyMs + 5, "exception ends the read without waiting for the timeout");
+  printf("  short, bad CRC and exception replies rejected\n");
+
+  // Still usable afterwards
+  peer.queue(FRAMES[0].bytes, FRAME_LENGTH);
+  expect(meter1.readData(reading) && matches(reading, FRAMES[0]), "reads after failures");
+}
+
+// Poll once a millisecond until the transaction ends; returns the result
+// and how many polls reported busy
+static PZEMSensor::PollResult pollUntilDone(PZEMSensor& meter, DeviceReading& reading, int& busyPolls,
+                                            unsigned long& endedAt) {
+  PZEMSensor::PollResult result;
+  busyPolls = 0;
+  while ((result = meter.poll(reading)) == PZEMSensor::POLL_BUSY) {
+    busyPolls++;
+    delay(1);
+  }
+  endedAt = millis();
+  return result;
+}
+
+static void checkStateMachine() {
+  printf("\nState machine on the virtual clock (requestData() + poll()):\n");
+  HardwareSerial port(1);
+  ReplayPeer peer;
+  peer.trickle = true;
+  port.attach(&peer);
+  PZEMSensor meter(&port, 0x01, "WIRED_01", "Wired Load 1");
+  DeviceReading reading = {};
+  int busyPolls;
+  unsigned long endedAt;
+
+  // IDLE -> AWAITING -> PARSING -> IDLE
+  expect(!meter.isBusy() && meter.poll(reading) == PZEMSensor::POLL_IDLE, "idle before a request");
+  peer.queue(FRAMES[0].bytes, FRAME_LENGTH);
+  unsigned long requestedAt = millis();
+  expect(meter.requestData() && meter.isBusy(), "request starts a transaction");
+  expect(!meter.requestData() && peer.requests == 1, "no second request while one is in flight");
+
+  // The last byte arrives at latency + 24 ms: busy until then, then one
+  // more busy poll for the parse step
+  unsigned long lastByteAt = requestedAt + peer.latencyMs + FRAME_LENGTH - 1;
+  PZEMSensor::PollResult result = pollUntilDone(meter, reading, busyPolls, endedAt);
+  expect(result == PZEMSensor::POLL_READY && matches(reading, FRAMES[0]), "frame arriving byte by byte is read");
+  expect(endedAt == lastByteAt + 1, "parsed on the poll after the frame completed");
+  expect(reading.timestamp == requestedAt, "reading is stamped with the request time");
+  expect(!meter.isBusy() && meter.poll(reading) == PZEMSensor::POLL_IDLE, "idle again after the reading");
+  printf("  byte-by-byte frame: %d busy polls, ready %lu ms after the request (last byte at %lu ms)\n", busyPolls,
+         endedAt - requestedAt, lastByteAt - requestedAt);
+
+  // Silence: busy through 99 ms, failed at 100 ms
+  requestedAt = millis();
+  meter.requestData();
+  result = pollUntilDone(meter, reading, busyPolls, endedAt);
+  expect(result == PZEMSensor::POLL_FAILED && endedAt - requestedAt == TIMEOUT_MS, "timeout at exactly 100 ms");
+  expect(!meter.isBusy(), "idle after a timeout");
+  printf("  no reply: failed after %lu ms, %d busy polls\n", endedAt - requestedAt, busyPolls);
+
+  // Part of a frame, then silence: the same timeout
+  peer.responses.push_back(std::vector<uint8_t>(FRAMES[0].bytes, FRAMES[0].bytes + 10));
+  requestedAt = millis();
+  meter.requestData();
+  result = pollUntilDone(meter, reading, busyPolls, endedAt);
+  expect(result == PZEMSensor::POLL_FAILED && endedAt - requestedAt == TIMEOUT_MS, "partial frame times out");
+
+  // A reply that starts after the timeout is dropped by the next request
+  peer.latencyMs = TIMEOUT_MS + 20;
+  peer.queue(FRAMES[1].bytes, FRAME_LENGTH);
+  meter.requestData();
+  result = pollUntilDone(meter, reading, busyPolls, endedAt);
+  expect(result == PZEMSensor::POLL_FAILED, "late reply misses the timeout");
+  delay(200);  // The late frame is now sitting in the UART
+  peer.latencyMs = 40;
+  peer.queue(FRAMES[0].bytes, FRAME_LENGTH);
+  meter.requestData();
+  result = pollUntilDone(meter, reading, busyPolls, endedAt);
+  expect(result == PZEMSensor::POLL_READY && matches(reading, FRAMES[0]), "late reply does not leak into the next");
+  printf("  late reply: dropped, next transaction reads its own frame\n");
+
+  // An exception ends the transaction as soon as its 5 bytes are in
+  peer.queue(EXCEPTION_FRAME, sizeof(EXCEPTION_FRAME));
+  requestedAt = millis();
+  meter.requestData();
+  result = pollUntilDone(meter, reading, busyPolls, endedAt);
+  expect(result == PZEMSensor::POLL_FAILED && endedAt - requestedAt < TIMEOUT_MS, "exception fails early");
+  printf("  exception reply: failed after %lu ms\n", endedAt - requestedAt);
+}
+
+// Worst iteration cost of one way of reading both meters
+struct LoopCost {
+  unsigned long iterations = 0;
+  unsigned long readings = 0;
+  unsigned long maxVirtualUs = 0;  // Virtual time spent inside the PZEM calls
+  double maxHostUs = 0;            // Host CPU time of the slowest iteration
+  unsigned long overlapped = 0;    // Iterations with both meters in flight
+};
+
+static void checkLoopLatency() {
+  printf("\nloop() with both meters, %d s on the virtual clock:\n", 120);
+  HardwareSerial port1(1);
+  HardwareSerial port2(2);
+  ReplayPeer peer1;
+  ReplayPeer peer2;
+  peer1.trickle = peer2.trickle = true;
+  peer2.latencyMs = 55;
+  port1.attach(&peer1);
+  port2.attach(&peer2);
+  PZEMSensor meter1(&port1, 0x01, "WIRED_01", "Wired Load 1");
+  PZEMSensor meter2(&port2, 0x02, "WIRED_02", "Wired Load 2");
+  const unsigned long runMs = 120000;
+  const unsigned long cycles = runMs / READ_INTERVAL_MS;
+  for (unsigned long i = 0; i < cycles; i++) {
+    peer1.queue(FRAMES[0].bytes, FRAME_LENGTH);
+    peer2.queue(FRAMES[1].bytes, FRAME_LENGTH);
+  }
+
+  // Non-blocking, as loop() does it: start both, then poll every iteration
+  LoopCost polled;
+  unsigned long end = millis() + runMs;
+  unsigned long lastRequest = millis() - READ_INTERVAL_MS;
+  while (millis() < end) {
+    unsigned long virtualStart = micros();
+    auto hostStart = std::chrono::steady_clock::now();
+    unsigned long now = millis();
+    if (now - lastRequest >= READ_INTERVAL_MS) {
+      meter1.requestData();
+      meter2.requestData();
+      lastRequest = now;
+    }
+    DeviceReading reading;
+    polled.readings += meter1.poll(reading) == PZEMSensor::POLL_READY;
+    polled.readings += meter2.poll(reading) == PZEMSensor::POLL_READY;
+    double hostUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - hostStart).count();
+    polled.overlapped += meter1.isBusy() && meter2.isBusy();
+    polled.maxVirtualUs = max(polled.maxVirtualUs, micros() - virtualStart);
+    polled.maxHostUs = max(polled.maxHostUs, hostUs);
+    polled.iterations++;
+    delay(1);  // loop()'s yield
+  }
+  expect(polled.readings == 2 * cycles, "every reading of both meters arrives");
+  expect(polled.maxVirtualUs == 0, "polling never waits on a UART");
+  expect(polled.overlapped > 0, "both transactions are in flight together");
+
+  // The blocking reads they replaced, for comparison
+  LoopCost blocking;
+  for (unsigned long i = 0; i < cycles; i++) {
+    peer1.queue(FRAMES[0].bytes, FRAME_LENGTH);
+    peer2.queue(FRAMES[1].bytes, FRAME_LENGTH);
+  }
+  end = millis() + runMs;
+  lastRequest = millis() - READ_INTERVAL_MS;
+  while (millis() < end) {
+    unsigned long virtualStart = micros();
+    unsigned long now = millis();
+    if (now - lastRequest >= READ_INTERVAL_MS) {
+      DeviceReading reading;
+      blocking.readings += meter1.readData(reading);
+      blocking.readings += meter2.readData(reading);
+      lastRequest = now;
+    }
+    blocking.maxVirtualUs = max(blocking.maxVirtualUs, micros() - virtualStart);
+    blocking.iterations++;
+    delay(1);
+  }
+  expect(blocking.readings == 2 * cycles, "blocking reads also arrive");
+
+  printf("  poll():     %lu iterations, %lu readings, worst iteration %.1f ms waiting (host CPU %.1f us)\n",
+         polled.iterations, polled.readings, polled.maxVirtualUs / 1000.0, polled.maxHostUs);
+  printf("  readData(): %lu iterations, %lu readings, worst iteration %.1f ms waiting\n", blocking.iterations,
+         blocking.readings, blocking.maxVirtualUs / 1000.0);
+  printf("  both meters in flight during %lu iterations\n", polled.overlapped);
+}
+
+int main(int argc, char** argv) {
+  printf("=== PZEM-004T Modbus client (PZEMSensor <-> recorded frames) ===\n\n");
+  checkParse();
+  checkSerial();
+  checkStateMachine();
+  checkLoopLatency();
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#include "pzem_model.h"
+#include "telemetry_frame.h"
+
+static const uint8_t READ_INPUT_REGISTERS = 0x04;
+static const uint16_t REGISTER_COUNT = 10;
+
+PZEMModel::PZEMModel(uint8_t addr, const LoadModel& model, unsigned long responseLatencyMs)
+  : address(addr), load(model), latencyMs(responseLatencyMs), energyWh(0), lastSampleAt(0), requests(0), badRequests(0) {}
+
+static void putWord(uint8_t* p, uint16_t value) {
+  p[0] = value >> 8;
+  p[1] = value & 0xFF;
+}
+
+static void putPair(uint8_t* p, uint32_t value) {
+  // 32-bit registers go low word first
+  putWord(p, value & 0xFFFF);
+  putWord(p + 2, value >> 16);
+}
+
+void PZEMModel::onHostWrite(HardwareSerial& port, const uint8_t* data, size_t len) {
+  // Modbus RTU: same CRC as the telemetry frame (CRC-16/MODBUS)
+  if (len != 8 || data[0] != address || TelemetryCodec::crc16(data, 6) != (uint16_t)(data[6] | (data[7] << 8))) {
+    badRequests++;
+    return;  // A real meter stays silent; the master times out
+  }
+  requests++;
+  
+  uint8_t response[25];
+  size_t responseLen;
+  uint16_t start = (data[2] << 8) | data[3];
+  uint16_t count = (data[4] << 8) | data[5];
+  
+  if (data[1] != READ_INPUT_REGISTERS || start != 0 || count != REGISTER_COUNT) {
+    response[0] = address;
+    response[1] = data[1] | 0x80;
+    response[2] = 0x02;  // Illegal data address
+    responseLen = 3;
+  } else {
+    unsigned long now = millis();
+    LoadSample s = load.sample(now);
+    if (lastSampleAt) {
+      energyWh += s.power * (now - lastSampleAt) / 3600000.0;
+    }
+    lastSampleAt = now;
+    
+    response[0] = address;
+    response[1] = READ_INPUT_REGISTERS;
+    response[2] = REGISTER_COUNT * 2;
+    uint8_t* regs = response + 3;
+    putWord(regs + 0, (uint16_t)lroundf(s.voltage * 10));
+    putPair(regs + 2, (uint32_t)lroundf(s.current * 1000));
+    putPair(regs + 6, (uint32_t)lroundf(s.power * 10));
+    putPair(regs + 10, (uint32_t)energyWh);
+    putWord(regs + 14, (uint16_t)lroundf(s.frequency * 10));
+    putWord(regs + 16, (uint16_t)lroundf(s.powerFactor * 100));
+    putWord(regs + 18, 0);  // Alarm status
+    responseLen = 3 + REGISTER_COUNT * 2;
+  }
+  
+  uint16_t crc = TelemetryCodec::crc16(response, responseLen);
+  response[responseLen++] = crc & 0xFF;
+  response[responseLen++] = crc >> 8;
+  port.inject(response, responseLen, latencyMs);
+}
@@ -0,0 +1,30 @@
+#ifndef PZEM_MODEL_H
+#define PZEM_MODEL_H
+
+#include <HardwareSerial.h>
+#include "load_model.h"
+
+// PZEM-004T v3 on a simulated UART: answers "read input registers"
+// (0x04) for the 10 measurement registers, with realistic latency, and
+// accumulates energy between reads like the meter's own counter
+class PZEMModel : public SerialPeer {
+private:
+  uint8_t address;
+  LoadModel load;
+  unsigned long latencyMs;
+  double energyWh;
+  unsigned long lastSampleAt;
+  uint32_t requests;
+  uint32_t badRequests;
+  
+public:
+  PZEMModel(uint8_t addr, const LoadModel& model, unsigned long responseLatencyMs = 40);
+  
+  void onHostWrite(HardwareSerial& port, const uint8_t* data, size_t len) override;
+  
+  uint32_t requestCount() const { return requests; }
+  uint32_t badRequestCount() const { return badRequests; }
+  double energyWattHours() const { return energyWh; }
+};
+
+#endif
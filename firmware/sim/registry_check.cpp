@@ -0,0 +1,286 @@
+// Native check and benchmark of the device registry
+// (pio run -e native_registry).
+//
+// Checks DeviceRegistry (src/device_registry.cpp) against a std::map
+// model: FNV-1a against published vectors, a full table, slot reuse, and
+// random insert/remove/find churn over IDs chosen so their hashes share
+// home positions (long probe chains, chains wrapping past the end of the
+// index) to exercise linear probing and backward-shift deletion. After
+// every operation each ID must be found in its own slot or not at all,
+// and iteration must visit exactly the live slots. Then compares lookup
+// cost with the linear scan by ID the index replaced. Exits non-zero on
+// any failure.
+//
+//   .pio/build/native_registry/program [--seed N] [--ops N]
+
+#include <Arduino.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "device_registry.h"
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  long ops = 200000;
+};
+
+static const uint16_t INDEX_SIZE = registryIndexSize(MAX_DEVICES);
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--ops") && hasValue) options.ops = atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--ops N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint16_t homeOf(const std::string& id) {
+  return DeviceRegistry::hashId(id.c_str()) & (INDEX_SIZE - 1);
+}
+
+// `count` IDs whose index home is `home`
+static void collidingIds(uint16_t home, int count, std::vector<std::string>& ids) {
+  char id[24];
+  for (uint32_t n = 0; count > 0; n++) {
+    snprintf(id, sizeof(id), "node-%u", n);
+    if (homeOf(id) == home) {
+      ids.push_back(id);
+      count--;
+    }
+  }
+}
+
+// Every ID found where the model says, and iteration visits exactly the
+// model's slots
+static bool consistent(const DeviceRegistry& registry, const std::map<std::string, DeviceHandle>& model,
+                       const std::vector<std::string>& ids) {
+  for (const std::string& id : ids) {
+    auto it = model.find(id);
+    DeviceHandle handle = registry.find(String(id.c_str()));
+    if (it == model.end() ? handle != INVALID_DEVICE : handle != it->second || registry[handle].id != id.c_str()) {
+      return false;
+    }
+  }
+
+  std::vector<bool> live(MAX_DEVICES, false);
+  for (const auto& entry : model) {
+    live[entry.second] = true;
+  }
+  int visited = 0;
+  DeviceHandle previous = -1;
+  for (DeviceHandle h = registry.first(); h != INVALID_DEVICE; h = registry.next(h)) {
+    if (h <= previous || !live[h] || !registry.isValid(h)) {
+      return false;
+    }
+    previous = h;
+    visited++;
+  }
+  return visited == (int)model.size() && registry.count() == (int)model.size() &&
+         registry.isFull() == (model.size() == MAX_DEVICES);
+}
+
+static void checkHash() {
+  printf("FNV-1a:\n");
+  // Published 32-bit FNV-1a test vectors
+  expect(DeviceRegistry::hashId("") == 0x811C9DC5UL, "hash of \"\"");
+  expect(DeviceRegistry::hashId("a") == 0xE40C292CUL, "hash of \"a\"");
+  expect(DeviceRegistry::hashId("foobar") == 0xBF9CF968UL, "hash of \"foobar\"");
+
+  // IDs the nodes actually send spread over the index
+  std::vector<int> homes(INDEX_SIZE, 0);
+  char id[24];
+  for (int n = 0; n < 64 * INDEX_SIZE; n++) {
+    snprintf(id, sizeof(id), "%d", n);
+    homes[homeOf(id)]++;
+  }
+  int fullest = 0;
+  for (int h : homes) {
+    fullest = max(fullest, h);
+  }
+  expect(fullest < 2 * 64, "numeric node IDs spread over the index");
+  printf("  test vectors checked; %d numeric IDs over %d positions, fullest %d (mean 64)\n", 64 * INDEX_SIZE,
+         INDEX_SIZE, fullest);
+}
+
+static void checkFullTable(DeviceRegistry& registry) {
+  printf("\nFull table (%d devices, %d index positions):\n", MAX_DEVICES, INDEX_SIZE);
+  registry.clear();
+  std::vector<std::string> ids;
+  collidingIds(INDEX_SIZE - 1, MAX_DEVICES + 1, ids);  // One chain, wrapping past the end
+
+  std::map<std::string, DeviceHandle> model;
+  bool lowFirst = true;
+  for (int i = 0; i < MAX_DEVICES; i++) {
+    DeviceHandle h = registry.insert(String(ids[i].c_str()));
+    lowFirst = lowFirst && h == i;
+    model[ids[i]] = h;
+  }
+  expect(lowFirst, "slots handed out from the lowest");
+  expect(registry.isFull(), "full after MAX_DEVICES inserts");
+  expect(registry.insert(String(ids[MAX_DEVICES].c_str())) == INVALID_DEVICE, "insert into a full table fails");
+  expect(registry.insert(String(ids[0].c_str())) == INVALID_DEVICE, "duplicate insert fails");
+  expect(consistent(registry, model, ids), "every device found in a full single chain");
+
+  // Remove from the middle of the chain: the rest must shift back
+  DeviceHandle freed = model[ids[3]];
+  const DeviceInfo* freedInfo = &registry[freed];
+  expect(registry.remove(freed), "remove from the middle of a chain");
+  expect(!registry.remove(freed), "second remove of the same handle fails");
+  expect(!registry.remove(MAX_DEVICES) && !registry.remove(INVALID_DEVICE), "remove of an out-of-range handle fails");
+  model.erase(ids[3]);
+  expect(consistent(registry, model, ids), "chain intact after removing from its middle");
+
+  DeviceHandle reused = registry.insert(String(ids[MAX_DEVICES].c_str()));
+  expect(reused == freed, "freed slot reused");
+  expect(&registry[reused] == freedInfo && registry[reused].id == ids[MAX_DEVICES].c_str(),
+         "reused slot keeps its DeviceInfo");
+  model[ids[MAX_DEVICES]] = reused;
+  expect(consistent(registry, model, ids), "consistent after reuse");
+
+  registry.clear();
+  model.clear();
+  expect(consistent(registry, model, ids) && registry.first() == INVALID_DEVICE, "clear() empties the table");
+  printf("  one %d-long chain wrapping the index: insert, overflow, middle removal and reuse checked\n",
+         MAX_DEVICES);
+}
+
+static void checkChurn(DeviceRegistry& registry, const CheckOptions& options) {
+  printf("\nChurn (%ld operations, seed %u):\n", options.ops, options.seed);
+  std::mt19937 rng(options.seed);
+  registry.clear();
+
+  // Clusters at the wrap point, at adjacent homes (chains that run into
+  // each other) and anywhere
+  std::vector<std::string> ids;
+  collidingIds(INDEX_SIZE - 1, 6, ids);
+  collidingIds(0, 6, ids);
+  collidingIds(1, 4, ids);
+  collidingIds(INDEX_SIZE / 2, 6, ids);
+  collidingIds(INDEX_SIZE / 2 + 1, 4, ids);
+  char id[24];
+  for (int n = 0; n < 2 * MAX_DEVICES; n++) {
+    snprintf(id, sizeof(id), "%d", 1000 + n);
+    ids.push_back(id);
+  }
+
+  std::map<std::string, DeviceHandle> model;
+  long inserts = 0, removes = 0, fullRejects = 0, inconsistent = 0;
+  for (long op = 0; op < options.ops; op++) {
+    const std::string& pick = ids[rng() % ids.size()];
+    bool present = model.count(pick) > 0;
+    // Lean towards full or empty tables in long stretches
+    bool growing = (op / 5000) % 2 == 0;
+    if (rng() % 100 < (growing ? 70u : 30u)) {
+      DeviceHandle h = registry.insert(String(pick.c_str()));
+      if (present || model.size() == MAX_DEVICES) {
+        expect(h == INVALID_DEVICE, "insert of a present ID or into a full table fails");
+        fullRejects += !present;
+      } else {
+        expect(registry.isValid(h), "insert succeeds with room");
+        if (registry.isValid(h)) {
+          model[pick] = h;
+          inserts++;
+        }
+      }
+    } else if (present) {
+      expect(registry.remove(model[pick]), "remove of a present device");
+      model.erase(pick);
+      removes++;
+    } else {
+      expect(registry.find(String(pick.c_str())) == INVALID_DEVICE, "absent ID not found");
+    }
+    if (!consistent(registry, model, ids) && inconsistent++ == 0) {
+      printf("  registry and model diverge at operation %ld\n", op);
+    }
+  }
+  expect(inconsistent == 0, "registry matches the model after every operation");
+  printf("  %ld inserts, %ld removes, %ld rejected as full, %zu IDs: %ld inconsistent\n", inserts, removes,
+         fullRejects, ids.size(), inconsistent);
+}
+
+template <typename F>
+static double timeNanos(long repeats, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < repeats; i++) {
+    body(i);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / repeats;
+}
+
+// How devices were found before the index: compare every live ID
+static DeviceHandle linearFind(const DeviceRegistry& registry, const String& id) {
+  for (DeviceHandle h = registry.first(); h != INVALID_DEVICE; h = registry.next(h)) {
+    if (registry[h].id == id) {
+      return h;
+    }
+  }
+  return INVALID_DEVICE;
+}
+
+static void benchmark(DeviceRegistry& registry) {
+  printf("\nLookup cost (full table of %d):\n", MAX_DEVICES);
+  registry.clear();
+  std::vector<String> present, absent;
+  char id[24];
+  for (int n = 0; n < MAX_DEVICES; n++) {
+    snprintf(id, sizeof(id), "%d", 100 + n);  // Node IDs as the nodes send them
+    present.push_back(String(id));
+    registry.insert(present.back());
+    snprintf(id, sizeof(id), "%d", 900 + n);
+    absent.push_back(String(id));
+  }
+
+  volatile int sink = 0;
+  const long repeats = 2000000;
+  double hit = timeNanos(repeats, [&](long i) { sink = sink + registry.find(present[i % MAX_DEVICES]); });
+  double miss = timeNanos(repeats, [&](long i) { sink = sink + registry.find(absent[i % MAX_DEVICES]); });
+  double linearHit = timeNanos(repeats, [&](long i) { sink = sink + linearFind(registry, present[i % MAX_DEVICES]); });
+  double linearMiss = timeNanos(repeats, [&](long i) { sink = sink + linearFind(registry, absent[i % MAX_DEVICES]); });
+  printf("  find(), hit:   %6.1f ns index, %6.1f ns linear scan\n", hit, linearHit);
+  printf("  find(), miss:  %6.1f ns index, %6.1f ns linear scan\n", miss, linearMiss);
+
+  double churn = timeNanos(repeats / 4, [&](long i) {
+    const String& id = present[i % MAX_DEVICES];
+    registry.remove(registry.find(id));
+    sink = sink + registry.insert(id);
+  });
+  printf("  remove + insert: %6.1f ns\n", churn);
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Device registry (DeviceRegistry) ===\n");
+  printf("%d devices, %d-position index, %zu bytes (+ %zu per device used)\n\n", MAX_DEVICES, INDEX_SIZE,
+         sizeof(DeviceRegistry), sizeof(DeviceInfo));
+  static DeviceRegistry registry;
+  checkHash();
+  checkFullTable(registry);
+  checkChurn(registry, options);
+  benchmark(registry);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,361 @@
+// Native check of the history rollups (pio run -e native_rollup).
+//
+// Feeds DeviceRollups (src/rollup_tiers.cpp) a week and a day of synthetic
+// readings (2-5 s reports, load steps, spikes and offline gaps) the way
+// updateDeviceHistory does, then checks every tier against a naive
+// replay of the same integration segments: each tier's energy equals the
+// raw-integrated energy over the span it holds, and every bucket's
+// min/max/mean matches a brute-force aggregate, including across 2^32 ms
+// of audit clock, where a 32-bit millis() would wrap. Also checks which
+// store a history request is served from (HistoryQuery::selectTier) and
+// measures the cost of an update. Exits non-zero on any failure.
+//
+//   .pio/build/native_rollup/program [--seed N] [--days N]
+
+#include <Arduino.h>
+#include <chrono>
+#include <climits>
+#include <random>
+#include <vector>
+#include "config.h"
+#include "history_query.h"
+#include "rollup_tiers.h"
+
+#define CHECK_BATCH 32
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  int days = 8;
+};
+
+// One integration segment as updateDeviceHistory hands it over
+struct Segment {
+  uint64_t from;  // Audit clock, ms
+  uint64_t to;
+  float power;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--days") && hasValue) options.days = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--days N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Readings of one device: reports every 2-5 s, a load that steps between
+// levels, short spikes, and now and then minutes to hours offline
+static std::vector<Segment> makeProfile(std::mt19937& rng, uint64_t start, uint64_t duration) {
+  std::uniform_int_distribution<int> interval(2000, 5000);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  const float levels[] = {0.0f, 0.8f, 45.0f, 120.0f, 1800.0f, 2400.0f};
+
+  std::vector<Segment> segments;
+  uint64_t now = start;
+  uint64_t previous = now;
+  float level = 45.0f;
+  segments.push_back({now, now, level});  // First reading: nothing to integrate
+  while (now - start < duration) {
+    float chance = unit(rng);
+    if (chance < 0.0004f) {
+      now += 60000UL * (1 + rng() % 240);  // Offline up to 4 h
+    } else {
+      now += interval(rng);
+    }
+    if (unit(rng) < 0.01f) {
+      level = levels[rng() % 6];
+    }
+    float power = level * (0.95f + 0.1f * unit(rng));
+    if (unit(rng) < 0.002f) {
+      power = 3500.0f;  // Inrush spike
+    }
+    power = roundf(power * 10.0f) / 10.0f;  // PZEM resolution
+    segments.push_back({previous, now, power});
+    previous = now;
+  }
+  return segments;
+}
+
+static void feed(DeviceRollups& rollups, const std::vector<Segment>& segments) {
+  for (const Segment& segment : segments) {
+    rollups.add(segment.from, segment.to, segment.power);
+  }
+}
+
+static std::vector<RollupPoint> readTier(const DeviceRollups& rollups, int tier, uint64_t from = 0,
+                                         uint64_t to = UINT64_MAX) {
+  std::vector<RollupPoint> points;
+  RollupReadState state(from, to);
+  RollupPoint batch[CHECK_BATCH];
+  int n;
+  while ((n = rollups.readBatch(tier, state, batch, CHECK_BATCH)) > 0) {
+    points.insert(points.end(), batch, batch + n);
+  }
+  return points;
+}
+
+// Energy (kWh) of the segments between from and to, by the same rectangle rule
+static double integrate(const std::vector<Segment>& segments, uint64_t from, uint64_t to) {
+  double energy = 0;
+  for (const Segment& segment : segments) {
+    uint64_t start = max(segment.from, from);
+    uint64_t end = min(segment.to, to);
+    if (end > start) {
+      energy += segment.power * (double)(end - start) / 3600000000.0;
+    }
+  }
+  return energy;
+}
+
+static bool close(double a, double b, double tolerance) {
+  return fabs(a - b) <= tolerance * max(fabs(a), fabs(b)) + 1e-9;
+}
+
+static const char* TIER_NAMES[ROLLUP_TIER_COUNT] = {"1-minute", "15-minute", "hourly"};
+
+static void checkEnergy(const std::vector<Segment>& segments, const DeviceRollups& rollups, const char* label) {
+  printf("Energy (%s):\n", label);
+  uint64_t end = segments.back().to;
+  for (int tier = 0; tier < ROLLUP_TIER_COUNT; tier++) {
+    std::vector<RollupPoint> points = readTier(rollups, tier);
+    double rolled = 0;
+    for (const RollupPoint& point : points) {
+      rolled += point.energy;
+    }
+    double raw = integrate(segments, rollups.firstTimestamp(tier), end);
+    expect(close(rolled, raw, 1e-5), "tier energy equals raw-integrated energy");
+    printf("  %-9s %3d of %3d buckets, %8.4f kWh rolled up, %8.4f kWh integrated (%+.2e)\n", TIER_NAMES[tier],
+           (int)points.size(), rollups.size(tier), rolled, raw, raw > 0 ? (rolled - raw) / raw : 0.0);
+  }
+}
+
+static void checkBuckets(const std::vector<Segment>& segments, const DeviceRollups& rollups) {
+  // Brute force: every bucket's aggregate from every segment touching it
+  printf("Buckets: ");
+  int checked = 0;
+  for (int tier = 0; tier < ROLLUP_TIER_COUNT; tier++) {
+    uint64_t width = rollups.width(tier);
+    std::vector<RollupPoint> points = readTier(rollups, tier);
+    size_t next = 0;
+    for (uint64_t start = rollups.firstTimestamp(tier); start <= rollups.lastTimestamp(tier); start += width) {
+      uint64_t end = start + width;
+      double energy = 0;
+      uint64_t covered = 0;
+      float minPower = 1e9f;
+      float maxPower = -1;
+      for (const Segment& segment : segments) {
+        bool touches = segment.to > segment.from
+          ? segment.from < end && segment.to > start
+          : segment.from >= start && segment.from < end;
+        if (!touches) {
+          continue;
+        }
+        uint64_t overlap = min(segment.to, end) - max(segment.from, start);
+        energy += segment.power * (double)overlap / 3600000000.0;
+        covered += overlap;
+        minPower = min(minPower, segment.power);
+        maxPower = max(maxPower, segment.power);
+      }
+      if (maxPower < 0) {
+        expect(next == points.size() || points[next].timestamp != start, "empty bucket is skipped");
+        continue;
+      }
+      if (next == points.size() || points[next].timestamp != start) {
+        expect(false, "bucket with readings is returned");
+        continue;
+      }
+      const RollupPoint& point = points[next++];
+      expect(close(point.energy, energy, 1e-5), "bucket energy");
+      expect(point.coveredMs / 100 == covered / 100, "bucket coverage");
+      expect(fabs(point.minPower - minPower) < 0.05f && fabs(point.maxPower - maxPower) < 0.05f, "bucket min/max");
+      if (covered >= 1000) {
+        expect(close(point.avgPower, energy * 3600000000.0 / covered, 2e-3), "bucket mean is time-weighted");
+      }
+      checked++;
+    }
+    expect(next == points.size(), "no buckets beyond the brute-force ones");
+  }
+  printf("%d buckets match a brute-force aggregate\n", checked);
+}
+
+static void checkRange(const DeviceRollups& rollups) {
+  // A range read returns exactly the buckets overlapping it
+  printf("Range: ");
+  std::vector<RollupPoint> all = readTier(rollups, ROLLUP_QUARTER);
+  uint64_t from = rollups.firstTimestamp(ROLLUP_QUARTER) + 7 * 900000UL + 12345;
+  uint64_t to = from + 6 * 3600000UL;
+  std::vector<RollupPoint> part = readTier(rollups, ROLLUP_QUARTER, from, to);
+  size_t expected = 0;
+  for (const RollupPoint& point : all) {
+    if (point.timestamp + 900000UL > from && point.timestamp <= to) {
+      expected++;
+    }
+  }
+  expect(part.size() == expected && !part.empty() && part.front().timestamp + 900000UL > from, "range read");
+  printf("%zu of %zu quarter-hour buckets in a 6 h range\n", part.size(), all.size());
+}
+
+static void checkSelection(std::mt19937& rng) {
+  // A device that has reported every 3 s for 3 days
+  printf("Tier selection: ");
+  static HistoryBuffer history;
+  static DeviceRollups rollups;
+  DeviceReading reading = {};
+  unsigned long start = 1000;
+  unsigned long now = start;
+  for (; now < start + 3 * 86400000UL; now += 3000) {
+    reading.power = 100.0f + rng() % 50;
+    reading.timestamp = now;
+    rollups.add(history.isEmpty() ? now : history.lastTimestamp(), now, reading.power);
+    history.append(reading);
+  }
+  unsigned long newest = history.lastTimestamp();
+
+  struct Case {
+    const char* what;
+    unsigned long range;
+    uint32_t points;
+    int tier;
+  };
+  const Case cases[] = {
+    {"whole raw ring by default", newest - history.firstTimestamp(), HISTORY_DEFAULT_POINTS, HISTORY_TIER_RAW},
+    {"last 10 minutes, 300 points: raw", 600000UL, 300, HISTORY_TIER_RAW},
+    {"last 10 minutes, 50 points: 1-minute", 600000UL, 50, ROLLUP_MINUTE},
+    {"last 90 minutes: 1-minute", 5400000UL, HISTORY_DEFAULT_POINTS, ROLLUP_MINUTE},
+    {"last 2 hours: 15-minute (one more bucket than the 1-minute ring)", 7200000UL, HISTORY_DEFAULT_POINTS, ROLLUP_QUARTER},
+    {"last 20 hours: 15-minute", 72000000UL, HISTORY_DEFAULT_POINTS, ROLLUP_QUARTER},
+    {"last day, 50 points: hourly", 86400000UL, 50, ROLLUP_HOUR},
+    {"last week: hourly (all there is)", 7 * 86400000UL, HISTORY_DEFAULT_POINTS, ROLLUP_HOUR},
+    {"last week, 10 points: hourly (fewest)", 7 * 86400000UL, 10, ROLLUP_HOUR},
+  };
+  for (const Case& c : cases) {
+    HistoryQuery query;
+    query.to = newest;
+    query.from = newest > c.range ? newest - c.range : 0;
+    query.points = c.points;
+    query.selectTier(history, rollups);
+    if (query.tier != c.tier) {
+      printf("\n  %s: got tier %d", c.what, query.tier);
+    }
+    expect(query.tier == c.tier, c.what);
+  }
+
+  // Four hours old, after 50 days of earlier boots on the audit clock: a
+  // day's range starts before its first reading
+  const int64_t offset = 50 * 86400000LL;
+  static HistoryBuffer youngHistory;
+  static DeviceRollups youngRollups;
+  for (now = start; now < start + 4 * 3600000UL; now += 3000) {
+    reading.timestamp = now;
+    unsigned long previous = youngHistory.isEmpty() ? now : youngHistory.lastTimestamp();
+    youngRollups.add(previous + offset, now + offset, reading.power);
+    youngHistory.append(reading);
+  }
+  HistoryQuery query;
+  query.to = youngHistory.lastTimestamp();
+  query.from = 0;
+  query.points = 200;
+  query.clockOffset = offset;
+  query.selectTier(youngHistory, youngRollups);
+  expect(query.tier == ROLLUP_QUARTER, "young device, last day: 15-minute, not hourly");
+
+  // Its buckets come back on millis()
+  RollupSeries quarters(youngRollups, ROLLUP_QUARTER, offset);
+  uint32_t position = quarters.lowerBound(query.from);
+  uint32_t end = quarters.upperBound(query.to);
+  HistoryPoint point;
+  int read = 0;
+  bool inRange = true;
+  while (quarters.read(position, end, &point, 1) == 1) {
+    inRange = inRange && point.timestamp + 900000UL > start && point.timestamp <= query.to;
+    read++;
+  }
+  expect(read == youngRollups.size(ROLLUP_QUARTER) && inRange, "rollup timestamps are converted back to millis()");
+  printf("%zu queries\n", sizeof(cases) / sizeof(cases[0]) + 2);
+}
+
+static void benchmark(const std::vector<Segment>& segments) {
+  static DeviceRollups rollups;
+  auto start = std::chrono::steady_clock::now();
+  feed(rollups, segments);
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("Update:  %.0f ns per reading on the host (%zu readings, all tiers)\n", wall * 1e9 / segments.size(),
+         segments.size());
+
+  start = std::chrono::steady_clock::now();
+  size_t points = 0;
+  const int reads = 1000;
+  for (int i = 0; i < reads; i++) {
+    points += readTier(rollups, ROLLUP_HOUR).size();
+  }
+  wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("Read:    %.1f us per full hourly tier (%zu buckets)\n", wall * 1e6 / reads, points / reads);
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  std::mt19937 rng(options.seed);
+
+  printf("=== History rollups (DeviceRollups <-> naive replay) ===\n");
+  printf("%d/%d/%d buckets of 1 min/15 min/1 h, %zu bytes per device (raw ring: %zu)\n\n",
+         ROLLUP_MINUTE_BUCKETS, ROLLUP_QUARTER_BUCKETS, ROLLUP_HOUR_BUCKETS, sizeof(DeviceRollups),
+         sizeof(HistoryBuffer));
+
+  // Young device: every tier still holds the whole history
+  std::vector<Segment> young = makeProfile(rng, 5000, 100 * 60000UL);
+  static DeviceRollups youngRollups;
+  feed(youngRollups, young);
+  checkEnergy(young, youngRollups, "100 minutes");
+  double total = integrate(young, 0, UINT64_MAX);
+  std::vector<RollupPoint> hours = readTier(youngRollups, ROLLUP_HOUR);
+  double hourly = 0;
+  for (const RollupPoint& point : hours) {
+    hourly += point.energy;
+  }
+  expect(close(hourly, total, 1e-5), "young device: hourly tier holds all energy");
+
+  // Old device: the minute and quarter tiers have wrapped many times
+  std::vector<Segment> old = makeProfile(rng, 123456, options.days * 86400000UL);
+  static DeviceRollups oldRollups;
+  feed(oldRollups, old);
+  checkEnergy(old, oldRollups, "long run");
+  checkBuckets(old, oldRollups);
+  checkRange(oldRollups);
+
+  // 2^32 ms into the audit clock (49.7 days) falls inside a bucket of
+  // every tier; a 32-bit millis() would have wrapped there
+  std::vector<Segment> late = makeProfile(rng, 0xFFFFFFFFULL - 90 * 60000ULL, 3 * 3600000UL);
+  static DeviceRollups lateRollups;
+  feed(lateRollups, late);
+  checkEnergy(late, lateRollups, "across 2^32 ms");
+  checkBuckets(late, lateRollups);
+  expect(lateRollups.lastTimestamp(ROLLUP_MINUTE) > 0xFFFFFFFFULL, "buckets go on past 2^32 ms");
+  checkSelection(rng);
+
+  oldRollups.clear();
+  expect(oldRollups.isEmpty() && readTier(oldRollups, ROLLUP_HOUR).empty(), "clear empties every tier");
+  printf("\n");
+  benchmark(old);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,480 @@
+// Host simulator for the main auditor firmware (pio run -e native).
+//
+// Runs the unmodified setup()/loop() from src/main.cpp on a virtual clock
+// with two simulated PZEM-004T meters on the UARTs, a fleet of virtual
+// wireless nodes on the ESP-NOW path (every fourth batching like a
+// low-power node) and HTTP/SSE clients exercising the API, then prints a
+// summary. Time is accelerated: each loop() iteration
+// costs 1 ms of virtual time (its delay(1)), nothing else waits.
+// The audit log partition is emulated in a temporary file, or in the
+// --flash file, which a later run recovers from like a rebooted auditor.
+//
+// With --clients N the run ends with N dashboards on /events, then the
+// same N polling /api/devices every 2 s as the dashboard used to, each
+// for --client-minutes, after as long with none. Host CPU per simulated
+// second and the heap high-water mark are reported for each.
+//
+//   .pio/build/native/program [--minutes N] [--nodes N] [--seed N]
+//                             [--poll-ms N] [--loss P] [--flash FILE]
+//                             [--clients N] [--client-minutes N]
+//                             [--dump] [--verbose]
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <esp_now.h>
+#include <esp_partition.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <vector>
+#include "audit_log.h"
+#include "config.h"
+#include "device_registry.h"
+#include "export_stream.h"
+#include "json_check.h"
+#include "pzem_model.h"
+#include "virtual_node.h"
+
+#define SIM_BATCH_SIZE 6  // Measurements per frame from low-power nodes (every fourth node)
+#define SIM_FLASH_SIZE 0x170000  // The auditlog partition in partitions.csv
+#define SIM_DASHBOARD_POLL_MS 2000  // The dashboard's refresh without /events
+#define SIM_EVENT_READ_MS 100  // How often a browser takes queued events
+#define SIM_HEAP_HEADER 16  // Size prefix of a counted allocation (keeps max_align_t alignment)
+
+// Firmware under test (src/main.cpp)
+void setup();
+void loop();
+extern HardwareSerial PZEM1Serial;
+extern HardwareSerial PZEM2Serial;
+extern AsyncWebServer server;
+extern DeviceRegistry devices;
+extern AuditLog auditLog;
+
+struct SimOptions {
+  unsigned long minutes = 60;
+  int nodes = 6;
+  uint32_t seed = 1;
+  unsigned long pollMs = 10000;  // HTTP client refresh period
+  unsigned long nodeIntervalMs = 5000;
+  unsigned long nodeJitterMs = 250;
+  float loss = 0;  // Probability each node frame is lost on air
+  int clients = 0;  // Dashboards in the push/poll comparison; 0 skips it
+  unsigned long clientMinutes = 5;  // Length of each comparison phase
+  const char* flashPath = nullptr;  // Temporary flash image if unset
+  bool dump = false;
+  bool verbose = false;
+};
+
+struct HttpStats {
+  uint32_t requests = 0;
+  uint32_t malformed = 0;
+  uint32_t errors = 0;
+  uint64_t bytes = 0;
+  double wallMicros = 0;
+};
+
+// What a set of dashboards cost the auditor over one comparison phase
+struct ClientLoad {
+  const char* name;
+  double loopMicros = 0;   // Wall time in loop(), where events are built and sent
+  double serveMicros = 0;  // Wall time answering requests
+  size_t heapBase = 0;     // Bytes in use when the phase started
+  size_t heapHigh = 0;
+  uint32_t responses = 0;  // Event frames or /api/devices bodies
+  uint64_t bytes = 0;
+  uint32_t dropped = 0;    // Event frames refused by a full client queue
+
+  ClientLoad(const char* label) : name(label) {}
+};
+
+static bool parseOptions(int argc, char** argv, SimOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    String arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--minutes" && hasValue) options.minutes = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--nodes" && hasValue) options.nodes = atoi(argv[++i]);
+    else if (arg == "--seed" && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--poll-ms" && hasValue) options.pollMs = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--loss" && hasValue) options.loss = atof(argv[++i]);
+    else if (arg == "--clients" && hasValue) options.clients = atoi(argv[++i]);
+    else if (arg == "--client-minutes" && hasValue) options.clientMinutes = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--flash" && hasValue) options.flashPath = argv[++i];
+    else if (arg == "--dump") options.dump = true;
+    else if (arg == "--verbose") options.verbose = true;
+    else {
+      fprintf(stderr, "usage: %s [--minutes N] [--nodes N] [--seed N] [--poll-ms N] [--loss P] [--flash FILE] "
+              "[--clients N] [--client-minutes N] [--dump] [--verbose]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Issue one request through the registered handlers and drain the body
+static std::string httpGet(const String& url, HttpStats& stats, bool expectJson,
+                           const std::vector<std::pair<String, String>>& params = {}) {
+  AsyncWebServerRequest request(HTTP_GET, url);
+  for (const auto& param : params) {
+    request.addParam(param.first, param.second);
+  }
+  auto start = std::chrono::steady_clock::now();
+  server.dispatch(&request);
+
+  std::string body;
+  AsyncWebServerResponse* response = request.response();
+  if (response) {
+    response->drain(body);
+  }
+  stats.wallMicros += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  stats.requests++;
+  stats.bytes += body.size();
+  if (!response || response->code() != 200) {
+    stats.errors++;
+  } else if (expectJson && !isWellFormedJson(body)) {
+    stats.malformed++;
+    fprintf(stderr, "malformed JSON from %s: %.200s\n", url.c_str(), body.c_str());
+  }
+  return body;
+}
+
+// Bytes held through operator new: the firmware, the HAL's library shims
+// and this file. The dashboard comparison samples it where the auditor
+// holds the most (a response built, frames queued); the host allocator's
+// totals behind ESP.getFreeHeap() also count chunks it caches after free
+static size_t heapInUse = 0;
+
+void* operator new(size_t size) {
+  uint8_t* block = (uint8_t*)malloc(size + SIM_HEAP_HEADER);
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  *(size_t*)block = size;
+  heapInUse += size;
+  return block + SIM_HEAP_HEADER;
+}
+
+void operator delete(void* p) noexcept {
+  if (p) {
+    uint8_t* block = (uint8_t*)p - SIM_HEAP_HEADER;
+    heapInUse -= *(size_t*)block;
+    free(block);
+  }
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return operator new(size);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+
+static void sampleHeap(ClientLoad& load) {
+  load.heapHigh = max(load.heapHigh, heapInUse);
+}
+
+static std::vector<std::unique_ptr<VirtualNode>> nodes;
+
+// One loop() iteration with the nodes reporting; returns its wall time (us)
+static double runLoop(unsigned long now) {
+  for (auto& node : nodes) {
+    if (node->due(now)) {
+      node->send(now);
+    }
+  }
+  auto start = std::chrono::steady_clock::now();
+  loop();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// GET /api/devices as a dashboard does; the heap is sampled while the
+// response is still held
+static void fetchDevices(ClientLoad& load, HttpStats& stats) {
+  AsyncWebServerRequest request(HTTP_GET, "/api/devices");
+  auto start = std::chrono::steady_clock::now();
+  server.dispatch(&request);
+  std::string body;
+  AsyncWebServerResponse* response = request.response();
+  sampleHeap(load);
+  if (response) {
+    response->drain(body);
+  }
+  load.serveMicros += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  load.responses++;
+  load.bytes += body.size();
+  stats.requests++;
+  if (!response || response->code() != 200) {
+    stats.errors++;
+  } else if (!isWellFormedJson(body)) {
+    stats.malformed++;
+  }
+}
+
+// `clients` dashboards for `duration` ms of virtual time: subscribed to
+// /events (loading the list on connect and on a "devices" event), or
+// polling the list every SIM_DASHBOARD_POLL_MS, staggered
+static void runDashboards(ClientLoad& load, int clients, bool push, unsigned long duration, HttpStats& stats) {
+  std::vector<std::unique_ptr<AsyncWebServerRequest>> subscriptions;
+  std::vector<AsyncEventSourceClient*> sources;
+  std::vector<unsigned long> nextPoll;
+  unsigned long startedAt = millis();
+  load.heapBase = heapInUse;
+  for (int i = 0; i < clients; i++) {
+    if (push) {
+      subscriptions.emplace_back(new AsyncWebServerRequest(HTTP_GET, "/events"));
+      server.dispatch(subscriptions.back().get());
+      sources.push_back(subscriptions.back()->eventSourceClient());
+      fetchDevices(load, stats);
+    } else {
+      nextPoll.push_back(startedAt + SIM_DASHBOARD_POLL_MS * i / clients);
+    }
+  }
+
+  unsigned long nextEventRead = startedAt;
+  while ((long)(millis() - (startedAt + duration)) < 0) {
+    unsigned long now = millis();
+    for (size_t i = 0; i < nextPoll.size(); i++) {
+      if ((long)(now - nextPoll[i]) >= 0) {
+        fetchDevices(load, stats);
+        nextPoll[i] += SIM_DASHBOARD_POLL_MS;
+      }
+    }
+    if (!sources.empty() && (long)(now - nextEventRead) >= 0) {
+      sampleHeap(load);
+      for (AsyncEventSourceClient* source : sources) {
+        std::string message;
+        while (source && source->takeMessage(message)) {
+          load.responses++;
+          load.bytes += message.size();
+          if (message.find("event: devices") != std::string::npos) {
+            fetchDevices(load, stats);
+          }
+        }
+      }
+      nextEventRead = now + SIM_EVENT_READ_MS;
+    }
+    load.loopMicros += runLoop(now);
+    sampleHeap(load);
+  }
+
+  for (AsyncEventSourceClient* source : sources) {
+    if (source) {
+      load.dropped += source->droppedCount();
+      source->close();
+    }
+  }
+}
+
+static void printLoad(const ClientLoad& load, unsigned long duration) {
+  double seconds = duration / 1000.0;
+  printf("  %-13s CPU %6.2f ms/s (loop %6.2f, requests %6.2f), heap high-water +%6lu B, %6lu messages, %8llu bytes, "
+         "%lu dropped\n",
+         load.name, (load.loopMicros + load.serveMicros) / 1000.0 / seconds, load.loopMicros / 1000.0 / seconds,
+         load.serveMicros / 1000.0 / seconds, (unsigned long)(max(load.heapHigh, load.heapBase) - load.heapBase),
+         (unsigned long)load.responses,
+         (unsigned long long)load.bytes, (unsigned long)load.dropped);
+}
+
+// Acknowledgements from the firmware go back to the node they address
+static void onFirmwareSend(const uint8_t* mac, const uint8_t* data, int len) {
+  TelemetryAck ack;
+  if (!TelemetryCodec::decodeAck(data, len, ack)) {
+    return;
+  }
+  for (auto& node : nodes) {
+    if (memcmp(node->macAddress(), mac, 6) == 0 && node->hash() == ack.nodeHash) {
+      node->acknowledged();
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  SimOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  HardwareSerial::setConsoleEnabled(options.verbose);
+  if (!halFlashAttach(options.flashPath, SIM_FLASH_SIZE, AUDIT_LOG_PARTITION, AUDIT_LOG_SUBTYPE)) {
+    fprintf(stderr, "cannot open flash image %s\n", options.flashPath ? options.flashPath : "(temporary)");
+    return 2;
+  }
+
+  // Two wired loads: a fridge and a TV that idles in standby
+  PZEMModel meter1(PZEM1_ADDR, LoadModel(LoadModel::randomProfile(0), options.seed * 31 + 1));
+  PZEMModel meter2(PZEM2_ADDR, LoadModel(LoadModel::randomProfile(3), options.seed * 31 + 2));
+  PZEM1Serial.attach(&meter1);
+  PZEM2Serial.attach(&meter2);
+
+  setup();
+  halEspNowOnSend(onFirmwareSend);
+
+  for (int i = 0; i < options.nodes; i++) {
+    LoadModel model(LoadModel::randomProfile(options.seed + i), options.seed * 1009 + i);
+    nodes.emplace_back(new VirtualNode(i, model, options.nodeIntervalMs, options.nodeJitterMs));
+    nodes.back()->setLoss(options.loss);
+    if (i % 4 == 2) {
+      nodes.back()->setBatching(SIM_BATCH_SIZE);  // Low-power node
+    }
+  }
+
+  // A dashboard subscribed to /events, reading everything every 100 ms
+  AsyncWebServerRequest subscribe(HTTP_GET, "/events");
+  server.dispatch(&subscribe);
+  AsyncEventSourceClient* dashboard = subscribe.eventSourceClient();
+  uint32_t eventFrames = 0;
+  uint64_t eventBytes = 0;
+
+  HttpStats stats;
+  unsigned long startedAt = millis();
+  unsigned long endAt = startedAt + options.minutes * 60000UL;
+  unsigned long nextPoll = startedAt + options.pollMs;
+  unsigned long nextEventRead = startedAt;
+  uint64_t iterations = 0;
+  int historyCursor = 0;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  while ((long)(millis() - endAt) < 0) {
+    unsigned long now = millis();
+
+    if ((long)(now - nextPoll) >= 0) {
+      // Device list, status and one device's history per refresh
+      httpGet("/api/devices", stats, true);
+      httpGet("/api/status", stats, true);
+
+      int index = 0;
+      for (DeviceHandle h = devices.first(); h != INVALID_DEVICE; h = devices.next(h), index++) {
+        if (index == historyCursor % max(1, devices.count())) {
+          // In turn the raw ring, a day from the rollup tiers, the last
+          // hour thinned to the chart's width and the energy buckets
+          int request = historyCursor / max(1, devices.count()) % 4;
+          if (request == 0) {
+            httpGet("/api/devices/" + devices[h].id, stats, true);
+          } else if (request == 1) {
+            httpGet("/api/devices/" + devices[h].id, stats, true, {{"range", "86400"}, {"points", "200"}});
+          } else if (request == 2) {
+            httpGet("/api/devices/" + devices[h].id, stats, true,
+                    {{"range", "3600"}, {"points", "120"}, {"decimate", "minmax"}, {"fields", "power"}});
+          } else {
+            httpGet("/api/energy/" + devices[h].id, stats, true);
+          }
+          break;
+        }
+      }
+      historyCursor++;
+      nextPoll = now + options.pollMs;
+    }
+
+    if (dashboard && (long)(now - nextEventRead) >= 0) {
+      std::string message;
+      while (dashboard->takeMessage(message)) {
+        eventFrames++;
+        eventBytes += message.size();
+      }
+      nextEventRead = now + SIM_EVENT_READ_MS;
+    }
+
+    runLoop(now);
+    iterations++;
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double simSeconds = (millis() - startedAt) / 1000.0;
+
+  printf("=== Simulation summary ===\n");
+  printf("Simulated %.0f s in %.2f s wall (%.0fx real time), %llu loop() iterations (%.2f us each)\n",
+         simSeconds, wallSeconds, simSeconds / max(wallSeconds, 1e-9), (unsigned long long)iterations,
+         wallSeconds * 1e6 / max<uint64_t>(iterations, 1));
+
+  printf("Devices: %d\n", devices.count());
+  for (DeviceHandle h = devices.first(); h != INVALID_DEVICE; h = devices.next(h)) {
+    DeviceInfo& device = devices[h];
+    printf("  %-14s %-24s readings=%-6lu avg=%8.1f W max=%8.1f W energy=%7.3f kWh%s%s%s\n",
+           device.id.c_str(), device.getDisplayName().c_str(), (unsigned long)device.history.totalAppended(),
+           device.avgPower, device.maxPower, device.totalEnergy,
+           device.standbyWaste ? " [standby]" : "", device.usageAnomaly ? " [24/7]" : "",
+           device.efficiencyIssue ? " [low PF]" : "");
+    LinkSummary link = device.link.summary();
+    if (link.valid) {
+      printf("  %-14s link: %d dBm, %lu frames, %lu lost (%.0f%% recent), %lu samples, %lu missed, %lu repeats, %lu ms interval%s\n",
+             "", link.rssi, (unsigned long)link.frames, (unsigned long)link.framesLost, link.lossRate * 100,
+             (unsigned long)link.samples, (unsigned long)link.samplesMissed, (unsigned long)link.duplicates,
+             link.frameInterval, device.isActive ? "" : " [inactive]");
+    }
+  }
+
+  printf("PZEM: %lu + %lu requests answered, meters counted %.3f / %.3f kWh\n",
+         (unsigned long)meter1.requestCount(), (unsigned long)meter2.requestCount(),
+         meter1.energyWattHours() / 1000.0, meter2.energyWattHours() / 1000.0);
+
+  uint32_t framesSent = 0;
+  uint32_t framesLost = 0;
+  uint32_t acks = 0;
+  for (auto& node : nodes) {
+    framesSent += node->sentCount();
+    framesLost += node->lostCount();
+    acks += node->ackCount();
+  }
+  printf("ESP-NOW: %lu frames from %d nodes, %lu lost on air, %lu acknowledged\n", (unsigned long)framesSent,
+         options.nodes, (unsigned long)framesLost, (unsigned long)acks);
+
+  printf("HTTP: %lu requests, %llu bytes, %lu errors, %lu malformed, %.1f us per request\n",
+         (unsigned long)stats.requests, (unsigned long long)stats.bytes, (unsigned long)stats.errors,
+         (unsigned long)stats.malformed, stats.wallMicros / max<uint32_t>(stats.requests, 1));
+  printf("Events: %lu frames, %llu bytes, %lu dropped\n", (unsigned long)eventFrames,
+         (unsigned long long)eventBytes, dashboard ? (unsigned long)dashboard->droppedCount() : 0UL);
+
+  // The same dashboards pushed to and polling, after a baseline with none
+  HttpStats clientStats;
+  if (options.clients > 0) {
+    if (dashboard) {
+      dashboard->close();
+    }
+    unsigned long duration = options.clientMinutes * 60000UL;
+    ClientLoad idle("no clients");
+    ClientLoad pushed("/events");
+    ClientLoad polled("/api/devices");
+    runDashboards(idle, 0, false, duration, clientStats);
+    runDashboards(pushed, options.clients, true, duration, clientStats);
+    runDashboards(polled, options.clients, false, duration, clientStats);
+    printf("Dashboards: %d for %lu min each way (host CPU per simulated second)\n", options.clients,
+           options.clientMinutes);
+    printLoad(idle, duration);
+    printLoad(pushed, duration);
+    printLoad(polled, duration);
+  }
+
+  // Left unflushed, as after a power cut
+  const FlashLogStats& logStats = auditLog.stats();
+  printf("Audit log: %lu records recovered (%lu torn) in %lu us at boot, %lu written, %lu pending, "
+         "%lu flushes (max %.1f ms), %lu erases, generation %lu of %lu segments\n",
+         (unsigned long)logStats.recovered, (unsigned long)logStats.torn, (unsigned long)logStats.recoveryMicros,
+         (unsigned long)logStats.written, (unsigned long)auditLog.pending(), (unsigned long)logStats.flushes,
+         logStats.maxFlushMicros / 1000.0, (unsigned long)logStats.erases, (unsigned long)logStats.generation,
+         (unsigned long)logStats.segments);
+
+  HttpStats finalStats;
+  std::string status = httpGet("/api/status", finalStats, true);
+  printf("Status: %s\n", status.c_str());
+
+  // Everything the auditor holds, as an analyst would download it
+  std::string csv = httpGet("/api/export", finalStats, false);
+  std::string binary = httpGet("/api/export", finalStats, false, {{"format", "binary"}});
+  printf("Export: %ld CSV rows (%zu bytes), %zu bytes binary%s\n", (long)std::count(csv.begin(), csv.end(), '\n') - 1,
+         csv.size(), binary.size(), binary.compare(0, 4, EXPORT_MAGIC) == 0 ? "" : " (BAD HEADER)");
+
+  if (options.dump) {
+    printf("%s\n", httpGet("/api/devices", finalStats, true).c_str());
+  }
+
+  return stats.malformed || stats.errors || finalStats.errors || clientStats.malformed || clientStats.errors ? 1 : 0;
+}
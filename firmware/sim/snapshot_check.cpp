@@ -0,0 +1,216 @@
+// Concurrent stress check of the snapshot publisher
+// (pio run -e native_snapshot, built with -fsanitize=thread).
+//
+// One writer thread plays loop(), filling the back buffer of a
+// SnapshotPublisher (src/device_snapshot.cpp) and publishing it as fast as
+// it can; reader threads play the HTTP handlers, pinning the front buffer
+// with SnapshotReader, sometimes holding it as long as a slow client
+// would: first one reader alone, which races the writer's flips most
+// often, then several. Every table the writer fills is stamped with its
+// generation in every field, so a reader can tell a torn or overwritten
+// table: each pinned table must be one whole generation, equal to its
+// version, stay unchanged for as long as it is pinned, and never be older
+// than one the same reader saw before. The writer must skip (not wait)
+// while its back buffer is pinned. Any data race fails the run through
+// TSan's exit code. Exits non-zero on any failure.
+//
+//   .pio/build/native_snapshot/program [--publishes N] [--readers N]
+
+#include <Arduino.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "device_registry.h"
+#include "device_snapshot.h"
+
+struct CheckOptions {
+  uint32_t publishes = 50000;
+  int readers = 3;
+};
+
+// What one reader thread saw
+struct ReaderResult {
+  uint32_t pins = 0;
+  uint32_t held = 0;         // Pins held across a pause
+  uint32_t torn = 0;         // Fields from more than one generation
+  uint32_t changed = 0;      // Table changed while pinned
+  uint32_t backwards = 0;    // Older than a table seen before
+  uint32_t notFound = 0;     // find() missed a device in the table
+  uint32_t newest = 0;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--publishes") && hasValue) options.publishes = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--readers") && hasValue) options.readers = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--publishes N] [--readers N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Generation g of the table: count and every field follow from g
+static void fillTable(DeviceTableSnapshot& table, uint32_t g) {
+  table.count = 1 + g % MAX_DEVICES;
+  for (uint16_t i = 0; i < table.count; i++) {
+    DeviceSnapshot& d = table.devices[i];
+    d = DeviceSnapshot();
+    d.handle = i;
+    snprintf(d.id, sizeof(d.id), "%u", 100 + i);
+    snprintf(d.name, sizeof(d.name), "Device %u gen %u", i, g);
+    d.idHash = DeviceRegistry::hashId(d.id);
+    d.lastSeen = g;
+    d.currentReading.timestamp = g;
+    d.currentReading.power = (float)(g % 100000);
+    d.totalEnergy = (float)(g % 100000);
+    d.windowSamples = g & 0xFFFF;
+    d.link.frames = g;
+  }
+}
+
+// Generation of a table if all of it is one, else UINT32_MAX
+static uint32_t generationOf(const DeviceTableSnapshot& table) {
+  uint32_t g = table.version;
+  if (table.count != 1 + g % MAX_DEVICES) {
+    return UINT32_MAX;
+  }
+  char name[DEVICE_NAME_MAX];
+  for (uint16_t i = 0; i < table.count; i++) {
+    const DeviceSnapshot& d = table.devices[i];
+    snprintf(name, sizeof(name), "Device %u gen %u", i, g);
+    if (d.handle != i || d.lastSeen != g || d.currentReading.timestamp != g || d.link.frames != g ||
+        d.currentReading.power != (float)(g % 100000) || d.totalEnergy != (float)(g % 100000) ||
+        d.windowSamples != (g & 0xFFFF) || strcmp(d.name, name) != 0) {
+      return UINT32_MAX;
+    }
+  }
+  return g;
+}
+
+static void readerLoop(SnapshotPublisher& publisher, const std::atomic<bool>& done, ReaderResult& result,
+                       uint32_t seed) {
+  uint32_t state = seed;
+  while (!done.load(std::memory_order_acquire)) {
+    SnapshotReader snapshot(publisher);
+    result.pins++;
+    if (snapshot->version == 0) {
+      continue;  // Nothing published yet
+    }
+
+    uint32_t g = generationOf(*snapshot);
+    if (g == UINT32_MAX) {
+      result.torn++;
+      continue;
+    }
+    if (g < result.newest) {
+      result.backwards++;
+    }
+    result.newest = max(result.newest, g);
+
+    char id[DEVICE_ID_MAX];
+    snprintf(id, sizeof(id), "%u", 100 + g % snapshot->count);
+    const DeviceSnapshot* found = snapshot->find(id);
+    if (!found || found->handle != (int16_t)(g % snapshot->count)) {
+      result.notFound++;
+    }
+
+    // Now and then hold the pin like a slow client, then look again
+    state = state * 1103515245 + 12345;
+    if ((state >> 16) % 16 == 0) {
+      for (int i = 0; i < 50; i++) {
+        std::this_thread::yield();
+      }
+      result.held++;
+      if (generationOf(*snapshot) != g) {
+        result.changed++;
+      }
+    }
+  }
+}
+
+static void checkPublisher(int readerCount, uint32_t publishes) {
+  printf("Writer and %d reader thread(s), %u publishes:\n", readerCount, publishes);
+  std::unique_ptr<SnapshotPublisher> fresh(new SnapshotPublisher());
+  SnapshotPublisher& publisher = *fresh;
+  std::atomic<bool> done(false);
+  std::vector<ReaderResult> results(readerCount);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < readerCount; i++) {
+    readers.emplace_back(readerLoop, std::ref(publisher), std::cref(done), std::ref(results[i]), 7919u * (i + 1));
+  }
+
+  // The owner task: fill and publish, skipping while the back buffer is pinned
+  uint32_t published = 0, attempts = 0;
+  while (published < publishes) {
+    attempts++;
+    DeviceTableSnapshot* table = publisher.beginWrite();
+    if (!table) {
+      std::this_thread::yield();
+      continue;
+    }
+    fillTable(*table, published + 1);  // The version publish() will stamp
+    publisher.publish();
+    published++;
+  }
+  done.store(true, std::memory_order_release);
+  for (std::thread& t : readers) {
+    t.join();
+  }
+
+  ReaderResult total;
+  for (const ReaderResult& r : results) {
+    total.pins += r.pins;
+    total.held += r.held;
+    total.torn += r.torn;
+    total.changed += r.changed;
+    total.backwards += r.backwards;
+    total.notFound += r.notFound;
+  }
+  printf("  %u pins (%u held across a pause): %u torn, %u changed while pinned, %u went backwards, %u lookups missed\n",
+         total.pins, total.held, total.torn, total.changed, total.backwards, total.notFound);
+  printf("  writer: %u published, %u skipped for a pinned back buffer\n", published, publisher.skippedPublishes());
+
+  expect(total.torn == 0, "every pinned table is one whole generation");
+  expect(total.changed == 0, "a pinned table does not change");
+  expect(total.backwards == 0, "a reader never sees an older table");
+  expect(total.notFound == 0, "find() locates every device of the table");
+  expect(publisher.skippedPublishes() == attempts - published, "every pinned back buffer counted as a skip");
+  expect(total.pins > 0 && total.held > 0, "readers ran alongside the writer");
+
+  SnapshotReader last(publisher);
+  expect(last->version == published && generationOf(*last) == published, "newest table is the last published");
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Snapshot publisher (SnapshotPublisher), writer and reader threads ===\n");
+  printf("%zu-byte tables of up to %d devices\n\n", sizeof(DeviceTableSnapshot), MAX_DEVICES);
+  // One reader alone races the writer's flips most often; several
+  // keep both buffers pinned and make the writer skip
+  checkPublisher(1, options.publishes);
+  printf("\n");
+  checkPublisher(options.readers, options.publishes / 5);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
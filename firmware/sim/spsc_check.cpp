@@ -0,0 +1,183 @@
+// Two-thread stress check of the lock-free SPSC ring
+// (pio run -e native_spsc, built with -fsanitize=thread).
+//
+// A producer thread plays the Wi-Fi receive callback and a consumer
+// thread plays loop(), on real threads so ThreadSanitizer sees every
+// access to the ring. The producer fills EspNowFrame slots in place
+// through reserve()/commit() with a pattern derived from a running
+// number; the consumer reads them through front()/release() and checks
+// each frame arrives once, in order and intact. Runs with a producer that
+// retries on a full ring (nothing may be lost) and one that drops like
+// the callback (received plus drops must equal sent), on the firmware's
+// ring and on one- and two-slot rings where head and tail chase each
+// other every item. Any data race fails the run through TSan's exit
+// code. Exits non-zero on any failure.
+//
+//   .pio/build/native_spsc/program [--items N]
+
+#include <Arduino.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "config.h"
+#include "espnow_queue.h"
+#include "spsc_queue.h"
+
+struct CheckOptions {
+  uint32_t items = 500000;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--items") && hasValue) options.items = strtoul(argv[++i], nullptr, 10);
+    else {
+      fprintf(stderr, "usage: %s [--items N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Frame `n`: its number up front, then bytes that depend on it
+static void fill(EspNowFrame& frame, uint32_t n) {
+  frame.len = 4 + n % (ESPNOW_RX_FRAME_MAX - 3);
+  memcpy(frame.data, &n, 4);
+  for (int i = 4; i < frame.len; i++) {
+    frame.data[i] = (uint8_t)(n * 31 + i);
+  }
+  memset(frame.mac, n & 0xFF, sizeof(frame.mac));
+  frame.rssi = -(int8_t)(n % 90);
+  frame.receivedAt = n;
+}
+
+static bool intact(const EspNowFrame& frame, uint32_t& n) {
+  if (frame.len < 4 || frame.len > ESPNOW_RX_FRAME_MAX) {
+    return false;
+  }
+  memcpy(&n, frame.data, 4);
+  if (frame.len != 4 + n % (ESPNOW_RX_FRAME_MAX - 3) || frame.receivedAt != n || frame.rssi != -(int8_t)(n % 90)) {
+    return false;
+  }
+  for (int i = 4; i < frame.len; i++) {
+    if (frame.data[i] != (uint8_t)(n * 31 + i)) {
+      return false;
+    }
+  }
+  return frame.mac[0] == (n & 0xFF) && frame.mac[5] == (n & 0xFF);
+}
+
+struct RunResult {
+  uint32_t received = 0;
+  uint32_t outOfOrder = 0;  // Repeated, reordered or skipped (when nothing may be lost)
+  uint32_t corrupt = 0;
+  uint32_t overfull = 0;    // size() above capacity seen by the consumer
+  double seconds = 0;
+};
+
+// The producer sends `items` frames; with `retry` it waits out a full ring
+template <size_t N>
+static RunResult run(SpscQueue<EspNowFrame, N>& queue, uint32_t items, bool retry) {
+  RunResult result;
+  std::atomic<bool> done(false);
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread producer([&]() {
+    for (uint32_t n = 0; n < items; n++) {
+      EspNowFrame* slot;
+      while (!(slot = queue.reserve()) && retry) {
+        std::this_thread::yield();
+      }
+      if (slot) {
+        fill(*slot, n);
+        queue.commit();
+      }
+      if (!retry && n % 4 == 0) {
+        std::this_thread::yield();  // Frames come in bursts, not back to back
+      }
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  std::thread consumer([&]() {
+    int64_t last = -1;
+    while (true) {
+      bool finished = done.load(std::memory_order_acquire);
+      if (queue.size() > queue.capacity()) {
+        result.overfull++;
+      }
+      const EspNowFrame* frame = queue.front();
+      if (!frame) {
+        if (finished) {
+          break;  // Nothing left after the producer stopped
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      uint32_t n;
+      if (!intact(*frame, n)) {
+        result.corrupt++;
+      } else if ((int64_t)n <= last || (retry && (int64_t)n != last + 1)) {
+        result.outOfOrder++;
+      } else {
+        last = n;
+      }
+      result.received++;
+      queue.release();
+    }
+  });
+
+  producer.join();
+  consumer.join();
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+template <size_t N>
+static void checkRing(const char* name, uint32_t items) {
+  for (int retry = 1; retry >= 0; retry--) {
+    std::unique_ptr<SpscQueue<EspNowFrame, N>> ring(new SpscQueue<EspNowFrame, N>());
+    SpscQueue<EspNowFrame, N>& queue = *ring;
+    RunResult r = run(queue, items, retry);
+    printf("  %-22s %-8s %8u received, %8u dropped, high water %2u/%zu, %5.2f M/s\n", name,
+           retry ? "retry" : "drop", r.received, queue.drops(), queue.highWater(), N, r.received / r.seconds / 1e6);
+
+    expect(r.corrupt == 0, "every frame intact");
+    expect(r.outOfOrder == 0, "frames once and in order");
+    expect(r.overfull == 0 && queue.highWater() <= N, "depth never above capacity");
+    expect(queue.size() == 0, "ring empty after the consumer caught up");
+    if (retry) {
+      expect(r.received == items, "nothing lost when the producer waits");
+    } else {
+      expect(r.received + queue.drops() == items, "received plus drops equals sent");
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Lock-free SPSC ring (SpscQueue), producer and consumer threads ===\n");
+  printf("%u frames per run, %zu-byte EspNowFrame\n\n", options.items, sizeof(EspNowFrame));
+  checkRing<ESPNOW_RX_QUEUE_SIZE>("ESP-NOW ring", options.items);
+  checkRing<2>("two slots", options.items / 4);
+  checkRing<1>("one slot", options.items / 4);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+#include "virtual_node.h"
+#include <esp_now.h>
+#include "telemetry_frame.h"
+
+VirtualNode::VirtualNode(int index, const LoadModel& model, unsigned long sendIntervalMs, unsigned long sendJitterMs)
+  : load(model), intervalMs(sendIntervalMs), jitterMs(sendJitterMs), framesSent(0), framesLost(0), acks(0),
+    lossRate(0), voltageSense(index % 2 == 1), batchSize(1), held(0) {
+  snprintf(nodeId, sizeof(nodeId), "SIM_NODE_%03d", index);
+  nodeHash = TelemetryCodec::hashNodeId(nodeId);
+  
+  const uint8_t base[6] = {0x24, 0x0A, 0xC4, 0x10, (uint8_t)(index >> 8), (uint8_t)index};
+  memcpy(mac, base, sizeof(mac));
+  
+  // Numbering starts at random, as on a real node; signal falls off with
+  // distance from the auditor
+  sequence = (uint16_t)(load.random() * 65536);
+  transmission = (uint16_t)(load.random() * 65536);
+  rssi = (int8_t)(-45 - (index * 7) % 40);
+  
+  // Nodes boot at different times within the first interval
+  nextSendAt = millis() + (unsigned long)(load.random() * intervalMs);
+}
+
+void VirtualNode::setBatching(uint8_t samples) {
+  batchSize = samples < 1 ? 1 : (samples > TELEMETRY_BATCH_MAX + 1 ? TELEMETRY_BATCH_MAX + 1 : samples);
+  held = 0;
+}
+
+size_t VirtualNode::encode(unsigned long now, uint8_t* buffer, size_t capacity) {
+  LoadSample s = load.sample(now);
+  
+  // Same frame the node firmware sends, with or without voltage sense
+  TelemetryFrame frame;
+  frame.flags = (voltageSense ? TELEMETRY_FLAG_VOLTAGE : TELEMETRY_FLAG_PF_ESTIMATED) | TELEMETRY_FLAG_HARMONICS;
+  frame.flags |= TELEMETRY_FLAG_LINK;
+  frame.powerFactor = (uint8_t)lroundf(s.powerFactor * 100);
+  frame.nodeHash = nodeHash;
+  frame.sequence = sequence++;
+  frame.currentMa = (uint32_t)lroundf(s.current * 1000);
+  frame.powerDeciWatts = (uint32_t)lroundf(s.power * 10);
+  frame.voltageDeciVolts = (uint16_t)lroundf(s.voltage * 10);
+  frame.frequencyCentiHz = (uint16_t)lroundf(s.frequency * 100);
+  
+  // THD spread over the 3rd, 5th and 7th, falling with order
+  static const float shares[3] = {0.8f, 0.5f, 0.3f};
+  frame.fundamentalMa = (uint32_t)lroundf(s.current * 1000 / sqrtf(1 + s.thd * s.thd));
+  for (int i = 0; i < 3; i++) {
+    frame.harmonicPermille[i] = (uint16_t)lroundf(s.thd * shares[i] * 1000);
+  }
+  frame.thdPermille = (uint16_t)lroundf(s.thd * 1000);
+  
+  long jitter = jitterMs ? (long)(load.random() * 2 * jitterMs) - (long)jitterMs : 0;
+  nextSendAt = now + intervalMs + jitter;
+  
+  // Hold the measurement until the batch is full, as in RTC memory
+  if (held + 1 < batchSize) {
+    TelemetryRecord& record = heldSamples[held];
+    record.powerFactor = frame.powerFactor;
+    record.currentMa = frame.currentMa;
+    record.powerDeciWatts = frame.powerDeciWatts;
+    heldAt[held++] = now;
+    return 0;
+  }
+  frame.batchCount = held;
+  if (held > 0) {
+    frame.flags |= TELEMETRY_FLAG_BATCH;
+  }
+  for (uint8_t i = 0; i < held; i++) {
+    frame.batch[i] = heldSamples[i];
+    frame.batch[i].ageDeciSeconds = (uint16_t)((now - heldAt[i] + 50) / 100);
+  }
+  held = 0;
+  frame.transmission = transmission++;
+  framesSent++;
+  return TelemetryCodec::encode(frame, buffer, capacity);
+}
+
+void VirtualNode::send(unsigned long now) {
+  uint8_t buffer[TELEMETRY_FRAME_MAX];
+  size_t len = encode(now, buffer, sizeof(buffer));
+  if (len == 0) {
+    return;
+  }
+  if (load.random() < lossRate) {
+    framesLost++;
+  } else {
+    halEspNowDeliver(mac, buffer, len, rssi);
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef VIRTUAL_NODE_H
+#define VIRTUAL_NODE_H
+
+#include <Arduino.h>
+#include "load_model.h"
+#include "telemetry_frame.h"
+
+// Stand-in for a wireless-audit-device: measures its load and sends the
+// same binary telemetry frame through the ESP-NOW receive path. Half the
+// fleet has voltage sense (measured V, Hz and PF), half estimates PF.
+// With batching on it behaves like a low-power node: one measurement per
+// interval, sent together every N. Frames can be lost on the way; lost
+// frames are not resent (sim/link_check.cpp in the node project covers
+// the retransmit buffer).
+class VirtualNode {
+private:
+  char nodeId[16];
+  uint8_t mac[6];
+  uint32_t nodeHash;
+  uint16_t sequence;
+  uint16_t transmission;
+  LoadModel load;
+  unsigned long intervalMs;
+  unsigned long jitterMs;
+  unsigned long nextSendAt;
+  uint32_t framesSent;
+  uint32_t framesLost;
+  uint32_t acks;
+  float lossRate;
+  int8_t rssi;
+  bool voltageSense;  // Odd-numbered nodes are fitted with one
+  
+  // Low-power batching
+  uint8_t batchSize;
+  uint8_t held;
+  TelemetryRecord heldSamples[TELEMETRY_BATCH_MAX];
+  unsigned long heldAt[TELEMETRY_BATCH_MAX];
+  
+public:
+  VirtualNode(int index, const LoadModel& model, unsigned long sendIntervalMs, unsigned long sendJitterMs);
+  
+  bool due(unsigned long now) const { return (long)(now - nextSendAt) >= 0; }
+  unsigned long nextSendTime() const { return nextSendAt; }
+  void setBatching(uint8_t samples);  // Measurements per frame (1 to TELEMETRY_BATCH_MAX + 1)
+  void setLoss(float probability) { lossRate = probability; }
+  
+  // Next frame, or 0 while a batch is still filling; schedules the one after
+  size_t encode(unsigned long now, uint8_t* buffer, size_t capacity);
+  void send(unsigned long now);  // encode() + deliver, unless lost
+  void acknowledged() { acks++; }
+  
+  const char* id() const { return nodeId; }
+  const uint8_t* macAddress() const { return mac; }
+  uint32_t hash() const { return nodeHash; }
+  uint32_t sentCount() const { return framesSent; }
+  uint32_t lostCount() const { return framesLost; }
+  uint32_t ackCount() const { return acks; }
+};
+
+#endif
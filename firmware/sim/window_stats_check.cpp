@@ -0,0 +1,287 @@
+// Native check of the sliding-window statistics (pio run -e native_stats).
+//
+// Feeds WindowStats (src/window_stats.cpp) random power streams through a
+// HistoryBuffer the way updateDeviceHistory does: noise, steps, spikes,
+// monotonic ramps (the worst case for the min/max queues), runs of equal
+// values, bursts with no time between readings, silences longer than the
+// age limit and a history cleared underneath the window. After every
+// reading, count, span, min, max, mean, variance, energy and the active
+// count must match a brute-force pass over the same window, for
+// count-bounded, age-bounded and mixed windows. Then compares the cost of
+// an update with that brute-force pass. Exits non-zero on any failure.
+//
+//   .pio/build/native_stats/program [--seed N] [--readings N]
+
+#include <Arduino.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "config.h"
+#include "device_data.h"
+#include "history_buffer.h"
+#include "window_stats.h"
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  long readings = 20000;
+};
+
+// A window as configured and as WindowStats bounds it
+struct WindowConfig {
+  const char* name;
+  uint16_t samples;
+  unsigned long ageMs;
+};
+
+// Brute-force aggregate of one window
+struct Expected {
+  int count;
+  unsigned long spanMs;
+  uint32_t minimum;  // 0.1W
+  uint32_t maximum;
+  double mean;
+  double variance;   // (0.1W)^2
+  uint64_t energy;   // 0.1W * ms
+  int active;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--readings") && hasValue) options.readings = atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--readings N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// The sample bound WindowStats actually applies
+static int effectiveSamples(uint16_t samples) {
+  int limit = min(STATS_WINDOW_MAX_SAMPLES, MAX_HISTORY_ENTRIES - 1);
+  return samples > 0 && samples < limit ? samples : limit;
+}
+
+// Newest samples of `times`/`powers` within the window's bounds
+static Expected bruteForce(const std::vector<unsigned long>& times, const std::vector<uint32_t>& powers,
+                           const WindowConfig& config) {
+  Expected e = Expected();
+  int n = times.size();
+  int limit = effectiveSamples(config.samples);
+  int first = n - 1;
+  while (first > 0 && n - first < limit &&
+         (config.ageMs == 0 || times[n - 1] - times[first - 1] <= config.ageMs)) {
+    first--;
+  }
+
+  e.count = n - first;
+  e.spanMs = times[n - 1] - times[first];
+  e.minimum = UINT32_MAX;
+  double sum = 0, squares = 0;
+  for (int i = first; i < n; i++) {
+    e.minimum = min(e.minimum, powers[i]);
+    e.maximum = max(e.maximum, powers[i]);
+    sum += powers[i];
+    squares += (double)powers[i] * powers[i];
+    e.active += powers[i] > ALWAYS_ON_POWER_THRESHOLD * 10;
+    if (i > first) {
+      e.energy += (uint64_t)powers[i] * (times[i] - times[i - 1]);
+    }
+  }
+  e.mean = sum / e.count;
+  e.variance = max(0.0, squares / e.count - e.mean * e.mean);
+  return e;
+}
+
+static bool near(double got, double want, double tolerance) {
+  return fabs(got - want) <= tolerance * max(1.0, fabs(want));
+}
+
+// One reading of a random stream; the shape changes every few hundred
+class Stream {
+private:
+  std::mt19937& rng;
+  int shape = 0;
+  int left = 0;
+  float level = 100;
+  unsigned long now = 1000;
+
+public:
+  explicit Stream(std::mt19937& random) : rng(random) {}
+
+  DeviceReading next() {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    if (left-- <= 0) {
+      shape = rng() % 7;
+      left = 50 + rng() % 400;
+      level = unit(rng) < 0.2f ? 0 : 3000 * unit(rng);
+    }
+
+    float power = level;
+    unsigned long step = 1500 + rng() % 3000;
+    switch (shape) {
+      case 0: power = level * (0.9f + 0.2f * unit(rng)); break;   // Noise
+      case 1: power = unit(rng) < 0.05f ? 3000 * unit(rng) : level; break;  // Spikes on a flat load
+      case 2: level += 5; power = level; break;                    // Rising ramp
+      case 3: level = max(0.0f, level - 5); power = level; break;  // Falling ramp
+      case 4: break;                                               // Equal values
+      case 5: step = rng() % 3 == 0 ? 0 : rng() % 20; break;       // Burst, no time between
+      case 6: step = unit(rng) < 0.1f ? 400000 + rng() % 600000 : step; break;  // Silences past the age limit
+    }
+    now += step;
+
+    DeviceReading r = {};
+    r.voltage = 230;
+    r.power = power;
+    r.current = power / 230;
+    r.powerFactor = 1;
+    r.timestamp = now;
+    return r;
+  }
+};
+
+static void checkWindows(const CheckOptions& options) {
+  const WindowConfig configs[] = {
+    {"recent (count)", STATS_SAMPLE_WINDOW, 0},
+    {"timed (count and age)", STATS_WINDOW_MAX_SAMPLES, STATS_TIME_WINDOW_MS},
+    {"age only", 0, 60000},
+    {"single sample", 1, 0},
+    {"over the limit", 60000, 0},
+  };
+  const int configCount = sizeof(configs) / sizeof(configs[0]);
+
+  printf("Windows against brute force (%ld readings, seed %u):\n", options.readings, options.seed);
+  std::mt19937 rng(options.seed);
+  Stream stream(rng);
+  static HistoryBuffer history;
+  std::vector<WindowStats> windows;
+  for (const WindowConfig& config : configs) {
+    windows.push_back(WindowStats(config.samples, config.ageMs));
+  }
+
+  // Readings since the history was last cleared, as stored
+  std::vector<unsigned long> times;
+  std::vector<uint32_t> powers;
+  int mismatches[configCount] = {};
+  int longest[configCount] = {};
+  int clears = 0;
+
+  for (long i = 0; i < options.readings; i++) {
+    if (rng() % 5000 == 0) {
+      history.clear();  // Device removed and its slot reused
+      times.clear();
+      powers.clear();
+      clears++;
+    }
+
+    history.append(stream.next());
+    times.push_back(history.lastTimestamp());
+    powers.push_back(history.bySequence(history.totalAppended() - 1).powerDeciWatts());
+
+    for (int c = 0; c < configCount; c++) {
+      WindowStats& w = windows[c];
+      w.add(history);
+      Expected e = bruteForce(times, powers, configs[c]);
+      bool ok = w.count() == e.count && w.spanMs() == e.spanMs && w.active() == e.active &&
+                w.minimum(history) == (float)(e.minimum / 10.0) && w.maximum(history) == (float)(e.maximum / 10.0) &&
+                near(w.mean(), e.mean / 10, 1e-6) && near(w.energyKWh(), e.energy / 36000000000.0, 1e-6) &&
+                fabs(w.variance() - e.variance / 100) <= 1e-4 * max(1.0, e.variance / 100) + 1e-3;
+      if (!ok && mismatches[c]++ == 0) {
+        printf("  %s at reading %ld: count %d/%d, min %.1f/%.1f, max %.1f/%.1f, mean %.3f/%.3f\n", configs[c].name, i,
+               w.count(), e.count, w.minimum(history), e.minimum / 10.0, w.maximum(history), e.maximum / 10.0,
+               w.mean(), e.mean / 10);
+      }
+      longest[c] = max(longest[c], (int)w.count());
+    }
+  }
+
+  for (int c = 0; c < configCount; c++) {
+    printf("  %-22s up to %3d samples, %d mismatch(es)\n", configs[c].name, longest[c], mismatches[c]);
+    expect(mismatches[c] == 0, configs[c].name);
+    expect(longest[c] == effectiveSamples(configs[c].samples) || configs[c].ageMs > 0, "window fills to its bound");
+  }
+  printf("  history cleared %d time(s) underneath the windows\n", clears);
+}
+
+template <typename F>
+static double timeNanos(long repeats, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < repeats; i++) {
+    body(i);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / repeats;
+}
+
+static void benchmark(const CheckOptions& options) {
+  printf("\nCost of one reading (%d-sample window):\n", STATS_WINDOW_MAX_SAMPLES);
+  std::mt19937 rng(options.seed);
+  Stream stream(rng);
+  std::vector<DeviceReading> readings;
+  for (int i = 0; i < 4096; i++) {
+    readings.push_back(stream.next());
+  }
+  for (size_t i = 0; i < readings.size(); i++) {
+    readings[i].timestamp = 1000 + i * 2000;  // No silences: the window stays full
+  }
+
+  static HistoryBuffer history;
+  WindowStats stats(STATS_WINDOW_MAX_SAMPLES, 0);
+  volatile float sink = 0;
+  const long repeats = 400000;
+  double incremental = timeNanos(repeats, [&](long i) {
+    DeviceReading r = readings[i & 4095];
+    r.timestamp = 1000 + i * 2000;
+    history.append(r);
+    stats.add(history);
+    sink = sink + stats.mean() + stats.minimum(history) + stats.maximum(history);
+  });
+
+  // Recomputing min/max/mean/variance over the window from the history
+  int window = effectiveSamples(STATS_WINDOW_MAX_SAMPLES);
+  double brute = timeNanos(repeats / 10, [&](long i) {
+    DeviceReading r = readings[i & 4095];
+    r.timestamp = 1000 + i * 2000;
+    history.append(r);
+    uint32_t lo = UINT32_MAX, hi = 0;
+    uint64_t sum = 0, squares = 0;
+    for (uint32_t seq = history.totalAppended() - window; seq < history.totalAppended(); seq++) {
+      uint32_t p = history.bySequence(seq).powerDeciWatts();
+      lo = min(lo, p);
+      hi = max(hi, p);
+      sum += p;
+      squares += (uint64_t)p * p;
+    }
+    sink = sink + sum + squares + lo + hi;
+  });
+  printf("  WindowStats::add(): %7.1f ns/reading\n", incremental);
+  printf("  brute-force pass:   %7.1f ns/reading (%.0fx)\n", brute, brute / incremental);
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Sliding-window statistics (WindowStats) ===\n");
+  printf("%d-sample history, windows of up to %d samples\n\n", MAX_HISTORY_ENTRIES,
+         effectiveSamples(STATS_WINDOW_MAX_SAMPLES));
+  checkWindows(options);
+  benchmark(options);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+#include "api_streams.h"
+
+void DeviceListStream::writeDevice(JsonText& out, const DeviceSnapshot& device) {
+  out.raw('{');
+  out.key("id"); out.string(device.id); out.raw(',');
+  out.key("name"); out.string(device.name); out.raw(',');
+  out.key("customName"); out.string(device.customName); out.raw(',');
+  out.key("displayName"); out.string(device.getDisplayName()); out.raw(',');
+  out.key("type"); out.string(device.type); out.raw(',');
+  out.key("isActive"); out.boolean(device.isActive); out.raw(',');
+  out.key("lastSeen"); out.number(device.lastSeen); out.raw(',');
+  out.key("standbyWaste"); out.boolean(device.standbyWaste); out.raw(',');
+  out.key("usageAnomaly"); out.boolean(device.usageAnomaly); out.raw(',');
+  out.key("efficiencyIssue"); out.boolean(device.efficiencyIssue); out.raw(',');
+  out.key("totalEnergy"); out.number(device.totalEnergy); out.raw(',');
+  out.key("avgPower"); out.number(device.avgPower); out.raw(',');
+  out.key("maxPower"); out.number(device.maxPower); out.raw(',');
+  
+  const EnergySummary& energy = device.energy;
+  out.key("energy");
+  out.raw('{');
+  out.key("method"); out.string(EnergyAccount::methodName(energy.method)); out.raw(',');
+  out.key("hour"); out.number(energy.hourEnergy); out.raw(',');
+  out.key("hourCost"); out.number(energy.hourCost); out.raw(',');
+  out.key("today"); out.number(energy.todayEnergy); out.raw(',');
+  out.key("todayCost"); out.number(energy.todayCost); out.raw(',');
+  out.key("gaps"); out.number((unsigned long)energy.gaps); out.raw(',');
+  out.key("counterResets"); out.number((unsigned long)energy.counterResets); out.raw(',');
+  out.key("counterRollovers"); out.number((unsigned long)energy.counterRollovers); out.raw(',');
+  out.key("counterGlitches"); out.number((unsigned long)energy.counterGlitches);
+  out.raw('}');
+  out.raw(',');
+  
+  out.key("window");
+  out.raw('{');
+  out.key("seconds"); out.number(device.windowSeconds); out.raw(',');
+  out.key("samples"); out.number((unsigned long)device.windowSamples); out.raw(',');
+  out.key("avgPower"); out.number(device.windowAvgPower); out.raw(',');
+  out.key("minPower"); out.number(device.windowMinPower); out.raw(',');
+  out.key("maxPower"); out.number(device.windowMaxPower); out.raw(',');
+  out.key("stdDevPower"); out.number(device.windowStdDevPower); out.raw(',');
+  out.key("energy"); out.number(device.windowEnergy);
+  out.raw('}');
+  out.raw(',');
+  
+  const DeviceReading& reading = device.currentReading;
+  out.key("currentReading");
+  out.raw('{');
+  out.key("voltage"); out.number(reading.voltage); out.raw(',');
+  out.key("current"); out.number(reading.current); out.raw(',');
+  out.key("power"); out.number(reading.power); out.raw(',');
+  out.key("energy"); out.number(reading.energy); out.raw(',');
+  out.key("frequency"); out.number(reading.frequency); out.raw(',');
+  out.key("powerFactor"); out.number(reading.powerFactor); out.raw(',');
+  out.key("timestamp"); out.number(reading.timestamp);
+  out.raw('}');
+  out.raw(',');
+  
+  out.key("harmonics");
+  if (reading.harmonics.valid) {
+    out.raw('{');
+    out.key("fundamental"); out.number(reading.harmonics.fundamental); out.raw(',');
+    out.key("h3"); out.number(reading.harmonics.orders[0]); out.raw(',');
+    out.key("h5"); out.number(reading.harmonics.orders[1]); out.raw(',');
+    out.key("h7"); out.number(reading.harmonics.orders[2]); out.raw(',');
+    out.key("thd"); out.number(reading.harmonics.thd);
+    out.raw('}');
+  } else {
+    out.raw("null");
+  }
+  out.raw(',');
+  
+  const LinkSummary& link = device.link;
+  out.key("link");
+  if (link.valid) {
+    out.raw('{');
+    out.key("rssi"); out.number((double)link.rssi); out.raw(',');
+    out.key("lastSequence"); out.number((unsigned long)link.lastSequence); out.raw(',');
+    out.key("lossRate"); out.number(link.lossRate); out.raw(',');
+    out.key("frames"); out.number((unsigned long)link.frames); out.raw(',');
+    out.key("framesLost"); out.number((unsigned long)link.framesLost); out.raw(',');
+    out.key("samples"); out.number((unsigned long)link.samples); out.raw(',');
+    out.key("samplesMissed"); out.number((unsigned long)link.samplesMissed); out.raw(',');
+    out.key("duplicates"); out.number((unsigned long)link.duplicates); out.raw(',');
+    out.key("restarts"); out.number((unsigned long)link.restarts); out.raw(',');
+    out.key("intervalMs"); out.number(link.frameInterval);
+    out.raw('}');
+  } else {
+    out.raw("null");
+  }
+  
+  out.raw('}');
+}
+
+bool DeviceListStream::nextChunk(JsonText& out) {
+  if (!opened) {
+    out.raw('[');
+    opened = true;
+  }
+  
+  // The first device past the last one written, in whichever snapshot
+  // is current now
+  SnapshotReader snapshot(snapshots);
+  for (uint16_t i = 0; i < snapshot->count; i++) {
+    const DeviceSnapshot& device = snapshot->devices[i];
+    if (device.handle > lastHandle) {
+      if (lastHandle >= 0) {
+        out.raw(',');
+      }
+      writeDevice(out, device);
+      lastHandle = device.handle;
+      return true;
+    }
+  }
+  
+  out.raw(']');
+  return false;
+}
+
+HistoryStream::HistoryStream(const HistoryBuffer* history, const DeviceRollups* rollups, const HistoryQuery& query,
+                             const DeviceSlot& device)
+  : slot(device), fields(query.fields), written(0), opened(false) {
+  if (!history || !rollups) {
+    return;
+  }
+  if (query.tier == HISTORY_TIER_RAW) {
+    series.reset(new RawSeries(*history));
+  } else {
+    series.reset(new RollupSeries(*rollups, query.tier, query.clockOffset));
+  }
+  decimator.reset(new HistoryDecimator(*series, query));
+  if (fields == 0) {
+    fields = query.tier == HISTORY_TIER_RAW ? HISTORY_RAW_FIELDS : HISTORY_ROLLUP_FIELDS;
+  }
+}
+
+void HistoryStream::writePoint(JsonText& out, const HistoryPoint& point, uint8_t fields) {
+  out.raw('{');
+  out.key("timestamp"); out.number(point.timestamp);
+  if (fields & HISTORY_FIELD_VOLTAGE) { out.raw(','); out.key("voltage"); out.number(point.voltage); }
+  if (fields & HISTORY_FIELD_CURRENT) { out.raw(','); out.key("current"); out.number(point.current); }
+  if (fields & HISTORY_FIELD_POWER) { out.raw(','); out.key("power"); out.number(point.power); }
+  if (fields & HISTORY_FIELD_POWER_FACTOR) { out.raw(','); out.key("powerFactor"); out.number(point.powerFactor); }
+  if (fields & HISTORY_FIELD_MIN_POWER) { out.raw(','); out.key("minPower"); out.number(point.minPower); }
+  if (fields & HISTORY_FIELD_MAX_POWER) { out.raw(','); out.key("maxPower"); out.number(point.maxPower); }
+  if (fields & HISTORY_FIELD_ENERGY) { out.raw(','); out.key("energy"); out.number(point.energy); }
+  if (fields & HISTORY_FIELD_COVERAGE) { out.raw(','); out.key("coverage"); out.number(point.coverage); }
+  out.raw('}');
+}
+
+bool HistoryStream::nextChunk(JsonText& out) {
+  if (!series) {
+    out.raw("{\"error\":\"Device not found\"}");
+    return false;
+  }
+  
+  if (!opened) {
+    out.raw('[');
+    opened = true;
+  }
+  
+  // Read between two checks of the slot, so a point of whichever device
+  // took it over is never written
+  HistoryPoint point;
+  if (slot.current() && decimator->next(point) && slot.current()) {
+    if (written++ > 0) {
+      out.raw(',');
+    }
+    writePoint(out, point, fields);
+    return true;
+  }
+  
+  out.raw(']');
+  return false;
+}
+
+void EnergyStream::writeBucket(JsonText& out, const EnergyPoint& point, int tier) {
+  out.raw('{');
+  out.key("start"); out.number((double)point.start); out.raw(',');
+  if (tier == ENERGY_HOUR) {
+    out.key("hour"); out.number((unsigned long)(point.index % 24)); out.raw(',');
+  }
+  out.key("energy"); out.number(point.energy); out.raw(',');
+  out.key("cost"); out.number(point.cost); out.raw(',');
+  out.key("coverage"); out.number(point.coveredMs / 1000.0);
+  out.raw('}');
+}
+
+bool EnergyStream::nextChunk(JsonText& out) {
+  if (!account) {
+    out.raw("{\"error\":\"Device not found\"}");
+    return false;
+  }
+  
+  if (!opened) {
+    out.raw("{\"rates\":[");
+    for (int hour = 0; hour < 24; hour++) {
+      if (hour > 0) {
+        out.raw(',');
+      }
+      out.number(tariff.rate(hour));
+    }
+    out.raw("],\"hours\":[");
+    opened = true;
+    return true;
+  }
+  
+  // A device gone from its slot closes both lists (see HistoryStream)
+  EnergyPoint point;
+  if (slot.current() && account->readBatch(tier, state, &point, 1) > 0 && slot.current()) {
+    if (written++ > 0) {
+      out.raw(',');
+    }
+    writeBucket(out, point, tier);
+    return true;
+  }
+  
+  if (tier == ENERGY_HOUR) {
+    out.raw("],\"days\":[");
+    tier = ENERGY_DAY;
+    state = EnergyReadState();
+    written = 0;
+    return true;
+  }
+  
+  out.raw("]}");
+  return false;
+}
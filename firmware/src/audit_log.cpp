@@ -0,0 +1,290 @@
+#include "audit_log.h"
+
+static_assert(MAX_DEVICES + 1 < FLASH_LOG_SLOTS - 1, "a checkpoint must fit in one segment");
+
+static void put16(uint8_t* p, uint16_t value) {
+  p[0] = value & 0xFF;
+  p[1] = value >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putFloat(uint8_t* p, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put32(p, bits);
+}
+
+static float getFloat(const uint8_t* p) {
+  uint32_t bits = get32(p);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void AuditRecord::encode(const AuditRecord& record, uint8_t* payload) {
+  memset(payload, 0, FLASH_LOG_PAYLOAD_SIZE);
+  payload[0] = record.type;
+  if (record.type == AUDIT_RECORD_CLOCK) {
+    put32(payload + 4, record.time);
+  } else if (record.type == AUDIT_RECORD_DEVICE) {
+    payload[1] = record.flags;
+    putFloat(payload + 2, record.totalEnergy);
+    memcpy(payload + 6, record.id, strnlen(record.id, AUDIT_ID_MAX));
+  } else {
+    // Same scaled fields as the RAM history
+    HistorySample sample = HistorySample::encode(record.reading, 0);
+    payload[1] = sample.pf;
+    put16(payload + 2, sample.voltage);
+    put32(payload + 4, record.deviceHash);
+    put32(payload + 8, record.time);
+    memcpy(payload + 12, sample.current, 3);
+    memcpy(payload + 15, sample.power, 3);
+    putFloat(payload + 18, record.totalEnergy);
+  }
+}
+
+bool AuditRecord::decode(const uint8_t* payload, AuditRecord& record) {
+  record = AuditRecord();
+  record.type = (AuditRecordType)payload[0];
+  if (record.type == AUDIT_RECORD_CLOCK) {
+    record.time = get32(payload + 4);
+  } else if (record.type == AUDIT_RECORD_DEVICE) {
+    record.flags = payload[1];
+    record.totalEnergy = getFloat(payload + 2);
+    memcpy(record.id, payload + 6, AUDIT_ID_MAX);
+    record.id[AUDIT_ID_MAX] = '\0';
+    record.deviceHash = DeviceRegistry::hashId(record.id);
+  } else if (record.type == AUDIT_RECORD_SAMPLE) {
+    HistorySample sample;
+    sample.pf = payload[1];
+    sample.voltage = payload[2] | (payload[3] << 8);
+    memcpy(sample.current, payload + 12, 3);
+    memcpy(sample.power, payload + 15, 3);
+    record.deviceHash = get32(payload + 4);
+    record.time = get32(payload + 8);
+    record.totalEnergy = getFloat(payload + 18);
+    sample.decode(record.reading, record.time);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+AuditLog::AuditLog()
+  : devices(nullptr), clockSeconds(0), clockMillis(0), clockSeq(0), lastSample(0), lastFlush(0), restoredTotal(0) {
+  memset(loggedAppended, 0, sizeof(loggedAppended));
+}
+
+bool AuditLog::begin(const DeviceRegistry& registry) {
+  devices = &registry;
+  restoredTotal = 0;
+  clockSeconds = 0;
+
+  const esp_partition_t* partition = esp_partition_find_first(
+    ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)AUDIT_LOG_SUBTYPE, AUDIT_LOG_PARTITION);
+  if (!log.begin(partition, restoreRecord, this)) {
+    return false;
+  }
+  log.setCheckpoint(writeCheckpoint, this);
+
+  // Carry the clock on past the newest record
+  beginClockWrite();
+  if (log.stats().recovered > 0) {
+    clockSeconds++;
+  }
+  clockMillis = millis();
+  endClockWrite();
+  lastSample = clockMillis;
+  lastFlush = clockMillis;
+  return true;
+}
+
+void AuditLog::restoreRecord(const uint8_t* payload, void* context) {
+  AuditLog& self = *(AuditLog*)context;
+  AuditRecord record;
+  if (!AuditRecord::decode(payload, record)) {
+    return;
+  }
+  if (record.type == AUDIT_RECORD_CLOCK) {
+    self.clockSeconds = max(self.clockSeconds, record.time);
+    return;
+  }
+
+  int i = 0;
+  while (i < self.restoredTotal && DeviceRegistry::hashId(self.restoredDevices[i].id) != record.deviceHash) {
+    i++;
+  }
+
+  // Energy totals only grow: the largest seen wins, whatever the order of
+  // checkpoint and buffered records
+  if (record.type == AUDIT_RECORD_DEVICE) {
+    if (record.flags & AUDIT_DEVICE_REMOVED) {
+      if (i < self.restoredTotal) {
+        self.restoredDevices[i] = self.restoredDevices[--self.restoredTotal];
+      }
+      return;
+    }
+    if (i == self.restoredTotal) {
+      if (self.restoredTotal == MAX_DEVICES) {
+        return;
+      }
+      AuditDeviceState& state = self.restoredDevices[self.restoredTotal++];
+      memcpy(state.id, record.id, sizeof(state.id));
+      state.totalEnergy = 0;
+      state.lastLogged = 0;
+    }
+    AuditDeviceState& state = self.restoredDevices[i];
+    state.wireless = record.flags & AUDIT_DEVICE_WIRELESS;
+    state.totalEnergy = max(state.totalEnergy, record.totalEnergy);
+  } else if (record.type == AUDIT_RECORD_SAMPLE) {
+    self.clockSeconds = max(self.clockSeconds, record.time);
+    if (i < self.restoredTotal) {
+      AuditDeviceState& state = self.restoredDevices[i];
+      state.totalEnergy = max(state.totalEnergy, record.totalEnergy);
+      state.lastLogged = max(state.lastLogged, record.time);
+    }
+  }
+}
+
+void AuditLog::writeCheckpoint(FlashLog& log, void* context) {
+  // The new segment must restore on its own: the clock, then every device
+  AuditLog& self = *(AuditLog*)context;
+  uint8_t payload[FLASH_LOG_PAYLOAD_SIZE];
+  AuditRecord record = AuditRecord();
+  record.type = AUDIT_RECORD_CLOCK;
+  record.time = self.clockSeconds;
+  AuditRecord::encode(record, payload);
+  log.checkpoint(payload);
+
+  for (DeviceHandle h = self.devices->first(); h != INVALID_DEVICE; h = self.devices->next(h)) {
+    const DeviceInfo& device = (*self.devices)[h];
+    if (device.id.length() > AUDIT_ID_MAX) {
+      continue;
+    }
+    record = AuditRecord();
+    record.type = AUDIT_RECORD_DEVICE;
+    record.flags = device.type == "wireless" ? AUDIT_DEVICE_WIRELESS : 0;
+    record.totalEnergy = device.totalEnergy;
+    strncpy(record.id, device.id.c_str(), AUDIT_ID_MAX);
+    AuditRecord::encode(record, payload);
+    log.checkpoint(payload);
+  }
+}
+
+void AuditLog::appendDevice(const DeviceInfo& device, uint8_t flags) {
+  if (!log.isReady() || device.id.length() > AUDIT_ID_MAX) {
+    return;
+  }
+  AuditRecord record = AuditRecord();
+  record.type = AUDIT_RECORD_DEVICE;
+  record.flags = flags | (device.type == "wireless" ? AUDIT_DEVICE_WIRELESS : 0);
+  record.totalEnergy = device.totalEnergy;
+  strncpy(record.id, device.id.c_str(), AUDIT_ID_MAX);
+
+  uint8_t payload[FLASH_LOG_PAYLOAD_SIZE];
+  AuditRecord::encode(record, payload);
+  log.append(payload);
+}
+
+void AuditLog::deviceAdded(DeviceHandle handle, const DeviceInfo& device) {
+  loggedAppended[handle] = 0;
+  appendDevice(device, 0);
+}
+
+void AuditLog::deviceRemoved(const DeviceInfo& device) {
+  appendDevice(device, AUDIT_DEVICE_REMOVED);
+}
+
+void AuditLog::beginClockWrite() {
+  clockSeq.store(clockSeq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void AuditLog::endClockWrite() {
+  clockSeq.store(clockSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void AuditLog::tick(unsigned long now) {
+  // Whole seconds only, so the clock never drifts (and millis() may wrap)
+  unsigned long elapsed = (now - clockMillis) / 1000;
+  if (elapsed == 0) {
+    return;
+  }
+  beginClockWrite();
+  clockSeconds += elapsed;
+  clockMillis += elapsed * 1000;
+  endClockWrite();
+}
+
+int64_t AuditLog::clockOffset() const {
+  // tick() moves both fields together; retry if it ran in between
+  while (true) {
+    uint32_t before = clockSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      // Writer is mid-update; let it finish even if it runs at lower priority
+      delay(1);
+      continue;
+    }
+    
+    int64_t offset = (int64_t)clockSeconds * 1000 - clockMillis;
+    
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (clockSeq.load(std::memory_order_relaxed) == before) {
+      return offset;
+    }
+  }
+}
+
+uint64_t AuditLog::timeOf(unsigned long timestamp) const {
+  // Relative to the last whole second counted, so only the distance to
+  // it has to fit a long
+  int64_t time = (int64_t)clockSeconds * 1000 + (long)(timestamp - clockMillis);
+  return time > 0 ? (uint64_t)time : 0;
+}
+
+void AuditLog::update(unsigned long now) {
+  // The clock runs without a log too (energy buckets are on it)
+  tick(now);
+  if (!log.isReady()) {
+    return;
+  }
+
+  if (now - lastSample >= AUDIT_LOG_SAMPLE_MS) {
+    lastSample = now;
+    for (DeviceHandle h = devices->first(); h != INVALID_DEVICE; h = devices->next(h)) {
+      const DeviceInfo& device = (*devices)[h];
+      uint32_t appended = device.history.totalAppended();
+      if (appended == loggedAppended[h] || device.id.length() > AUDIT_ID_MAX) {
+        continue;  // Nothing new since the last record
+      }
+      AuditRecord record = AuditRecord();
+      record.type = AUDIT_RECORD_SAMPLE;
+      record.time = clockSeconds;
+      record.deviceHash = DeviceRegistry::hashId(device.id.c_str());
+      record.totalEnergy = device.totalEnergy;
+      record.reading = device.currentReading;
+
+      uint8_t payload[FLASH_LOG_PAYLOAD_SIZE];
+      AuditRecord::encode(record, payload);
+      if (log.append(payload)) {
+        loggedAppended[h] = appended;
+      }
+    }
+  }
+
+  // Few large writes: on a timer, or early before the buffer fills
+  bool due = log.pending() > 0 && now - lastFlush >= AUDIT_LOG_FLUSH_MS;
+  if (due || log.pending() >= AUDIT_LOG_BUFFER_RECORDS * 3 / 4) {
+    log.flush();
+    lastFlush = now;
+  }
+}
@@ -0,0 +1,135 @@
+#include "device_registry.h"
+#include <new>
+
+uint32_t DeviceRegistry::hashId(const char* id) {
+  // FNV-1a
+  uint32_t hash = 2166136261UL;
+  while (*id) {
+    hash ^= (uint8_t)*id++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+DeviceRegistry::DeviceRegistry() {
+  for (int i = 0; i < MAX_DEVICES; i++) {
+    slots[i] = nullptr;
+    used[i] = false;
+    generations[i] = 0;
+  }
+  clear();
+}
+
+DeviceRegistry::~DeviceRegistry() {
+  for (int i = 0; i < MAX_DEVICES; i++) {
+    delete slots[i];
+  }
+}
+
+void DeviceRegistry::clear() {
+  for (int i = 0; i < INDEX_SIZE; i++) {
+    index[i].slot = INVALID_DEVICE;
+  }
+  
+  // Hand out low slots first
+  freeCount = MAX_DEVICES;
+  for (int i = 0; i < MAX_DEVICES; i++) {
+    if (used[i]) {
+      generations[i]++;
+    }
+    used[i] = false;
+    freeSlots[i] = MAX_DEVICES - 1 - i;
+  }
+  deviceCount = 0;
+}
+
+int DeviceRegistry::findIndexPosition(const char* id, uint32_t hash) const {
+  for (uint16_t pos = hash & INDEX_MASK;; pos = (pos + 1) & INDEX_MASK) {
+    const IndexEntry& entry = index[pos];
+    if (entry.slot == INVALID_DEVICE) {
+      return -1;
+    }
+    if (entry.hash == hash && strcmp(slots[entry.slot]->id.c_str(), id) == 0) {
+      return pos;
+    }
+  }
+}
+
+DeviceHandle DeviceRegistry::find(const String& id) const {
+  int pos = findIndexPosition(id.c_str(), hashId(id.c_str()));
+  return pos >= 0 ? index[pos].slot : INVALID_DEVICE;
+}
+
+DeviceHandle DeviceRegistry::insert(const String& id) {
+  uint32_t hash = hashId(id.c_str());
+  if (freeCount == 0 || findIndexPosition(id.c_str(), hash) >= 0) {
+    return INVALID_DEVICE;
+  }
+  
+  DeviceHandle slot = freeSlots[freeCount - 1];
+  if (!slots[slot]) {
+    slots[slot] = new (std::nothrow) DeviceInfo();
+    if (!slots[slot]) {
+      return INVALID_DEVICE;
+    }
+  }
+  freeCount--;
+  used[slot] = true;
+  deviceCount++;
+  
+  // Load factor stays <= 0.5, so an empty position always exists
+  uint16_t pos = hash & INDEX_MASK;
+  while (index[pos].slot != INVALID_DEVICE) {
+    pos = (pos + 1) & INDEX_MASK;
+  }
+  index[pos].hash = hash;
+  index[pos].slot = slot;
+  
+  slots[slot]->id = id;
+  return slot;
+}
+
+bool DeviceRegistry::remove(DeviceHandle handle) {
+  if (!isValid(handle)) {
+    return false;
+  }
+  
+  int pos = findIndexPosition(slots[handle]->id.c_str(), hashId(slots[handle]->id.c_str()));
+  if (pos < 0) {
+    return false;
+  }
+  
+  // Backward-shift deletion keeps probe chains intact without tombstones
+  uint16_t hole = pos;
+  uint16_t next = pos;
+  while (true) {
+    next = (next + 1) & INDEX_MASK;
+    if (index[next].slot == INVALID_DEVICE) {
+      break;
+    }
+    uint16_t home = index[next].hash & INDEX_MASK;
+    bool homeBetween = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+    if (!homeBetween) {
+      index[hole] = index[next];
+      hole = next;
+    }
+  }
+  index[hole].slot = INVALID_DEVICE;
+  
+  // Before the slot changes: readers holding it see a new generation
+  generations[handle]++;
+  used[handle] = false;
+  slots[handle]->id = "";
+  freeSlots[freeCount++] = handle;
+  deviceCount--;
+  return true;
+}
+
+DeviceHandle DeviceRegistry::next(DeviceHandle handle) const {
+  for (int i = handle + 1; i < MAX_DEVICES; i++) {
+    if (used[i]) {
+      return i;
+    }
+  }
+  return INVALID_DEVICE;
+}
@@ -0,0 +1,77 @@
+#include "device_snapshot.h"
+#include "device_registry.h"
+
+static void copyString(char* dest, size_t size, const String& src) {
+  strncpy(dest, src.c_str(), size - 1);
+  dest[size - 1] = '\0';
+}
+
+void DeviceSnapshot::capture(const DeviceInfo& device) {
+  idHash = DeviceRegistry::hashId(device.id.c_str());
+  copyString(id, sizeof(id), device.id);
+  copyString(name, sizeof(name), device.name);
+  copyString(customName, sizeof(customName), device.customName);
+  copyString(type, sizeof(type), device.type);
+  currentReading = device.currentReading;
+  lastSeen = device.lastSeen;
+  isActive = device.isActive;
+  link = device.link.summary();
+  standbyWaste = device.standbyWaste;
+  usageAnomaly = device.usageAnomaly;
+  efficiencyIssue = device.efficiencyIssue;
+  totalEnergy = device.totalEnergy;
+  energy = device.energyAccount.summary();
+  avgPower = device.avgPower;
+  maxPower = device.maxPower;
+  
+  windowSeconds = device.timedStats.spanMs() / 1000;
+  windowSamples = device.timedStats.count();
+  windowAvgPower = device.timedStats.mean();
+  windowMinPower = device.timedStats.minimum(device.history);
+  windowMaxPower = device.timedStats.maximum(device.history);
+  windowStdDevPower = device.timedStats.stdDev();
+  windowEnergy = device.timedStats.energyKWh();
+}
+
+const DeviceSnapshot* DeviceTableSnapshot::find(const char* deviceId) const {
+  uint32_t hash = DeviceRegistry::hashId(deviceId);
+  for (uint16_t i = 0; i < count; i++) {
+    if (devices[i].idHash == hash && strcmp(devices[i].id, deviceId) == 0) {
+      return &devices[i];
+    }
+  }
+  return nullptr;
+}
+
+DeviceTableSnapshot* SnapshotPublisher::beginWrite() {
+  uint8_t back = front.load() ^ 1;
+  if (readers[back].load() != 0) {
+    skipped++;
+    return nullptr;
+  }
+  return &buffers[back];
+}
+
+void SnapshotPublisher::publish() {
+  uint8_t back = front.load() ^ 1;
+  buffers[back].version = ++version;
+  buffers[back].publishedAt = millis();
+  front.store(back);
+}
+
+const DeviceTableSnapshot* SnapshotPublisher::acquire() {
+  while (true) {
+    uint8_t idx = front.load();
+    readers[idx]++;
+    // Re-check: the writer may have flipped and started on this buffer
+    // between our load and the pin
+    if (front.load() == idx) {
+      return &buffers[idx];
+    }
+    readers[idx]--;
+  }
+}
+
+void SnapshotPublisher::release(const DeviceTableSnapshot* snapshot) {
+  readers[snapshot == &buffers[0] ? 0 : 1]--;
+}
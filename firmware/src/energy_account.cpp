@@ -0,0 +1,283 @@
+#include "energy_account.h"
+#include "device_data.h"
+
+#define ENERGY_HOUR_MS 3600000UL
+#define ENERGY_DAY_MS 86400000UL
+#define ENERGY_CLOCK_SHIFT_MS ((uint64_t)TARIFF_CLOCK_HOUR * ENERGY_HOUR_MS)
+
+static_assert(ENERGY_HOUR_BUCKETS + ENERGY_DAY_BUCKETS <= 0xFFFF, "slots are 16-bit");
+static_assert(TARIFF_CLOCK_HOUR >= 0 && TARIFF_CLOCK_HOUR < 24, "hour of day");
+
+static void resetBucket(EnergyBucket& bucket) {
+  bucket.energy = 0;
+  bucket.cost = 0;
+  bucket.coveredMs = 0;
+}
+
+Tariff::Tariff() {
+  setRate(0, 0, TARIFF_STANDARD_RATE);
+  setRate(TARIFF_OFFPEAK_START, TARIFF_OFFPEAK_END, TARIFF_OFFPEAK_RATE);
+  setRate(TARIFF_PEAK_START, TARIFF_PEAK_END, TARIFF_PEAK_RATE);
+}
+
+void Tariff::setRate(int from, int to, float rate) {
+  // from == to is the whole day
+  int hour = from % 24;
+  do {
+    rates[hour] = rate;
+    hour = (hour + 1) % 24;
+  } while (hour != to % 24);
+}
+
+uint32_t EnergyAccount::indexOf(int tier, uint64_t clock) {
+  return (clock + ENERGY_CLOCK_SHIFT_MS) / (tier == ENERGY_HOUR ? ENERGY_HOUR_MS : ENERGY_DAY_MS);
+}
+
+int64_t EnergyAccount::startOf(int tier, uint32_t index) {
+  return (int64_t)index * (tier == ENERGY_HOUR ? ENERGY_HOUR_MS : ENERGY_DAY_MS) - (int64_t)ENERGY_CLOCK_SHIFT_MS;
+}
+
+const char* EnergyAccount::methodName(EnergyMethod method) {
+  switch (method) {
+    case ENERGY_METER: return "meter";
+    case ENERGY_TRAPEZOID: return "trapezoid";
+    case ENERGY_GAP: return "gap";
+    default: return "none";
+  }
+}
+
+EnergyAccount::EnergyAccount() : writeSeq(0) {
+  const uint16_t capacities[ENERGY_TIER_COUNT] = {ENERGY_HOUR_BUCKETS, ENERGY_DAY_BUCKETS};
+  uint16_t offset = 0;
+  for (int i = 0; i < ENERGY_TIER_COUNT; i++) {
+    tiers[i].offset = offset;
+    tiers[i].capacity = capacities[i];
+    offset += capacities[i];
+  }
+  clear();
+}
+
+void EnergyAccount::beginWrite() {
+  writeSeq.store(writeSeq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void EnergyAccount::endWrite() {
+  writeSeq.store(writeSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void EnergyAccount::clear() {
+  beginWrite();
+  for (int i = 0; i < ENERGY_TIER_COUNT; i++) {
+    tiers[i].head = 0;
+    tiers[i].count = 0;
+    tiers[i].newest = 0;
+    tiers[i].openEnergy = 0;
+    tiers[i].openCost = 0;
+  }
+  total = 0;
+  started = false;
+  lastClock = 0;
+  lastPower = 0;
+  counterValid = false;
+  lastCounter = 0;
+  method = ENERGY_NONE;
+  gaps = 0;
+  counterResets = 0;
+  counterRollovers = 0;
+  counterGlitches = 0;
+  endWrite();
+}
+
+void EnergyAccount::restore(double kWh) {
+  total = kWh;
+}
+
+EnergyBucket& EnergyAccount::advance(EnergyTier& tier, uint32_t index) {
+  // Open buckets up to `index`; skipped ones stay empty. A gap longer
+  // than the ring leaves nothing worth keeping
+  if (tier.count > 0 && index - tier.newest >= tier.capacity) {
+    tier.count = 0;
+  }
+  if (tier.count == 0) {
+    tier.head = 0;
+    tier.count = 1;
+    tier.newest = index;
+    tier.openEnergy = 0;
+    tier.openCost = 0;
+    resetBucket(at(tier, 0));
+  }
+
+  while (tier.newest < index) {
+    if (tier.count < tier.capacity) {
+      tier.count++;
+    } else {
+      tier.head = (tier.head + 1) % tier.capacity;
+    }
+    tier.newest++;
+    tier.openEnergy = 0;
+    tier.openCost = 0;
+    resetBucket(at(tier, tier.count - 1));
+  }
+  return at(tier, tier.count - 1);
+}
+
+void EnergyAccount::addTier(EnergyTier& tier, uint32_t index, uint32_t ms, double energy, double cost) {
+  // Sums kept in double: a day of 2 s readings is tens of thousands of
+  // additions far below a float's resolution of the sum
+  EnergyBucket& bucket = advance(tier, index);
+  tier.openEnergy += energy;
+  tier.openCost += cost;
+  bucket.energy = (float)tier.openEnergy;
+  bucket.cost = (float)tier.openCost;
+  bucket.coveredMs += ms;
+}
+
+void EnergyAccount::spread(uint64_t from, uint64_t to, float powerFrom, float powerTo, const Tariff& tariff) {
+  // Power runs linearly from powerFrom to powerTo; split at hour
+  // boundaries so each piece is priced at its own hour's rate
+  double span = (double)(to - from);
+  double slope = (powerTo - powerFrom) / span;
+  for (uint64_t start = from; start < to; ) {
+    uint32_t hour = indexOf(ENERGY_HOUR, start);
+    uint64_t end = min(to, (uint64_t)startOf(ENERGY_HOUR, hour + 1));
+    double powerStart = powerFrom + slope * (double)(start - from);
+    double powerEnd = powerFrom + slope * (double)(end - from);
+    double energy = (powerStart + powerEnd) / 2 * (double)(end - start) / 3600000000.0;  // W*ms -> kWh
+    double cost = energy * tariff.rate(hour % 24);
+    addTier(tiers[ENERGY_HOUR], hour, end - start, energy, cost);
+    addTier(tiers[ENERGY_DAY], hour / 24, end - start, energy, cost);
+    start = end;
+  }
+}
+
+bool EnergyAccount::meterEnergy(uint32_t counter, uint64_t elapsed, uint32_t& wattHours) {
+  // Most the meter could have counted in the time, plus one for the
+  // counter's 1 Wh step
+  double most = ENERGY_METER_MAX_POWER * (double)elapsed / 3600000.0 + 1;
+  uint32_t limit = most < 4e9 ? (uint32_t)most : 4000000000UL;
+
+  if (counter >= lastCounter) {
+    wattHours = counter - lastCounter;
+    return wattHours <= limit;
+  }
+  if (lastCounter < ENERGY_METER_ROLLOVER_WH && ENERGY_METER_ROLLOVER_WH - lastCounter + counter <= limit) {
+    wattHours = ENERGY_METER_ROLLOVER_WH - lastCounter + counter;
+    counterRollovers++;
+    return true;
+  }
+  if (counter <= limit) {
+    wattHours = counter;  // Reset, counted up from zero since
+    counterResets++;
+    return true;
+  }
+  return false;
+}
+
+bool EnergyAccount::add(const DeviceReading& reading, uint64_t clock, const Tariff& tariff) {
+  if (started && clock <= lastClock) {
+    return false;  // Only forward, like the history
+  }
+
+  bool counted = false;
+  beginWrite();
+  if (started) {
+    uint64_t elapsed = clock - lastClock;
+    uint32_t wattHours;
+    bool metered = reading.metered && counterValid;
+    if (metered && meterEnergy(reading.meterWh, elapsed, wattHours)) {
+      // The meter kept counting through missed polls: no gap to skip
+      double kWh = wattHours / 1000.0;
+      float power = (float)(kWh * 3600000000.0 / (double)elapsed);
+      spread(lastClock, clock, power, power, tariff);
+      total += kWh;
+      method = ENERGY_METER;
+      counted = true;
+    } else {
+      if (metered) {
+        counterGlitches++;
+      }
+      if (elapsed <= ENERGY_MAX_GAP_MS) {
+        spread(lastClock, clock, lastPower, reading.power, tariff);
+        total += ((double)lastPower + reading.power) / 2 * (double)elapsed / 3600000000.0;
+        method = ENERGY_TRAPEZOID;
+        counted = true;
+      } else {
+        gaps++;
+        method = ENERGY_GAP;
+      }
+    }
+  }
+  started = true;
+  lastClock = clock;
+  lastPower = reading.power;
+  counterValid = reading.metered;
+  lastCounter = reading.meterWh;
+  endWrite();
+  return counted;
+}
+
+EnergySummary EnergyAccount::summary() const {
+  EnergySummary s = EnergySummary();
+  s.method = method;
+  s.gaps = gaps;
+  s.counterResets = counterResets;
+  s.counterRollovers = counterRollovers;
+  s.counterGlitches = counterGlitches;
+  if (!started) {
+    return s;
+  }
+
+  // The hour and day of the latest reading; nothing counted in them yet
+  // reads as zero
+  const EnergyTier& hours = tiers[ENERGY_HOUR];
+  if (hours.count > 0 && hours.newest == indexOf(ENERGY_HOUR, lastClock)) {
+    s.hourEnergy = hours.openEnergy;
+    s.hourCost = hours.openCost;
+  }
+  const EnergyTier& days = tiers[ENERGY_DAY];
+  if (days.count > 0 && days.newest == indexOf(ENERGY_DAY, lastClock)) {
+    s.todayEnergy = days.openEnergy;
+    s.todayCost = days.openCost;
+  }
+  return s;
+}
+
+int EnergyAccount::readBatch(int tier, EnergyReadState& state, EnergyPoint* out, int max) const {
+  while (true) {
+    uint32_t before = writeSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      // Writer is mid-update; let it finish even if it runs at lower priority
+      delay(1);
+      continue;
+    }
+
+    const EnergyTier& t = tiers[tier];
+    EnergyReadState next = state;
+    int n = 0;
+
+    if (t.count > 0) {
+      uint32_t first = t.newest - (t.count - 1);
+      if (!next.started || next.next < first) {
+        next.next = first;  // Evicted (or before the oldest bucket)
+      }
+      next.started = true;
+      while (n < max && next.next <= t.newest) {
+        const EnergyBucket& bucket = at(t, next.next - first);
+        EnergyPoint& point = out[n++];
+        point.index = next.next;
+        point.start = startOf(tier, next.next);
+        point.coveredMs = bucket.coveredMs;
+        point.energy = bucket.energy;
+        point.cost = bucket.cost;
+        next.next++;
+      }
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (writeSeq.load(std::memory_order_relaxed) == before) {
+      state = next;
+      return n;
+    }
+  }
+}
@@ -0,0 +1,405 @@
+#include "export_stream.h"
+#include <climits>
+#include "audit_log.h"
+
+#define EXPORT_CSV_HEADER \
+  "source,device,time_ms,voltage,current,power,power_factor,min_power,max_power,energy_kwh,coverage_s,total_kwh\n"
+
+// Binary schema: field names as in the CSV header, types as Python's
+// struct codes ('s' is a length byte and that many characters)
+struct ExportField {
+  const char* name;
+  char type;
+};
+
+struct ExportKind {
+  ExportRecordKind kind;
+  const char* name;
+  const ExportField* fields;
+  uint8_t fieldCount;
+};
+
+static const ExportField DEVICE_FIELDS[] = {{"device", 'I'}, {"flags", 'B'}, {"id", 's'}};
+static const ExportField RAW_FIELDS[] = {
+  {"device", 'I'}, {"time_ms", 'Q'}, {"voltage", 'f'}, {"current", 'f'}, {"power", 'f'}, {"power_factor", 'f'}};
+static const ExportField ROLLUP_FIELDS[] = {
+  {"device", 'I'}, {"tier", 'B'}, {"time_ms", 'Q'}, {"power", 'f'}, {"min_power", 'f'}, {"max_power", 'f'},
+  {"energy_kwh", 'f'}, {"coverage_s", 'f'}};
+static const ExportField LOGGED_FIELDS[] = {
+  {"device", 'I'}, {"time_ms", 'Q'}, {"voltage", 'f'}, {"current", 'f'}, {"power", 'f'}, {"power_factor", 'f'},
+  {"total_kwh", 'f'}};
+static const ExportField END_FIELDS[] = {{"records", 'I'}};
+
+#define FIELD_COUNT(fields) (uint8_t)(sizeof(fields) / sizeof(fields[0]))
+
+static const ExportKind KINDS[] = {
+  {EXPORT_RECORD_DEVICE, "device", DEVICE_FIELDS, FIELD_COUNT(DEVICE_FIELDS)},
+  {EXPORT_RECORD_RAW, "raw", RAW_FIELDS, FIELD_COUNT(RAW_FIELDS)},
+  {EXPORT_RECORD_ROLLUP, "rollup", ROLLUP_FIELDS, FIELD_COUNT(ROLLUP_FIELDS)},
+  {EXPORT_RECORD_LOGGED, "logged", LOGGED_FIELDS, FIELD_COUNT(LOGGED_FIELDS)},
+  {EXPORT_RECORD_END, "end", END_FIELDS, FIELD_COUNT(END_FIELDS)},
+};
+
+// CSV source names by RollupTierIndex
+static const char* const TIER_NAMES[ROLLUP_TIER_COUNT] = {"minute", "quarter", "hour"};
+
+static void put(JsonText& out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out.raw((char)((value >> (8 * i)) & 0xFF));
+  }
+}
+
+static void putFloat(JsonText& out, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put(out, bits, 4);
+}
+
+static void putString(JsonText& out, const char* text) {
+  size_t len = min(strlen(text), (size_t)255);
+  put(out, len, 1);
+  for (size_t i = 0; i < len; i++) {
+    out.raw(text[i]);
+  }
+}
+
+static void writeUnsigned(JsonText& out, uint64_t value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (n > 0) {
+    out.raw(digits[--n]);
+  }
+}
+
+// Fixed decimals, at or above the resolution the value was stored with;
+// an empty cell for anything not finite
+static void writeFixed(JsonText& out, float value, int decimals) {
+  static const uint32_t SCALE[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+  double magnitude = fabs((double)value);
+  if (!(magnitude < 1e12)) {
+    return;
+  }
+  uint64_t scaled = (uint64_t)(magnitude * SCALE[decimals] + 0.5);
+  if (value < 0 && scaled > 0) {
+    out.raw('-');
+  }
+  writeUnsigned(out, scaled / SCALE[decimals]);
+  if (decimals > 0) {
+    out.raw('.');
+    uint32_t fraction = scaled % SCALE[decimals];
+    for (int i = decimals - 1; i >= 0; i--) {
+      out.raw('0' + fraction / SCALE[i] % 10);
+    }
+  }
+}
+
+static void writeCsvField(JsonText& out, const char* text) {
+  if (!strpbrk(text, ",\"\r\n")) {
+    out.raw(text);
+    return;
+  }
+  out.raw('"');
+  for (; *text; text++) {
+    if (*text == '"') {
+      out.raw('"');
+    }
+    out.raw(*text);
+  }
+  out.raw('"');
+}
+
+ExportStream::ExportStream(const DeviceRegistry& source, const DeviceTableSnapshot& snapshot, const FlashLog* records,
+                           int64_t offset, ExportFormat exportFormat)
+  : registry(source), log(records), clockOffset(offset), format(exportFormat), deviceCount(0), nameCount(0),
+    nameNext(0), stage(STAGE_HEADER), device(0), tier(ROLLUP_HOUR), records(0), rollupState(0, UINT64_MAX),
+    batchCount(0), batchPos(0) {
+  for (int i = 0; i < snapshot.count && deviceCount < MAX_DEVICES; i++) {
+    const DeviceSnapshot& listed = snapshot.devices[i];
+    Device& entry = devices[deviceCount++];
+    entry.handle = listed.handle;
+    entry.generation = listed.generation;
+    entry.hash = listed.idHash;
+    entry.wireless = strcmp(listed.type, "wireless") == 0;
+    strncpy(entry.id, listed.id, sizeof(entry.id) - 1);
+    entry.id[sizeof(entry.id) - 1] = '\0';
+    remember(entry.hash, entry.id);
+  }
+}
+
+void ExportStream::remember(uint32_t hash, const char* id) {
+  for (int i = 0; i < nameCount; i++) {
+    if (names[i].hash == hash) {
+      return;
+    }
+  }
+  Name& name = names[nameCount < EXPORT_NAMES ? nameCount++ : nameNext++ % EXPORT_NAMES];
+  name.hash = hash;
+  strncpy(name.id, id, sizeof(name.id) - 1);
+  name.id[sizeof(name.id) - 1] = '\0';
+}
+
+const char* ExportStream::nameOf(uint32_t hash, char* fallback) const {
+  for (int i = 0; i < nameCount; i++) {
+    if (names[i].hash == hash) {
+      return names[i].id;
+    }
+  }
+  snprintf(fallback, DEVICE_ID_MAX, "#%08lx", (unsigned long)hash);
+  return fallback;
+}
+
+uint64_t ExportStream::auditTime(unsigned long timestamp) const {
+  int64_t time = (int64_t)timestamp + clockOffset;
+  return time > 0 ? (uint64_t)time : 0;
+}
+
+void ExportStream::writeHeader(JsonText& out) {
+  if (format == EXPORT_CSV) {
+    out.raw(EXPORT_CSV_HEADER);
+    return;
+  }
+  out.raw(EXPORT_MAGIC);
+  put(out, EXPORT_VERSION, 1);
+  put(out, sizeof(KINDS) / sizeof(KINDS[0]), 1);
+  for (const ExportKind& kind : KINDS) {
+    put(out, kind.kind, 1);
+    putString(out, kind.name);
+    put(out, kind.fieldCount, 1);
+    for (int i = 0; i < kind.fieldCount; i++) {
+      putString(out, kind.fields[i].name);
+      out.raw(kind.fields[i].type);
+    }
+  }
+}
+
+void ExportStream::writeDevice(JsonText& out, uint32_t hash, uint8_t flags, const char* id) {
+  // Binary only: the CSV names devices in every row
+  put(out, EXPORT_RECORD_DEVICE, 1);
+  put(out, hash, 4);
+  put(out, flags, 1);
+  putString(out, id);
+  records++;
+}
+
+void ExportStream::writeLogged(JsonText& out, const uint8_t* payload) {
+  AuditRecord record;
+  if (!AuditRecord::decode(payload, record)) {
+    return;
+  }
+  if (record.type == AUDIT_RECORD_DEVICE) {
+    remember(record.deviceHash, record.id);
+    if (format == EXPORT_BINARY) {
+      writeDevice(out, record.deviceHash, record.flags, record.id);
+    }
+    return;
+  }
+  if (record.type != AUDIT_RECORD_SAMPLE) {
+    return;
+  }
+
+  const DeviceReading& reading = record.reading;
+  uint64_t time = (uint64_t)record.time * 1000;
+  if (format == EXPORT_BINARY) {
+    put(out, EXPORT_RECORD_LOGGED, 1);
+    put(out, record.deviceHash, 4);
+    put(out, time, 8);
+    putFloat(out, reading.voltage);
+    putFloat(out, reading.current);
+    putFloat(out, reading.power);
+    putFloat(out, reading.powerFactor);
+    putFloat(out, record.totalEnergy);
+  } else {
+    char fallback[DEVICE_ID_MAX];
+    out.raw("log,");
+    writeCsvField(out, nameOf(record.deviceHash, fallback));
+    out.raw(',');
+    writeUnsigned(out, time);
+    out.raw(',');
+    writeFixed(out, reading.voltage, 1);
+    out.raw(',');
+    writeFixed(out, reading.current, 3);
+    out.raw(',');
+    writeFixed(out, reading.power, 1);
+    out.raw(',');
+    writeFixed(out, reading.powerFactor, 2);
+    out.raw(",,,,,");
+    writeFixed(out, record.totalEnergy, 6);
+    out.raw('\n');
+  }
+  records++;
+}
+
+void ExportStream::writeReading(JsonText& out, const Device& source, const DeviceReading& reading) {
+  uint64_t time = auditTime(reading.timestamp);
+  if (format == EXPORT_BINARY) {
+    put(out, EXPORT_RECORD_RAW, 1);
+    put(out, source.hash, 4);
+    put(out, time, 8);
+    putFloat(out, reading.voltage);
+    putFloat(out, reading.current);
+    putFloat(out, reading.power);
+    putFloat(out, reading.powerFactor);
+  } else {
+    out.raw("raw,");
+    writeCsvField(out, source.id);
+    out.raw(',');
+    writeUnsigned(out, time);
+    out.raw(',');
+    writeFixed(out, reading.voltage, 1);
+    out.raw(',');
+    writeFixed(out, reading.current, 3);
+    out.raw(',');
+    writeFixed(out, reading.power, 1);
+    out.raw(',');
+    writeFixed(out, reading.powerFactor, 2);
+    out.raw(",,,,,\n");
+  }
+  records++;
+}
+
+void ExportStream::writeBucket(JsonText& out, const Device& source, const RollupPoint& bucket) {
+  uint64_t time = bucket.timestamp;  // Already on the audit clock
+  float coverage = bucket.coveredMs / 1000.0f;
+  if (format == EXPORT_BINARY) {
+    put(out, EXPORT_RECORD_ROLLUP, 1);
+    put(out, source.hash, 4);
+    put(out, tier, 1);
+    put(out, time, 8);
+    putFloat(out, bucket.avgPower);
+    putFloat(out, bucket.minPower);
+    putFloat(out, bucket.maxPower);
+    putFloat(out, bucket.energy);
+    putFloat(out, coverage);
+  } else {
+    out.raw(TIER_NAMES[tier]);
+    out.raw(',');
+    writeCsvField(out, source.id);
+    out.raw(',');
+    writeUnsigned(out, time);
+    out.raw(",,,");
+    writeFixed(out, bucket.avgPower, 2);
+    out.raw(",,");
+    writeFixed(out, bucket.minPower, 1);
+    out.raw(',');
+    writeFixed(out, bucket.maxPower, 1);
+    out.raw(',');
+    writeFixed(out, bucket.energy, 6);
+    out.raw(',');
+    writeFixed(out, coverage, 1);
+    out.raw(",\n");
+  }
+  records++;
+}
+
+bool ExportStream::nextLogged(JsonText& out) {
+  if (batchPos == batchCount) {
+    batchCount = log ? log->read(logState, batch.logged[0], EXPORT_BATCH) : 0;
+    batchPos = 0;
+    if (batchCount == 0) {
+      return false;  // Caught up with the writer
+    }
+  }
+  writeLogged(out, batch.logged[batchPos++]);
+  return true;
+}
+
+void ExportStream::nextSource() {
+  // Coarsest first: each tier reaches further back than the next
+  if (tier == HISTORY_TIER_RAW) {
+    device++;
+    tier = ROLLUP_HOUR;
+  } else if (tier == ROLLUP_MINUTE) {
+    tier = HISTORY_TIER_RAW;
+  } else {
+    tier--;
+  }
+  historyState = HistoryReadState();
+  rollupState = RollupReadState(0, UINT64_MAX);
+  batchCount = 0;
+  batchPos = 0;
+}
+
+bool ExportStream::nextHistory(JsonText& out) {
+  const Device& source = devices[device];
+  const DeviceInfo& info = registry[source.handle];
+  DeviceSlot slot(registry, source.handle, source.generation);
+  if (batchPos == batchCount) {
+    bool listed = slot.current();
+    if (listed) {
+      if (tier == HISTORY_TIER_RAW) {
+        batchCount = info.history.readBatch(historyState, batch.readings, EXPORT_BATCH);
+      } else {
+        batchCount = info.rollups.readBatch(tier, rollupState, batch.buckets, EXPORT_BATCH);
+      }
+    }
+    batchPos = 0;
+    if (!listed || !slot.current()) {
+      // Removed since the export started, and the slot may hold another
+      // device by now: drop the batch and the rest of this device
+      tier = HISTORY_TIER_RAW;
+      nextSource();
+      return true;
+    }
+    if (batchCount == 0) {
+      nextSource();
+      return true;
+    }
+  }
+  if (tier == HISTORY_TIER_RAW) {
+    writeReading(out, source, batch.readings[batchPos++]);
+  } else {
+    writeBucket(out, source, batch.buckets[batchPos++]);
+  }
+  return true;
+}
+
+bool ExportStream::nextChunk(JsonText& out) {
+  switch (stage) {
+    case STAGE_HEADER:
+      writeHeader(out);
+      stage = STAGE_DEVICES;
+      return true;
+
+    case STAGE_DEVICES:
+      // Binary: name the devices up front
+      if (format == EXPORT_BINARY && device < deviceCount) {
+        const Device& listed = devices[device++];
+        writeDevice(out, listed.hash, listed.wireless ? AUDIT_DEVICE_WIRELESS : 0, listed.id);
+        return true;
+      }
+      stage = STAGE_LOG;
+      return true;
+
+    case STAGE_LOG:
+      if (!nextLogged(out)) {
+        stage = STAGE_HISTORY;
+        device = 0;
+        tier = ROLLUP_HOUR;
+        batchCount = 0;
+        batchPos = 0;
+      }
+      return true;
+
+    case STAGE_HISTORY:
+      if (device < deviceCount) {
+        return nextHistory(out);
+      }
+      stage = STAGE_END;
+      return true;
+
+    case STAGE_END:
+      if (format == EXPORT_BINARY) {
+        put(out, EXPORT_RECORD_END, 1);
+        put(out, records, 4);
+      }
+      stage = STAGE_DONE;
+      return false;
+
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,300 @@
+#include "flash_log.h"
+#include "telemetry_frame.h"
+
+static_assert(FLASH_LOG_SEGMENT_SIZE % SPI_FLASH_SEC_SIZE == 0, "segments must be whole erase sectors");
+static_assert(AUDIT_LOG_BUFFER_RECORDS >= 1, "the log needs a RAM buffer");
+
+#define FLASH_LOG_SCAN_SLOTS 16  // Slots read per chunk while recovering
+
+static void put32(uint8_t* p, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+FlashLog::FlashLog()
+  : partition(nullptr), segments(0), tail(0), nextSlot(0), generation(0), segmentBase(0),
+    checkpointHook(nullptr), checkpointContext(nullptr), inCheckpoint(false), pendingCount(0) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+void FlashLog::seal(uint8_t* slot) {
+  uint16_t crc = TelemetryCodec::crc16(slot, FLASH_LOG_PAYLOAD_SIZE);
+  slot[FLASH_LOG_PAYLOAD_SIZE] = crc & 0xFF;
+  slot[FLASH_LOG_PAYLOAD_SIZE + 1] = crc >> 8;
+}
+
+bool FlashLog::isSealed(const uint8_t* slot) {
+  uint16_t crc = TelemetryCodec::crc16(slot, FLASH_LOG_PAYLOAD_SIZE);
+  return slot[FLASH_LOG_PAYLOAD_SIZE] == (crc & 0xFF) && slot[FLASH_LOG_PAYLOAD_SIZE + 1] == (crc >> 8);
+}
+
+bool FlashLog::isErased(const uint8_t* slot) {
+  for (int i = 0; i < FLASH_LOG_SLOT_SIZE; i++) {
+    if (slot[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FlashLog::begin(const esp_partition_t* target, Visitor restore, void* context) {
+  partition = nullptr;
+  pendingCount = 0;
+  memset(&counters, 0, sizeof(counters));
+  if (!target || target->size < 2 * FLASH_LOG_SEGMENT_SIZE) {
+    return false;
+  }
+
+  unsigned long started = micros();
+  partition = target;
+  segments = target->size / FLASH_LOG_SEGMENT_SIZE;
+
+  // Newest segment by generation; only the headers are read
+  bool found = false;
+  for (uint32_t segment = 0; segment < segments; segment++) {
+    uint32_t segmentGeneration;
+    if (readHeader(segment, segmentGeneration) && (!found || segmentGeneration > generation)) {
+      found = true;
+      generation = segmentGeneration;
+      tail = segment;
+    }
+  }
+
+  if (found) {
+    nextSlot = scanTail(restore, context);
+  } else {
+    // Blank (or foreign) partition: the first flush starts segment 0
+    generation = 0;
+    tail = segments - 1;
+    nextSlot = FLASH_LOG_SLOTS;
+  }
+  // Rotation moves tail and generation on together
+  segmentBase = (tail + segments - generation % segments) % segments;
+
+  counters.segments = segments;
+  counters.generation = generation;
+  counters.recoveryMicros = micros() - started;
+  return true;
+}
+
+void FlashLog::setCheckpoint(Checkpoint hook, void* context) {
+  checkpointHook = hook;
+  checkpointContext = context;
+}
+
+bool FlashLog::readHeader(uint32_t segment, uint32_t& segmentGeneration) const {
+  uint8_t header[FLASH_LOG_SLOT_SIZE];
+  if (esp_partition_read(partition, slotOffset(segment, 0), header, sizeof(header)) != ESP_OK ||
+      !isSealed(header) || get32(header) != FLASH_LOG_MAGIC || header[8] != FLASH_LOG_SLOT_SIZE) {
+    return false;
+  }
+  segmentGeneration = get32(header + 4);
+  return true;
+}
+
+uint32_t FlashLog::scanTail(Visitor restore, void* context) {
+  // Records end at the first erased slot; a slot that is neither erased
+  // nor intact is a write that was cut short, and later records follow it
+  uint8_t chunk[FLASH_LOG_SCAN_SLOTS][FLASH_LOG_SLOT_SIZE];
+  uint32_t end = 1;
+  for (uint32_t first = 1; first < FLASH_LOG_SLOTS; first += FLASH_LOG_SCAN_SLOTS) {
+    uint32_t count = min((uint32_t)FLASH_LOG_SCAN_SLOTS, (uint32_t)(FLASH_LOG_SLOTS - first));
+    if (esp_partition_read(partition, slotOffset(tail, first), chunk, count * FLASH_LOG_SLOT_SIZE) != ESP_OK) {
+      return FLASH_LOG_SLOTS;  // Unreadable: leave this segment alone
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      if (isErased(chunk[i])) {
+        return end;
+      }
+      if (isSealed(chunk[i])) {
+        counters.recovered++;
+        if (restore) {
+          restore(chunk[i], context);
+        }
+      } else {
+        counters.torn++;
+      }
+      end = first + i + 1;
+    }
+  }
+  return end;
+}
+
+bool FlashLog::append(const uint8_t* payload) {
+  if (!partition) {
+    return false;
+  }
+  if (pendingCount >= AUDIT_LOG_BUFFER_RECORDS) {
+    counters.dropped++;
+    return false;
+  }
+  memcpy(buffer[pendingCount], payload, FLASH_LOG_PAYLOAD_SIZE);
+  seal(buffer[pendingCount]);
+  pendingCount++;
+  counters.appended++;
+  return true;
+}
+
+bool FlashLog::flush() {
+  if (!partition || pendingCount == 0) {
+    return true;
+  }
+
+  unsigned long started = micros();
+  size_t done = 0;
+  bool ok = true;
+  while (done < pendingCount) {
+    if (nextSlot >= FLASH_LOG_SLOTS && !rotate()) {
+      ok = false;
+      break;
+    }
+
+    // One write per run of slots up to the end of the segment
+    size_t run = min(pendingCount - done, (size_t)(FLASH_LOG_SLOTS - nextSlot));
+    esp_err_t result = esp_partition_write(partition, slotOffset(tail, nextSlot), buffer[done], run * FLASH_LOG_SLOT_SIZE);
+    nextSlot += run;  // Even on failure: partly programmed slots cannot be reused
+    if (result != ESP_OK) {
+      counters.writeErrors++;
+      ok = false;
+      break;
+    }
+    done += run;
+    counters.written += run;
+  }
+
+  // Whatever did not make it stays buffered for the next flush
+  pendingCount -= done;
+  memmove(buffer, buffer[done], pendingCount * FLASH_LOG_SLOT_SIZE);
+
+  counters.flushes++;
+  uint32_t elapsed = micros() - started;
+  if (elapsed > counters.maxFlushMicros) {
+    counters.maxFlushMicros = elapsed;
+  }
+  return ok;
+}
+
+bool FlashLog::rotate() {
+  // The oldest segment is the one after the tail
+  uint32_t next = (tail + 1) % segments;
+  if (esp_partition_erase_range(partition, next * FLASH_LOG_SEGMENT_SIZE, FLASH_LOG_SEGMENT_SIZE) != ESP_OK) {
+    counters.writeErrors++;
+    return false;
+  }
+  counters.erases++;
+
+  uint8_t header[FLASH_LOG_SLOT_SIZE] = {0};
+  put32(header, FLASH_LOG_MAGIC);
+  put32(header + 4, generation + 1);
+  header[8] = FLASH_LOG_SLOT_SIZE;
+  seal(header);
+  if (esp_partition_write(partition, slotOffset(next, 0), header, sizeof(header)) != ESP_OK) {
+    counters.writeErrors++;
+    return false;
+  }
+
+  tail = next;
+  generation++;
+  nextSlot = 1;
+  counters.generation = generation;
+
+  if (checkpointHook) {
+    inCheckpoint = true;
+    checkpointHook(*this, checkpointContext);
+    inCheckpoint = false;
+  }
+  return true;
+}
+
+bool FlashLog::checkpoint(const uint8_t* payload) {
+  if (!inCheckpoint || nextSlot >= FLASH_LOG_SLOTS) {
+    return false;
+  }
+  uint8_t slot[FLASH_LOG_SLOT_SIZE];
+  memcpy(slot, payload, FLASH_LOG_PAYLOAD_SIZE);
+  seal(slot);
+  esp_err_t result = esp_partition_write(partition, slotOffset(tail, nextSlot), slot, sizeof(slot));
+  nextSlot++;
+  if (result != ESP_OK) {
+    counters.writeErrors++;
+    return false;
+  }
+  counters.written++;
+  return true;
+}
+
+int FlashLog::read(FlashLogReadState& state, uint8_t* out, int max) const {
+  // No lock: flash is only programmed in order and erased a segment at a
+  // time, and every header names its generation. The header is checked
+  // again after each read, so slots of a segment recycled meanwhile are
+  // never handed out as older ones
+  uint8_t chunk[FLASH_LOG_SCAN_SLOTS][FLASH_LOG_SLOT_SIZE];
+  if (!partition) {
+    return 0;
+  }
+
+  while (true) {
+    // Slots below nextSlot are fully programmed (or failed for good).
+    // Read before the generation: a rotation in between can only pair the
+    // new segment with the old, larger limit, and its erased slots stop us
+    uint32_t limit = nextSlot;
+    uint32_t newest = generation;
+    if (newest == 0) {
+      return 0;
+    }
+
+    // Oldest segment still on flash
+    if (!state.started || newest - state.generation >= segments) {
+      state.started = true;
+      state.generation = newest >= segments ? newest - segments + 1 : 1;
+      state.slot = 1;
+    }
+    uint32_t end = state.generation == newest ? min(limit, (uint32_t)FLASH_LOG_SLOTS) : FLASH_LOG_SLOTS;
+    if (state.slot >= end && state.generation == newest) {
+      return 0;  // Caught up
+    }
+
+    uint32_t segment = (segmentBase + state.generation) % segments;
+    uint32_t count = min((uint32_t)min(max, FLASH_LOG_SCAN_SLOTS), end - min(state.slot, end));
+    uint32_t before;
+    uint32_t after;
+    bool valid = count > 0 && readHeader(segment, before) && before == state.generation &&
+                 esp_partition_read(partition, slotOffset(segment, state.slot), chunk, count * FLASH_LOG_SLOT_SIZE) == ESP_OK &&
+                 readHeader(segment, after) && after == state.generation;
+    if (!valid) {
+      // Finished, unreadable or recycled: on to the next segment
+      if (state.generation >= newest) {
+        return 0;
+      }
+      state.generation++;
+      state.slot = 1;
+      continue;
+    }
+
+    int n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      if (isErased(chunk[i])) {
+        // Records end here; in the newest segment the writer may still be
+        // mid-rotation, so come back to this slot
+        if (state.generation >= newest) {
+          return n;
+        }
+        state.slot = FLASH_LOG_SLOTS;
+        break;
+      }
+      state.slot++;
+      if (isSealed(chunk[i])) {
+        memcpy(out + n * FLASH_LOG_PAYLOAD_SIZE, chunk[i], FLASH_LOG_PAYLOAD_SIZE);
+        n++;
+      }
+    }
+    if (n > 0) {
+      return n;
+    }
+  }
+}
@@ -0,0 +1,256 @@
+#include "history_buffer.h"
+#include "device_data.h"
+
+static uint32_t toScaled(float value, float scale, uint32_t maxValue) {
+  if (!(value > 0)) {
+    return 0;
+  }
+  float scaled = value * scale + 0.5f;
+  return scaled >= (float)maxValue ? maxValue : (uint32_t)scaled;
+}
+
+void HistorySample::set24(uint8_t* p, uint32_t value) {
+  p[0] = value & 0xFF;
+  p[1] = (value >> 8) & 0xFF;
+  p[2] = (value >> 16) & 0xFF;
+}
+
+HistorySample HistorySample::encode(const DeviceReading& reading, uint32_t deltaMs) {
+  HistorySample sample;
+  set24(sample.dt, deltaMs & MAX_24BIT);
+  sample.pf = toScaled(reading.powerFactor, 100.0f, 100) | (deltaMs >> 24 & 0x01) << 7;
+  sample.voltage = toScaled(reading.voltage, 10.0f, MAX_VOLTAGE) | (deltaMs >> 25 & 0x0F) << 12;
+  set24(sample.current, toScaled(reading.current, 1000.0f, MAX_CURRENT) | (deltaMs >> 29) << 21);
+  set24(sample.power, toScaled(reading.power, 10.0f, MAX_24BIT));
+  return sample;
+}
+
+void HistorySample::decode(DeviceReading& reading, unsigned long timestamp) const {
+  reading.voltage = voltageDeciVolts() / 10.0;
+  reading.current = currentMa() / 1000.0;
+  reading.power = powerDeciWatts() / 10.0;
+  reading.powerFactor = pfHundredths() / 100.0;
+  reading.energy = 0;     // Not kept per sample
+  reading.frequency = 0;  // Not kept per sample
+  reading.timestamp = timestamp;
+}
+
+void HistoryBuffer::beginWrite() {
+  writeSeq.store(writeSeq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void HistoryBuffer::endWrite() {
+  writeSeq.store(writeSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void HistoryBuffer::clear() {
+  beginWrite();
+  head = 0;
+  count = 0;
+  appended = 0;
+  oldestTimestamp = 0;
+  newestTimestamp = 0;
+  endWrite();
+}
+
+void HistoryBuffer::append(const DeviceReading& reading) {
+  uint32_t delta = count > 0 ? reading.timestamp - newestTimestamp : 0;
+  HistorySample sample = HistorySample::encode(reading, delta);
+  
+  beginWrite();
+  if (count < MAX_HISTORY_ENTRIES) {
+    samples[(head + count) % MAX_HISTORY_ENTRIES] = sample;
+    count++;
+    if (count == 1) {
+      oldestTimestamp = reading.timestamp;
+    }
+  } else {
+    // Overwrite the oldest slot; the next slot becomes the oldest
+    samples[head] = sample;
+    head = (head + 1) % MAX_HISTORY_ENTRIES;
+    oldestTimestamp += samples[head].deltaMs();
+  }
+  
+  if (appended % HISTORY_ANCHOR_INTERVAL == 0) {
+    anchors[(appended / HISTORY_ANCHOR_INTERVAL) % HISTORY_ANCHORS] = reading.timestamp;
+  }
+  newestTimestamp = reading.timestamp;
+  appended++;
+  endWrite();
+}
+
+int HistoryBuffer::readBatch(HistoryReadState& state, DeviceReading* out, int max) const {
+  while (true) {
+    uint32_t before = writeSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      // Writer is mid-update; let it finish even if it runs at lower priority
+      delay(1);
+      continue;
+    }
+    
+    HistoryReadState next = state;
+    uint32_t first = appended - count;
+    int n = 0;
+    
+    if (state.started && appended < state.nextSeq) {
+      // Cleared underneath the reader
+      next.endSeq = next.nextSeq;
+    } else {
+      bool restart = !next.started || next.nextSeq < first;
+      if (!next.started) {
+        next.started = true;
+        next.endSeq = appended;
+      }
+      if (restart) {
+        next.nextSeq = first;
+      }
+      
+      while (n < max && next.nextSeq < next.endSeq && next.nextSeq < appended) {
+        const HistorySample& sample = bySequence(next.nextSeq);
+        if (restart && n == 0) {
+          next.timestamp = oldestTimestamp;
+        } else {
+          next.timestamp += sample.deltaMs();
+        }
+        sample.decode(out[n++], next.timestamp);
+        next.nextSeq++;
+      }
+    }
+    
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (writeSeq.load(std::memory_order_relaxed) == before) {
+      state = next;
+      return n;
+    }
+  }
+}
+
+unsigned long HistoryBuffer::timestampOf(uint32_t seq) const {
+  // From the nearest anchor at or before seq (or the oldest sample)
+  uint32_t first = appended - count;
+  uint32_t base = seq - seq % HISTORY_ANCHOR_INTERVAL;
+  unsigned long timestamp;
+  if (base < first) {
+    base = first;
+    timestamp = oldestTimestamp;
+  } else {
+    timestamp = anchors[(base / HISTORY_ANCHOR_INTERVAL) % HISTORY_ANCHORS];
+  }
+  for (uint32_t s = base + 1; s <= seq; s++) {
+    timestamp += bySequence(s).deltaMs();
+  }
+  return timestamp;
+}
+
+uint32_t HistoryBuffer::search(unsigned long timestamp, bool after) const {
+  uint32_t first = appended - count;
+  if (count == 0 || (after ? oldestTimestamp > timestamp : oldestTimestamp >= timestamp)) {
+    return first;
+  }
+  
+  // Last anchor still in the ring that is before the target, then scan
+  uint32_t lowest = (first + HISTORY_ANCHOR_INTERVAL - 1) / HISTORY_ANCHOR_INTERVAL;
+  uint32_t lo = lowest;
+  uint32_t hi = (appended - 1) / HISTORY_ANCHOR_INTERVAL + 1;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    unsigned long anchor = anchors[mid % HISTORY_ANCHORS];
+    if (after ? anchor <= timestamp : anchor < timestamp) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  uint32_t seq = first;
+  unsigned long current = oldestTimestamp;
+  if (lo > lowest) {
+    seq = (lo - 1) * HISTORY_ANCHOR_INTERVAL;
+    current = anchors[(lo - 1) % HISTORY_ANCHORS];
+  }
+  while (++seq < appended) {
+    current += bySequence(seq).deltaMs();
+    if (after ? current > timestamp : current >= timestamp) {
+      break;
+    }
+  }
+  return seq;
+}
+
+uint32_t HistoryBuffer::seek(unsigned long timestamp, bool after) const {
+  while (true) {
+    uint32_t before = writeSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      delay(1);
+      continue;
+    }
+    
+    uint32_t seq = search(timestamp, after);
+    
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (writeSeq.load(std::memory_order_relaxed) == before) {
+      return seq;
+    }
+  }
+}
+
+HistoryReadState HistoryBuffer::readFrom(uint32_t seq, uint32_t endSeq) const {
+  while (true) {
+    uint32_t before = writeSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      delay(1);
+      continue;
+    }
+    
+    // readBatch() adds each sample's delta to the previous timestamp
+    HistoryReadState state;
+    state.started = true;
+    state.nextSeq = max(seq, appended - count);
+    state.endSeq = min(endSeq, appended);
+    if (state.nextSeq < appended) {
+      state.timestamp = timestampOf(state.nextSeq) - bySequence(state.nextSeq).deltaMs();
+    } else {
+      state.timestamp = newestTimestamp;
+    }
+    
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (writeSeq.load(std::memory_order_relaxed) == before) {
+      return state;
+    }
+  }
+}
+
+HistoryBounds HistoryBuffer::bounds() const {
+  while (true) {
+    uint32_t before = writeSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      delay(1);
+      continue;
+    }
+    
+    HistoryBounds extent;
+    extent.count = count;
+    extent.first = oldestTimestamp;
+    extent.last = newestTimestamp;
+    
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (writeSeq.load(std::memory_order_relaxed) == before) {
+      return extent;
+    }
+  }
+}
+
+bool HistoryBuffer::Cursor::next(DeviceReading& reading) {
+  if (index >= buffer->count) {
+    return false;
+  }
+  
+  const HistorySample& sample = buffer->at(index);
+  if (index > 0) {
+    timestamp += sample.deltaMs();
+  }
+  sample.decode(reading, timestamp);
+  index++;
+  return true;
+}
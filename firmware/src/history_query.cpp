@@ -0,0 +1,312 @@
+#include "history_query.h"
+
+static uint64_t auditTime(unsigned long timestamp, int64_t clockOffset) {
+  // Saturating, so an open-ended `to` stays past every bucket
+  uint64_t time = timestamp;
+  if (clockOffset < 0) {
+    return time > (uint64_t)-clockOffset ? time - (uint64_t)-clockOffset : 0;
+  }
+  return time > UINT64_MAX - (uint64_t)clockOffset ? UINT64_MAX : time + (uint64_t)clockOffset;
+}
+
+void HistoryQuery::selectTier(const HistoryBuffer& history, const DeviceRollups& rollups) {
+  HistoryBounds raw = history.bounds();
+  RollupBounds tiers = rollups.bounds();
+
+  // Compared on the audit clock, which the rollups keep and which does
+  // not wrap. Nothing predates the device's first reading: a store
+  // reaching back to it covers any earlier `from`
+  uint64_t clockFrom = auditTime(from, clockOffset);
+  uint64_t clockTo = auditTime(to, clockOffset);
+  uint64_t start = max(clockFrom, tiers.firstReading);
+
+  // Raw samples in range, assuming an even reporting interval
+  if (raw.count > 0 && auditTime(raw.first, clockOffset) <= start) {
+    unsigned long span = raw.last - raw.first;
+    unsigned long inRange = min(to, raw.last) - min(from, raw.last);
+    uint32_t estimate = span > 0 ? (uint32_t)((double)raw.count * inRange / span) : raw.count;
+    if (estimate <= points) {
+      tier = HISTORY_TIER_RAW;
+      return;
+    }
+  }
+
+  int fallback = HISTORY_TIER_RAW;
+  for (int i = 0; i < ROLLUP_TIER_COUNT; i++) {
+    if (tiers.count[i] == 0) {
+      continue;
+    }
+    uint64_t first = tiers.first[i];
+    uint64_t buckets = clockTo > max(clockFrom, first) ? (clockTo - max(clockFrom, first)) / tiers.width[i] + 1 : 1;
+    if (buckets <= points) {
+      if (first <= start) {
+        tier = i;
+        return;
+      }
+      fallback = i;
+    }
+  }
+  if (fallback == HISTORY_TIER_RAW && !tiers.isEmpty()) {
+    fallback = ROLLUP_HOUR;  // Over budget everywhere: the fewest points
+  }
+  tier = fallback;
+}
+
+uint8_t HistoryQuery::parseFields(const char* list) {
+  static const struct {
+    const char* name;
+    uint8_t field;
+  } FIELDS[] = {
+    {"voltage", HISTORY_FIELD_VOLTAGE},
+    {"current", HISTORY_FIELD_CURRENT},
+    {"power", HISTORY_FIELD_POWER},
+    {"powerFactor", HISTORY_FIELD_POWER_FACTOR},
+    {"minPower", HISTORY_FIELD_MIN_POWER},
+    {"maxPower", HISTORY_FIELD_MAX_POWER},
+    {"energy", HISTORY_FIELD_ENERGY},
+    {"coverage", HISTORY_FIELD_COVERAGE},
+  };
+
+  uint8_t fields = 0;
+  while (*list) {
+    size_t len = strcspn(list, ",");
+    for (const auto& entry : FIELDS) {
+      if (strlen(entry.name) == len && strncmp(entry.name, list, len) == 0) {
+        fields |= entry.field;
+      }
+    }
+    list += len;
+    if (*list == ',') {
+      list++;
+    }
+  }
+  return fields;
+}
+
+int RawSeries::read(uint32_t& position, uint32_t end, HistoryPoint* out, int max) const {
+  if (position >= end) {
+    return 0;
+  }
+  if (!cursor.started || cursor.nextSeq != position || cursor.endSeq != end) {
+    cursor = history.readFrom(position, end);
+  }
+  int n = history.readBatch(cursor, batch, min(max, HISTORY_QUERY_BATCH));
+  for (int i = 0; i < n; i++) {
+    const DeviceReading& reading = batch[i];
+    HistoryPoint& point = out[i];
+    point.timestamp = reading.timestamp;
+    point.voltage = reading.voltage;
+    point.current = reading.current;
+    point.power = reading.power;
+    point.powerFactor = reading.powerFactor;
+    point.minPower = reading.power;
+    point.maxPower = reading.power;
+    point.energy = 0;
+    point.coverage = 0;
+  }
+  position = n > 0 ? cursor.nextSeq : end;
+  return n;
+}
+
+uint32_t RollupSeries::lowerBound(unsigned long timestamp) const {
+  RollupBounds extent = rollups.bounds();
+  if (extent.count[tier] == 0) {
+    return 0;
+  }
+  return max(auditTime(timestamp, clockOffset), extent.first[tier]) / extent.width[tier];
+}
+
+uint32_t RollupSeries::upperBound(unsigned long timestamp) const {
+  RollupBounds extent = rollups.bounds();
+  if (extent.count[tier] == 0) {
+    return 0;
+  }
+  return min(auditTime(timestamp, clockOffset), extent.last[tier]) / extent.width[tier] + 1;
+}
+
+int RollupSeries::read(uint32_t& position, uint32_t end, HistoryPoint* out, int max) const {
+  if (position >= end) {
+    return 0;
+  }
+  unsigned long width = rollups.width(tier);
+  RollupReadState state((uint64_t)position * width, (uint64_t)(end - 1) * width);
+  int n = rollups.readBatch(tier, state, batch, min(max, HISTORY_QUERY_BATCH));
+  for (int i = 0; i < n; i++) {
+    const RollupPoint& bucket = batch[i];
+    HistoryPoint& point = out[i];
+    point.timestamp = (unsigned long)(bucket.timestamp - clockOffset);
+    point.voltage = 0;
+    point.current = 0;
+    point.power = bucket.avgPower;
+    point.powerFactor = 0;
+    point.minPower = bucket.minPower;
+    point.maxPower = bucket.maxPower;
+    point.energy = bucket.energy;
+    point.coverage = bucket.coveredMs / 1000.0f;
+  }
+  position = n > 0 ? state.next / width : end;
+  return n;
+}
+
+HistoryDecimator::HistoryDecimator(const HistorySeries& source, const HistoryQuery& query)
+  : series(source), decimation(query.decimation), stage(0), hasPending(false), batchCount(0), batchPos(0) {
+  begin = series.lowerBound(query.from);
+  end = max(begin, series.upperBound(query.to));
+  points = max(query.points, (uint32_t)1);
+  position = begin;
+  decimating = end - begin > points;
+  if (decimation == HISTORY_LTTB) {
+    buckets = points >= 2 ? points - 2 : 0;
+  } else {
+    buckets = max(points / 2, (uint32_t)1);
+  }
+}
+
+uint32_t HistoryDecimator::bucketStart(uint32_t i) const {
+  // LTTB keeps the first and last points out of the buckets
+  if (decimation == HISTORY_LTTB) {
+    return begin + 1 + (uint32_t)((uint64_t)(end - begin - 2) * i / buckets);
+  }
+  return begin + (uint32_t)((uint64_t)(end - begin) * i / buckets);
+}
+
+bool HistoryDecimator::firstIn(uint32_t from, uint32_t stop, HistoryPoint& out) {
+  return series.read(from, stop, &out, 1) > 0;
+}
+
+bool HistoryDecimator::lastIn(uint32_t from, uint32_t stop, HistoryPoint& out) {
+  bool found = false;
+  int n;
+  while ((n = series.read(from, stop, batch, HISTORY_QUERY_BATCH)) > 0) {
+    out = batch[n - 1];
+    found = true;
+  }
+  return found;
+}
+
+bool HistoryDecimator::nextLttb(HistoryPoint& out) {
+  while (true) {
+    if (stage == 0) {
+      stage++;
+      if (firstIn(begin, end, selected)) {
+        out = selected;
+        return true;
+      }
+      stage = buckets + 2;  // Nothing in range
+    }
+    if (stage > buckets + 1 || (stage == buckets + 1 && points < 2)) {
+      return false;
+    }
+    if (stage == buckets + 1) {
+      stage++;
+      return lastIn(end - 1, end, out);
+    }
+
+    // Mean of the next bucket (the last point after the final one)
+    uint32_t i = stage++ - 1;
+    uint32_t nextFrom = i + 1 < buckets ? bucketStart(i + 1) : end - 1;
+    uint32_t nextTo = i + 1 < buckets ? bucketStart(i + 2) : end;
+    double meanTime = 0;
+    double meanPower = 0;
+    uint32_t count = 0;
+    int n;
+    while ((n = series.read(nextFrom, nextTo, batch, HISTORY_QUERY_BATCH)) > 0) {
+      for (int k = 0; k < n; k++) {
+        meanTime += batch[k].timestamp - selected.timestamp;
+        meanPower += batch[k].power;
+      }
+      count += n;
+    }
+    if (count > 0) {
+      meanTime /= count;
+      meanPower /= count;
+    } else {
+      meanPower = selected.power;
+    }
+
+    // The point of this bucket spanning the largest triangle with the
+    // last one emitted and that mean
+    uint32_t from = bucketStart(i);
+    uint32_t to = bucketStart(i + 1);
+    double largest = -1;
+    while ((n = series.read(from, to, batch, HISTORY_QUERY_BATCH)) > 0) {
+      for (int k = 0; k < n; k++) {
+        double dt = (double)(batch[k].timestamp - selected.timestamp);
+        double area = fabs(dt * (meanPower - selected.power) - meanTime * (batch[k].power - selected.power));
+        if (area > largest) {
+          largest = area;
+          out = batch[k];
+        }
+      }
+    }
+    if (largest >= 0) {
+      selected = out;
+      return true;
+    }
+    // Empty bucket: on to the next
+  }
+}
+
+bool HistoryDecimator::nextMinMax(HistoryPoint& out) {
+  if (hasPending) {
+    hasPending = false;
+    out = pending;
+    return true;
+  }
+
+  while (stage < buckets) {
+    uint32_t from = bucketStart(stage);
+    uint32_t to = bucketStart(stage + 1);
+    stage++;
+
+    HistoryPoint lowest;
+    HistoryPoint highest;
+    bool found = false;
+    int n;
+    while ((n = series.read(from, to, batch, HISTORY_QUERY_BATCH)) > 0) {
+      for (int k = 0; k < n; k++) {
+        if (!found || batch[k].minPower < lowest.minPower) {
+          lowest = batch[k];
+        }
+        if (!found || batch[k].maxPower > highest.maxPower) {
+          highest = batch[k];
+        }
+        found = true;
+      }
+    }
+    if (!found) {
+      continue;
+    }
+
+    // In time order; a single point when the budget allows no more
+    if (points < 2 || lowest.timestamp == highest.timestamp) {
+      out = highest;
+    } else if (lowest.timestamp < highest.timestamp) {
+      out = lowest;
+      pending = highest;
+      hasPending = true;
+    } else {
+      out = highest;
+      pending = lowest;
+      hasPending = true;
+    }
+    return true;
+  }
+  return false;
+}
+
+bool HistoryDecimator::next(HistoryPoint& out) {
+  if (decimating) {
+    return decimation == HISTORY_LTTB ? nextLttb(out) : nextMinMax(out);
+  }
+
+  if (batchPos == batchCount) {
+    batchCount = series.read(position, end, batch, HISTORY_QUERY_BATCH);
+    batchPos = 0;
+  }
+  if (batchPos < batchCount) {
+    out = batch[batchPos++];
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,175 @@
+#include "json_stream.h"
+
+// Binary powers of ten used by ArduinoJson's float normalization
+static const double POSITIVE_POWERS[] = {1e1, 1e2, 1e4, 1e8, 1e16, 1e32, 1e64, 1e128, 1e256};
+static const double NEGATIVE_POWERS[] = {1e-1, 1e-2, 1e-4, 1e-8, 1e-16, 1e-32, 1e-64, 1e-128, 1e-256};
+static const double NEGATIVE_POWERS_PLUS_ONE[] = {1e0, 1e-1, 1e-3, 1e-7, 1e-15, 1e-31, 1e-63, 1e-127, 1e-255};
+
+static int16_t normalizeFloat(double& value) {
+  int16_t powersOf10 = 0;
+  int8_t index = 8;
+  int bit = 1 << index;
+  
+  if (value >= 1e7) {
+    for (; index >= 0; index--) {
+      if (value >= POSITIVE_POWERS[index]) {
+        value *= NEGATIVE_POWERS[index];
+        powersOf10 = int16_t(powersOf10 + bit);
+      }
+      bit >>= 1;
+    }
+  }
+  
+  if (value > 0 && value <= 1e-5) {
+    for (; index >= 0; index--) {
+      if (value < NEGATIVE_POWERS_PLUS_ONE[index]) {
+        value *= POSITIVE_POWERS[index];
+        powersOf10 = int16_t(powersOf10 - bit);
+      }
+      bit >>= 1;
+    }
+  }
+  
+  return powersOf10;
+}
+
+void JsonText::raw(char c) {
+  if (len + 1 < capacity) {
+    buffer[len++] = c;
+  } else {
+    overflowed = true;
+  }
+}
+
+void JsonText::raw(const char* text) {
+  while (*text) {
+    raw(*text++);
+  }
+}
+
+void JsonText::string(const char* text) {
+  raw('"');
+  for (; *text; text++) {
+    switch (*text) {
+      case '"': raw("\\\""); break;
+      case '\\': raw("\\\\"); break;
+      case '\b': raw("\\b"); break;
+      case '\f': raw("\\f"); break;
+      case '\n': raw("\\n"); break;
+      case '\r': raw("\\r"); break;
+      case '\t': raw("\\t"); break;
+      default: raw(*text); break;
+    }
+  }
+  raw('"');
+}
+
+void JsonText::key(const char* name) {
+  string(name);
+  raw(':');
+}
+
+void JsonText::number(unsigned long value) {
+  char digits[12];
+  char* p = digits + sizeof(digits);
+  *--p = '\0';
+  do {
+    *--p = char('0' + value % 10);
+    value /= 10;
+  } while (value);
+  raw(p);
+}
+
+void JsonText::writeDecimals(uint32_t value, int8_t width) {
+  char digits[16];
+  char* end = digits + sizeof(digits);
+  char* p = end;
+  *--p = '\0';
+  while (width--) {
+    *--p = char(value % 10 + '0');
+    value /= 10;
+  }
+  *--p = '.';
+  raw(p);
+}
+
+void JsonText::number(double value) {
+  if (isnan(value) || isinf(value)) {
+    raw("null");
+    return;
+  }
+  
+  if (value < 0.0) {
+    raw('-');
+    value = -value;
+  }
+  
+  // Same decomposition as ArduinoJson's FloatParts<double>
+  uint32_t maxDecimalPart = 1000000000;
+  int8_t decimalPlaces = 9;
+  int16_t exponent = normalizeFloat(value);
+  
+  uint32_t integral = uint32_t(value);
+  for (uint32_t tmp = integral; tmp >= 10; tmp /= 10) {
+    maxDecimalPart /= 10;
+    decimalPlaces--;
+  }
+  
+  double remainder = (value - double(integral)) * double(maxDecimalPart);
+  uint32_t decimal = uint32_t(remainder);
+  remainder = remainder - double(decimal);
+  
+  // Round half up
+  decimal += uint32_t(remainder * 2);
+  if (decimal >= maxDecimalPart) {
+    decimal = 0;
+    integral++;
+    if (exponent && integral >= 10) {
+      exponent++;
+      integral = 1;
+    }
+  }
+  
+  // Remove trailing zeros
+  while (decimal % 10 == 0 && decimalPlaces > 0) {
+    decimal /= 10;
+    decimalPlaces--;
+  }
+  
+  number((unsigned long)integral);
+  if (decimalPlaces) {
+    writeDecimals(decimal, decimalPlaces);
+  }
+  if (exponent) {
+    raw('e');
+    if (exponent < 0) {
+      raw('-');
+      exponent = -exponent;
+    }
+    number((unsigned long)exponent);
+  }
+}
+
+size_t JsonChunkSource::fill(uint8_t* buffer, size_t maxLen) {
+  size_t written = 0;
+  
+  while (written < maxLen) {
+    if (pendingPos == pendingLen) {
+      if (finished) {
+        break;
+      }
+      JsonText text(staging, sizeof(staging));
+      finished = !nextChunk(text);
+      pendingLen = text.length();
+      pendingPos = 0;
+      continue;
+    }
+    
+    size_t n = min(maxLen - written, pendingLen - pendingPos);
+    memcpy(buffer + written, staging + pendingPos, n);
+    written += n;
+    pendingPos += n;
+  }
+  
+  return written;
+}
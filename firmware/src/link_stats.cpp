@@ -0,0 +1,50 @@
+#include "link_stats.h"
+
+void LinkStats::frameReceived(const uint8_t* source, int8_t frameRssi, unsigned long receivedAt, const TelemetryFrame& frame) {
+  memcpy(mac, source, sizeof(mac));
+  rssi = frameRssi;
+  
+  // Transmissions since the last new frame; 1 without the counter
+  uint16_t advance = 1;
+  if (frame.flags & TELEMETRY_FLAG_LINK) {
+    uint16_t previous = frames.lastSequence();
+    bool started = frames.hasSequence();
+    if (frames.observe(frame.transmission) != SEQUENCE_NEW || !started) {
+      lastFrameAt = receivedAt;
+      return;
+    }
+    advance = frame.transmission - previous;
+  }
+  
+  // Smoothed interval, ignoring outages (gaps far longer than usual)
+  if (lastFrameAt != 0) {
+    unsigned long gap = (receivedAt - lastFrameAt) / advance;
+    if (frameInterval == 0) {
+      frameInterval = gap;
+    } else if (gap < 4 * frameInterval) {
+      frameInterval += ((long)gap - (long)frameInterval) / 4;
+    }
+  }
+  lastFrameAt = receivedAt;
+}
+
+unsigned long LinkStats::activityTimeout() const {
+  unsigned long timeout = frameInterval * DEVICE_TIMEOUT_INTERVALS;
+  return timeout > DEVICE_TIMEOUT_MS ? timeout : DEVICE_TIMEOUT_MS;
+}
+
+LinkSummary LinkStats::summary() const {
+  LinkSummary s;
+  s.valid = samples.hasSequence();
+  s.rssi = rssi;
+  s.lastSequence = samples.lastSequence();
+  s.lossRate = frames.hasSequence() ? frames.lossRate() : samples.lossRate();
+  s.frames = frames.receivedCount();
+  s.framesLost = frames.missingCount();
+  s.samples = samples.receivedCount();
+  s.samplesMissed = samples.missingCount();
+  s.duplicates = samples.duplicateCount();
+  s.restarts = samples.restartCount();
+  s.frameInterval = frameInterval;
+  return s;
+}
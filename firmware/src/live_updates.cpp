@@ -0,0 +1,82 @@
+#include "live_updates.h"
+
+static_assert(LIVE_FRAME_MAX > LIVE_DELTA_MAX + 2, "Update frame must fit at least one delta");
+
+void LiveUpdates::markDevice(DeviceHandle handle) {
+  if (handle >= 0 && handle < MAX_DEVICES) {
+    dirty.set(handle);
+  }
+}
+
+void LiveUpdates::clear() {
+  dirty.reset();
+  structureChanged = false;
+}
+
+bool LiveUpdates::due(unsigned long now) const {
+  return (dirty.any() || structureChanged) && now - lastPush >= LIVE_PUSH_INTERVAL_MS;
+}
+
+bool LiveUpdates::takeStructureChange() {
+  bool changed = structureChanged;
+  structureChanged = false;
+  return changed;
+}
+
+size_t LiveUpdates::buildFrame(const DeviceRegistry& devices, char* buffer, size_t capacity) {
+  JsonText out(buffer, capacity);
+  int written = 0;
+  
+  out.raw('[');
+  for (DeviceHandle h = 0; h < MAX_DEVICES && dirty.any(); h++) {
+    if (!dirty.test(h)) {
+      continue;
+    }
+    if (out.length() + LIVE_DELTA_MAX + 2 > capacity) {
+      break;  // Rest goes out in the next frame
+    }
+    
+    dirty.reset(h);
+    if (!devices.isValid(h)) {
+      continue;  // Removed since it was marked
+    }
+    if (written++ > 0) {
+      out.raw(',');
+    }
+    writeDelta(out, devices[h]);
+  }
+  out.raw(']');
+  
+  buffer[out.length()] = '\0';
+  return written > 0 ? out.length() : 0;
+}
+
+void LiveUpdates::writeDelta(JsonText& out, const DeviceInfo& device) {
+  // Only what changes with a reading; names and window stats come from
+  // /api/devices, which clients refetch on a structure change
+  const DeviceReading& reading = device.currentReading;
+  
+  out.raw('{');
+  out.key("id"); out.string(device.id.c_str()); out.raw(',');
+  out.key("isActive"); out.boolean(device.isActive); out.raw(',');
+  out.key("lastSeen"); out.number(device.lastSeen); out.raw(',');
+  out.key("standbyWaste"); out.boolean(device.standbyWaste); out.raw(',');
+  out.key("usageAnomaly"); out.boolean(device.usageAnomaly); out.raw(',');
+  out.key("efficiencyIssue"); out.boolean(device.efficiencyIssue); out.raw(',');
+  out.key("totalEnergy"); out.number(device.totalEnergy); out.raw(',');
+  out.key("avgPower"); out.number(device.avgPower); out.raw(',');
+  out.key("maxPower"); out.number(device.maxPower); out.raw(',');
+  
+  out.key("currentReading");
+  out.raw('{');
+  out.key("voltage"); out.number(reading.voltage); out.raw(',');
+  out.key("current"); out.number(reading.current); out.raw(',');
+  out.key("power"); out.number(reading.power); out.raw(',');
+  out.key("energy"); out.number(reading.energy); out.raw(',');
+  out.key("frequency"); out.number(reading.frequency); out.raw(',');
+  out.key("powerFactor"); out.number(reading.powerFactor); out.raw(',');
+  out.key("timestamp"); out.number(reading.timestamp);
+  out.raw('}');
+  
+  out.raw('}');
+}
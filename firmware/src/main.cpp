@@ -2,14 +2,28 @@
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
 #include <esp_now.h>
+#include <esp_wifi.h>
 #include <ArduinoJson.h>
+#include <memory>
+#include "ack_peers.h"
+#include "api_streams.h"
+#include "audit_log.h"
 #include "config.h"
 #include "device_data.h"
+#include "device_registry.h"
+#include "device_snapshot.h"
+#include "espnow_queue.h"
+#include "export_stream.h"
+#include "live_updates.h"
 #include "pzem_sensor.h"
+#include "spsc_queue.h"
+#include "telemetry_frame.h"
 #include "waste_detector.h"
+#include "web_assets.h"
 
 // Web Server
 AsyncWebServer server(WEB_SERVER_PORT);
+AsyncEventSource events("/events");
 
 // PZEM Sensors (2 wired loads)
 // Note: Adjust serial pins based on your ESP32 board
@@ -19,13 +33,49 @@ HardwareSerial PZEM2Serial(2);
 PZEMSensor pzem1(&PZEM1Serial, PZEM1_ADDR, WIRED_LOAD_1_ID, "Wired Load 1");
 PZEMSensor pzem2(&PZEM2Serial, PZEM2_ADDR, WIRED_LOAD_2_ID, "Wired Load 2");
 
-// Device storage
-DeviceInfo devices[MAX_DEVICES];
-int deviceCount = 0;
+// Device storage (hash-indexed, slots never move)
+DeviceRegistry devices;
+
+// ESP-NOW receive queue: the Wi-Fi callback only copies raw frames here,
+// loop() decodes them and updates devices
+EspNowQueue espNowQueue;
+uint32_t espNowOversized = 0;
+uint32_t acksSent = 0;
+uint32_t ackFailures = 0;
+uint32_t framesRejected = 0;  // From nodes the registry could not take (full, or out of memory)
+AckPeerTable ackPeers;  // Nodes currently in the ESP-NOW peer list
+
+// RSSI of the last ESP-NOW frame and its sender, from promiscuous mode
+// (this core's receive callback does not carry it); Wi-Fi task only
+uint8_t rssiSource[6];
+int8_t rssiLast = 0;
+
+// HTTP handlers run on the async TCP task: they read published snapshots
+// and queue mutations, loop() owns the device registry
+SnapshotPublisher deviceSnapshots;
+bool snapshotDirty = true;
+
+enum DeviceCommandType { DEVICE_CMD_RENAME, DEVICE_CMD_DELETE };
+struct DeviceCommand {
+  DeviceCommandType type;
+  char id[DEVICE_ID_MAX];
+  char name[DEVICE_NAME_MAX];
+};
+SpscQueue<DeviceCommand, DEVICE_COMMAND_QUEUE_SIZE> deviceCommands;
+
+// Changed devices waiting to be pushed to /events clients (loop() only)
+LiveUpdates liveUpdates;
+
+// Device history persisted to flash across reboots (loop() only)
+AuditLog auditLog;
+
+// Time-of-use prices for the energy buckets (read-only once built)
+Tariff tariff;
 
 // Timing
 unsigned long lastPZEMRead = 0;
 unsigned long lastWasteCheck = 0;
+unsigned long lastActivityCheck = 0;
 const unsigned long PZEM_READ_INTERVAL = 2000;  // Read every 2 seconds
 
 // Function prototypes
@@ -33,13 +83,28 @@ void initWiFiAP();
 void initESPNOW();
 void initWebServer();
 void initDevices();
-int findDeviceIndex(String deviceId);
+void initStorage();
+void restoreDevices();
+DeviceHandle findOrAddDevice(const String& id, const String& name, const String& type);
 void addOrUpdateDevice(String id, String name, String type, DeviceReading reading);
+void updateDevice(DeviceHandle idx, const DeviceReading& reading);
+void updateActivity(unsigned long now);
 void updateDeviceHistory(DeviceInfo& device, DeviceReading reading);
 void onESPNOWReceive(const uint8_t* mac, const uint8_t* data, int len);
-String getDashboardHTML();
-String getDeviceHistoryJSON(String deviceId);
-String getAllDevicesJSON();
+void onPromiscuousFrame(void* buffer, wifi_promiscuous_pkt_type_t type);
+void sendAcknowledgement(const uint8_t* mac, const TelemetryFrame& frame);
+void processESPNOWQueue();
+void handleESPNOWFrame(const EspNowFrame& frame);
+void processDeviceCommands();
+void publishDeviceSnapshot();
+void pushLiveUpdates(unsigned long now);
+bool queueDeviceCommand(DeviceCommandType type, const String& id, const String& name);
+void sendJsonStream(AsyncWebServerRequest* request, std::shared_ptr<JsonChunkSource> source);
+const DeviceInfo* findHistoryDevice(const String& deviceId, DeviceSlot& slot);
+void sendDeviceHistory(AsyncWebServerRequest* request, const String& deviceId);
+void sendExport(AsyncWebServerRequest* request);
+void sendEnergy(AsyncWebServerRequest* request, const String& deviceId);
+void sendWebAsset(AsyncWebServerRequest* request, const WebAsset& asset);
 
 void setup() {
   Serial.begin(115200);
@@ -50,6 +115,9 @@ void setup() {
   // Initialize devices array
   initDevices();
   
+  // Recover the audit log before any device is added
+  initStorage();
+  
   // Initialize WiFi Access Point
   initWiFiAP();
   
@@ -85,6 +153,9 @@ void setup() {
     addOrUpdateDevice(WIRED_LOAD_2_ID, "Wired Load 2", "wired", DeviceReading{});
   }
   
+  // Devices and energy totals from the last run
+  restoreDevices();
+  
   Serial.println("\n=== System Ready ===");
   Serial.print("AP SSID: ");
   Serial.println(AP_SSID);
@@ -99,30 +170,60 @@ void setup() {
 void loop() {
   unsigned long now = millis();
   
-  // Read PZEM sensors periodically
+  // Start a PZEM transaction on both UARTs periodically; the responses
+  // are collected by poll() below so neither sensor blocks loop()
   if (now - lastPZEMRead >= PZEM_READ_INTERVAL) {
-    DeviceReading reading1, reading2;
-    
-    if (pzem1.readData(reading1)) {
-      addOrUpdateDevice(WIRED_LOAD_1_ID, "Wired Load 1", "wired", reading1);
-    }
-    
-    if (pzem2.readData(reading2)) {
-      addOrUpdateDevice(WIRED_LOAD_2_ID, "Wired Load 2", "wired", reading2);
-    }
-    
+    pzem1.requestData();
+    pzem2.requestData();
     lastPZEMRead = now;
   }
   
+  // Handle queued wireless frames and HTTP mutations
+  processESPNOWQueue();
+  processDeviceCommands();
+  
+  DeviceReading reading;
+  if (pzem1.poll(reading) == PZEMSensor::POLL_READY) {
+    addOrUpdateDevice(WIRED_LOAD_1_ID, "Wired Load 1", "wired", reading);
+  }
+  
+  if (pzem2.poll(reading) == PZEMSensor::POLL_READY) {
+    addOrUpdateDevice(WIRED_LOAD_2_ID, "Wired Load 2", "wired", reading);
+  }
+  
+  // Devices that stopped reporting
+  if (now - lastActivityCheck >= ACTIVITY_CHECK_INTERVAL_MS) {
+    updateActivity(now);
+    lastActivityCheck = now;
+  }
+  
   // Check for waste periodically
   if (now - lastWasteCheck >= ANOMALY_CHECK_INTERVAL_MS) {
-    for (int i = 0; i < deviceCount; i++) {
-      WasteDetector::analyzeDevice(devices[i]);
+    for (DeviceHandle h = devices.first(); h != INVALID_DEVICE; h = devices.next(h)) {
+      DeviceInfo& device = devices[h];
+      bool flags[] = {device.standbyWaste, device.usageAnomaly, device.efficiencyIssue};
+      WasteDetector::analyzeDevice(device);
+      if (flags[0] != device.standbyWaste || flags[1] != device.usageAnomaly || flags[2] != device.efficiencyIssue) {
+        liveUpdates.markDevice(h);
+      }
     }
     lastWasteCheck = now;
+    snapshotDirty = true;
+  }
+  
+  // Log to flash (batched)
+  auditLog.update(now);
+  
+  // Publish at most one snapshot per update cycle
+  if (snapshotDirty) {
+    publishDeviceSnapshot();
   }
   
-  delay(100);
+  // Push changed devices to dashboard clients
+  pushLiveUpdates(now);
+  
+  // Yield to the idle task without stalling PZEM polling
+  delay(1);
 }
 
 void initWiFiAP() {
@@ -151,52 +252,102 @@ void initESPNOW() {
   }
   
   esp_now_register_recv_cb(onESPNOWReceive);
+  
+  // Management frames only: ESP-NOW travels in action frames
+  wifi_promiscuous_filter_t filter = {};
+  filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+  esp_wifi_set_promiscuous_filter(&filter);
+  esp_wifi_set_promiscuous_rx_cb(onPromiscuousFrame);
+  esp_wifi_set_promiscuous(true);
   Serial.println("✓ ESP-NOW receiver initialized");
 }
 
 void initWebServer() {
-  // Root - Dashboard
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest* request) {
-    request->send(200, "text/html", getDashboardHTML());
+  // Dashboard assets, served gzip'd straight from flash
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    const WebAsset* asset = &WEB_ASSETS[i];
+    server.on(asset->path, HTTP_GET, [asset](AsyncWebServerRequest* request) {
+      sendWebAsset(request, *asset);
+    });
+  }
+  
+  // Live updates: dashboards subscribe here instead of polling
+  server.addHandler(&events);
+  
+  // API: Get device history (registered first: the plain "/api/devices"
+  // route also matches every path below it)
+  server.on("^/api/devices/(.+)$", HTTP_GET, [](AsyncWebServerRequest* request) {
+    sendDeviceHistory(request, request->pathArg(0));
   });
   
   // API: Get all devices
   server.on("/api/devices", HTTP_GET, [](AsyncWebServerRequest* request) {
-    request->send(200, "application/json", getAllDevicesJSON());
-  });
-  
-  // API: Get device history
-  server.on("^/api/devices/(.+)$", HTTP_GET, [](AsyncWebServerRequest* request) {
-    String deviceId = request->pathArg(0);
-    request->send(200, "application/json", getDeviceHistoryJSON(deviceId));
+    sendJsonStream(request, std::make_shared<DeviceListStream>(deviceSnapshots));
   });
   
   // API: Get device details
   server.on("^/api/device/(.+)$", HTTP_GET, [](AsyncWebServerRequest* request) {
     String deviceId = request->pathArg(0);
-    int idx = findDeviceIndex(deviceId);
+    SnapshotReader snapshot(deviceSnapshots);
+    const DeviceSnapshot* device = snapshot->find(deviceId.c_str());
     
-    if (idx >= 0) {
+    if (device) {
       StaticJsonDocument<1024> doc;
-      doc["id"] = devices[idx].id;
-      doc["name"] = devices[idx].name;
-      doc["customName"] = devices[idx].customName;
-      doc["displayName"] = devices[idx].getDisplayName();
-      doc["type"] = devices[idx].type;
-      doc["isActive"] = devices[idx].isActive;
-      doc["lastSeen"] = devices[idx].lastSeen;
-      doc["standbyWaste"] = devices[idx].standbyWaste;
-      doc["usageAnomaly"] = devices[idx].usageAnomaly;
-      doc["efficiencyIssue"] = devices[idx].efficiencyIssue;
+      doc["id"] = device->id;
+      doc["name"] = device->name;
+      doc["customName"] = device->customName;
+      doc["displayName"] = device->getDisplayName();
+      doc["type"] = device->type;
+      doc["isActive"] = device->isActive;
+      doc["lastSeen"] = device->lastSeen;
+      if (device->link.valid) {
+        JsonObject link = doc.createNestedObject("link");
+        link["rssi"] = device->link.rssi;
+        link["lastSequence"] = device->link.lastSequence;
+        link["lossRate"] = device->link.lossRate;
+        link["frames"] = device->link.frames;
+        link["framesLost"] = device->link.framesLost;
+        link["samples"] = device->link.samples;
+        link["samplesMissed"] = device->link.samplesMissed;
+        link["duplicates"] = device->link.duplicates;
+        link["restarts"] = device->link.restarts;
+        link["intervalMs"] = device->link.frameInterval;
+      }
+      doc["standbyWaste"] = device->standbyWaste;
+      doc["usageAnomaly"] = device->usageAnomaly;
+      doc["efficiencyIssue"] = device->efficiencyIssue;
+      doc["totalEnergy"] = device->totalEnergy;
+      
+      const EnergySummary& account = device->energy;
+      JsonObject energy = doc.createNestedObject("energy");
+      energy["method"] = EnergyAccount::methodName(account.method);
+      energy["hour"] = account.hourEnergy;
+      energy["hourCost"] = account.hourCost;
+      energy["today"] = account.todayEnergy;
+      energy["todayCost"] = account.todayCost;
+      energy["gaps"] = account.gaps;
+      energy["counterResets"] = account.counterResets;
+      energy["counterRollovers"] = account.counterRollovers;
+      energy["counterGlitches"] = account.counterGlitches;
       
       JsonObject reading = doc.createNestedObject("currentReading");
-      reading["voltage"] = devices[idx].currentReading.voltage;
-      reading["current"] = devices[idx].currentReading.current;
-      reading["power"] = devices[idx].currentReading.power;
-      reading["energy"] = devices[idx].currentReading.energy;
-      reading["frequency"] = devices[idx].currentReading.frequency;
-      reading["powerFactor"] = devices[idx].currentReading.powerFactor;
-      reading["timestamp"] = devices[idx].currentReading.timestamp;
+      reading["voltage"] = device->currentReading.voltage;
+      reading["current"] = device->currentReading.current;
+      reading["power"] = device->currentReading.power;
+      reading["energy"] = device->currentReading.energy;
+      reading["frequency"] = device->currentReading.frequency;
+      reading["powerFactor"] = device->currentReading.powerFactor;
+      reading["timestamp"] = device->currentReading.timestamp;
+      
+      const HarmonicReading& harmonics = device->currentReading.harmonics;
+      if (harmonics.valid) {
+        JsonObject spectrum = doc.createNestedObject("harmonics");
+        spectrum["fundamental"] = harmonics.fundamental;
+        spectrum["h3"] = harmonics.orders[0];
+        spectrum["h5"] = harmonics.orders[1];
+        spectrum["h7"] = harmonics.orders[2];
+        spectrum["thd"] = harmonics.thd;
+      }
       
       String response;
       serializeJson(doc, response);
@@ -206,23 +357,22 @@ void initWebServer() {
     }
   });
   
-  // API: Rename device
+  // API: Rename device (applied by loop() via the command queue)
   server.on("^/api/device/(.+)/rename$", HTTP_POST, [](AsyncWebServerRequest* request) {
     String deviceId = request->pathArg(0);
-    int idx = findDeviceIndex(deviceId);
+    SnapshotReader snapshot(deviceSnapshots);
     
-    if (idx >= 0) {
+    if (snapshot->find(deviceId.c_str())) {
       if (request->hasParam("name", true)) {
         String newName = request->getParam("name", true)->value();
         newName.trim();
         
         if (newName.length() > 0 && newName.length() <= 50) {
-          devices[idx].customName = newName;
-          Serial.print("Device ");
-          Serial.print(deviceId);
-          Serial.print(" renamed to: ");
-          Serial.println(newName);
-          request->send(200, "application/json", "{\"success\":true,\"message\":\"Device renamed\"}");
+          if (queueDeviceCommand(DEVICE_CMD_RENAME, deviceId, newName)) {
+            request->send(200, "application/json", "{\"success\":true,\"message\":\"Device renamed\"}");
+          } else {
+            request->send(503, "application/json", "{\"error\":\"Busy, try again\"}");
+          }
         } else {
           request->send(400, "application/json", "{\"error\":\"Invalid name length\"}");
         }
@@ -237,20 +387,17 @@ void initWebServer() {
   // API: Delete device (only wireless devices can be deleted)
   server.on("^/api/device/(.+)/delete$", HTTP_POST, [](AsyncWebServerRequest* request) {
     String deviceId = request->pathArg(0);
-    int idx = findDeviceIndex(deviceId);
+    SnapshotReader snapshot(deviceSnapshots);
+    const DeviceSnapshot* device = snapshot->find(deviceId.c_str());
     
-    if (idx >= 0) {
+    if (device) {
       // Only allow deletion of wireless devices
-      if (devices[idx].type == "wireless") {
-        // Shift array to remove device
-        for (int i = idx; i < deviceCount - 1; i++) {
-          devices[i] = devices[i + 1];
+      if (strcmp(device->type, "wireless") == 0) {
+        if (queueDeviceCommand(DEVICE_CMD_DELETE, deviceId, "")) {
+          request->send(200, "application/json", "{\"success\":true,\"message\":\"Device deleted\"}");
+        } else {
+          request->send(503, "application/json", "{\"error\":\"Busy, try again\"}");
         }
-        deviceCount--;
-        Serial.print("Device ");
-        Serial.print(deviceId);
-        Serial.println(" deleted");
-        request->send(200, "application/json", "{\"success\":true,\"message\":\"Device deleted\"}");
       } else {
         request->send(403, "application/json", "{\"error\":\"Cannot delete wired devices\"}");
       }
@@ -259,53 +406,243 @@ void initWebServer() {
     }
   });
   
+  // API: Hourly and daily energy and cost of a device
+  server.on("^/api/energy/(.+)$", HTTP_GET, [](AsyncWebServerRequest* request) {
+    sendEnergy(request, request->pathArg(0));
+  });
+  
+  // API: Every device's history, logged and in RAM, for offline analysis
+  server.on("/api/export", HTTP_GET, [](AsyncWebServerRequest* request) {
+    sendExport(request);
+  });
+  
+  // API: System status (ESP-NOW receive queue counters)
+  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest* request) {
+    StaticJsonDocument<512> doc;
+    doc["uptime"] = millis() / 1000;
+    doc["freeHeap"] = ESP.getFreeHeap();
+    {
+      SnapshotReader snapshot(deviceSnapshots);
+      doc["deviceCount"] = snapshot->count;
+    }
+    
+    JsonObject rx = doc.createNestedObject("espNowQueue");
+    rx["depth"] = espNowQueue.size();
+    rx["capacity"] = espNowQueue.capacity();
+    rx["highWater"] = espNowQueue.highWater();
+    rx["drops"] = espNowQueue.drops();
+    rx["oversized"] = espNowOversized;
+    rx["acksSent"] = acksSent;
+    rx["ackFailures"] = ackFailures;
+    rx["ackPeerEvictions"] = ackPeers.evictionCount();
+    rx["rejected"] = framesRejected;
+    
+    JsonObject live = doc.createNestedObject("liveUpdates");
+    live["clients"] = events.count();
+    live["sent"] = liveUpdates.sentCount();
+    live["deferred"] = liveUpdates.deferredCount();
+    
+    // Written by loop(); plain counters, read without locking
+    const FlashLogStats& logStats = auditLog.stats();
+    JsonObject storage = doc.createNestedObject("storage");
+    storage["ready"] = auditLog.isReady();
+    storage["clock"] = auditLog.clock();
+    storage["segments"] = logStats.segments;
+    storage["generation"] = logStats.generation;
+    storage["pending"] = auditLog.pending();
+    storage["written"] = logStats.written;
+    storage["flushes"] = logStats.flushes;
+    storage["erases"] = logStats.erases;
+    storage["dropped"] = logStats.dropped;
+    storage["writeErrors"] = logStats.writeErrors;
+    storage["recovered"] = logStats.recovered;
+    storage["torn"] = logStats.torn;
+    storage["maxFlushUs"] = logStats.maxFlushMicros;
+    
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+  });
+  
   server.begin();
   Serial.println("✓ Web server started on port " + String(WEB_SERVER_PORT));
 }
 
 void initDevices() {
-  deviceCount = 0;
-  for (int i = 0; i < MAX_DEVICES; i++) {
-    devices[i].historyCount = 0;
-    devices[i].isActive = false;
-    devices[i].totalEnergy = 0;
-    devices[i].avgPower = 0;
-    devices[i].maxPower = 0;
-    devices[i].customName = "";  // Initialize custom name
+  devices.clear();
+  snapshotDirty = true;
+}
+
+void initStorage() {
+  if (!auditLog.begin(devices)) {
+    Serial.println("✗ No audit log partition, history is not persisted");
+    return;
+  }
+  const FlashLogStats& logStats = auditLog.stats();
+  Serial.print("✓ Audit log: ");
+  Serial.print(logStats.recovered);
+  Serial.print(" records recovered from ");
+  Serial.print(logStats.segments);
+  Serial.print(" segments in ");
+  Serial.print(logStats.recoveryMicros);
+  Serial.println(" us");
+  if (logStats.torn > 0) {
+    Serial.print("  skipped ");
+    Serial.print(logStats.torn);
+    Serial.println(" interrupted writes");
   }
 }
 
-int findDeviceIndex(String deviceId) {
-  for (int i = 0; i < deviceCount; i++) {
-    if (devices[i].id == deviceId) {
-      return i;
+void restoreDevices() {
+  // Wired loads are already in place; nodes come back inactive until
+  // they report again
+  for (int i = 0; i < auditLog.restoredCount(); i++) {
+    const AuditDeviceState& state = auditLog.restored(i);
+    String id = state.id;
+    DeviceHandle idx = state.wireless ? findOrAddDevice(id, "Wireless Node " + id, "wireless") : devices.find(id);
+    if (idx != INVALID_DEVICE) {
+      devices[idx].energyAccount.restore(state.totalEnergy);
+      devices[idx].totalEnergy = state.totalEnergy;
     }
   }
-  return -1;
 }
 
-void addOrUpdateDevice(String id, String name, String type, DeviceReading reading) {
-  int idx = findDeviceIndex(id);
-  
-  if (idx < 0) {
-    // Add new device
-    if (deviceCount < MAX_DEVICES) {
-      idx = deviceCount++;
-      devices[idx].id = id;
-      devices[idx].name = name;
-      devices[idx].customName = "";  // Initialize custom name
-      devices[idx].type = type;
-      devices[idx].historyCount = 0;
-      devices[idx].totalEnergy = 0;
-      devices[idx].avgPower = 0;
-      devices[idx].maxPower = 0;
-    } else {
-      Serial.println("Warning: Max devices reached");
-      return;
+bool queueDeviceCommand(DeviceCommandType type, const String& id, const String& name) {
+  // Producer side: async TCP task only
+  DeviceCommand* command = deviceCommands.reserve();
+  if (!command) {
+    return false;
+  }
+  command->type = type;
+  strncpy(command->id, id.c_str(), sizeof(command->id) - 1);
+  command->id[sizeof(command->id) - 1] = '\0';
+  strncpy(command->name, name.c_str(), sizeof(command->name) - 1);
+  command->name[sizeof(command->name) - 1] = '\0';
+  deviceCommands.commit();
+  return true;
+}
+
+void processDeviceCommands() {
+  DeviceCommand command;
+  while (deviceCommands.pop(command)) {
+    DeviceHandle idx = devices.find(command.id);
+    if (idx == INVALID_DEVICE) {
+      continue;  // Deleted since the request was accepted
     }
+    
+    if (command.type == DEVICE_CMD_RENAME) {
+      devices[idx].customName = command.name;
+      liveUpdates.markStructure();
+      Serial.print("Device ");
+      Serial.print(command.id);
+      Serial.print(" renamed to: ");
+      Serial.println(command.name);
+    } else if (command.type == DEVICE_CMD_DELETE && devices[idx].type == "wireless") {
+      // Free the slot; other devices keep their handles. The peer goes
+      // from the ACK table too, or a node that keeps sending would look
+      // known there and never be acknowledged again
+      if (esp_now_is_peer_exist(devices[idx].link.mac)) {
+        esp_now_del_peer(devices[idx].link.mac);
+      }
+      ackPeers.forget(devices[idx].link.mac);
+      auditLog.deviceRemoved(devices[idx]);
+      devices.remove(idx);
+      liveUpdates.markStructure();
+      Serial.print("Device ");
+      Serial.print(command.id);
+      Serial.println(" deleted");
+    }
+    snapshotDirty = true;
+  }
+}
+
+void publishDeviceSnapshot() {
+  DeviceTableSnapshot* snapshot = deviceSnapshots.beginWrite();
+  if (!snapshot) {
+    return;  // A reader still holds the back buffer; retry next iteration
+  }
+  
+  snapshot->count = 0;
+  for (DeviceHandle h = devices.first(); h != INVALID_DEVICE; h = devices.next(h)) {
+    DeviceSnapshot& entry = snapshot->devices[snapshot->count++];
+    entry.capture(devices[h]);
+    entry.handle = h;
+    entry.generation = devices.generation(h);
   }
   
-  // Update device
+  deviceSnapshots.publish();
+  snapshotDirty = false;
+}
+
+void pushLiveUpdates(unsigned long now) {
+  if (!liveUpdates.due(now)) {
+    return;
+  }
+  
+  if (events.count() == 0) {
+    liveUpdates.clear();  // Clients load the full list when they connect
+    return;
+  }
+  
+  // Backpressure: while clients are behind, keep coalescing into the
+  // dirty set rather than queueing frames that would be stale on arrival
+  if (events.avgPacketsWaiting() >= LIVE_MAX_BACKLOG) {
+    liveUpdates.deferred(now);
+    return;
+  }
+  
+  if (liveUpdates.takeStructureChange()) {
+    events.send("{}", "devices", now);
+  }
+  
+  static char frame[LIVE_FRAME_MAX];
+  if (liveUpdates.hasDeltas() && liveUpdates.buildFrame(devices, frame, sizeof(frame)) > 0) {
+    events.send(frame, "update", now);
+  }
+  liveUpdates.sent(now);
+}
+
+DeviceHandle findOrAddDevice(const String& id, const String& name, const String& type) {
+  DeviceHandle idx = devices.find(id);
+  
+  if (idx == INVALID_DEVICE) {
+    // Add new device; a slot's first device allocates it, which can fail
+    idx = devices.insert(id);
+    if (idx == INVALID_DEVICE) {
+      Serial.println(devices.isFull() ? "Warning: Max devices reached" : "Warning: No memory for another device");
+      return idx;
+    }
+    devices[idx].name = name;
+    devices[idx].customName = "";  // Initialize custom name
+    devices[idx].type = type;
+    devices[idx].history.clear();
+    devices[idx].rollups.clear();
+    devices[idx].recentStats.reset();
+    devices[idx].timedStats.reset();
+    devices[idx].energyAccount.clear();
+    devices[idx].totalEnergy = 0;
+    devices[idx].avgPower = 0;
+    devices[idx].maxPower = 0;
+    devices[idx].standbyWaste = false;
+    devices[idx].usageAnomaly = false;
+    devices[idx].efficiencyIssue = false;
+    devices[idx].lastSeen = millis();
+    devices[idx].isActive = false;
+    devices[idx].link.reset();
+    auditLog.deviceAdded(idx, devices[idx]);
+    liveUpdates.markStructure();
+  }
+  return idx;
+}
+
+void addOrUpdateDevice(String id, String name, String type, DeviceReading reading) {
+  DeviceHandle idx = findOrAddDevice(id, name, type);
+  if (idx != INVALID_DEVICE) {
+    updateDevice(idx, reading);
+  }
+}
+
+void updateDevice(DeviceHandle idx, const DeviceReading& reading) {
   devices[idx].currentReading = reading;
   devices[idx].lastSeen = millis();
   devices[idx].isActive = true;
@@ -317,621 +654,319 @@ void addOrUpdateDevice(String id, String name, String type, DeviceReading readin
   
   // Update history
   updateDeviceHistory(devices[idx], reading);
-  
-  // Check if device is inactive (no update for 30 seconds)
-  if (millis() - devices[idx].lastSeen > 30000) {
-    devices[idx].isActive = false;
+  snapshotDirty = true;
+  liveUpdates.markDevice(idx);
+}
+
+void updateActivity(unsigned long now) {
+  for (DeviceHandle h = devices.first(); h != INVALID_DEVICE; h = devices.next(h)) {
+    DeviceInfo& device = devices[h];
+    bool active = now - device.lastSeen < device.link.activityTimeout();
+    if (active != device.isActive) {
+      device.isActive = active;
+      liveUpdates.markDevice(h);
+      snapshotDirty = true;
+    }
   }
 }
 
 void updateDeviceHistory(DeviceInfo& device, DeviceReading reading) {
-  // Add to history (circular buffer)
-  int idx = device.historyCount % MAX_HISTORY_ENTRIES;
-  device.history[idx] = reading;
-  
-  if (device.historyCount < MAX_HISTORY_ENTRIES) {
-    device.historyCount++;
+  // Energy since the previous reading, from the meter's counter or
+  // integrated (see energy_account.h). The rollup tiers take the same
+  // interval on the same clock, and like the total skip a gap
+  uint64_t clock = auditLog.timeOf(reading.timestamp);
+  uint64_t segmentStart = device.energyAccount.lastTime();
+  if (!device.energyAccount.add(reading, clock, tariff)) {
+    segmentStart = clock;
   }
+  device.totalEnergy = device.energyAccount.totalEnergy();
+  device.rollups.add(segmentStart, clock, reading.power);
   
-  // Update average power
-  float sum = 0;
-  int count = min(device.historyCount, 100);  // Average over last 100 readings
-  for (int i = 0; i < count; i++) {
-    sum += device.history[i].power;
+  // Add to history (circular buffer) every HISTORY_INTERVAL_MS, with a
+  // tenth of slack so a node reporting at that rate is not halved by jitter
+  if (!device.history.isEmpty() &&
+      reading.timestamp - device.history.lastTimestamp() < HISTORY_INTERVAL_MS - HISTORY_INTERVAL_MS / 10) {
+    return;
   }
-  device.avgPower = count > 0 ? sum / count : 0;
+  device.history.append(reading);
   
-  // Update total energy (simplified: integrate power over time)
-  if (device.historyCount > 1) {
-    unsigned long timeDiff = reading.timestamp - device.history[(idx - 1 + MAX_HISTORY_ENTRIES) % MAX_HISTORY_ENTRIES].timestamp;
-    float energyDelta = (reading.power * timeDiff) / (3600000.0);  // Convert to kWh
-    device.totalEnergy += energyDelta;
-  }
+  // Update sliding-window statistics (O(1) per stored reading)
+  device.recentStats.add(device.history);
+  device.timedStats.add(device.history);
+  device.avgPower = device.recentStats.mean();
 }
 
 void onESPNOWReceive(const uint8_t* mac, const uint8_t* data, int len) {
-  if (len < sizeof(DeviceReading)) {
+  // Runs in the Wi-Fi task: copy the raw frame and return
+  if (len <= 0 || len > ESPNOW_RX_FRAME_MAX) {
+    espNowOversized++;
     return;
   }
   
-  // Parse JSON packet from wireless node
-  StaticJsonDocument<256> doc;
-  DeserializationError error = deserializeJson(doc, data, len);
+  EspNowFrame* slot = espNowQueue.reserve();
+  if (!slot) {
+    return;  // Queue full, counted as a drop
+  }
   
-  if (error) {
-    Serial.println("Failed to parse ESP-NOW packet");
+  memcpy(slot->mac, mac, sizeof(slot->mac));
+  memcpy(slot->data, data, len);
+  slot->len = len;
+  slot->rssi = memcmp(mac, rssiSource, sizeof(rssiSource)) == 0 ? rssiLast : 0;
+  slot->receivedAt = millis();
+  espNowQueue.commit();
+}
+
+void onPromiscuousFrame(void* buffer, wifi_promiscuous_pkt_type_t type) {
+  // Runs in the Wi-Fi task just before the ESP-NOW receive callback for
+  // the same frame: a vendor-specific action frame (frame control 0xD0,
+  // category 127), sender address at offset 10
+  const wifi_promiscuous_pkt_t* packet = (const wifi_promiscuous_pkt_t*)buffer;
+  const uint8_t* header = packet->payload;
+  if (type != WIFI_PKT_MGMT || packet->rx_ctrl.sig_len < 25 || header[0] != 0xD0 || header[24] != 0x7F) {
+    return;
+  }
+  memcpy(rssiSource, header + 10, sizeof(rssiSource));
+  rssiLast = packet->rx_ctrl.rssi;
+}
+
+void processESPNOWQueue() {
+  // Drain a bounded batch per loop() iteration
+  for (int i = 0; i < ESPNOW_RX_BATCH; i++) {
+    const EspNowFrame* frame = espNowQueue.front();
+    if (!frame) {
+      break;
+    }
+    handleESPNOWFrame(*frame);
+    espNowQueue.release();
+  }
+}
+
+void handleESPNOWFrame(const EspNowFrame& rx) {
+  // Decode binary telemetry frame from wireless node (no allocation)
+  TelemetryFrame frame;
+  if (!TelemetryCodec::decode(rx.data, rx.len, frame)) {
+    Serial.println("Failed to decode ESP-NOW packet");
     return;
   }
   
-  // Extract data
-  String nodeId = doc["id"] | "UNKNOWN";
-  float current = doc["i"] | 0.0;
-  float power = doc["p"] | 0.0;
-  float pf = doc["pf"] | 0.85;
+  // Node IDs are carried as a hash
+  char nodeId[16];
+  snprintf(nodeId, sizeof(nodeId), "NODE_%08lX", (unsigned long)frame.nodeHash);
   
   // Create reading
   DeviceReading reading;
-  reading.voltage = 230.0;  // Assumed voltage
-  reading.current = current;
-  reading.power = power;
-  reading.powerFactor = pf;
-  reading.frequency = 50.0;  // Assumed frequency
+  reading.current = frame.currentMa / 1000.0;
+  reading.power = frame.powerDeciWatts / 10.0;
+  reading.powerFactor = frame.powerFactor / 100.0;
+  reading.powerFactorEstimated = frame.flags & TELEMETRY_FLAG_PF_ESTIMATED;
+  if (frame.flags & TELEMETRY_FLAG_VOLTAGE) {
+    reading.voltage = frame.voltageDeciVolts / 10.0;
+    reading.frequency = frame.frequencyCentiHz / 100.0;
+  } else {
+    reading.voltage = ASSUMED_LINE_VOLTAGE;  // Node has no voltage sense
+    reading.frequency = ASSUMED_LINE_FREQUENCY;
+  }
+  if (frame.flags & TELEMETRY_FLAG_HARMONICS) {
+    reading.harmonics.valid = true;
+    reading.harmonics.fundamental = frame.fundamentalMa / 1000.0;
+    for (int i = 0; i < 3; i++) {
+      reading.harmonics.orders[i] = frame.harmonicPermille[i] / 10.0;
+    }
+    reading.harmonics.thd = frame.thdPermille / 10.0;
+  }
   reading.energy = 0;  // Will be calculated over time
-  reading.timestamp = millis();
+  reading.timestamp = rx.receivedAt;
+  String name = "Wireless Node " + String(nodeId);
   
-  // Add or update device
-  addOrUpdateDevice(nodeId, "Wireless Node " + nodeId, "wireless", reading);
+  DeviceHandle idx = findOrAddDevice(nodeId, name, "wireless");
+  if (idx == INVALID_DEVICE) {
+    framesRejected++;
+    return;
+  }
+  DeviceInfo& device = devices[idx];
+  device.link.frameReceived(rx.mac, rx.rssi, rx.receivedAt, frame);
+  device.lastSeen = millis();
+  sendAcknowledgement(rx.mac, frame);
+  
+  // Earlier samples (a low-power node's batch, or ones resent after a
+  // missed acknowledgement) are backfilled at their original times, oldest
+  // first, sharing the header's voltage and frequency. Repeats are
+  // dropped, and so is a sample that arrives after newer ones (the
+  // history only grows forward). The energy account has seen every
+  // reading, including those the raw ring skipped
+  uint8_t stored = 0;
+  for (uint8_t i = 0; i < TelemetryCodec::sampleCount(frame); i++) {
+    TelemetrySample sample;
+    if (!TelemetryCodec::sampleAt(frame, i, rx.receivedAt, sample) ||
+        device.link.samples.observe(sample.sequence) == SEQUENCE_DUPLICATE) {
+      continue;
+    }
+    if (device.energyAccount.hasReading() && auditLog.timeOf(sample.timestamp) <= device.energyAccount.lastTime()) {
+      continue;
+    }
+    if (sample.newest) {
+      updateDevice(idx, reading);
+    } else {
+      DeviceReading past = reading;
+      past.current = sample.currentMa / 1000.0;
+      past.power = sample.powerDeciWatts / 10.0;
+      past.powerFactor = sample.powerFactor / 100.0;
+      past.harmonics.valid = false;
+      past.timestamp = sample.timestamp;
+      updateDevice(idx, past);
+    }
+    stored++;
+  }
+  if (stored == 0) {
+    return;  // Nothing new
+  }
   
   Serial.print("Received from ");
   Serial.print(nodeId);
   Serial.print(": ");
-  Serial.print(current, 2);
+  Serial.print(reading.current, 2);
   Serial.print("A, ");
-  Serial.print(power, 2);
-  Serial.println("W");
+  Serial.print(reading.power, 2);
+  Serial.print("W");
+  if (stored > 1) {
+    Serial.print(" (+");
+    Serial.print(stored - 1);
+    Serial.print(" earlier)");
+  }
+  Serial.println();
 }
 
-String getAllDevicesJSON() {
-  StaticJsonDocument<4096> doc;
-  JsonArray devicesArray = doc.createArray();
-  
-  for (int i = 0; i < deviceCount; i++) {
-    JsonObject device = devicesArray.createNestedObject();
-    device["id"] = devices[i].id;
-    device["name"] = devices[i].name;
-    device["customName"] = devices[i].customName;
-    device["displayName"] = devices[i].getDisplayName();
-    device["type"] = devices[i].type;
-    device["isActive"] = devices[i].isActive;
-    device["lastSeen"] = devices[i].lastSeen;
-    device["standbyWaste"] = devices[i].standbyWaste;
-    device["usageAnomaly"] = devices[i].usageAnomaly;
-    device["efficiencyIssue"] = devices[i].efficiencyIssue;
-    device["totalEnergy"] = devices[i].totalEnergy;
-    device["avgPower"] = devices[i].avgPower;
-    device["maxPower"] = devices[i].maxPower;
-    
-    JsonObject reading = device.createNestedObject("currentReading");
-    reading["voltage"] = devices[i].currentReading.voltage;
-    reading["current"] = devices[i].currentReading.current;
-    reading["power"] = devices[i].currentReading.power;
-    reading["energy"] = devices[i].currentReading.energy;
-    reading["frequency"] = devices[i].currentReading.frequency;
-    reading["powerFactor"] = devices[i].currentReading.powerFactor;
-    reading["timestamp"] = devices[i].currentReading.timestamp;
-  }
-  
-  String response;
-  serializeJson(doc, response);
-  return response;
+void sendAcknowledgement(const uint8_t* mac, const TelemetryFrame& frame) {
+  // Unicast, so the MAC layer retries it; the node must be a peer. The
+  // peer list is shorter than the node count, so the node acknowledged
+  // longest ago gives up its entry
+  uint8_t evicted[ESP_NOW_ETH_ALEN];
+  AckPeerResult slot = ackPeers.use(mac, evicted);
+  if (slot == ACK_PEER_REPLACED) {
+    esp_now_del_peer(evicted);
+  }
+  if (slot != ACK_PEER_KNOWN && !esp_now_is_peer_exist(mac)) {
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    peer.channel = 0;  // The AP's
+    peer.ifidx = WIFI_IF_AP;
+    peer.encrypt = ESP_NOW_ENCRYPT;
+    if (esp_now_add_peer(&peer) != ESP_OK) {
+      ackPeers.forget(mac);
+      ackFailures++;
+      return;
+    }
+  }
+  
+  uint8_t data[TELEMETRY_ACK_SIZE];
+  size_t len = TelemetryCodec::encodeAck({frame.nodeHash, frame.sequence}, data, sizeof(data));
+  if (esp_now_send(mac, data, len) == ESP_OK) {
+    acksSent++;
+  } else {
+    ackFailures++;
+  }
 }
 
-String getDeviceHistoryJSON(String deviceId) {
-  int idx = findDeviceIndex(deviceId);
-  
-  if (idx < 0) {
-    return "{\"error\":\"Device not found\"}";
+void sendJsonStream(AsyncWebServerRequest* request, std::shared_ptr<JsonChunkSource> source) {
+  // The source lives as long as the response's filler callback
+  AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+    [source](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      return source->fill(buffer, maxLen);
+    });
+  request->send(response);
+}
+
+const DeviceInfo* findHistoryDevice(const String& deviceId, DeviceSlot& slot) {
+  // Resolve through the snapshot; registry slots never move, and the
+  // history ring, rollups and energy account are read under their
+  // sequence locks. The slot's generation tells when the device has been
+  // removed since (the snapshot may be older). Nothing else of the device
+  // may be touched from the HTTP task
+  SnapshotReader snapshot(deviceSnapshots);
+  const DeviceSnapshot* device = snapshot->find(deviceId.c_str());
+  if (!device) {
+    return nullptr;
+  }
+  slot = DeviceSlot(devices, device->handle, device->generation);
+  return slot.current() ? &devices[device->handle] : nullptr;
+}
+
+void sendDeviceHistory(AsyncWebServerRequest* request, const String& deviceId) {
+  // ?from=&to= (ms) or ?range= (s back from the newest reading), ?points=
+  // as the budget, ?fields= and ?decimate=lttb|minmax; by default the
+  // whole raw ring
+  HistoryQuery query;
+  DeviceSlot slot;
+  const DeviceInfo* device = findHistoryDevice(deviceId, slot);
+  if (!device) {
+    sendJsonStream(request, std::make_shared<HistoryStream>(nullptr, nullptr, query));
+    return;
   }
   
-  StaticJsonDocument<8192> doc;
-  JsonArray historyArray = doc.createArray();
-  
-  int count = min(devices[idx].historyCount, 200);  // Return last 200 readings
-  int startIdx = devices[idx].historyCount >= MAX_HISTORY_ENTRIES ? 
-                 (devices[idx].historyCount % MAX_HISTORY_ENTRIES) : 0;
-  
-  for (int i = 0; i < count; i++) {
-    int actualIdx = (startIdx + i) % MAX_HISTORY_ENTRIES;
-    JsonObject entry = historyArray.createNestedObject();
-    entry["timestamp"] = devices[idx].history[actualIdx].timestamp;
-    entry["voltage"] = devices[idx].history[actualIdx].voltage;
-    entry["current"] = devices[idx].history[actualIdx].current;
-    entry["power"] = devices[idx].history[actualIdx].power;
-    entry["powerFactor"] = devices[idx].history[actualIdx].powerFactor;
+  HistoryBounds raw = device->history.bounds();
+  query.to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : raw.last;
+  if (request->hasParam("from")) {
+    query.from = strtoul(request->getParam("from")->value().c_str(), nullptr, 10);
+  } else if (request->hasParam("range")) {
+    unsigned long range = strtoul(request->getParam("range")->value().c_str(), nullptr, 10) * 1000UL;
+    query.from = query.to > range ? query.to - range : 0;
+  } else {
+    query.from = raw.first;
+  }
+  if (request->hasParam("points")) {
+    query.points = max(1UL, strtoul(request->getParam("points")->value().c_str(), nullptr, 10));
   }
+  if (request->hasParam("fields")) {
+    query.fields = HistoryQuery::parseFields(request->getParam("fields")->value().c_str());
+  }
+  if (request->hasParam("decimate") && request->getParam("decimate")->value() == "minmax") {
+    query.decimation = HISTORY_MINMAX;
+  }
+  query.clockOffset = auditLog.clockOffset();
+  query.selectTier(device->history, device->rollups);
   
-  String response;
-  serializeJson(doc, response);
-  return response;
+  sendJsonStream(request, std::make_shared<HistoryStream>(&device->history, &device->rollups, query, slot));
 }
 
-String getDashboardHTML() {
-  return R"(
-<!DOCTYPE html>
-<html lang="en">
-<head>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>Energy Audit Dashboard</title>
-    <script src="https://cdn.jsdelivr.net/npm/chart.js@3.9.1/dist/chart.min.js"></script>
-    <style>
-        * { margin: 0; padding: 0; box-sizing: border-box; }
-        body {
-            font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, Oxygen, Ubuntu, sans-serif;
-            background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);
-            min-height: 100vh;
-            padding: 20px;
-        }
-        .container {
-            max-width: 1400px;
-            margin: 0 auto;
-        }
-        .header {
-            background: white;
-            padding: 20px;
-            border-radius: 10px;
-            margin-bottom: 20px;
-            box-shadow: 0 4px 6px rgba(0,0,0,0.1);
-        }
-        h1 {
-            color: #333;
-            margin-bottom: 10px;
-        }
-        .subtitle {
-            color: #666;
-            font-size: 14px;
-        }
-        .devices-grid {
-            display: grid;
-            grid-template-columns: repeat(auto-fit, minmax(300px, 1fr));
-            gap: 20px;
-            margin-bottom: 20px;
-        }
-        .device-card {
-            background: white;
-            border-radius: 10px;
-            padding: 20px;
-            box-shadow: 0 4px 6px rgba(0,0,0,0.1);
-            transition: transform 0.2s;
-        }
-        .device-card:hover {
-            transform: translateY(-5px);
-        }
-        .device-header {
-            display: flex;
-            justify-content: space-between;
-            align-items: center;
-            margin-bottom: 15px;
-        }
-        .device-name {
-            font-size: 18px;
-            font-weight: bold;
-            color: #333;
-        }
-        .status-badge {
-            padding: 5px 10px;
-            border-radius: 20px;
-            font-size: 12px;
-            font-weight: bold;
-        }
-        .status-active {
-            background: #10b981;
-            color: white;
-        }
-        .status-inactive {
-            background: #ef4444;
-            color: white;
-        }
-        .device-type {
-            font-size: 12px;
-            color: #666;
-            margin-bottom: 10px;
-        }
-        .metric {
-            display: flex;
-            justify-content: space-between;
-            padding: 8px 0;
-            border-bottom: 1px solid #eee;
-        }
-        .metric:last-child {
-            border-bottom: none;
-        }
-        .metric-label {
-            color: #666;
-        }
-        .metric-value {
-            font-weight: bold;
-            color: #333;
-        }
-        .waste-alert {
-            margin-top: 15px;
-            padding: 10px;
-            border-radius: 5px;
-            font-size: 12px;
-        }
-        .alert-standby {
-            background: #fef3c7;
-            color: #92400e;
-        }
-        .alert-anomaly {
-            background: #fee2e2;
-            color: #991b1b;
-        }
-        .alert-efficiency {
-            background: #dbeafe;
-            color: #1e40af;
-        }
-        .chart-container {
-            background: white;
-            border-radius: 10px;
-            padding: 20px;
-            margin-bottom: 20px;
-            box-shadow: 0 4px 6px rgba(0,0,0,0.1);
-        }
-        .chart-title {
-            font-size: 18px;
-            font-weight: bold;
-            margin-bottom: 15px;
-            color: #333;
-        }
-        .refresh-info {
-            text-align: center;
-            color: white;
-            margin-top: 20px;
-            font-size: 14px;
-        }
-        .device-actions {
-            margin-top: 15px;
-            padding-top: 15px;
-            border-top: 1px solid #eee;
-            display: flex;
-            gap: 10px;
-        }
-        .btn {
-            padding: 8px 16px;
-            border: none;
-            border-radius: 5px;
-            cursor: pointer;
-            font-size: 12px;
-            font-weight: bold;
-            transition: all 0.2s;
-        }
-        .btn-rename {
-            background: #3b82f6;
-            color: white;
-        }
-        .btn-rename:hover {
-            background: #2563eb;
-        }
-        .btn-delete {
-            background: #ef4444;
-            color: white;
-        }
-        .btn-delete:hover {
-            background: #dc2626;
-        }
-        .btn:disabled {
-            opacity: 0.5;
-            cursor: not-allowed;
-        }
-        .modal {
-            display: none;
-            position: fixed;
-            top: 0;
-            left: 0;
-            width: 100%;
-            height: 100%;
-            background: rgba(0,0,0,0.5);
-            z-index: 1000;
-            justify-content: center;
-            align-items: center;
-        }
-        .modal-content {
-            background: white;
-            padding: 30px;
-            border-radius: 10px;
-            max-width: 400px;
-            width: 90%;
-        }
-        .modal-title {
-            font-size: 20px;
-            font-weight: bold;
-            margin-bottom: 20px;
-        }
-        .modal-input {
-            width: 100%;
-            padding: 10px;
-            border: 1px solid #ddd;
-            border-radius: 5px;
-            font-size: 14px;
-            margin-bottom: 20px;
-        }
-        .modal-buttons {
-            display: flex;
-            gap: 10px;
-            justify-content: flex-end;
-        }
-        .btn-cancel {
-            background: #6b7280;
-            color: white;
-        }
-        .btn-save {
-            background: #10b981;
-            color: white;
-        }
-    </style>
-</head>
-<body>
-    <div class="container">
-        <div class="header">
-            <h1>⚡ Energy Audit Dashboard</h1>
-            <div class="subtitle">Real-time monitoring of wired and wireless energy loads</div>
-        </div>
-        
-        <div id="devices-container" class="devices-grid"></div>
-        
-        <div class="chart-container">
-            <div class="chart-title">Power Consumption History</div>
-            <canvas id="powerChart"></canvas>
-        </div>
-        
-        <div class="refresh-info">Auto-refreshing every 2 seconds</div>
-    </div>
-
-    <!-- Rename Modal -->
-    <div id="renameModal" class="modal">
-        <div class="modal-content">
-            <div class="modal-title">Rename Device</div>
-            <input type="text" id="renameInput" class="modal-input" placeholder="Enter new name" maxlength="50">
-            <div class="modal-buttons">
-                <button class="btn btn-cancel" onclick="closeRenameModal()">Cancel</button>
-                <button class="btn btn-save" onclick="saveRename()">Save</button>
-            </div>
-        </div>
-    </div>
-
-    <script>
-        let currentDeviceId = null;
-        
-        function renameDevice(deviceId, currentName) {
-            currentDeviceId = deviceId;
-            document.getElementById('renameInput').value = currentName;
-            document.getElementById('renameModal').style.display = 'flex';
-        }
-        
-        function closeRenameModal() {
-            document.getElementById('renameModal').style.display = 'none';
-            currentDeviceId = null;
-        }
-        
-        async function saveRename() {
-            if (!currentDeviceId) return;
-            
-            const newName = document.getElementById('renameInput').value.trim();
-            if (!newName) {
-                alert('Please enter a name');
-                return;
-            }
-            
-            try {
-                const formData = new URLSearchParams();
-                formData.append('name', newName);
-                
-                const response = await fetch(`/api/device/${currentDeviceId}/rename`, {
-                    method: 'POST',
-                    headers: {
-                        'Content-Type': 'application/x-www-form-urlencoded'
-                    },
-                    body: formData
-                });
-                
-                const result = await response.json();
-                if (result.success) {
-                    closeRenameModal();
-                    fetchDevices(); // Refresh
-                } else {
-                    alert('Error: ' + (result.error || 'Failed to rename device'));
-                }
-            } catch (error) {
-                alert('Error renaming device: ' + error.message);
-            }
-        }
-        
-        async function deleteDevice(deviceId, deviceName) {
-            if (!confirm(`Are you sure you want to delete "${deviceName}"?\n\nThis action cannot be undone.`)) {
-                return;
-            }
-            
-            try {
-                const response = await fetch(`/api/device/${deviceId}/delete`, {
-                    method: 'POST'
-                });
-                
-                const result = await response.json();
-                if (result.success) {
-                    fetchDevices(); // Refresh
-                } else {
-                    alert('Error: ' + (result.error || 'Failed to delete device'));
-                }
-            } catch (error) {
-                alert('Error deleting device: ' + error.message);
-            }
-        }
-        
-        // Close modal on outside click
-        document.getElementById('renameModal').addEventListener('click', function(e) {
-            if (e.target === this) {
-                closeRenameModal();
-            }
-        });
-        
-        // Close modal on Escape key
-        document.addEventListener('keydown', function(e) {
-            if (e.key === 'Escape') {
-                closeRenameModal();
-            }
-        });
-        
-        // Submit on Enter key in rename input
-        document.getElementById('renameInput').addEventListener('keydown', function(e) {
-            if (e.key === 'Enter') {
-                saveRename();
-            }
-        });
-        const powerChart = new Chart(document.getElementById('powerChart'), {
-            type: 'line',
-            data: {
-                labels: [],
-                datasets: []
-            },
-            options: {
-                responsive: true,
-                maintainAspectRatio: true,
-                scales: {
-                    y: {
-                        beginAtZero: true,
-                        title: {
-                            display: true,
-                            text: 'Power (W)'
-                        }
-                    },
-                    x: {
-                        title: {
-                            display: true,
-                            text: 'Time'
-                        }
-                    }
-                }
-            }
-        });
-
-        async function fetchDevices() {
-            try {
-                const response = await fetch('/api/devices');
-                const devices = await response.json();
-                updateDashboard(devices);
-            } catch (error) {
-                console.error('Error fetching devices:', error);
-            }
-        }
+void sendExport(AsyncWebServerRequest* request) {
+  // ?format=csv (default) or ?format=binary
+  bool binary = request->hasParam("format") && request->getParam("format")->value() == "binary";
+  std::shared_ptr<ExportStream> source;
+  {
+    SnapshotReader snapshot(deviceSnapshots);
+    source = std::make_shared<ExportStream>(devices, *snapshot, auditLog.isReady() ? &auditLog.records() : nullptr,
+                                            auditLog.clockOffset(), binary ? EXPORT_BINARY : EXPORT_CSV);
+  }
+  
+  AsyncWebServerResponse* response = request->beginChunkedResponse(source->contentType(),
+    [source](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      return source->fill(buffer, maxLen);
+    });
+  response->addHeader("Content-Disposition",
+                      binary ? "attachment; filename=\"audit-export.bin\"" : "attachment; filename=\"audit-export.csv\"");
+  request->send(response);
+}
 
-        function updateDashboard(devices) {
-            const container = document.getElementById('devices-container');
-            container.innerHTML = '';
-            
-            const chartData = {
-                labels: [],
-                datasets: []
-            };
-            
-            const colors = ['#3b82f6', '#10b981', '#f59e0b', '#ef4444', '#8b5cf6'];
-            
-            devices.forEach((device, index) => {
-                // Create device card
-                const card = document.createElement('div');
-                card.className = 'device-card';
-                
-                const alerts = [];
-                if (device.standbyWaste) alerts.push({type: 'standby', text: '⚠️ Standby waste detected'});
-                if (device.usageAnomaly) alerts.push({type: 'anomaly', text: '⚠️ Usage anomaly: 24/7 operation'});
-                if (device.efficiencyIssue) alerts.push({type: 'efficiency', text: '⚠️ Low power factor: Efficiency issue'});
-                
-                const displayName = device.displayName || device.name;
-                card.innerHTML = `
-                    <div class="device-header">
-                        <div class="device-name">${displayName}</div>
-                        <span class="status-badge ${device.isActive ? 'status-active' : 'status-inactive'}">
-                            ${device.isActive ? '🟢 Active' : '🔴 Inactive'}
-                        </span>
-                    </div>
-                    <div class="device-type">${device.type.toUpperCase()} • ${device.id}</div>
-                    <div class="metric">
-                        <span class="metric-label">Voltage:</span>
-                        <span class="metric-value">${device.currentReading.voltage.toFixed(1)} V</span>
-                    </div>
-                    <div class="metric">
-                        <span class="metric-label">Current:</span>
-                        <span class="metric-value">${device.currentReading.current.toFixed(2)} A</span>
-                    </div>
-                    <div class="metric">
-                        <span class="metric-label">Power:</span>
-                        <span class="metric-value">${device.currentReading.power.toFixed(2)} W</span>
-                    </div>
-                    <div class="metric">
-                        <span class="metric-label">Power Factor:</span>
-                        <span class="metric-value">${device.currentReading.powerFactor.toFixed(2)}</span>
-                    </div>
-                    <div class="metric">
-                        <span class="metric-label">Total Energy:</span>
-                        <span class="metric-value">${device.totalEnergy.toFixed(3)} kWh</span>
-                    </div>
-                    <div class="metric">
-                        <span class="metric-label">Avg Power:</span>
-                        <span class="metric-value">${device.avgPower.toFixed(2)} W</span>
-                    </div>
-                    ${alerts.map(alert => `
-                        <div class="waste-alert alert-${alert.type}">${alert.text}</div>
-                    `).join('')}
-                    <div class="device-actions">
-                        <button class="btn btn-rename" onclick="renameDevice('${device.id}', '${displayName.replace(/'/g, "\\'")}')">✏️ Rename</button>
-                        ${device.type === 'wireless' ? `<button class="btn btn-delete" onclick="deleteDevice('${device.id}', '${displayName.replace(/'/g, "\\'")}')">🗑️ Delete</button>` : ''}
-                    </div>
-                `;
-                
-                container.appendChild(card);
-                
-                // Add to chart
-                if (device.isActive && device.currentReading.power > 0) {
-                    const displayName = device.displayName || device.name;
-                    const dataset = {
-                        label: displayName,
-                        data: [device.currentReading.power],
-                        borderColor: colors[index % colors.length],
-                        backgroundColor: colors[index % colors.length] + '20',
-                        tension: 0.4
-                    };
-                    chartData.datasets.push(dataset);
-                }
-            });
-            
-            // Update chart
-            if (chartData.datasets.length > 0) {
-                const now = new Date().toLocaleTimeString();
-                chartData.labels = [now];
-                
-                powerChart.data.labels.push(now);
-                powerChart.data.labels = powerChart.data.labels.slice(-20); // Keep last 20 points
-                
-                chartData.datasets.forEach((dataset, idx) => {
-                    if (powerChart.data.datasets[idx]) {
-                        powerChart.data.datasets[idx].data.push(dataset.data[0]);
-                        powerChart.data.datasets[idx].data = powerChart.data.datasets[idx].data.slice(-20);
-                    } else {
-                        powerChart.data.datasets.push(dataset);
-                    }
-                });
-                
-                powerChart.update('none');
-            }
-        }
+void sendEnergy(AsyncWebServerRequest* request, const String& deviceId) {
+  DeviceSlot slot;
+  const DeviceInfo* device = findHistoryDevice(deviceId, slot);
+  sendJsonStream(request, std::make_shared<EnergyStream>(device ? &device->energyAccount : nullptr, tariff, slot));
+}
 
-        // Initial load
-        fetchDevices();
-        
-        // Auto-refresh every 2 seconds
-        setInterval(fetchDevices, 2000);
-    </script>
-</body>
-</html>
-)";
-}
\ No newline at end of file
+void sendWebAsset(AsyncWebServerRequest* request, const WebAsset& asset) {
+  // Browsers revalidate on every load (no-cache); an unchanged asset
+  // costs a 304 with no body
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset.etag) {
+    AsyncWebServerResponse* response = request->beginResponse(304);
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    return;
+  }
+  
+  AsyncWebServerResponse* response = request->beginResponse_P(200, asset.contentType, asset.data, asset.length);
+  response->addHeader("Content-Encoding", "gzip");
+  response->addHeader("ETag", asset.etag);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
@@ -5,15 +5,18 @@ PZEMSensor::PZEMSensor(HardwareSerial* serialPort, uint8_t addr, String id, Stri
   address = addr;
   deviceId = id;
   deviceName = name;
+  state = STATE_IDLE;
+  rxCount = 0;
+  requestTime = 0;
 }
 
 bool PZEMSensor::begin() {
   // Serial should already be initialized by main.cpp
   delay(200);
-  // Try to read voltage to verify connection (retry 3 times)
+  // Try a full read to verify connection (retry 3 times)
   for (int i = 0; i < 3; i++) {
-    uint16_t voltage = readRegister(VOLTAGE_REG);
-    if (voltage != 0xFFFF && voltage > 0) {
+    DeviceReading reading;
+    if (readData(reading) && reading.voltage > 0) {
       return true;
     }
     delay(100);
@@ -21,7 +24,7 @@ bool PZEMSensor::begin() {
   return false;
 }
 
-uint16_t PZEMSensor::calculateCRC(uint8_t* data, uint8_t len) {
+uint16_t PZEMSensor::calculateCRC(const uint8_t* data, uint8_t len) {
   uint16_t crc = 0xFFFF;
   for (uint8_t i = 0; i < len; i++) {
     crc ^= data[i];
@@ -55,82 +58,109 @@ bool PZEMSensor::sendCommand(uint8_t cmd, uint16_t reg, uint16_t value) {
   }
   
   // Send command
-  serial->write(frame, 8);
-  delay(100);
-  
-  return true;
+  return serial->write(frame, 8) == 8;
 }
 
-uint16_t PZEMSensor::readRegister(uint16_t reg) {
-  if (!sendCommand(READ_REGISTER_CMD, reg)) {
-    return 0xFFFF;
-  }
-  
-  uint8_t response[7];
-  uint8_t bytesRead = 0;
-  unsigned long startTime = millis();
-  
-  while (bytesRead < 7 && (millis() - startTime < 200)) {
-    if (serial->available()) {
-      response[bytesRead++] = serial->read();
+bool PZEMSensor::receiveAvailable() {
+  // Drain whatever the UART already holds; returns true once the expected
+  // frame length (or a shorter exception frame) has arrived
+  while (rxCount < RESPONSE_LENGTH && serial->available()) {
+    rxBuffer[rxCount++] = serial->read();
+    if (rxCount == ERROR_RESPONSE_LENGTH && (rxBuffer[1] & ERROR_FLAG)) {
+      return true;
     }
   }
-  
-  if (bytesRead < 7) {
-    return 0xFFFF;
+  return rxCount >= RESPONSE_LENGTH;
+}
+
+uint16_t PZEMSensor::registerAt(const uint8_t* frame, uint16_t reg) {
+  // Register data starts after addr, func and byte count (big-endian words)
+  const uint8_t* p = frame + 3 + reg * 2;
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+
+uint32_t PZEMSensor::registerPairAt(const uint8_t* frame, uint16_t reg) {
+  // 32-bit values are sent low word first
+  return ((uint32_t)registerAt(frame, reg + 1) << 16) | registerAt(frame, reg);
+}
+
+bool PZEMSensor::parseResponse(const uint8_t* frame, uint8_t len, uint8_t addr, DeviceReading& reading) {
+  if (len < RESPONSE_LENGTH) {
+    return false;
   }
   
-  // Verify response
-  if (response[0] != address || response[1] != READ_REGISTER_CMD) {
-    return 0xFFFF;
+  // Verify header
+  if (frame[0] != addr || frame[1] != READ_REGISTER_CMD || frame[2] != REGISTER_COUNT * 2) {
+    return false;
   }
   
   // Verify CRC
-  uint16_t receivedCRC = (response[6] << 8) | response[5];
-  uint16_t calculatedCRC = calculateCRC(response, 5);
-  
-  if (receivedCRC != calculatedCRC) {
-    return 0xFFFF;
+  uint16_t receivedCRC = (frame[RESPONSE_LENGTH - 1] << 8) | frame[RESPONSE_LENGTH - 2];
+  if (receivedCRC != calculateCRC(frame, RESPONSE_LENGTH - 2)) {
+    return false;
   }
   
-  // Extract value
-  return (response[2] << 8) | response[3];
+  reading.voltage = registerAt(frame, VOLTAGE_REG) / 10.0;
+  reading.current = registerPairAt(frame, CURRENT_REG) / 1000.0;
+  reading.power = registerPairAt(frame, POWER_REG) / 10.0;
+  reading.meterWh = registerPairAt(frame, ENERGY_REG);
+  reading.energy = reading.meterWh / 1000.0;  // Wh -> kWh
+  reading.metered = true;
+  reading.frequency = registerAt(frame, FREQUENCY_REG) / 10.0;
+  reading.powerFactor = registerAt(frame, PF_REG) / 100.0;
+  
+  return true;
 }
 
-bool PZEMSensor::readData(DeviceReading& reading) {
-  reading.timestamp = millis();
-  
-  // Read voltage (0.1V resolution)
-  uint16_t voltageRaw = readRegister(VOLTAGE_REG);
-  if (voltageRaw == 0xFFFF) return false;
-  reading.voltage = voltageRaw / 10.0;
-  
-  // Read current (0.001A resolution)
-  uint16_t currentRaw = readRegister(CURRENT_REG);
-  if (currentRaw == 0xFFFF) return false;
-  reading.current = currentRaw / 1000.0;
+bool PZEMSensor::requestData() {
+  if (state != STATE_IDLE) {
+    return false;
+  }
   
-  // Read power (0.1W resolution)
-  uint16_t powerRaw = readRegister(POWER_REG);
-  if (powerRaw == 0xFFFF) return false;
-  reading.power = powerRaw / 10.0;
+  // Read every measurement register in one Modbus transaction
+  if (!sendCommand(READ_REGISTER_CMD, VOLTAGE_REG, REGISTER_COUNT)) {
+    return false;
+  }
   
-  // Read energy (1Wh resolution, converted to kWh)
-  uint16_t energyLow = readRegister(ENERGY_REG);
-  uint16_t energyHigh = readRegister(ENERGY_REG + 1);
-  if (energyLow == 0xFFFF || energyHigh == 0xFFFF) return false;
-  uint32_t energyRaw = ((uint32_t)energyHigh << 16) | energyLow;
-  reading.energy = energyRaw / 1000.0;
+  rxCount = 0;
+  requestTime = millis();
+  state = STATE_AWAITING;
+  return true;
+}
+
+PZEMSensor::PollResult PZEMSensor::poll(DeviceReading& reading) {
+  switch (state) {
+    case STATE_IDLE:
+      return POLL_IDLE;
+      
+    case STATE_AWAITING:
+      if (receiveAvailable()) {
+        // Frame complete, parse on the next poll to keep each step short
+        state = STATE_PARSING;
+      } else if (millis() - requestTime >= RESPONSE_TIMEOUT_MS) {
+        state = STATE_IDLE;
+        return POLL_FAILED;
+      }
+      return POLL_BUSY;
+      
+    case STATE_PARSING:
+      state = STATE_IDLE;
+      reading.timestamp = requestTime;
+      return parseResponse(rxBuffer, rxCount, address, reading) ? POLL_READY : POLL_FAILED;
+  }
   
-  // Read frequency (0.1Hz resolution)
-  uint16_t freqRaw = readRegister(FREQUENCY_REG);
-  if (freqRaw == 0xFFFF) return false;
-  reading.frequency = freqRaw / 10.0;
+  return POLL_IDLE;
+}
+
+bool PZEMSensor::readData(DeviceReading& reading) {
+  if (!requestData()) {
+    return false;
+  }
   
-  // Read power factor (0.01 resolution)
-  uint16_t pfRaw = readRegister(PF_REG);
-  if (pfRaw == 0xFFFF) return false;
-  reading.powerFactor = pfRaw / 100.0;
+  PollResult result;
+  while ((result = poll(reading)) == POLL_BUSY) {
+    yield();
+  }
   
-  return true;
+  return result == POLL_READY;
 }
@@ -0,0 +1,230 @@
+#include "rollup_tiers.h"
+
+#define ROLLUP_MINUTE_MS 60000UL
+#define ROLLUP_QUARTER_MS 900000UL
+#define ROLLUP_HOUR_MS 3600000UL
+#define ROLLUP_EMPTY 0xFFFFFF  // minPower of a bucket with no readings
+
+static_assert(ROLLUP_HOUR_MS / 100 <= 0xFFFF, "coverage must fit a bucket");
+static_assert(ROLLUP_MINUTE_BUCKETS + ROLLUP_QUARTER_BUCKETS + ROLLUP_HOUR_BUCKETS <= 0xFFFF, "slots are 16-bit");
+
+static uint32_t get24(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static void set24(uint8_t* p, uint32_t value) {
+  p[0] = value & 0xFF;
+  p[1] = (value >> 8) & 0xFF;
+  p[2] = (value >> 16) & 0xFF;
+}
+
+static uint32_t toDeciWatts(float power) {
+  // Same rounding as the history ring
+  if (!(power > 0)) {
+    return 0;
+  }
+  float scaled = power * 10.0f + 0.5f;
+  return scaled >= (float)(ROLLUP_EMPTY - 1) ? ROLLUP_EMPTY - 1 : (uint32_t)scaled;
+}
+
+static void resetBucket(RollupBucket& bucket) {
+  set24(bucket.minPower, ROLLUP_EMPTY);
+  set24(bucket.maxPower, 0);
+  bucket.covered = 0;
+  bucket.energy = 0;
+}
+
+DeviceRollups::DeviceRollups() : writeSeq(0) {
+  const unsigned long widths[ROLLUP_TIER_COUNT] = {ROLLUP_MINUTE_MS, ROLLUP_QUARTER_MS, ROLLUP_HOUR_MS};
+  const uint16_t capacities[ROLLUP_TIER_COUNT] = {ROLLUP_MINUTE_BUCKETS, ROLLUP_QUARTER_BUCKETS, ROLLUP_HOUR_BUCKETS};
+  uint16_t offset = 0;
+  for (int i = 0; i < ROLLUP_TIER_COUNT; i++) {
+    tiers[i].widthMs = widths[i];
+    tiers[i].offset = offset;
+    tiers[i].capacity = capacities[i];
+    offset += capacities[i];
+  }
+  clear();
+}
+
+void DeviceRollups::beginWrite() {
+  writeSeq.store(writeSeq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void DeviceRollups::endWrite() {
+  writeSeq.store(writeSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void DeviceRollups::clear() {
+  beginWrite();
+  for (int i = 0; i < ROLLUP_TIER_COUNT; i++) {
+    tiers[i].head = 0;
+    tiers[i].count = 0;
+    tiers[i].newestStart = 0;
+    tiers[i].openCoveredMs = 0;
+  }
+  since = 0;
+  endWrite();
+}
+
+uint64_t DeviceRollups::firstTimestamp(int tier) const {
+  const RollupTier& t = tiers[tier];
+  return t.count > 0 ? t.newestStart - (uint64_t)(t.count - 1) * t.widthMs : 0;
+}
+
+RollupBucket& DeviceRollups::advance(RollupTier& tier, uint64_t start) {
+  // Open buckets up to `start`; skipped ones stay empty. A gap longer
+  // than the ring leaves nothing worth keeping
+  if (tier.count > 0 && (start - tier.newestStart) / tier.widthMs >= tier.capacity) {
+    tier.count = 0;
+  }
+  if (tier.count == 0) {
+    tier.head = 0;
+    tier.count = 1;
+    tier.newestStart = start;
+    tier.openCoveredMs = 0;
+    resetBucket(at(tier, 0));
+  }
+
+  while (tier.newestStart < start) {
+    if (tier.count < tier.capacity) {
+      tier.count++;
+    } else {
+      tier.head = (tier.head + 1) % tier.capacity;
+    }
+    tier.newestStart += tier.widthMs;
+    tier.openCoveredMs = 0;
+    resetBucket(at(tier, tier.count - 1));
+  }
+  return at(tier, tier.count - 1);
+}
+
+void DeviceRollups::addTier(RollupTier& tier, uint64_t from, uint64_t to, float power, uint32_t deciWatts) {
+  uint64_t width = tier.widthMs;
+
+  // Only the newest bucket is still open
+  if (tier.count > 0 && from < tier.newestStart) {
+    if (to < tier.newestStart) {
+      return;
+    }
+    from = tier.newestStart;
+  }
+
+  // Of a long segment only the last `capacity` buckets would survive
+  uint64_t last = to > from ? to - 1 : to;
+  last -= last % width;
+  uint64_t span = (uint64_t)(tier.capacity - 1) * width;
+  if (last > from && last - from > span) {
+    from = last - span;
+  }
+
+  for (uint64_t start = from - from % width; ; start += width) {
+    uint64_t end = start + width;
+    uint32_t overlap = (uint32_t)(min(to, end) - max(from, start));
+    RollupBucket& bucket = advance(tier, start);
+
+    if (deciWatts < get24(bucket.minPower)) {
+      set24(bucket.minPower, deciWatts);
+    }
+    if (deciWatts > get24(bucket.maxPower)) {
+      set24(bucket.maxPower, deciWatts);
+    }
+    bucket.energy += (float)(power * (double)overlap / 3600000000.0);  // W*ms -> kWh
+    tier.openCoveredMs += overlap;
+    bucket.covered = tier.openCoveredMs / 100;
+
+    if (end >= to) {
+      break;
+    }
+  }
+}
+
+void DeviceRollups::add(uint64_t from, uint64_t to, float power) {
+  if (to < from) {
+    return;
+  }
+  uint32_t deciWatts = toDeciWatts(power);
+  beginWrite();
+  if (isEmpty()) {
+    since = from;
+  }
+  for (int i = 0; i < ROLLUP_TIER_COUNT; i++) {
+    addTier(tiers[i], from, to, power, deciWatts);
+  }
+  endWrite();
+}
+
+int DeviceRollups::readBatch(int tier, RollupReadState& state, RollupPoint* out, int max) const {
+  while (true) {
+    uint32_t before = writeSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      // Writer is mid-update; let it finish even if it runs at lower priority
+      delay(1);
+      continue;
+    }
+
+    const RollupTier& t = tiers[tier];
+    RollupReadState next = state;
+    int n = 0;
+
+    if (!next.started) {
+      next.started = true;
+      next.next -= next.next % t.widthMs;
+    }
+    if (t.count > 0) {
+      uint64_t first = t.newestStart - (uint64_t)(t.count - 1) * t.widthMs;
+      if (next.next < first) {
+        next.next = first;  // Evicted (or before the oldest bucket)
+      }
+      while (n < max && next.next <= next.end && next.next <= t.newestStart) {
+        const RollupBucket& bucket = at(t, t.count - 1 - (t.newestStart - next.next) / t.widthMs);
+        uint64_t start = next.next;
+        next.next += t.widthMs;
+
+        uint32_t minPower = get24(bucket.minPower);
+        uint32_t maxPower = get24(bucket.maxPower);
+        if (minPower > maxPower) {
+          continue;  // No readings in this bucket
+        }
+        RollupPoint& point = out[n++];
+        point.timestamp = start;
+        point.coveredMs = start == t.newestStart ? t.openCoveredMs : bucket.covered * 100UL;
+        point.minPower = minPower / 10.0f;
+        point.maxPower = maxPower / 10.0f;
+        point.energy = bucket.energy;
+        point.avgPower = point.coveredMs > 0 ? bucket.energy * 3600000000.0 / point.coveredMs : point.maxPower;
+      }
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (writeSeq.load(std::memory_order_relaxed) == before) {
+      state = next;
+      return n;
+    }
+  }
+}
+
+RollupBounds DeviceRollups::bounds() const {
+  while (true) {
+    uint32_t before = writeSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+      delay(1);
+      continue;
+    }
+
+    RollupBounds extent;
+    extent.firstReading = since;
+    for (int i = 0; i < ROLLUP_TIER_COUNT; i++) {
+      extent.count[i] = tiers[i].count;
+      extent.first[i] = firstTimestamp(i);
+      extent.last[i] = tiers[i].newestStart;
+      extent.width[i] = tiers[i].widthMs;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (writeSeq.load(std::memory_order_relaxed) == before) {
+      return extent;
+    }
+  }
+}
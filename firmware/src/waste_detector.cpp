@@ -21,22 +21,17 @@ bool WasteDetector::isStandbyWaste(const DeviceReading& reading) {
 
 bool WasteDetector::isUsageAnomaly(const DeviceInfo& device) {
   // Check if device has been on 24/7 (simplified: check if always consuming)
-  if (device.historyCount < 10) return false;
-  
-  int alwaysOnCount = 0;
-  for (int i = 0; i < device.historyCount && i < 100; i++) {
-    if (device.history[i].power > 1.0) {
-      alwaysOnCount++;
-    }
-  }
+  // Uses the precomputed window over the last STATS_SAMPLE_WINDOW readings
+  int count = device.recentStats.count();
+  if (count < 10) return false;
   
   // If 95%+ of readings show consumption, it's always on
-  return (alwaysOnCount * 100 / min(device.historyCount, 100)) >= 95;
+  return (device.recentStats.active() * 100 / count) >= 95;
 }
 
 bool WasteDetector::isEfficiencyIssue(const DeviceReading& reading) {
-  // Low power factor indicates efficiency issues
-  return (reading.powerFactor > 0.0 && reading.powerFactor < LOW_PF_THRESHOLD);
+  // Low power factor indicates efficiency issues; only a measured PF counts
+  return (!reading.powerFactorEstimated && reading.powerFactor > 0.0 && reading.powerFactor < LOW_PF_THRESHOLD);
 }
 
 String WasteDetector::generateAlertMessage(const DeviceInfo& device) {
@@ -0,0 +1,4 @@
+#include "web_assets.h"
+
+// Generated into the build directory by the pre-build script
+#include "web_assets_data.h"
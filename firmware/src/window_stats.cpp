@@ -0,0 +1,117 @@
+#include "window_stats.h"
+
+static const uint32_t ACTIVE_THRESHOLD_DECIWATTS = (uint32_t)(ALWAYS_ON_POWER_THRESHOLD * 10);
+
+WindowStats::WindowStats(uint16_t samples, unsigned long ageMs) {
+  // Keep one history slot spare so the oldest windowed sample is never
+  // overwritten before it has been evicted
+  uint16_t limit = min(STATS_WINDOW_MAX_SAMPLES, MAX_HISTORY_ENTRIES - 1);
+  maxSamples = samples > 0 && samples < limit ? samples : limit;
+  maxAgeMs = ageMs;
+  reset();
+}
+
+void WindowStats::reset() {
+  startSeq = 0;
+  endSeq = 0;
+  startTimestamp = 0;
+  endTimestamp = 0;
+  sum = 0;
+  sumSquares = 0;
+  energySum = 0;
+  activeCount = 0;
+  minQueue.clear();
+  maxQueue.clear();
+}
+
+void WindowStats::evictOldest(const HistoryBuffer& history) {
+  uint32_t power = history.bySequence(startSeq).powerDeciWatts();
+  sum -= power;
+  sumSquares -= (uint64_t)power * power;
+  if (power > ACTIVE_THRESHOLD_DECIWATTS) {
+    activeCount--;
+  }
+  
+  if (minQueue.size > 0 && minQueue.front() == (uint16_t)startSeq) {
+    minQueue.popFront();
+  }
+  if (maxQueue.size > 0 && maxQueue.front() == (uint16_t)startSeq) {
+    maxQueue.popFront();
+  }
+  
+  startSeq++;
+  if (startSeq < endSeq) {
+    // The new oldest sample no longer has a predecessor in the window
+    const HistorySample& next = history.bySequence(startSeq);
+    startTimestamp += next.deltaMs();
+    energySum -= (uint64_t)next.powerDeciWatts() * next.deltaMs();
+  }
+}
+
+void WindowStats::add(const HistoryBuffer& history) {
+  if (history.isEmpty()) {
+    return;
+  }
+  
+  uint32_t seq = history.totalAppended() - 1;
+  const HistorySample& sample = history.bySequence(seq);
+  uint32_t power = sample.powerDeciWatts();
+  
+  if (count() == 0 || seq != endSeq) {
+    // First sample, or the history was cleared underneath us
+    reset();
+    startSeq = seq;
+    startTimestamp = history.lastTimestamp();
+  } else {
+    energySum += (uint64_t)power * sample.deltaMs();
+  }
+  
+  endSeq = seq + 1;
+  endTimestamp = history.lastTimestamp();
+  sum += power;
+  sumSquares += (uint64_t)power * power;
+  if (power > ACTIVE_THRESHOLD_DECIWATTS) {
+    activeCount++;
+  }
+  
+  while (minQueue.size > 0 && history.bySequence(expand(minQueue.back())).powerDeciWatts() >= power) {
+    minQueue.popBack();
+  }
+  minQueue.pushBack((uint16_t)seq);
+  
+  while (maxQueue.size > 0 && history.bySequence(expand(maxQueue.back())).powerDeciWatts() <= power) {
+    maxQueue.popBack();
+  }
+  maxQueue.pushBack((uint16_t)seq);
+  
+  // Shrink to the configured bounds
+  while (count() > maxSamples) {
+    evictOldest(history);
+  }
+  while (maxAgeMs > 0 && count() > 1 && endTimestamp - startTimestamp > maxAgeMs) {
+    evictOldest(history);
+  }
+}
+
+float WindowStats::mean() const {
+  uint16_t n = count();
+  return n > 0 ? (sum / (double)n) / 10.0 : 0;
+}
+
+float WindowStats::minimum(const HistoryBuffer& history) const {
+  return minQueue.size > 0 ? history.bySequence(expand(minQueue.front())).powerDeciWatts() / 10.0 : 0;
+}
+
+float WindowStats::maximum(const HistoryBuffer& history) const {
+  return maxQueue.size > 0 ? history.bySequence(expand(maxQueue.front())).powerDeciWatts() / 10.0 : 0;
+}
+
+float WindowStats::variance() const {
+  uint16_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+  double m = sum / (double)n;
+  double v = sumSquares / (double)n - m * m;
+  return v > 0 ? v / 100.0 : 0;  // (0.1W)^2 -> W^2
+}
@@ -0,0 +1,113 @@
+// Minimal line chart for the dashboard (served from the auditor, no CDN).
+// Implements the subset of the Chart.js API the dashboard uses:
+// new Chart(canvas, {type: 'line', data: {labels, datasets}, options}),
+// chart.data and chart.update().
+(function () {
+    const PAD = {left: 56, right: 16, top: 36, bottom: 40};
+
+    function niceStep(range) {
+        const raw = range / 5;
+        const mag = Math.pow(10, Math.floor(Math.log10(raw)));
+        const norm = raw / mag;
+        return (norm < 1.5 ? 1 : norm < 3 ? 2 : norm < 7 ? 5 : 10) * mag;
+    }
+
+    class Chart {
+        constructor(canvas, config) {
+            this.canvas = canvas;
+            this.ctx = canvas.getContext('2d');
+            this.data = config.data || {labels: [], datasets: []};
+            this.options = config.options || {};
+            window.addEventListener('resize', () => this.update());
+            this.update();
+        }
+
+        axisTitle(axis) {
+            const scales = this.options.scales || {};
+            const title = scales[axis] && scales[axis].title;
+            return title && title.display ? title.text : '';
+        }
+
+        update() {
+            const canvas = this.canvas;
+            const ctx = this.ctx;
+            const ratio = window.devicePixelRatio || 1;
+            const width = canvas.parentElement.clientWidth || 600;
+            const height = Math.round(width / 2);
+
+            canvas.style.width = width + 'px';
+            canvas.style.height = height + 'px';
+            canvas.width = width * ratio;
+            canvas.height = height * ratio;
+            ctx.setTransform(ratio, 0, 0, ratio, 0, 0);
+            ctx.clearRect(0, 0, width, height);
+            ctx.font = '12px sans-serif';
+
+            const labels = this.data.labels;
+            const datasets = this.data.datasets;
+            const plotW = width - PAD.left - PAD.right;
+            const plotH = height - PAD.top - PAD.bottom;
+
+            // Y range from all points, starting at zero
+            let max = 0;
+            datasets.forEach(ds => ds.data.forEach(v => { if (v > max) max = v; }));
+            if (max <= 0) max = 1;
+            const step = niceStep(max);
+            max = Math.ceil(max / step) * step;
+            const y = v => PAD.top + plotH - (v / max) * plotH;
+            const slots = Math.max(labels.length, ...datasets.map(ds => ds.data.length), 2);
+            const x = i => PAD.left + (i / (slots - 1)) * plotW;
+
+            // Grid and axes
+            ctx.strokeStyle = '#e5e7eb';
+            ctx.fillStyle = '#666';
+            ctx.lineWidth = 1;
+            ctx.textAlign = 'right';
+            ctx.textBaseline = 'middle';
+            for (let v = 0; v <= max + step / 2; v += step) {
+                ctx.beginPath();
+                ctx.moveTo(PAD.left, y(v));
+                ctx.lineTo(PAD.left + plotW, y(v));
+                ctx.stroke();
+                ctx.fillText(+v.toFixed(2), PAD.left - 6, y(v));
+            }
+
+            ctx.textAlign = 'center';
+            ctx.textBaseline = 'top';
+            const every = Math.ceil(labels.length / 6) || 1;
+            labels.forEach((label, i) => {
+                if (i % every === 0) ctx.fillText(label, x(i), PAD.top + plotH + 6);
+            });
+            ctx.fillText(this.axisTitle('x'), PAD.left + plotW / 2, height - 14);
+
+            ctx.save();
+            ctx.translate(12, PAD.top + plotH / 2);
+            ctx.rotate(-Math.PI / 2);
+            ctx.fillText(this.axisTitle('y'), 0, -6);
+            ctx.restore();
+
+            // Series and legend
+            let legendX = PAD.left;
+            ctx.textAlign = 'left';
+            ctx.textBaseline = 'middle';
+            datasets.forEach(ds => {
+                ctx.strokeStyle = ds.borderColor || '#3b82f6';
+                ctx.lineWidth = 2;
+                ctx.beginPath();
+                ds.data.forEach((v, i) => {
+                    if (i === 0) ctx.moveTo(x(i), y(v));
+                    else ctx.lineTo(x(i), y(v));
+                });
+                ctx.stroke();
+
+                ctx.fillStyle = ctx.strokeStyle;
+                ctx.fillRect(legendX, 12, 12, 12);
+                ctx.fillStyle = '#333';
+                ctx.fillText(ds.label, legendX + 16, 18);
+                legendX += 28 + ctx.measureText(ds.label).width;
+            });
+        }
+    }
+
+    window.Chart = Chart;
+})();
@@ -0,0 +1,42 @@
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Continuous ADC1 capture through I2S0 in built-in ADC mode. The I2S
+// peripheral clocks the conversions and DMA fills a ring of buffers in
+// the background, so sample timing has no software jitter; read() hands
+// out completed buffers only and blocks (CPU idle) while the next fills.
+// I2S0 is claimed exclusively and only ADC1 pins (GPIO32-39) can be used.
+//
+// With a second pin the ADC's pattern table alternates the two channels
+// (first, second, first, ...) at twice the rate, so both are sampled at
+// `rate` in lockstep, the second half a sample period behind the first.
+class AdcSampler {
+private:
+  int channels[2];   // ADC1 channels; channels[1] < 0 when single
+  uint32_t sampleRate;  // Per channel
+  bool running;
+  int pendingFirst;  // First-channel sample waiting for its partner, or -1
+  uint16_t raw[ADC_DMA_BUFFER_LEN];  // One DMA buffer as delivered
+
+public:
+  AdcSampler(int adcPin, uint32_t rate, int secondPin = -1);
+  bool begin();
+  void end();
+
+  // Copy up to maxSamples 12-bit samples per channel, in time order,
+  // waiting up to waitMs for a buffer to complete; returns the number
+  // copied per channel. second is required (and filled) with two pins.
+  size_t read(uint16_t* first, uint16_t* second, size_t maxSamples, uint32_t waitMs);
+  size_t read(uint16_t* samples, size_t maxSamples, uint32_t waitMs) { return read(samples, nullptr, maxSamples, waitMs); }
+
+  // Discard everything already captured so the next read starts fresh
+  void flush();
+
+  bool dualChannel() const { return channels[1] >= 0; }
+  uint32_t rate() const { return sampleRate; }
+};
+
+#endif
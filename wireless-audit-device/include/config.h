@@ -13,9 +13,15 @@
 #define ADC_VREF 3.3
 
 // Power Calculation Constants
-#define LINE_VOLTAGE 230.0  // V (adjust for your region)
+#define LINE_VOLTAGE 230.0  // V (adjust for your region); used without voltage sense
 #define DEFAULT_POWER_FACTOR 0.85  // Assumed power factor
 
+// Voltage Sense (optional): AC transformer module (e.g. ZMPT101B) biased to
+// mid-rail on a second ADC1 pin, sampled in lockstep with the CT for real
+// power, measured PF and line frequency
+#define VOLTAGE_SENSE_PIN -1  // e.g. 36 (VP); -1 if not fitted
+#define VOLTAGE_CALIBRATION 0.2625  // Line volts per ADC count (calibrate against a meter)
+
 // ESP-NOW Configuration
 #define ESP_NOW_CHANNEL 1
 // Master MAC address - UPDATE THIS with your main auditor's MAC address
@@ -23,14 +29,37 @@
 // Format: {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF}
 // For broadcast mode (not recommended but works): {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}
 #define MASTER_MAC_ADDR {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}  // CHANGE THIS!
+#define ACK_TIMEOUT_MS 100  // Low-power mode: wait for the master's acknowledgement
 
-// Sampling Configuration
-#define SAMPLES_PER_CYCLE 100
-#define SAMPLING_FREQUENCY 10000  // 10kHz for 50Hz AC (200 samples per cycle)
+// Sampling Configuration (continuous ADC capture via I2S DMA)
+#define ADC_SAMPLE_RATE 12000  // Hz; a whole number of samples per 50 Hz and 60 Hz cycle
+#define MAINS_FREQUENCY 50  // Hz (60 in the Americas)
+#define WINDOW_CYCLES 10  // Mains cycles per measurement window (200 ms at 50 Hz)
+#define ADC_DMA_BUFFER_LEN 600  // Conversions per DMA buffer (50 ms at 12 kHz, 25 ms with voltage sense)
+#define ADC_DMA_BUFFER_COUNT 8  // Ring depth; loop() must read within this many buffers
 #define TRANSMIT_INTERVAL_MS 5000  // Send data every 5 seconds
 
+// Low-Power Mode: deep sleep between measurements, kept in RTC memory and
+// sent in one batched frame each time the radio is woken
+#define LOW_POWER_MODE 0  // 1 to enable (TRANSMIT_INTERVAL_MS is then unused)
+#define SAMPLE_INTERVAL_MS 10000  // One measurement per wake
+#define BATCH_SIZE 6  // Measurements per transmission (1 to 16)
+
 // Battery Management (optional)
 #define BATTERY_PIN 35  // Battery voltage monitoring pin
 #define LOW_BATTERY_THRESHOLD 3.0  // V
+#define BATTERY_CAPACITY_MAH 2500
+
+// Power model for the battery estimate printed at first boot (typical
+// ESP32 module figures; measure your board to refine them)
+#define POWER_SUPPLY_VOLTS 3.3
+#define POWER_BOOT_MS 150     // Deep-sleep wake to setup()
+#define POWER_BOOT_MA 35.0
+#define POWER_SAMPLE_MS 260   // ADC start-up and one window, radio off
+#define POWER_SAMPLE_MA 45.0
+#define POWER_RADIO_MS 110    // Wi-Fi start, ESP-NOW send and acknowledgement
+#define POWER_RADIO_MA 120.0
+#define POWER_SLEEP_UA 10.0   // Deep sleep, regulator quiescent included
+#define POWER_ALWAYS_ON_MA 100.0  // Continuous mode, Wi-Fi idle
 
 #endif
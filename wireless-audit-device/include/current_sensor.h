@@ -2,6 +2,31 @@
 #define CURRENT_SENSOR_H
 
 #include <Arduino.h>
+#include "config.h"
+#include "adc_sampler.h"
+#include "cycle_window.h"
+
+// Everything the node reports, derived from one sample window
+struct Measurement {
+  float current;      // RMS current (A)
+  float power;        // Real power (W): mean of v*i, or estimated without voltage sense
+  float powerFactor;  // Real / apparent power, or estimated without voltage sense
+  float crestFactor;  // Peak / RMS; 1.41 for a sine, 2-3 for rectifier loads
+  uint32_t samples;   // Window length
+  
+  // Voltage sense; otherwise voltage is the assumed line voltage and
+  // frequency is 0
+  bool voltageMeasured;
+  float voltage;        // RMS voltage (V)
+  float apparentPower;  // VA
+  float frequency;      // Hz
+  
+  // Current harmonics: RMS of the odd orders 1, 3, ... 15 (A) and THD
+  // over orders 3-15 (ratio to the fundamental); zero below the noise floor
+  bool harmonicsMeasured;
+  float harmonics[CYCLE_WINDOW_HARMONICS];
+  float thd;
+};
 
 class CurrentSensor {
 private:
@@ -10,23 +35,32 @@ private:
   float currentRatio;
   float adcVref;
   float adcResolution;
+  float ampsPerCount;  // Applied once per window to the RMS in counts
+  float voltsPerCount;
   
-  // Calibration
-  float offset = 0.0;  // DC offset to subtract
+  // Continuous sampling: DMA buffers reduced into whole-cycle windows
+  AdcSampler sampler;
+  CycleWindow window;
+  uint16_t block[ADC_DMA_BUFFER_LEN];
+  uint16_t voltageBlock[ADC_DMA_BUFFER_LEN];
+  WindowResult latest;
+  bool fresh = false;  // latest completed since the last readCurrent()
   
-  // RMS calculation
-  float calculateRMS(float* samples, int count);
-  void calibrateOffset();
+  float estimatePowerFactor(float current, float crestFactor);
   
 public:
-  CurrentSensor(int sensorPin, float burden, float ratio, float vref, float resolution);
-  void begin();
+  CurrentSensor(int sensorPin, float burden, float ratio, float vref, float resolution,
+                int voltagePin = -1, float voltageCalibration = 0);
+  // Starts sampling; by default waits for the first window so the offset
+  // is settled before measure(). Not needed for one measurement: every
+  // window is exact on its own
+  void begin(bool settle = true);
+  void end();  // Stop sampling (before deep sleep)
+  bool update(uint32_t waitMs = 0);  // Process captured samples; true when a window completed
+  bool measure(Measurement& result, float assumedVoltage = LINE_VOLTAGE);  // Next window, all values at once
   float readCurrent();  // Returns RMS current in Amperes
-  float readPower(float voltage = 230.0, float powerFactor = 0.85);
-  float readPowerFactor();  // Simplified estimation
-  void calibrate();
+  void calibrate();  // Re-seed the DC offset tracker
+  bool hasVoltageSense() const { return sampler.dualChannel(); }
 };
 
 #endif
-
-
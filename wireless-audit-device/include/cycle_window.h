@@ -0,0 +1,143 @@
+#ifndef CYCLE_WINDOW_H
+#define CYCLE_WINDOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Offset tracker time constant: 2^14 samples (1.4 s at 12 kHz), slow
+// enough that the 50 Hz ripple on the tracked level is ~0.2% of the peak
+#define CYCLE_WINDOW_BIAS_SHIFT 14
+
+// Zero-crossing hysteresis on the voltage channel (half-counts, see below)
+#define CYCLE_WINDOW_ZC_HYSTERESIS 16
+
+// Current harmonics analysed per window: the odd orders 1, 3, ... 15
+#define CYCLE_WINDOW_HARMONICS 8
+
+// Longest mains cycle the harmonic sine table covers, in samples
+// (20 kHz at 50 Hz)
+#define CYCLE_WINDOW_MAX_CYCLE_SAMPLES 400
+
+// One completed window, in raw ADC counts
+struct WindowResult {
+  uint32_t samples;
+  float mean;  // DC level (the CT bias point)
+  float rms;   // RMS of the AC component around that level
+  float peak;  // Largest excursion from that level
+  
+  // Voltage channel, when one was fed for the whole window
+  bool hasVoltage;
+  float voltageRms;  // Counts
+  float realPower;   // Mean of v*i, counts^2
+  float frequency;   // Hz from zero crossings, 0 if fewer than two
+  
+  // Current harmonics, when the window is a whole number of table cycles
+  bool hasHarmonics;
+  float harmonics[CYCLE_WINDOW_HARMONICS];  // RMS of order 2h+1, counts
+  float thd;  // RMS of orders 3-15 over the fundamental
+};
+
+// DC tracking and window sums for one ADC channel
+struct ChannelSums {
+  int32_t biasQ16;   // Tracked DC level, counts << 16
+  int32_t sum;       // Of samples minus the tracked level
+  int32_t rawSum;    // Of samples, for the exact window mean
+  int64_t sumSquares;
+};
+
+// Splits a continuous stream of raw 12-bit ADC samples into windows that
+// span a whole number of mains cycles and reduces each one as its samples
+// arrive. Over whole cycles the window mean is exactly the DC bias, so it
+// can be removed without a separate no-load calibration and no partial
+// period skews the RMS.
+//
+// All per-sample work is integer: an IIR high-pass tracks the bias in
+// Q16, samples minus the tracked level are summed (32-bit) and squared
+// into 64 bits, and the one sqrt and float conversion happen per window.
+// Whatever the tracker has not yet followed is removed exactly from the
+// window sums at the end.
+//
+// An optional voltage channel is sampled in lockstep with the current:
+// the ADC converts I then V, so each V sample lands half a sample period
+// late. Averaging consecutive V samples re-centres it on the I sample
+// (kept as their sum, in half-counts, to stay exact). The same pass
+// accumulates sum(v*i) for real power and times rising zero crossings of
+// v, interpolated between samples, for the line frequency.
+//
+// Harmonics come from one single-bin DFT per odd order (a Goertzel bank
+// without the recursion): samples times a Q15 sine table, indexed at h
+// times the phase within the mains cycle, summed into 64 bits. Over whole
+// cycles each bin is exact for its order and the table's symmetry cancels
+// the DC bias exactly, so raw samples go in unmodified. Off-nominal mains
+// frequency moves order h by h times the offset, so high orders read low:
+// the 7th by ~2% of itself at +/-0.05 Hz, ~5% at +/-0.1 Hz.
+//
+// Plain C++ with no Arduino dependencies: the native env feeds it
+// synthetic waveforms (sim/waveform_check.cpp).
+class CycleWindow {
+private:
+  uint32_t windowLength;  // Samples per window
+  uint32_t sampleRate;
+  uint32_t count;
+  bool biasSeeded;        // Trackers hold still until the first window sets them
+  ChannelSums current;
+  uint16_t minSample;
+  uint16_t maxSample;
+  
+  // Voltage channel (half-counts)
+  ChannelSums voltage;
+  int64_t crossSum;        // sum(di * dv)
+  uint32_t voltageCount;   // Samples this window that had a voltage sample
+  uint16_t lastVoltage;    // Previous raw V sample, for alignment
+  bool voltagePrimed;
+  int32_t lastAligned;     // Previous V minus its tracked level
+  bool crossingArmed;      // V went below -hysteresis since the last crossing
+  uint32_t crossings;
+  float firstCrossing;     // Sample positions within the window
+  float lastCrossing;
+  
+  // Harmonic bank; cycleSamples is 0 when disabled
+  uint16_t cycleSamples;
+  uint16_t quarterCycle;
+  int16_t sineTable[CYCLE_WINDOW_MAX_CYCLE_SAMPLES + CYCLE_WINDOW_MAX_CYCLE_SAMPLES / 4];  // Plus a quarter for cos
+  uint16_t phase[CYCLE_WINDOW_HARMONICS];  // Table index of each order for the next sample
+  int64_t harmonicCos[CYCLE_WINDOW_HARMONICS];
+  int64_t harmonicSin[CYCLE_WINDOW_HARMONICS];
+  
+  WindowResult result;
+  bool complete;
+  
+  void addCurrent(const uint16_t* samples, size_t n);
+  void addWithVoltage(const uint16_t* samples, const uint16_t* volts, size_t n);
+  void addHarmonics(const uint16_t* samples, size_t n);
+  void buildSineTable();
+  void finish();
+
+public:
+  // Harmonics need a whole number of samples per mains cycle, divisible
+  // by 4 and at most CYCLE_WINDOW_MAX_CYCLE_SAMPLES (12 kHz at 50 or
+  // 60 Hz qualifies); otherwise, or when not wanted, they are skipped
+  CycleWindow(uint32_t rate, uint32_t mainsHz, uint32_t cycles, bool harmonics = true);
+
+  // Tracked DC level in counts; resetOffset() re-seeds it from the next
+  // complete window (e.g. after the CT is re-clamped)
+  float getOffset() const { return current.biasQ16 / 65536.0f; }
+  void resetOffset();
+
+  // Consume samples up to the end of the current window and return how
+  // many were taken. When a window completes, available() turns true and
+  // the rest of the block must be fed again after take(). volts, when
+  // given, holds the voltage sample taken with each current sample.
+  size_t add(const uint16_t* samples, const uint16_t* volts, size_t n);
+  size_t add(const uint16_t* samples, size_t n) { return add(samples, nullptr, n); }
+
+  bool available() const { return complete; }
+  WindowResult take();
+
+  // Drop any partial window (e.g. after a gap in the sample stream)
+  void restart();
+
+  uint32_t length() const { return windowLength; }
+};
+
+#endif
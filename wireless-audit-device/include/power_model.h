@@ -0,0 +1,31 @@
+#ifndef POWER_MODEL_H
+#define POWER_MODEL_H
+
+#include <stdint.h>
+
+// Supply current of each phase of a low-power wake, and of the always-on
+// node for comparison
+struct PowerProfile {
+  float supplyVolts;
+  float bootMs, bootMa;      // Deep-sleep wake to setup()
+  float sampleMs, sampleMa;  // ADC start-up and one window, radio off
+  float radioMs, radioMa;    // Wi-Fi start, ESP-NOW send and callback
+  float sleepUa;             // Deep sleep, board regulator included
+  float alwaysOnMa;          // Continuous mode, Wi-Fi idle
+};
+
+struct PowerEstimate {
+  float perSampleMj;  // Everything a measurement costs, its share of the radio and sleep included
+  float radioMj;      // One transmission
+  float averageMa;
+  float batteryDays;
+};
+
+// One measurement every intervalMs, radio woken every batchSize measurements
+PowerEstimate estimateDutyCycle(const PowerProfile& profile, uint32_t intervalMs, uint32_t batchSize,
+                                float batteryMah);
+
+// The same measurement rate with the node awake and the radio up throughout
+PowerEstimate estimateAlwaysOn(const PowerProfile& profile, uint32_t intervalMs, float batteryMah);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef SAMPLE_BATCH_H
+#define SAMPLE_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry_frame.h"
+
+#define SAMPLE_BATCH_MAGIC 0x42415443  // "BATC"
+#define SAMPLE_BATCH_MAX TELEMETRY_BATCH_MAX  // Held back; the newest rides in the frame header
+
+// One measurement waiting for the radio
+struct BatchedSample {
+  uint32_t takenAtMs;  // Node clock
+  uint8_t powerFactor;
+  uint32_t currentMa;
+  uint32_t powerDeciWatts;
+};
+
+// Measurements kept across deep sleep until the next transmission. Plain
+// data with no constructor so it can live in RTC memory (RTC_DATA_ATTR);
+// valid() tells a batch that survived the sleep from power-on contents.
+//
+// Every measurement takes the next sequence number, and the batch always
+// holds a contiguous run of them ending just before the newest, so the
+// frame only needs the newest one (see telemetry_frame.h). When full, the
+// oldest sample is dropped.
+//
+// In continuous mode the same structure is the retransmit buffer: every
+// sent measurement is held until the main auditor acknowledges it, and
+// unacknowledged ones ride along in the next frame's batch.
+//
+// Plain C++ with no Arduino dependencies (native envs: sim/batch_check.cpp,
+// sim/link_check.cpp).
+struct SampleBatch {
+  uint32_t magic;
+  uint16_t nextSequence;
+  uint16_t nextTransmission;
+  uint8_t count;
+  BatchedSample samples[SAMPLE_BATCH_MAX];  // Oldest first
+  
+  bool valid() const { return magic == SAMPLE_BATCH_MAGIC && count <= SAMPLE_BATCH_MAX; }
+  void reset(uint16_t firstSequence = 0, uint16_t firstTransmission = 0);  // Random at power-on
+  uint16_t takeSequence() { return nextSequence++; }
+  uint16_t takeTransmission() { return nextTransmission++; }
+  
+  // Keep a measurement (already numbered by takeSequence()) for later
+  void push(const TelemetryFrame& sample, uint32_t takenAtMs);
+  
+  // Frame carrying newest in the header and every held sample, aged
+  // against nowMs; returns the encoded length as TelemetryCodec::encode()
+  size_t encode(const TelemetryFrame& newest, uint32_t nowMs, uint8_t* buffer, size_t capacity) const;
+  
+  // After a delivered transmission
+  void clear() { count = 0; }
+  
+  // Drop held samples up to and including sequence (an acknowledged
+  // frame's header). Expects every numbered measurement to be held, ie
+  // not between takeSequence() and push(); returns the number dropped
+  uint8_t acknowledge(uint16_t sequence);
+  uint8_t size() const { return count; }
+};
+
+#endif
@@ -0,0 +1,258 @@
+// Native check of low-power batching (pio run -e native_batch).
+//
+// Runs the node's SampleBatch through simulated wakes and a lossy link,
+// decodes every delivered frame with TelemetryCodec and unbatches it as
+// the main auditor does, on a receiver clock with a different origin.
+// Every delivered sample must come back once, in sequence, with its
+// values and its original time (to the 0.1 s age resolution). Also checks
+// overflow (oldest dropped, numbering still contiguous), age saturation,
+// and that truncated, corrupt or over-long batch frames are rejected.
+// Then prints the power model: energy per measurement and battery life
+// against batch size and interval. Exits non-zero on any failure.
+//
+//   .pio/build/native_batch/program [--seed N] [--wakes N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "config.h"
+#include "sample_batch.h"
+#include "power_model.h"
+#include "telemetry_frame.h"
+
+#define CHECK_TIME_TOLERANCE_MS 50  // Half the age resolution
+#define CHECK_SEND_DELAY_MS 300     // Measurement to send: the header sample is stamped on arrival
+#define CHECK_RECEIVER_OFFSET_MS 7345678UL  // Receiver clock minus node clock
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  int wakes = 2000;
+};
+
+// What the node measured, for comparison with what the receiver got
+struct Truth {
+  uint32_t takenAtMs;
+  TelemetryFrame frame;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--wakes") && hasValue) options.wakes = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--wakes N]\n", argv[0]);
+      return false;
+    }
+  }
+  return options.wakes > 0;
+}
+
+static TelemetryFrame measurement(std::mt19937& rng, uint16_t sequence) {
+  TelemetryFrame frame = {};
+  frame.flags = TELEMETRY_FLAG_PF_ESTIMATED;
+  frame.powerFactor = 40 + rng() % 60;
+  frame.nodeHash = TelemetryCodec::hashNodeId(NODE_ID);
+  frame.sequence = sequence;
+  frame.currentMa = rng() % 20000;
+  frame.powerDeciWatts = rng() % 46000;
+  return frame;
+}
+
+// Decode and unbatch one frame; compare every sample with what was measured
+static int receive(const uint8_t* data, size_t len, uint32_t receivedAt, uint32_t sentAt,
+                   const std::vector<Truth>& truth, int32_t& lastSequence) {
+  TelemetryFrame frame;
+  if (!TelemetryCodec::decode(data, len, frame)) {
+    expect(false, "delivered frame decodes");
+    return 0;
+  }
+  int samples = 0;
+  for (uint8_t i = 0; i < TelemetryCodec::sampleCount(frame); i++) {
+    TelemetrySample sample;
+    if (!TelemetryCodec::sampleAt(frame, i, receivedAt, sample)) {
+      expect(false, "sample time on the receiver clock");
+      continue;
+    }
+    expect(sample.newest == (i == frame.batchCount), "header sample is the newest");
+    expect((int32_t)sample.sequence > lastSequence, "samples arrive once, in order");
+    lastSequence = sample.sequence;
+    samples++;
+
+    // Measurement time moved onto the receiver's clock
+    const Truth& t = truth[sample.sequence];
+    long expectedAt = (long)t.takenAtMs + (long)(receivedAt - sentAt);
+    long error = (long)sample.timestamp - expectedAt;
+    if (sample.newest) {
+      expect(error >= 0 && error <= CHECK_SEND_DELAY_MS, "newest stamped on arrival");
+    } else {
+      expect(labs(error) <= CHECK_TIME_TOLERANCE_MS, "original timestamp restored");
+    }
+    expect(sample.currentMa == t.frame.currentMa && sample.powerDeciWatts == t.frame.powerDeciWatts &&
+             sample.powerFactor == t.frame.powerFactor,
+           "values round-trip");
+  }
+  return samples;
+}
+
+// Node wakes every SAMPLE_INTERVAL_MS (with jitter), sends every
+// BATCH_SIZE samples over a link that loses some transmissions
+static void checkWakes(const CheckOptions& options, uint32_t batchSize, double loss) {
+  std::mt19937 rng(options.seed + batchSize);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  SampleBatch batch;
+  batch.reset();
+  std::vector<Truth> truth;
+  uint8_t data[TELEMETRY_FRAME_MAX];
+
+  uint32_t clock = 1000;
+  int32_t lastSequence = -1;
+  int sends = 0, delivered = 0, received = 0, maxHeld = 0;
+  for (int w = 0; w < options.wakes; w++) {
+    clock += SAMPLE_INTERVAL_MS + rng() % 40;
+    TelemetryFrame frame = measurement(rng, batch.takeSequence());
+    truth.push_back({clock, frame});
+
+    // Same decision as runLowPowerCycle(); the radio takes a little while
+    bool sent = false;
+    if (batch.size() + 1u >= batchSize) {
+      uint32_t sentAt = clock + CHECK_SEND_DELAY_MS;
+      size_t len = batch.encode(frame, sentAt, data, sizeof(data));
+      expect(len == TelemetryCodec::frameSize(frame.flags | (batch.size() ? TELEMETRY_FLAG_BATCH : 0), batch.size()),
+             "encoded length");
+      sends++;
+      if (uniform(rng) >= loss) {
+        received += receive(data, len, sentAt + CHECK_RECEIVER_OFFSET_MS, sentAt, truth, lastSequence);
+        batch.clear();
+        delivered++;
+        sent = true;
+      }
+    }
+    if (!sent) {
+      batch.push(frame, clock);
+    }
+    maxHeld = std::max(maxHeld, (int)batch.size());
+  }
+
+  int expectedLoss = options.wakes - received - batch.size();
+  printf("batch %2u, %2.0f%% link loss: %5d sends, %5d delivered, %6d samples received, %4d dropped, max %2d held\n",
+         batchSize, loss * 100, sends, delivered, received, expectedLoss, maxHeld);
+  expect(maxHeld <= SAMPLE_BATCH_MAX, "batch stays within RTC capacity");
+  if (loss == 0) {
+    expect(received + batch.size() == options.wakes, "lossless link delivers everything");
+  }
+}
+
+static void checkEdges() {
+  std::mt19937 rng(3);
+  uint8_t data[TELEMETRY_FRAME_MAX];
+
+  // Overflow keeps the newest SAMPLE_BATCH_MAX, still contiguous
+  SampleBatch batch;
+  batch.reset();
+  std::vector<Truth> truth;
+  uint32_t clock = 0;
+  for (int i = 0; i < SAMPLE_BATCH_MAX + 5; i++) {
+    clock += 10000;
+    TelemetryFrame frame = measurement(rng, batch.takeSequence());
+    truth.push_back({clock, frame});
+    batch.push(frame, clock);
+  }
+  expect(batch.size() == SAMPLE_BATCH_MAX, "full batch drops the oldest");
+  clock += 10000;
+  TelemetryFrame newest = measurement(rng, batch.takeSequence());
+  truth.push_back({clock, newest});
+  size_t len = batch.encode(newest, clock, data, sizeof(data));
+  expect(len == TELEMETRY_FRAME_MAX - 18, "largest batch frame size");  // No voltage, harmonics or link sections
+  int32_t lastSequence = 4;
+  int received = receive(data, len, clock + 5, clock, truth, lastSequence);
+  expect(received == SAMPLE_BATCH_MAX + 1, "whole overflowed batch received");
+
+  // Corrupt, truncated and over-long frames are rejected
+  TelemetryFrame frame;
+  data[len - 5] ^= 0x40;
+  expect(!TelemetryCodec::decode(data, len, frame), "corrupt batch rejected");
+  data[len - 5] ^= 0x40;
+  expect(!TelemetryCodec::decode(data, len - TELEMETRY_RECORD_SIZE, frame), "truncated batch rejected");
+  expect(!TelemetryCodec::decode(data, TELEMETRY_FRAME_SIZE - 1, frame), "short frame rejected");
+  data[TELEMETRY_FRAME_SIZE - 2] = TELEMETRY_BATCH_MAX + 1;
+  expect(!TelemetryCodec::decode(data, len, frame), "over-long batch count rejected");
+  newest.batchCount = TELEMETRY_BATCH_MAX + 1;
+  newest.flags |= TELEMETRY_FLAG_BATCH;
+  expect(TelemetryCodec::encode(newest, data, sizeof(data)) == 0, "over-long batch not encoded");
+
+  // A plain frame unbatches to itself
+  batch.clear();
+  newest = measurement(rng, 7);
+  len = batch.encode(newest, clock, data, sizeof(data));
+  expect(len == TELEMETRY_FRAME_SIZE, "empty batch sends a plain frame");
+  expect(TelemetryCodec::decode(data, len, frame) && TelemetryCodec::sampleCount(frame) == 1 &&
+           !(frame.flags & TELEMETRY_FLAG_BATCH),
+         "plain frame has one sample");
+
+  // Ages saturate, and a sample older than the receiver's clock is skipped
+  batch.push(measurement(rng, 8), 0);
+  len = batch.encode(measurement(rng, 9), 8000000, data, sizeof(data));
+  TelemetrySample sample;
+  expect(TelemetryCodec::decode(data, len, frame) && frame.batch[0].ageDeciSeconds == 0xFFFF, "age saturates");
+  expect(!TelemetryCodec::sampleAt(frame, 0, 60000, sample), "sample before receiver boot skipped");
+  expect(TelemetryCodec::sampleAt(frame, 1, 60000, sample) && sample.timestamp == 60000, "newest still usable");
+}
+
+static void printPowerModel() {
+  PowerProfile profile = {POWER_SUPPLY_VOLTS, POWER_BOOT_MS, POWER_BOOT_MA, POWER_SAMPLE_MS, POWER_SAMPLE_MA,
+                          POWER_RADIO_MS, POWER_RADIO_MA, POWER_SLEEP_UA, POWER_ALWAYS_ON_MA};
+  printf("\nPower model (%.1f V; wake %.0f ms @ %.0f mA, sample %.0f ms @ %.0f mA, radio %.0f ms @ %.0f mA, "
+         "sleep %.0f uA), %d mAh battery\n",
+         profile.supplyVolts, profile.bootMs, profile.bootMa, profile.sampleMs, profile.sampleMa, profile.radioMs,
+         profile.radioMa, profile.sleepUa, BATTERY_CAPACITY_MAH);
+  printf("%-12s %8s %14s %10s %10s\n", "interval", "batch", "mJ/sample", "avg mA", "days");
+
+  const uint32_t intervals[] = {5000, 10000, 60000};
+  const uint32_t batches[] = {1, 2, 4, 6, 10, 16};
+  for (uint32_t interval : intervals) {
+    PowerEstimate on = estimateAlwaysOn(profile, interval, BATTERY_CAPACITY_MAH);
+    printf("%9u ms %8s %14.1f %10.3f %10.1f\n", interval, "awake", on.perSampleMj, on.averageMa, on.batteryDays);
+    float previous = on.perSampleMj;
+    for (uint32_t size : batches) {
+      PowerEstimate e = estimateDutyCycle(profile, interval, size, BATTERY_CAPACITY_MAH);
+      printf("%9u ms %8u %14.1f %10.3f %10.1f\n", interval, size, e.perSampleMj, e.averageMa, e.batteryDays);
+      expect(e.perSampleMj < previous, "larger batches cost less per sample");
+      previous = e.perSampleMj;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Low-power batching (SampleBatch -> TelemetryCodec -> unbatch) ===\n");
+  printf("%d wakes every ~%d ms per run, receiver clock offset %lu ms\n\n", options.wakes, SAMPLE_INTERVAL_MS,
+         CHECK_RECEIVER_OFFSET_MS);
+  const uint32_t sizes[] = {1, 4, BATCH_SIZE, SAMPLE_BATCH_MAX + 1};
+  for (uint32_t size : sizes) {
+    checkWakes(options, size, 0.0);
+    checkWakes(options, size, 0.3);
+  }
+  checkEdges();
+  printPowerModel();
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
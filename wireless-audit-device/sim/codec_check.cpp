@@ -0,0 +1,397 @@
+// Native check of the telemetry frame codec (pio run -e native_codec).
+//
+// Round-trips TelemetryCodec (common/telemetry) over every combination of
+// optional sections and batch lengths with random field values, pins the
+// byte layout against a hand-assembled frame and the CRC against the
+// CRC-16/MODBUS check value, and requires every truncation, extension,
+// single-bit error, unknown magic or version and over-long batch to be
+// rejected. Version 1 frames must decode with their sections ignored.
+// Then compares frame sizes with the JSON packet the node used to send
+// and times encode and decode. Exits non-zero on any failure.
+//
+//   .pio/build/native_codec/program [--seed N] [--frames N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "telemetry_frame.h"
+
+#define CHECK_ESP_NOW_MAX 250  // ESP-NOW payload limit
+#define CHECK_ALL_FLAGS 0x1F
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  int frames = 20000;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--frames") && hasValue) options.frames = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--frames N]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static TelemetryFrame randomFrame(std::mt19937& rng, uint8_t flags, uint8_t batchCount) {
+  TelemetryFrame frame = TelemetryFrame();
+  frame.flags = flags;
+  frame.powerFactor = rng() % 101;
+  frame.nodeHash = rng();
+  frame.sequence = rng();
+  frame.currentMa = rng();
+  frame.powerDeciWatts = rng();
+  if (flags & TELEMETRY_FLAG_VOLTAGE) {
+    frame.voltageDeciVolts = rng();
+    frame.frequencyCentiHz = rng();
+  }
+  if (flags & TELEMETRY_FLAG_HARMONICS) {
+    frame.fundamentalMa = rng();
+    for (int i = 0; i < 3; i++) {
+      frame.harmonicPermille[i] = rng();
+    }
+    frame.thdPermille = rng();
+  }
+  if (flags & TELEMETRY_FLAG_LINK) {
+    frame.transmission = rng();
+  }
+  if (flags & TELEMETRY_FLAG_BATCH) {
+    frame.batchCount = batchCount;
+    for (int i = 0; i < batchCount; i++) {
+      frame.batch[i].ageDeciSeconds = rng();
+      frame.batch[i].powerFactor = rng() % 101;
+      frame.batch[i].currentMa = rng();
+      frame.batch[i].powerDeciWatts = rng();
+    }
+  }
+  return frame;
+}
+
+// Every field of the sections `frame` has
+static bool sameFrame(const TelemetryFrame& a, const TelemetryFrame& b) {
+  bool same = a.flags == b.flags && a.powerFactor == b.powerFactor && a.nodeHash == b.nodeHash &&
+              a.sequence == b.sequence && a.currentMa == b.currentMa && a.powerDeciWatts == b.powerDeciWatts &&
+              a.voltageDeciVolts == b.voltageDeciVolts && a.frequencyCentiHz == b.frequencyCentiHz &&
+              a.fundamentalMa == b.fundamentalMa && a.thdPermille == b.thdPermille &&
+              a.transmission == b.transmission && a.batchCount == b.batchCount;
+  for (int i = 0; same && i < 3; i++) {
+    same = a.harmonicPermille[i] == b.harmonicPermille[i];
+  }
+  for (int i = 0; same && i < a.batchCount; i++) {
+    same = a.batch[i].ageDeciSeconds == b.batch[i].ageDeciSeconds && a.batch[i].powerFactor == b.batch[i].powerFactor &&
+           a.batch[i].currentMa == b.batch[i].currentMa && a.batch[i].powerDeciWatts == b.batch[i].powerDeciWatts;
+  }
+  return same;
+}
+
+static void checkLayout() {
+  printf("Layout:\n");
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  expect(TelemetryCodec::crc16(check, sizeof(check)) == 0x4B37, "CRC-16/MODBUS check value");
+  expect(TelemetryCodec::hashNodeId("foobar") == 0xBF9CF968UL, "FNV-1a test vector");
+
+  // 1.234 A, 98.7 W, PF 0.87, 230.1 V, 50.02 Hz, transmission 0x0102
+  TelemetryFrame frame = TelemetryFrame();
+  frame.flags = TELEMETRY_FLAG_VOLTAGE | TELEMETRY_FLAG_LINK;
+  frame.powerFactor = 87;
+  frame.nodeHash = 0x44332211;
+  frame.sequence = 0xBEEF;
+  frame.currentMa = 1234;
+  frame.powerDeciWatts = 987;
+  frame.voltageDeciVolts = 2301;
+  frame.frequencyCentiHz = 5002;
+  frame.transmission = 0x0102;
+  const uint8_t expected[] = {
+    0xEA, 0x02, 0x12, 0x57,        // magic, version, flags, PF
+    0x11, 0x22, 0x33, 0x44,        // node hash
+    0xEF, 0xBE,                    // sequence
+    0xD2, 0x04, 0x00, 0x00,        // current
+    0xDB, 0x03, 0x00, 0x00,        // power
+    0xFD, 0x08, 0x8A, 0x13,        // voltage, frequency
+    0x02, 0x01,                    // transmission
+  };
+  uint8_t buffer[TELEMETRY_FRAME_MAX];
+  size_t len = TelemetryCodec::encode(frame, buffer, sizeof(buffer));
+  uint16_t crc = TelemetryCodec::crc16(expected, sizeof(expected));
+  expect(len == sizeof(expected) + 2 && !memcmp(buffer, expected, sizeof(expected)), "fields at their documented offsets");
+  expect(len >= 2 && buffer[len - 2] == (crc & 0xFF) && buffer[len - 1] == (crc >> 8), "CRC last, little-endian");
+  expect(TelemetryCodec::frameSize(CHECK_ALL_FLAGS, TELEMETRY_BATCH_MAX) == TELEMETRY_FRAME_MAX,
+         "TELEMETRY_FRAME_MAX is the largest frame");
+  expect(TELEMETRY_FRAME_MAX <= CHECK_ESP_NOW_MAX, "largest frame fits one ESP-NOW packet");
+
+  TelemetryAck ack = {0x44332211, 0xBEEF};
+  const uint8_t expectedAck[] = {0xEB, 0x02, 0x11, 0x22, 0x33, 0x44, 0xEF, 0xBE};
+  uint8_t ackBuffer[TELEMETRY_ACK_SIZE];
+  expect(TelemetryCodec::encodeAck(ack, ackBuffer, sizeof(ackBuffer)) == TELEMETRY_ACK_SIZE &&
+         !memcmp(ackBuffer, expectedAck, sizeof(expectedAck)), "acknowledgement layout");
+  printf("  %zu-byte frame with voltage and link sections matches the documented layout\n", len);
+}
+
+static void checkRoundTrip(std::mt19937& rng, const CheckOptions& options) {
+  printf("\nRound trip (%d frames, seed %u):\n", options.frames, options.seed);
+  uint8_t buffer[TELEMETRY_FRAME_MAX + 1];
+  int roundTrips = 0, sized = 0;
+  for (int i = 0; i < options.frames; i++) {
+    uint8_t flags = i % (CHECK_ALL_FLAGS + 1);
+    uint8_t batchCount = rng() % (TELEMETRY_BATCH_MAX + 1);
+    TelemetryFrame frame = randomFrame(rng, flags, batchCount);
+    size_t len = TelemetryCodec::encode(frame, buffer, sizeof(buffer));
+    sized += len == TelemetryCodec::frameSize(flags, frame.batchCount);
+    TelemetryFrame back;
+    memset(&back, 0xA5, sizeof(back));  // Absent sections must come back zeroed
+    roundTrips += TelemetryCodec::decode(buffer, len, back) && sameFrame(back, frame);
+  }
+  expect(sized == options.frames, "encoded length is frameSize()");
+  expect(roundTrips == options.frames, "every frame decodes to what was encoded");
+
+  TelemetryFrame full = randomFrame(rng, CHECK_ALL_FLAGS, TELEMETRY_BATCH_MAX);
+  size_t need = TelemetryCodec::frameSize(CHECK_ALL_FLAGS, TELEMETRY_BATCH_MAX);
+  expect(TelemetryCodec::encode(full, buffer, need - 1) == 0, "encode into a short buffer fails");
+  full.batchCount = TELEMETRY_BATCH_MAX + 1;
+  expect(TelemetryCodec::encode(full, buffer, sizeof(buffer)) == 0, "encode of an over-long batch fails");
+
+  int acks = 0;
+  for (int i = 0; i < 1000; i++) {
+    TelemetryAck ack = {(uint32_t)rng(), (uint16_t)rng()}, back;
+    uint8_t bytes[TELEMETRY_ACK_SIZE];
+    size_t len = TelemetryCodec::encodeAck(ack, bytes, sizeof(bytes));
+    acks += TelemetryCodec::decodeAck(bytes, len, back) && back.nodeHash == ack.nodeHash && back.sequence == ack.sequence;
+  }
+  expect(acks == 1000, "acknowledgements round-trip");
+  printf("  %d/%d frames and %d/1000 acknowledgements round-trip\n", roundTrips, options.frames, acks);
+}
+
+static void checkRejects(std::mt19937& rng) {
+  printf("\nMalformed frames:\n");
+  uint8_t buffer[TELEMETRY_FRAME_MAX + 1];
+  long tried = 0, accepted = 0;
+  for (uint8_t flags = 0; flags <= CHECK_ALL_FLAGS; flags++) {
+    TelemetryFrame frame = randomFrame(rng, flags, rng() % (TELEMETRY_BATCH_MAX + 1));
+    size_t len = TelemetryCodec::encode(frame, buffer, sizeof(buffer));
+    TelemetryFrame back;
+
+    // Every truncation and one byte too many
+    for (size_t cut = 0; cut < len; cut++, tried++) {
+      accepted += TelemetryCodec::decode(buffer, cut, back);
+    }
+    buffer[len] = 0;
+    accepted += TelemetryCodec::decode(buffer, len + 1, back);
+    tried++;
+
+    // Every single-bit error
+    for (size_t bit = 0; bit < len * 8; bit++, tried++) {
+      buffer[bit / 8] ^= 1 << (bit % 8);
+      accepted += TelemetryCodec::decode(buffer, len, back);
+      buffer[bit / 8] ^= 1 << (bit % 8);
+    }
+  }
+  expect(accepted == 0, "truncated, extended and bit-flipped frames rejected");
+
+  // Bad magic and unknown versions, with a valid CRC
+  TelemetryFrame frame = randomFrame(rng, TELEMETRY_FLAG_VOLTAGE, 0);
+  size_t len = TelemetryCodec::encode(frame, buffer, sizeof(buffer));
+  TelemetryFrame back;
+  int headers = 0;
+  const uint8_t bad[][2] = {{0xEB, 2}, {0x00, 2}, {0xEA, 0}, {0xEA, TELEMETRY_VERSION + 1}};
+  for (const uint8_t* header : bad) {
+    buffer[0] = header[0];
+    buffer[1] = header[1];
+    uint16_t crc = TelemetryCodec::crc16(buffer, len - 2);
+    buffer[len - 2] = crc & 0xFF;
+    buffer[len - 1] = crc >> 8;
+    headers += !TelemetryCodec::decode(buffer, len, back);
+  }
+  expect(headers == 4, "unknown magic and versions rejected");
+
+  // Over-long batch length with a valid CRC
+  frame = randomFrame(rng, TELEMETRY_FLAG_BATCH, TELEMETRY_BATCH_MAX);
+  len = TelemetryCodec::encode(frame, buffer, sizeof(buffer));
+  buffer[TELEMETRY_FRAME_SIZE - 2] = TELEMETRY_BATCH_MAX + 1;
+  uint16_t crc = TelemetryCodec::crc16(buffer, len - 2);
+  buffer[len - 2] = crc & 0xFF;
+  buffer[len - 1] = crc >> 8;
+  expect(!TelemetryCodec::decode(buffer, len, back), "batch longer than TELEMETRY_BATCH_MAX rejected");
+
+  // A version 1 frame: 20 bytes, sections ignored whatever the flags say
+  frame = randomFrame(rng, TELEMETRY_FLAG_VOLTAGE | TELEMETRY_FLAG_PF_ESTIMATED, 0);
+  TelemetryCodec::encode(frame, buffer, sizeof(buffer));
+  buffer[1] = 1;
+  crc = TelemetryCodec::crc16(buffer, TELEMETRY_FRAME_SIZE - 2);
+  buffer[TELEMETRY_FRAME_SIZE - 2] = crc & 0xFF;
+  buffer[TELEMETRY_FRAME_SIZE - 1] = crc >> 8;
+  bool v1 = TelemetryCodec::decode(buffer, TELEMETRY_FRAME_SIZE, back);
+  expect(v1 && back.flags == TELEMETRY_FLAG_PF_ESTIMATED && back.currentMa == frame.currentMa &&
+         back.voltageDeciVolts == 0, "version 1 frame decodes without sections");
+
+  int ackRejects = 0, ackTried = 0;
+  TelemetryAck ack = {0x12345678, 42};
+  uint8_t bytes[TELEMETRY_ACK_SIZE + 1];
+  TelemetryCodec::encodeAck(ack, bytes, sizeof(bytes));
+  for (size_t bit = 0; bit < TELEMETRY_ACK_SIZE * 8; bit++, ackTried++) {
+    bytes[bit / 8] ^= 1 << (bit % 8);
+    ackRejects += !TelemetryCodec::decodeAck(bytes, TELEMETRY_ACK_SIZE, ack);
+    bytes[bit / 8] ^= 1 << (bit % 8);
+  }
+  ackRejects += !TelemetryCodec::decodeAck(bytes, TELEMETRY_ACK_SIZE - 1, ack);
+  ackRejects += !TelemetryCodec::decodeAck(bytes, TELEMETRY_ACK_SIZE + 1, ack);
+  expect(ackRejects == ackTried + 2, "corrupted acknowledgements rejected");
+  printf("  %ld truncated, extended or bit-flipped frames: %ld accepted; %d/%d bad acknowledgements rejected\n", tried,
+         accepted, ackRejects, ackTried + 2);
+}
+
+static void checkSamples(std::mt19937& rng) {
+  printf("\nUnbatching:\n");
+  TelemetryFrame frame = randomFrame(rng, TELEMETRY_FLAG_BATCH, 4);
+  frame.sequence = 2;  // Batch sequence numbers wrap below zero
+  for (int i = 0; i < 4; i++) {
+    frame.batch[i].ageDeciSeconds = (4 - i) * 300;  // 2 min down to 30 s
+  }
+  int right = 0;
+  TelemetrySample sample;
+  for (uint8_t i = 0; i < TelemetryCodec::sampleCount(frame); i++) {
+    bool newest = i == frame.batchCount;
+    uint32_t age = newest ? 0 : frame.batch[i].ageDeciSeconds * 100UL;
+    right += TelemetryCodec::sampleAt(frame, i, 500000, sample) && sample.newest == newest &&
+             sample.sequence == (uint16_t)(2 - (4 - i)) && sample.timestamp == 500000 - age &&
+             sample.currentMa == (newest ? frame.currentMa : frame.batch[i].currentMa);
+  }
+  expect(right == 5, "samples oldest first, numbered and timed back from the header");
+  expect(!TelemetryCodec::sampleAt(frame, 5, 500000, sample), "index past the header sample fails");
+  expect(!TelemetryCodec::sampleAt(frame, 0, 60000, sample), "sample older than the receiver's clock fails");
+  printf("  %d/5 samples of a 4-sample batch placed\n", right);
+}
+
+// The packet the node sent before the binary frame: ArduinoJson's
+// {"id","i","p","pf","t"}, floats printed with up to 9 decimals and
+// trailing zeros dropped, as ArduinoJson 6 does
+static void appendFloat(std::string& out, double value) {
+  char text[32];
+  snprintf(text, sizeof(text), "%.9f", value);
+  char* end = text + strlen(text) - 1;
+  while (*end == '0') {
+    *end-- = '\0';
+  }
+  if (*end == '.') {
+    *end = '\0';
+  }
+  out += text;
+}
+
+static size_t jsonPacket(char* out, size_t capacity, float current, float power, float powerFactor, uint32_t millis) {
+  std::string json = "{\"id\":\"" NODE_ID "\",\"i\":";
+  appendFloat(json, current);
+  json += ",\"p\":";
+  appendFloat(json, power);
+  json += ",\"pf\":";
+  appendFloat(json, powerFactor);
+  json += ",\"t\":" + std::to_string(millis) + "}";
+  size_t len = json.size() < capacity ? json.size() : capacity - 1;
+  memcpy(out, json.c_str(), len + 1);
+  return len;
+}
+
+template <typename F>
+static double timeNanos(long repeats, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < repeats; i++) {
+    body(i);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / repeats;
+}
+
+static void compareWithJson(std::mt19937& rng) {
+  printf("\nAgainst the JSON packet:\n");
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  const int count = 4096;
+  std::vector<float> currents, powers, factors;
+  for (int i = 0; i < count; i++) {
+    float pf = 0.5f + 0.5f * unit(rng);
+    float current = 20 * unit(rng) * unit(rng);
+    currents.push_back(current);
+    factors.push_back(pf);
+    powers.push_back(current * 230 * pf);
+  }
+
+  char json[200];
+  size_t jsonBytes = 0;
+  for (int i = 0; i < count; i++) {
+    jsonBytes += jsonPacket(json, sizeof(json), currents[i], powers[i], factors[i], 1000 + i * 5000);
+  }
+  double jsonMean = (double)jsonBytes / count;
+  size_t continuous = TelemetryCodec::frameSize(TELEMETRY_FLAG_PF_ESTIMATED | TELEMETRY_FLAG_LINK);
+  size_t measured = TelemetryCodec::frameSize(TELEMETRY_FLAG_VOLTAGE | TELEMETRY_FLAG_HARMONICS | TELEMETRY_FLAG_LINK);
+  size_t batched = TelemetryCodec::frameSize(TELEMETRY_FLAG_BATCH | TELEMETRY_FLAG_LINK, TELEMETRY_BATCH_MAX);
+  printf("  JSON packet:              %5.1f bytes/sample (one sample per packet)\n", jsonMean);
+  printf("  frame, continuous node:   %5zu bytes/sample (%.1fx smaller)\n", continuous, jsonMean / continuous);
+  printf("  frame, voltage+harmonics: %5zu bytes/sample, with V, Hz, harmonics and THD\n", measured);
+  printf("  frame, full batch:        %5.1f bytes/sample (%d samples in %zu bytes)\n",
+         (double)batched / (TELEMETRY_BATCH_MAX + 1), TELEMETRY_BATCH_MAX + 1, batched);
+  expect(continuous < jsonMean, "binary frame smaller than the JSON packet");
+
+  // Host times; relative only
+  uint8_t buffer[TELEMETRY_FRAME_MAX];
+  volatile uint32_t sink = 0;
+  const long repeats = 1000000;
+  double jsonEncode = timeNanos(repeats / 10, [&](long i) {
+    int k = i % count;
+    sink = sink + jsonPacket(json, sizeof(json), currents[k], powers[k], factors[k], i);
+  });
+  double frameEncode = timeNanos(repeats, [&](long i) {
+    int k = i % count;
+    TelemetryFrame frame = TelemetryFrame();
+    frame.flags = TELEMETRY_FLAG_PF_ESTIMATED | TELEMETRY_FLAG_LINK;
+    frame.powerFactor = (uint8_t)(factors[k] * 100 + 0.5f);
+    frame.sequence = i;
+    frame.currentMa = (uint32_t)(currents[k] * 1000 + 0.5f);
+    frame.powerDeciWatts = (uint32_t)(powers[k] * 10 + 0.5f);
+    frame.transmission = i;
+    sink = sink + TelemetryCodec::encode(frame, buffer, sizeof(buffer));
+  });
+  size_t len = TelemetryCodec::encode(randomFrame(rng, TELEMETRY_FLAG_LINK, 0), buffer, sizeof(buffer));
+  double frameDecode = timeNanos(repeats, [&](long) {
+    TelemetryFrame frame;
+    sink = sink + TelemetryCodec::decode(buffer, len, frame);
+  });
+  printf("  encode: %6.1f ns frame, %6.1f ns JSON text (printf stand-in for ArduinoJson)\n", frameEncode, jsonEncode);
+  printf("  decode: %6.1f ns frame, CRC included\n", frameDecode);
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Telemetry frame codec (TelemetryCodec) ===\n");
+  printf("Version %d, %d to %d bytes, acknowledgements %d bytes\n\n", TELEMETRY_VERSION, TELEMETRY_FRAME_SIZE,
+         TELEMETRY_FRAME_MAX, TELEMETRY_ACK_SIZE);
+  std::mt19937 rng(options.seed);
+  checkLayout();
+  checkRoundTrip(rng, options);
+  checkRejects(rng);
+  checkSamples(rng);
+  compareWithJson(rng);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+// Host benchmark and accuracy check of the node's RMS kernel
+// (pio run -e native_bench).
+//
+// Compares the integer CycleWindow kernel with the float pipeline it
+// replaced: every sample converted to volts and amps against a one-shot
+// calibrated offset, stored as float and reduced with a float
+// multiply-accumulate. Both run over the same whole-cycle windows of
+// synthetic sine, distorted and DC-offset waveforms and are scored
+// against the analytic RMS; the DC cases calibrate the float offset at
+// mid-scale and then move the bias, as temperature or a re-clamped CT
+// would. The harmonic bank is timed separately, as the extra cost of the
+// same windows with it enabled (its accuracy is checked by the native
+// env's waveform_check). Host ns/sample are relative figures only; the
+// ESP32's FPU has no single-instruction divide, so the float path costs it
+// more than here. Exits non-zero if the integer kernel is out of tolerance.
+//
+//   .pio/build/native_bench/program [--windows N] [--seed N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "config.h"
+#include "cycle_window.h"
+#include "synthetic_waveform.h"
+
+#define BENCH_RMS_TOLERANCE 0.005  // Integer kernel vs analytic, relative
+#define BENCH_SETTLE_WINDOWS 40    // Tracker settling before scoring (8 s)
+
+// Same constants as the node's CurrentSensor
+#define BENCH_AMPS_PER_COUNT ((ADC_VREF / ADC_RESOLUTION) / SCT013_BURDEN_RESISTOR * SCT013_CURRENT_RATIO)
+
+struct BenchOptions {
+  int windows = 500;
+  uint32_t seed = 1;
+};
+
+struct BenchCase {
+  const char* name;
+  WaveformSpec wave;
+  float calibratedOffset;  // What the float pipeline's calibrateOffset() found
+};
+
+// The float pipeline the integer kernel replaced, parameters held in
+// memory as on the node so the compiler cannot fold the divisions
+struct FloatReference {
+  float offset;
+  float burdenResistor;
+  float currentRatio;
+  float adcVref;
+  float adcResolution;
+
+  float rms(const uint16_t* raw, float* samples, int count) const {
+    for (int i = 0; i < count; i++) {
+      float voltage = ((raw[i] - offset) / adcResolution) * adcVref;
+      samples[i] = (voltage / burdenResistor) * currentRatio;
+    }
+    float sumSquares = 0;
+    for (int i = 0; i < count; i++) {
+      sumSquares += samples[i] * samples[i];
+    }
+    return sqrt(sumSquares / count);
+  }
+};
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--windows") && hasValue) options.windows = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else {
+      fprintf(stderr, "usage: %s [--windows N] [--seed N]\n", argv[0]);
+      return false;
+    }
+  }
+  return options.windows > 0;
+}
+
+static WaveformSpec sine(double amplitude, double dcLevel, double noise) {
+  WaveformSpec wave;
+  wave.amplitude = amplitude;
+  wave.dcLevel = dcLevel;
+  wave.noise = noise;
+  return wave;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  WaveformSpec smps = sine(500, 2048, 1.5);  // Rectifier front end: odd harmonics
+  smps.harmonics[3] = 0.75;
+  smps.harmonics[5] = 0.45;
+  smps.harmonics[7] = 0.20;
+  WaveformSpec motor = sine(700, 2048, 1.0);
+  motor.harmonics[3] = 0.08;
+  motor.phase = 1.1;
+
+  BenchCase cases[] = {
+    {"sine 2 A", sine(820, 2048, 1.0), 2048},
+    {"sine 0.2 A", sine(82, 2048, 1.5), 2048},
+    {"distorted, rectifier", smps, 2048},
+    {"distorted, motor", motor, 2048},
+    {"DC offset -150 counts", sine(410, 1898, 1.0), 2048},
+    {"DC offset +300 counts", sine(410, 2348, 1.0), 2048},
+    {"DC offset, no load", sine(0, 1990, 1.0), 2048},
+  };
+
+  CycleWindow sizing(ADC_SAMPLE_RATE, MAINS_FREQUENCY, WINDOW_CYCLES);
+  const int windowLength = sizing.length();
+  FloatReference reference = {0, SCT013_BURDEN_RESISTOR, SCT013_CURRENT_RATIO, ADC_VREF, ADC_RESOLUTION};
+
+  printf("=== Node RMS kernel: integer vs float ===\n");
+  printf("%d-sample windows (%d cycles at %d Hz, %d Hz ADC), %d windows per case, after %d settling windows\n\n",
+         windowLength, WINDOW_CYCLES, MAINS_FREQUENCY, ADC_SAMPLE_RATE, options.windows, BENCH_SETTLE_WINDOWS);
+  printf("%-24s %9s %18s %18s %12s %12s %12s\n", "case", "true A", "int A (err %)", "float A (err %)", "int ns/smp",
+         "float ns/smp", "+harm ns/smp");
+
+  int failures = 0;
+  double intTotal = 0, floatTotal = 0, bankTotal = 0;
+  std::vector<uint16_t> raw((size_t)windowLength * options.windows);
+  std::vector<float> samples(windowLength);
+
+  for (const BenchCase& c : cases) {
+    SyntheticWaveform wave(c.wave, ADC_SAMPLE_RATE, options.seed);
+    double truth = (c.wave.amplitude > 0 ? wave.acRms() : sqrt(c.wave.noise * c.wave.noise + 1.0 / 12)) *
+                   BENCH_AMPS_PER_COUNT;
+
+    // Let the offset tracker settle as it would after power-up. The RMS
+    // kernel alone is what the float pipeline did
+    CycleWindow window(ADC_SAMPLE_RATE, MAINS_FREQUENCY, WINDOW_CYCLES, false);
+    CycleWindow withBank(ADC_SAMPLE_RATE, MAINS_FREQUENCY, WINDOW_CYCLES, true);
+    std::vector<uint16_t> settle(windowLength);
+    for (int w = 0; w < BENCH_SETTLE_WINDOWS; w++) {
+      wave.fill(settle.data(), windowLength);
+      window.add(settle.data(), windowLength);
+      window.take();
+      withBank.add(settle.data(), windowLength);
+      withBank.take();
+    }
+    wave.fill(raw.data(), raw.size());
+
+    // Integer kernel, exactly as CurrentSensor feeds it (plus the one scale per window)
+    double intWorst = 0, intLast = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int w = 0; w < options.windows; w++) {
+      window.add(&raw[(size_t)w * windowLength], windowLength);
+      intLast = window.take().rms * (float)BENCH_AMPS_PER_COUNT;
+      intWorst = fmax(intWorst, fabs(intLast - truth));
+    }
+    double intSeconds = secondsSince(start);
+
+    // Same kernel with the harmonic bank
+    volatile float bankThd = 0;  // Keeps the bank's results live
+    start = std::chrono::steady_clock::now();
+    for (int w = 0; w < options.windows; w++) {
+      withBank.add(&raw[(size_t)w * windowLength], windowLength);
+      bankThd += withBank.take().thd;
+    }
+    double bankSeconds = secondsSince(start) - intSeconds;
+
+    // Float pipeline
+    reference.offset = c.calibratedOffset;
+    double floatWorst = 0, floatLast = 0;
+    start = std::chrono::steady_clock::now();
+    for (int w = 0; w < options.windows; w++) {
+      floatLast = reference.rms(&raw[(size_t)w * windowLength], samples.data(), windowLength);
+      floatWorst = fmax(floatWorst, fabs(floatLast - truth));
+    }
+    double floatSeconds = secondsSince(start);
+
+    double intNs = intSeconds * 1e9 / raw.size();
+    double floatNs = floatSeconds * 1e9 / raw.size();
+    double bankNs = bankSeconds * 1e9 / raw.size();
+    intTotal += intSeconds;
+    floatTotal += floatSeconds;
+    bankTotal += bankSeconds;
+
+    // No-load case is scored in counts: relative error of the noise floor means little
+    bool ok = c.wave.amplitude > 0 ? intWorst <= BENCH_RMS_TOLERANCE * truth : intWorst <= BENCH_AMPS_PER_COUNT;
+    printf("%-24s %9.4f %9.4f (%6.3f) %9.4f (%6.2f) %12.2f %12.2f %12.2f %s\n", c.name, truth, intLast,
+           100 * intWorst / truth, floatLast, 100 * floatWorst / truth, intNs, floatNs, bankNs, ok ? "" : "FAIL");
+    if (!ok) {
+      failures++;
+    }
+  }
+
+  printf("\nInteger kernel %.2fx the float pipeline's speed on this host (%.1f vs %.1f ms total)\n",
+         floatTotal / fmax(intTotal, 1e-12), intTotal * 1000, floatTotal * 1000);
+  double windowsRun = (double)options.windows * (sizeof(cases) / sizeof(cases[0]));
+  double windowMs = 1000.0 * WINDOW_CYCLES / MAINS_FREQUENCY;
+  printf("Harmonic bank (%d odd orders) adds %.1f us per window on this host, %.3f%% of the %.0f ms window\n",
+         CYCLE_WINDOW_HARMONICS, bankTotal * 1e6 / windowsRun, 100 * bankTotal * 1e3 / windowsRun / windowMs, windowMs);
+  printf("%d case(s) out of tolerance (integer kernel within %.1f%% of the true RMS)\n", failures,
+         BENCH_RMS_TOLERANCE * 100);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,519 @@
+// Native check of the acknowledged link (pio run -e native_link).
+//
+// A continuous-mode node (SampleBatch as the retransmit buffer, numbered
+// and acknowledged as in src/main.cpp) talks to a receiver doing what the
+// main auditor does (SequenceTracker over sample numbers and over the
+// transmission counter, an acknowledgement per valid frame) through an
+// in-memory link that drops, duplicates and delays frames both ways.
+// Checks that no sample is accepted twice, that every sample the node
+// measured arrives unless the node itself gave up on it, that the
+// receiver's missing count matches what never arrived and that its frame
+// loss estimate matches the link. Sequence numbers start near the wrap
+// and the node restarts midway. Then more nodes than the radio has peer
+// entries share one receiver, which acknowledges through AckPeerTable as
+// sendAcknowledgement() in the main auditor does: every frame must be
+// acknowledged and every node's retransmit buffer drained. Exits non-zero
+// on any failure.
+//
+//   .pio/build/native_link/program [--seed N] [--sends N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <vector>
+#include "ack_peers.h"
+#include "config.h"
+#include "sample_batch.h"
+#include "sequence_tracker.h"
+#include "telemetry_frame.h"
+
+#define CHECK_LINK_DELAY_MS 30        // Longest normal flight time
+#define CHECK_LATE_DELAY_MS 7000      // Held-up frames arrive after the next send
+#define CHECK_LOSS_TOLERANCE 0.03     // Estimated vs actual frame loss
+#define CHECK_NODES 30                // Nodes sharing one receiver
+#define CHECK_RADIO_PEERS 20          // ESP_NOW_MAX_TOTAL_PEER_NUM
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  int sends = 5000;
+};
+
+struct LinkConditions {
+  const char* name;
+  double loss;       // Each frame, each way
+  double duplicate;  // Delivered twice
+  double late;       // Held back past the next send
+};
+
+// One frame in flight
+struct Packet {
+  uint32_t deliverAt;
+  bool toNode;  // Acknowledgement
+  std::vector<uint8_t> bytes;
+};
+
+// Drops, duplicates and delays frames; everything else arrives in order
+class LossyLink {
+private:
+  std::mt19937& rng;
+  LinkConditions conditions;
+  std::vector<Packet> inFlight;
+
+  double uniform() { return std::uniform_real_distribution<double>(0, 1)(rng); }
+
+public:
+  uint32_t dataSent = 0;
+  uint32_t dataDropped = 0;
+
+  LossyLink(std::mt19937& generator, const LinkConditions& c) : rng(generator), conditions(c) {}
+
+  void send(uint32_t now, bool toNode, const uint8_t* data, size_t len) {
+    if (!toNode) {
+      dataSent++;
+    }
+    if (uniform() < conditions.loss) {
+      if (!toNode) {
+        dataDropped++;
+      }
+      return;
+    }
+    int copies = uniform() < conditions.duplicate ? 2 : 1;
+    for (int i = 0; i < copies; i++) {
+      uint32_t delay = 1 + rng() % CHECK_LINK_DELAY_MS;
+      if (uniform() < conditions.late) {
+        delay += CHECK_LATE_DELAY_MS;
+      }
+      inFlight.push_back({now + delay, toNode, std::vector<uint8_t>(data, data + len)});
+    }
+  }
+
+  // Next packet due by now, earliest first
+  bool receive(uint32_t now, Packet& packet) {
+    int best = -1;
+    for (size_t i = 0; i < inFlight.size(); i++) {
+      if ((int32_t)(now - inFlight[i].deliverAt) >= 0 &&
+          (best < 0 || (int32_t)(inFlight[i].deliverAt - inFlight[best].deliverAt) < 0)) {
+        best = i;
+      }
+    }
+    if (best < 0) {
+      return false;
+    }
+    packet = inFlight[best];
+    inFlight.erase(inFlight.begin() + best);
+    return true;
+  }
+};
+
+// What the node measured, by sequence number
+struct Truth {
+  uint32_t currentMa;
+  uint32_t powerDeciWatts;
+  uint8_t powerFactor;
+  bool abandoned;  // Dropped from the full buffer, acknowledged or not
+};
+
+// Main auditor side
+struct Receiver {
+  SequenceTracker samples;
+  SequenceTracker frames;
+  std::map<uint16_t, int> accepted;  // Since the node's last restart
+  uint32_t arrivals = 0;             // Samples including repeats
+  uint32_t acksSent = 0;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+  if (!ok) {
+    if (failures < 10) {
+      printf("  FAIL: %s\n", what);
+    }
+    failures++;
+  }
+}
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--sends") && hasValue) options.sends = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--sends N]\n", argv[0]);
+      return false;
+    }
+  }
+  return options.sends > 0;
+}
+
+static void receiveFrame(Receiver& rx, LossyLink& link, uint32_t now, const Packet& packet,
+                         const std::map<uint16_t, Truth>& truth) {
+  TelemetryFrame frame;
+  if (!TelemetryCodec::decode(packet.bytes.data(), packet.bytes.size(), frame)) {
+    expect(false, "delivered frame decodes");
+    return;
+  }
+  expect(frame.flags & TELEMETRY_FLAG_LINK, "frame carries the transmission counter");
+  rx.frames.observe(frame.transmission);
+
+  for (uint8_t i = 0; i < TelemetryCodec::sampleCount(frame); i++) {
+    TelemetrySample sample;
+    if (!TelemetryCodec::sampleAt(frame, i, now, sample)) {
+      expect(false, "sample time on the receiver clock");
+      continue;
+    }
+    rx.arrivals++;
+    SequenceResult result = rx.samples.observe(sample.sequence);
+    if (result == SEQUENCE_DUPLICATE) {
+      continue;
+    }
+    if (result == SEQUENCE_RESTART) {
+      rx.accepted.clear();
+    }
+    expect(++rx.accepted[sample.sequence] == 1, "no sample accepted twice");
+    auto t = truth.find(sample.sequence);
+    expect(t != truth.end() && t->second.currentMa == sample.currentMa &&
+             t->second.powerDeciWatts == sample.powerDeciWatts && t->second.powerFactor == sample.powerFactor,
+           "accepted sample matches the measurement");
+  }
+
+  uint8_t ack[TELEMETRY_ACK_SIZE];
+  size_t len = TelemetryCodec::encodeAck({frame.nodeHash, frame.sequence}, ack, sizeof(ack));
+  link.send(now, true, ack, len);
+  rx.acksSent++;
+}
+
+// One node life: sends measurements through the link, lets everything in
+// flight land, then compares what arrived with what was measured
+static void runLife(std::mt19937& rng, LossyLink& link, Receiver& rx, SampleBatch& pending,
+                    uint16_t firstSequence, int sends, uint32_t& now, uint32_t& resent) {
+  const uint32_t nodeHash = TelemetryCodec::hashNodeId(NODE_ID);
+  pending.reset(firstSequence, rng());
+  std::map<uint16_t, Truth> truth;
+  uint32_t ackReceived = 0;
+  uint32_t missingBefore = rx.samples.missingCount();
+
+  for (int n = 0; n < sends + 4; n++) {
+    uint32_t sendAt = now + TRANSMIT_INTERVAL_MS;
+    for (; (int32_t)(now - sendAt) < 0; now += 10) {
+      Packet packet;
+      while (link.receive(now, packet)) {
+        if (packet.toNode) {
+          TelemetryAck ack;
+          if (TelemetryCodec::decodeAck(packet.bytes.data(), packet.bytes.size(), ack) && ack.nodeHash == nodeHash) {
+            ackReceived = 0x10000 | ack.sequence;
+          }
+        } else {
+          receiveFrame(rx, link, now, packet, truth);
+        }
+      }
+    }
+    if (n >= sends) {
+      continue;  // Drain only
+    }
+
+    // As sendDataToMaster()
+    if (ackReceived) {
+      pending.acknowledge(ackReceived & 0xFFFF);
+      ackReceived = 0;
+    }
+    TelemetryFrame frame = {};
+    frame.flags = TELEMETRY_FLAG_PF_ESTIMATED | TELEMETRY_FLAG_LINK;
+    frame.nodeHash = nodeHash;
+    frame.powerFactor = 40 + rng() % 60;
+    frame.currentMa = rng() % 20000;
+    frame.powerDeciWatts = rng() % 46000;
+    frame.sequence = pending.takeSequence();
+    frame.transmission = pending.takeTransmission();
+    truth[frame.sequence] = {frame.currentMa, frame.powerDeciWatts, frame.powerFactor, false};
+
+    uint8_t data[TELEMETRY_FRAME_MAX];
+    size_t len = pending.encode(frame, now, data, sizeof(data));
+    expect(len > 0, "frame encodes");
+    resent += pending.size();
+    link.send(now, false, data, len);
+
+    if (pending.size() == SAMPLE_BATCH_MAX) {
+      truth[(uint16_t)(frame.sequence - SAMPLE_BATCH_MAX)].abandoned = true;
+    }
+    pending.push(frame, now);
+  }
+
+  // Every measurement arrived unless the node gave up on it (or it is
+  // still unacknowledged); the ones that never came before the newest
+  // received are exactly the receiver's missing count
+  uint32_t never = 0;
+  uint32_t neverBeforeNewest = 0;
+  uint16_t newest = rx.samples.lastSequence() - firstSequence;
+  for (const auto& entry : truth) {
+    bool arrived = rx.accepted.count(entry.first) > 0;
+    bool held = (uint16_t)(pending.nextSequence - entry.first) <= pending.size();
+    if (!arrived) {
+      never++;
+      neverBeforeNewest += (uint16_t)(entry.first - firstSequence) < newest;
+      expect(entry.second.abandoned || held, "measurement delivered unless abandoned");
+    }
+  }
+  expect(rx.accepted.size() + never == truth.size(), "accounting adds up");
+  expect(rx.samples.missingCount() - missingBefore == neverBeforeNewest, "missing count matches what never came");
+}
+
+static void checkLink(const CheckOptions& options, const LinkConditions& conditions) {
+  std::mt19937 rng(options.seed);
+  LossyLink link(rng, conditions);
+  Receiver rx;
+  SampleBatch pending;
+  uint32_t now = 1000;
+  uint32_t resent = 0;
+
+  // Numbering wraps in the first life; the restart lands far from it
+  runLife(rng, link, rx, pending, 0xFFFF - options.sends / 4, options.sends / 2, now, resent);
+  runLife(rng, link, rx, pending, 0x4000, options.sends - options.sends / 2, now, resent);
+
+  expect(rx.samples.restartCount() == 1, "node restart detected once");
+  expect(rx.samples.duplicateCount() == rx.arrivals - rx.samples.receivedCount(), "every repeat counted");
+  expect(conditions.loss > 0 || conditions.duplicate > 0 || rx.samples.duplicateCount() == 0, "no repeats on a clean link");
+  expect(conditions.loss > 0 || rx.samples.missingCount() == 0, "nothing missing on a clean link");
+
+  double actual = link.dataSent ? (double)link.dataDropped / link.dataSent : 0;
+  uint32_t frames = rx.frames.receivedCount() + rx.frames.missingCount();
+  double estimated = frames ? (double)rx.frames.missingCount() / frames : 0;
+  expect(fabs(estimated - actual) <= CHECK_LOSS_TOLERANCE, "frame loss estimate tracks the link");
+  expect(rx.frames.lossRate() >= 0 && rx.frames.lossRate() <= 1, "window loss rate in range");
+
+  printf("%-18s %6lu %7lu %8lu %7lu %6lu %9.1f%% %8.1f%%\n", conditions.name, (unsigned long)link.dataSent,
+         (unsigned long)rx.samples.receivedCount(), (unsigned long)resent, (unsigned long)rx.samples.duplicateCount(),
+         (unsigned long)rx.samples.missingCount(), actual * 100, estimated * 100);
+}
+
+static void checkTracker() {
+  SequenceTracker t;
+  expect(t.observe(10) == SEQUENCE_NEW, "first number is new");
+  expect(t.observe(10) == SEQUENCE_DUPLICATE, "repeat is a duplicate");
+  expect(t.observe(13) == SEQUENCE_NEW && t.missingCount() == 2, "gap counted missing");
+  expect(t.observe(11) == SEQUENCE_LATE && t.missingCount() == 1, "late arrival fills the gap");
+  expect(t.observe(11) == SEQUENCE_DUPLICATE, "late repeat is a duplicate");
+  expect(t.observe(8) == SEQUENCE_LATE && t.missingCount() == 2, "before the first number widens the window");
+  expect(fabsf(t.lossRate() - 2.0f / 6) < 1e-6f, "window loss rate");
+
+  t.reset();
+  t.observe(0xFFFE);
+  expect(t.observe(1) == SEQUENCE_NEW && t.missingCount() == 2, "gap across the wrap");
+  expect(t.observe(0xFFFF) == SEQUENCE_LATE, "late across the wrap");
+  expect(t.observe(1 + SEQUENCE_RESTART_GAP + 1) == SEQUENCE_RESTART, "far jump ahead is a restart");
+  expect(t.observe(20) == SEQUENCE_RESTART && t.restartCount() == 2, "far jump back is a restart");
+  expect(t.observe(20 + SEQUENCE_WINDOW) == SEQUENCE_NEW && t.missingCount() == 1 + SEQUENCE_WINDOW - 1,
+         "gap as wide as the window");
+  expect(t.observe(20) == SEQUENCE_RESTART, "behind the window is a restart");
+
+  // Acknowledgements: round trip, corruption, and only the node's own
+  uint8_t ack[TELEMETRY_ACK_SIZE];
+  TelemetryAck decoded;
+  expect(TelemetryCodec::encodeAck({0x12345678, 0xBEEF}, ack, sizeof(ack)) == TELEMETRY_ACK_SIZE, "ack encodes");
+  expect(TelemetryCodec::decodeAck(ack, sizeof(ack), decoded) && decoded.nodeHash == 0x12345678 &&
+           decoded.sequence == 0xBEEF,
+         "ack round-trips");
+  ack[6] ^= 1;
+  expect(!TelemetryCodec::decodeAck(ack, sizeof(ack), decoded), "corrupt ack rejected");
+  expect(!TelemetryCodec::decodeAck(ack, sizeof(ack) - 1, decoded), "short ack rejected");
+
+  // The retransmit buffer ignores acknowledgements outside what it holds
+  SampleBatch batch;
+  batch.reset(0xFFFE);
+  TelemetryFrame frame = {};
+  for (int i = 0; i < 4; i++) {
+    frame.sequence = batch.takeSequence();
+    batch.push(frame, i * 1000);
+  }
+  expect(batch.acknowledge(0xFFFD) == 0 && batch.acknowledge(2) == 0, "stale and future acks drop nothing");
+  expect(batch.acknowledge(0xFFFF) == 2 && batch.size() == 2, "ack drops up to its sequence");
+  expect(batch.acknowledge(1) == 2 && batch.size() == 0, "ack across the wrap");
+}
+
+// The radio's peer list as esp_now_add_peer()/esp_now_send() treat it:
+// a fixed number of entries, unicast only to a peer
+struct PeerRadio {
+  std::vector<std::vector<uint8_t>> peers;
+  uint32_t addFailures = 0;
+  uint32_t sendFailures = 0;
+  size_t most = 0;
+
+  bool exists(const uint8_t* mac) const {
+    return std::find(peers.begin(), peers.end(), std::vector<uint8_t>(mac, mac + ACK_PEER_MAC_SIZE)) != peers.end();
+  }
+  bool add(const uint8_t* mac) {
+    if (peers.size() >= CHECK_RADIO_PEERS || exists(mac)) {
+      addFailures++;
+      return false;
+    }
+    peers.push_back(std::vector<uint8_t>(mac, mac + ACK_PEER_MAC_SIZE));
+    most = std::max(most, peers.size());
+    return true;
+  }
+  void remove(const uint8_t* mac) {
+    peers.erase(std::remove(peers.begin(), peers.end(), std::vector<uint8_t>(mac, mac + ACK_PEER_MAC_SIZE)),
+                peers.end());
+  }
+  bool send(const uint8_t* mac) {
+    if (!exists(mac)) {
+      sendFailures++;
+      return false;
+    }
+    return true;
+  }
+};
+
+// One of many nodes heard by the same receiver
+struct RadioNode {
+  uint8_t mac[ACK_PEER_MAC_SIZE];
+  uint32_t nodeHash;
+  SampleBatch pending;
+};
+
+// As sendAcknowledgement() in the main auditor; false if the ack never left
+static bool acknowledge(AckPeerTable& table, PeerRadio& radio, const uint8_t* mac) {
+  uint8_t evicted[ACK_PEER_MAC_SIZE];
+  AckPeerResult slot = table.use(mac, evicted);
+  if (slot == ACK_PEER_REPLACED) {
+    radio.remove(evicted);
+  }
+  if (slot != ACK_PEER_KNOWN && !radio.exists(mac) && !radio.add(mac)) {
+    table.forget(mac);
+    return false;
+  }
+  return radio.send(mac);
+}
+
+// As deleting a wireless device in the main auditor
+static void deleteNode(AckPeerTable& table, PeerRadio& radio, const uint8_t* mac) {
+  radio.remove(mac);
+  table.forget(mac);
+}
+
+static void checkManyNodes(const CheckOptions& options) {
+  // Least recently used goes first, and a refused peer frees its slot
+  AckPeerTable table;
+  uint8_t mac[ACK_PEER_MAC_SIZE] = {0x24, 0x6F, 0x28, 0, 0, 0};
+  uint8_t evicted[ACK_PEER_MAC_SIZE];
+  for (int i = 0; i < ACK_PEER_SLOTS; i++) {
+    mac[5] = i;
+    expect(table.use(mac, evicted) == ACK_PEER_ADDED, "free slot taken");
+  }
+  mac[5] = 0;
+  expect(table.use(mac, evicted) == ACK_PEER_KNOWN, "known peer reused");
+  mac[5] = ACK_PEER_SLOTS;
+  expect(table.use(mac, evicted) == ACK_PEER_REPLACED && evicted[5] == 1 && table.evictionCount() == 1,
+         "least recently used peer evicted");
+  table.forget(mac);
+  expect(!table.contains(mac) && table.size() == ACK_PEER_SLOTS - 1, "refused peer forgotten");
+  expect(table.use(mac, evicted) == ACK_PEER_ADDED, "forgotten slot reused");
+
+  // A deleted node that keeps sending is acknowledged again
+  AckPeerTable deletedTable;
+  PeerRadio deletedRadio;
+  mac[5] = 0x40;
+  expect(acknowledge(deletedTable, deletedRadio, mac), "node acknowledged before it is deleted");
+  deleteNode(deletedTable, deletedRadio, mac);
+  expect(acknowledge(deletedTable, deletedRadio, mac) && deletedRadio.sendFailures == 0,
+         "deleted node acknowledged when it resends");
+
+  // Nodes come and go in random order; each round a few stay quiet so
+  // the ones coming back have been evicted meanwhile
+  std::mt19937 rng(options.seed);
+  std::vector<RadioNode> nodes(CHECK_NODES);
+  for (int i = 0; i < CHECK_NODES; i++) {
+    char nodeId[16];
+    snprintf(nodeId, sizeof(nodeId), "NODE_%02d", i + 1);
+    memcpy(nodes[i].mac, mac, sizeof(mac));
+    nodes[i].mac[4] = 0x10;
+    nodes[i].mac[5] = i;
+    nodes[i].nodeHash = TelemetryCodec::hashNodeId(nodeId);
+    nodes[i].pending.reset(rng(), rng());
+  }
+  table.reset();
+  PeerRadio radio;
+  uint32_t now = 1000;
+  uint32_t frames = 0;
+  uint32_t acked = 0;
+  int rounds = std::max(1, options.sends / 50);
+  std::vector<int> order(CHECK_NODES);
+  for (int i = 0; i < CHECK_NODES; i++) {
+    order[i] = i;
+  }
+
+  for (int round = 0; round < rounds; round++) {
+    std::shuffle(order.begin(), order.end(), rng);
+    for (int i : order) {
+      RadioNode& node = nodes[i];
+      if (rng() % 4 == 0) {
+        continue;
+      }
+      TelemetryFrame frame = {};
+      frame.flags = TELEMETRY_FLAG_PF_ESTIMATED | TELEMETRY_FLAG_LINK;
+      frame.nodeHash = node.nodeHash;
+      frame.currentMa = rng() % 20000;
+      frame.sequence = node.pending.takeSequence();
+      frame.transmission = node.pending.takeTransmission();
+      uint8_t data[TELEMETRY_FRAME_MAX];
+      size_t len = node.pending.encode(frame, now, data, sizeof(data));
+      node.pending.push(frame, now);
+      frames++;
+
+      TelemetryFrame received;
+      expect(len > 0 && TelemetryCodec::decode(data, len, received), "frame from a shared receiver's node decodes");
+      if (!acknowledge(table, radio, node.mac)) {
+        continue;
+      }
+      uint8_t ack[TELEMETRY_ACK_SIZE];
+      TelemetryAck decoded;
+      size_t ackLen = TelemetryCodec::encodeAck({received.nodeHash, received.sequence}, ack, sizeof(ack));
+      if (TelemetryCodec::decodeAck(ack, ackLen, decoded) && decoded.nodeHash == node.nodeHash) {
+        node.pending.acknowledge(decoded.sequence);
+        acked++;
+      }
+      expect(node.pending.size() == 0, "acknowledged node holds nothing back");
+    }
+    now += TRANSMIT_INTERVAL_MS;
+  }
+
+  expect(acked == frames, "every frame acknowledged");
+  expect(radio.addFailures == 0 && radio.sendFailures == 0, "radio never refused a peer or an ack");
+  expect(radio.most <= CHECK_RADIO_PEERS && table.size() <= ACK_PEER_SLOTS, "peer list within the radio's limit");
+  expect(table.evictionCount() > 0, "peers evicted and re-added");
+
+  printf("\n%d nodes, %d-entry peer list: %lu frames, %lu acknowledged, %lu evictions, %lu refused\n", CHECK_NODES,
+         CHECK_RADIO_PEERS, (unsigned long)frames, (unsigned long)acked, (unsigned long)table.evictionCount(),
+         (unsigned long)(radio.addFailures + radio.sendFailures));
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  printf("=== Acknowledged link (SampleBatch <-> lossy link <-> SequenceTracker) ===\n");
+  printf("%d sends every %d ms per run, restart halfway\n\n", options.sends, TRANSMIT_INTERVAL_MS);
+  printf("%-18s %6s %7s %8s %7s %6s %10s %9s\n", "link", "frames", "samples", "resent", "repeats", "lost",
+         "frame loss", "estimate");
+  const LinkConditions links[] = {
+    {"clean", 0, 0, 0},
+    {"10% loss", 0.10, 0, 0},
+    {"30% loss", 0.30, 0, 0},
+    {"30% loss, dup", 0.30, 0.05, 0},
+    {"20% loss, late", 0.20, 0.02, 0.03},
+    {"60% loss", 0.60, 0.02, 0.02},
+  };
+  for (const LinkConditions& link : links) {
+    checkLink(options, link);
+  }
+  checkTracker();
+  checkManyNodes(options);
+
+  printf("\n%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
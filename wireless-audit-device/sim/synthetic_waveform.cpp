@@ -0,0 +1,40 @@
+#include "synthetic_waveform.h"
+#include <math.h>
+
+SyntheticWaveform::SyntheticWaveform(const WaveformSpec& waveform, double rate, uint32_t seed)
+    : spec(waveform), sampleRate(rate), index(0), rng(seed), gaussian(0.0, 1.0) {}
+
+double SyntheticWaveform::value(double t) const {
+  double w = 2 * M_PI * spec.frequency * t;
+  double v = spec.dcLevel + spec.amplitude * sin(w + spec.phase);
+  for (int h = 2; h <= SYNTH_MAX_HARMONIC; h++) {
+    if (spec.harmonics[h] != 0) {
+      v += spec.amplitude * spec.harmonics[h] * sin(h * (w + spec.phase));
+    }
+  }
+  return v;
+}
+
+uint16_t SyntheticWaveform::next() {
+  double v = value(index++ / sampleRate);
+  if (spec.noise > 0) {
+    v += spec.noise * gaussian(rng);
+  }
+  long counts = lround(v);
+  return (uint16_t)(counts < 0 ? 0 : counts > 4095 ? 4095 : counts);
+}
+
+void SyntheticWaveform::fill(uint16_t* samples, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    samples[i] = next();
+  }
+}
+
+double SyntheticWaveform::acRms() const {
+  double squares = 1.0;
+  for (int h = 2; h <= SYNTH_MAX_HARMONIC; h++) {
+    squares += spec.harmonics[h] * spec.harmonics[h];
+  }
+  // Rounding to integer counts adds 1/12 count^2 of noise power
+  return sqrt(spec.amplitude * spec.amplitude * squares / 2 + spec.noise * spec.noise + 1.0 / 12);
+}
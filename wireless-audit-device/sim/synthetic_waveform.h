@@ -0,0 +1,41 @@
+#ifndef SYNTHETIC_WAVEFORM_H
+#define SYNTHETIC_WAVEFORM_H
+
+#include <stdint.h>
+#include <random>
+
+#define SYNTH_MAX_HARMONIC 15
+
+// Mains waveform as the ADC would see it, in raw counts
+struct WaveformSpec {
+  double frequency = 50.0;     // Hz
+  double amplitude = 0.0;      // Fundamental peak (counts)
+  double phase = 0.0;          // Fundamental phase (radians)
+  double harmonics[SYNTH_MAX_HARMONIC + 1] = {};  // Peak of harmonic h relative to the fundamental
+  double dcLevel = 2048.0;     // Bias point (counts)
+  double noise = 0.0;          // Gaussian noise sigma (counts)
+};
+
+// Sample generator: analog value plus 12-bit quantised, clipped samples
+class SyntheticWaveform {
+private:
+  WaveformSpec spec;
+  double sampleRate;
+  uint64_t index;
+  std::mt19937 rng;
+  std::normal_distribution<double> gaussian;
+
+public:
+  SyntheticWaveform(const WaveformSpec& waveform, double rate, uint32_t seed);
+
+  double value(double t) const;  // Noise-free analog level at time t (s)
+  uint16_t next();               // Next ADC sample
+  void fill(uint16_t* samples, size_t n);
+  void skip(uint64_t samples) { index += samples; }
+
+  // Expected RMS of the AC part in counts, noise included
+  double acRms() const;
+  const WaveformSpec& getSpec() const { return spec; }
+};
+
+#endif
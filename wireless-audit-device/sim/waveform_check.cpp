@@ -0,0 +1,384 @@
+// Native check of the node's sampling kernel (pio run -e native).
+//
+// Feeds synthetic CT waveforms through CycleWindow in DMA-buffer-sized
+// blocks, exactly as CurrentSensor::update() does on the device, and
+// compares each window against the analytic RMS and DC level (crest
+// factor is reported alongside; noise inflates the peak). The old
+// 100-sample busy-wait window (half a cycle at 10 kHz) is measured on the
+// same waveforms for comparison.
+//
+// A second table pairs current with a voltage channel at known phase
+// shifts, distortion and line frequencies, each voltage sample taken half
+// a sample period after its current sample as the interleaved ADC does,
+// and checks real power, PF, RMS voltage and frequency. A third runs
+// waveforms with known odd harmonics through the harmonic bank and checks
+// each order against its analytic level and the THD. Exits non-zero if
+// any case is out of tolerance.
+//
+//   .pio/build/native/program [--seed N] [--windows N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include "config.h"
+#include "cycle_window.h"
+#include "synthetic_waveform.h"
+
+#define CHECK_RMS_TOLERANCE 0.01   // Relative
+#define CHECK_DC_TOLERANCE 0.005   // Of the fundamental peak; off-nominal mains leaks a partial cycle
+#define CHECK_PF_TOLERANCE 0.01    // Absolute
+#define CHECK_POWER_TOLERANCE 0.01 // Of the apparent power
+#define CHECK_FREQ_TOLERANCE 0.02  // Hz
+#define CHECK_HARMONIC_TOLERANCE 0.005  // Of the fundamental, per order
+#define CHECK_THD_TOLERANCE 0.01   // Absolute (1 percentage point)
+
+struct CheckOptions {
+  uint32_t seed = 1;
+  int windows = 50;
+};
+
+struct CheckCase {
+  const char* name;
+  uint32_t mainsHz;   // What the node is configured for
+  WaveformSpec wave;
+};
+
+struct PowerCase {
+  const char* name;
+  uint32_t mainsHz;
+  WaveformSpec current;
+  WaveformSpec voltage;
+};
+
+static bool parseOptions(int argc, char** argv, CheckOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--seed") && hasValue) options.seed = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--windows") && hasValue) options.windows = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--seed N] [--windows N]\n", argv[0]);
+      return false;
+    }
+  }
+  return options.windows > 0;
+}
+
+static WaveformSpec sine(double frequency, double amplitude, double dcLevel, double noise) {
+  WaveformSpec wave;
+  wave.frequency = frequency;
+  wave.amplitude = amplitude;
+  wave.dcLevel = dcLevel;
+  wave.noise = noise;
+  return wave;
+}
+
+// Crest factor of the noise-free waveform, from one finely sampled period
+static double expectedCrest(const SyntheticWaveform& wave) {
+  const WaveformSpec& spec = wave.getSpec();
+  double peak = 0;
+  for (int i = 0; i < 10000; i++) {
+    peak = std::max(peak, fabs(wave.value(i / (10000.0 * spec.frequency)) - spec.dcLevel));
+  }
+  return peak / wave.acRms();
+}
+
+// Worst relative RMS error of the legacy readCurrent(): 100 samples at
+// 10 kHz from a random point in the cycle, around a perfect offset
+static double legacyWorstError(const WaveformSpec& wave, int trials, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> start(0.0, 1.0);
+  SyntheticWaveform reference(wave, 10000, seed);
+  double expected = reference.acRms();
+  double worst = 0;
+  for (int t = 0; t < trials; t++) {
+    double t0 = start(rng);
+    double sumSquares = 0;
+    for (int i = 0; i < 100; i++) {
+      double d = lround(reference.value(t0 + i / 10000.0)) - wave.dcLevel;
+      sumSquares += d * d;
+    }
+    worst = std::max(worst, fabs(sqrt(sumSquares / 100) - expected) / expected);
+  }
+  return worst;
+}
+
+// Mean of v*i and the voltage RMS of the noise-free waveforms over one
+// finely sampled period (the reference for real power and PF)
+static void expectedPower(const SyntheticWaveform& current, const SyntheticWaveform& voltage, double& power) {
+  double f = current.getSpec().frequency;
+  double sum = 0;
+  const int steps = 20000;
+  for (int k = 0; k < steps; k++) {
+    double t = k / (steps * f);
+    sum += (current.value(t) - current.getSpec().dcLevel) * (voltage.value(t) - voltage.getSpec().dcLevel);
+  }
+  power = sum / steps;
+}
+
+static int checkPower(const CheckOptions& options) {
+  WaveformSpec line = sine(50, 1200, 2030, 1.0);
+
+  WaveformSpec rectifier = sine(50, 500, 2048, 1.5);
+  rectifier.harmonics[3] = 0.75;
+  rectifier.harmonics[5] = 0.45;
+  rectifier.harmonics[7] = 0.20;
+
+  WaveformSpec lagging30 = sine(50, 820, 2048, 1.0);
+  lagging30.phase = -M_PI / 6;
+  WaveformSpec lagging60 = sine(50, 820, 2048, 1.0);
+  lagging60.phase = -M_PI / 3;
+  WaveformSpec leading45 = sine(50, 600, 2048, 1.0);
+  leading45.phase = M_PI / 4;
+  WaveformSpec small = sine(50, 40, 2048, 1.5);
+  small.phase = -0.45;
+
+  WaveformSpec line60 = line;
+  line60.frequency = 60;
+  WaveformSpec lagging60Hz = lagging30;
+  lagging60Hz.frequency = 60;
+  WaveformSpec lineLow = line;
+  lineLow.frequency = 49.7;
+  WaveformSpec laggingLow = lagging30;
+  laggingLow.frequency = 49.7;
+  WaveformSpec lineHigh = line;
+  lineHigh.frequency = 50.3;
+  WaveformSpec resistiveHigh = sine(50.3, 820, 2048, 1.0);
+
+  PowerCase cases[] = {
+    {"resistive, PF 1", 50, sine(50, 820, 2048, 1.0), line},
+    {"inductive 30 deg, PF 0.87", 50, lagging30, line},
+    {"inductive 60 deg, PF 0.50", 50, lagging60, line},
+    {"capacitive 45 deg, PF 0.71", 50, leading45, line},
+    {"rectifier, distortion PF", 50, rectifier, line},
+    {"0.1 A, 26 deg, noisy", 50, small, line},
+    {"60 Hz mains, 30 deg", 60, lagging60Hz, line60},
+    {"49.7 Hz mains, 30 deg", 50, laggingLow, lineLow},
+    {"50.3 Hz mains, PF 1", 50, resistiveHigh, lineHigh},
+  };
+
+  printf("\n%-28s %9s %9s %7s %7s %8s %8s %8s\n", "case (voltage channel)", "P counts", "expected", "PF",
+         "exp.", "V rms", "exp.", "Hz");
+
+  int failures = 0;
+  uint16_t block[ADC_DMA_BUFFER_LEN];
+  uint16_t volts[ADC_DMA_BUFFER_LEN];
+  for (const PowerCase& c : cases) {
+    // V is converted half a sample period after I
+    WaveformSpec skewed = c.voltage;
+    skewed.phase += 2 * M_PI * c.voltage.frequency / (2.0 * ADC_SAMPLE_RATE);
+
+    SyntheticWaveform current(c.current, ADC_SAMPLE_RATE, options.seed);
+    SyntheticWaveform voltage(skewed, ADC_SAMPLE_RATE, options.seed + 1);
+    SyntheticWaveform reference(c.voltage, ADC_SAMPLE_RATE, options.seed + 1);
+    current.skip(options.seed % 89);
+    voltage.skip(options.seed % 89);
+
+    double power;
+    expectedPower(current, reference, power);
+    double apparent = current.acRms() * reference.acRms();
+    double pf = power / apparent;
+
+    CycleWindow window(ADC_SAMPLE_RATE, c.mainsHz, WINDOW_CYCLES);
+    double worstPower = 0, worstPf = 0, worstVoltage = 0, worstFrequency = 0;
+    WindowResult last = {};
+    int windows = 0;
+    while (windows < options.windows) {
+      current.fill(block, ADC_DMA_BUFFER_LEN);
+      voltage.fill(volts, ADC_DMA_BUFFER_LEN);
+      size_t pos = 0;
+      while (pos < ADC_DMA_BUFFER_LEN) {
+        pos += window.add(block + pos, volts + pos, ADC_DMA_BUFFER_LEN - pos);
+        if (window.available()) {
+          last = window.take();
+          double measuredPf = last.realPower / (last.rms * last.voltageRms);
+          worstPower = std::max(worstPower, fabs(last.realPower - power) / apparent);
+          worstPf = std::max(worstPf, fabs(measuredPf - pf));
+          worstVoltage = std::max(worstVoltage, fabs(last.voltageRms - reference.acRms()) / reference.acRms());
+          worstFrequency = std::max(worstFrequency, fabs(last.frequency - c.voltage.frequency));
+          windows++;
+        }
+      }
+    }
+
+    bool ok = last.hasVoltage && worstPower <= CHECK_POWER_TOLERANCE && worstPf <= CHECK_PF_TOLERANCE &&
+              worstVoltage <= CHECK_RMS_TOLERANCE && worstFrequency <= CHECK_FREQ_TOLERANCE;
+    printf("%-28s %9.0f %9.0f %7.3f %7.3f %8.2f %8.2f %8.3f %s\n", c.name, last.realPower, power,
+           last.realPower / (last.rms * last.voltageRms), pf, last.voltageRms, reference.acRms(), last.frequency,
+           ok ? "" : "FAIL");
+    if (!ok) {
+      failures++;
+    }
+  }
+  return failures;
+}
+
+static int checkHarmonics(const CheckOptions& options) {
+  WaveformSpec rectifier = sine(50, 500, 2048, 1.5);
+  rectifier.harmonics[3] = 0.75;
+  rectifier.harmonics[5] = 0.45;
+  rectifier.harmonics[7] = 0.20;
+
+  // Switched-mode supply: a long odd series
+  WaveformSpec smps = sine(50, 300, 2048, 1.5);
+  const double series[] = {0.82, 0.61, 0.38, 0.21, 0.12, 0.09, 0.07};
+  for (int i = 0; i < 7; i++) {
+    smps.harmonics[3 + 2 * i] = series[i];
+  }
+  smps.phase = 0.4;
+
+  WaveformSpec motor = sine(50, 700, 2048, 1.0);
+  motor.harmonics[3] = 0.08;
+  motor.harmonics[5] = 0.03;
+  motor.phase = -0.6;
+
+  WaveformSpec lamp = sine(50, 60, 2048, 1.5);  // ~0.15 A LED driver
+  lamp.harmonics[3] = 0.55;
+  lamp.harmonics[5] = 0.25;
+
+  WaveformSpec rectifier60 = rectifier;
+  rectifier60.frequency = 60;
+  WaveformSpec rectifierLow = rectifier;
+  rectifierLow.frequency = 49.95;
+  WaveformSpec rectifierHigh = rectifier;
+  rectifierHigh.frequency = 50.05;
+
+  CheckCase cases[] = {
+    {"2 A sine", 50, sine(50, 820, 2048, 1.0)},
+    {"rectifier (3rd-7th)", 50, rectifier},
+    {"switched-mode (3rd-15th)", 50, smps},
+    {"motor, mild 3rd/5th", 50, motor},
+    {"small LED driver, noisy", 50, lamp},
+    {"rectifier, 60 Hz mains", 60, rectifier60},
+    {"rectifier, 49.95 Hz mains", 50, rectifierLow},
+    {"rectifier, 50.05 Hz mains", 50, rectifierHigh},
+  };
+
+  printf("\n%-28s %9s %9s %7s %7s %7s %8s %8s\n", "case (harmonics)", "fund.", "expected", "3rd %",
+         "5th %", "7th %", "THD %", "exp.");
+
+  int failures = 0;
+  uint16_t block[ADC_DMA_BUFFER_LEN];
+  for (const CheckCase& c : cases) {
+    SyntheticWaveform wave(c.wave, ADC_SAMPLE_RATE, options.seed);
+    CycleWindow window(ADC_SAMPLE_RATE, c.mainsHz, WINDOW_CYCLES);
+    wave.skip(options.seed % 101);
+
+    // Analytic RMS of each analysed order, and the THD over the same orders
+    double expected[CYCLE_WINDOW_HARMONICS];
+    double distortion = 0;
+    for (int h = 0; h < CYCLE_WINDOW_HARMONICS; h++) {
+      int order = 2 * h + 1;
+      double relative = order == 1 ? 1.0 : c.wave.harmonics[order];
+      expected[h] = c.wave.amplitude * relative / sqrt(2.0);
+      if (order > 1) {
+        distortion += relative * relative;
+      }
+    }
+    double expectedThd = sqrt(distortion);
+
+    double worstOrder = 0, worstThd = 0;
+    WindowResult last = {};
+    int windows = 0;
+    while (windows < options.windows) {
+      wave.fill(block, ADC_DMA_BUFFER_LEN);
+      size_t pos = 0;
+      while (pos < ADC_DMA_BUFFER_LEN) {
+        pos += window.add(block + pos, ADC_DMA_BUFFER_LEN - pos);
+        if (window.available()) {
+          last = window.take();
+          for (int h = 0; h < CYCLE_WINDOW_HARMONICS; h++) {
+            worstOrder = std::max(worstOrder, fabs(last.harmonics[h] - expected[h]) / expected[0]);
+          }
+          worstThd = std::max(worstThd, fabs(last.thd - expectedThd));
+          windows++;
+        }
+      }
+    }
+
+    bool ok = last.hasHarmonics && worstOrder <= CHECK_HARMONIC_TOLERANCE && worstThd <= CHECK_THD_TOLERANCE;
+    printf("%-28s %9.2f %9.2f %7.2f %7.2f %7.2f %8.2f %8.2f %s\n", c.name, last.harmonics[0], expected[0],
+           100 * last.harmonics[1] / last.harmonics[0], 100 * last.harmonics[2] / last.harmonics[0],
+           100 * last.harmonics[3] / last.harmonics[0], 100 * last.thd, 100 * expectedThd, ok ? "" : "FAIL");
+    if (!ok) {
+      failures++;
+    }
+  }
+  return failures;
+}
+
+int main(int argc, char** argv) {
+  CheckOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  WaveformSpec distorted = sine(50, 600, 2048, 1.5);
+  distorted.harmonics[3] = 0.30;
+  distorted.harmonics[5] = 0.12;
+  distorted.phase = 0.7;
+
+  CheckCase cases[] = {
+    {"2 A sine 50 Hz", 50, sine(50, 820, 2048, 0)},
+    {"0.3 A sine, low bias, noise", 50, sine(50, 123, 1890, 2.0)},
+    {"1 A sine 60 Hz", 60, sine(60, 410, 2048, 1.0)},
+    {"distorted (3rd/5th)", 50, distorted},
+    {"mains at 49.8 Hz", 50, sine(49.8, 820, 2048, 1.0)},
+    {"mains at 50.2 Hz", 50, sine(50.2, 820, 2048, 1.0)},
+    {"large 3.3 A sine", 50, sine(50, 1350, 2048, 2.0)},
+  };
+
+  printf("=== Node sampling kernel (CycleWindow) ===\n");
+  printf("ADC %d Hz, DMA buffers of %d samples, %d-cycle windows, %d windows per case\n\n",
+         ADC_SAMPLE_RATE, ADC_DMA_BUFFER_LEN, WINDOW_CYCLES, options.windows);
+  printf("%-30s %9s %9s %9s %9s %7s %7s %10s\n", "case", "rms", "expected", "err %", "dc err %", "crest",
+         "exp.", "legacy %");
+
+  int failures = 0;
+  uint16_t block[ADC_DMA_BUFFER_LEN];
+  for (const CheckCase& c : cases) {
+    SyntheticWaveform wave(c.wave, ADC_SAMPLE_RATE, options.seed);
+    CycleWindow window(ADC_SAMPLE_RATE, c.mainsHz, WINDOW_CYCLES);
+
+    // Start mid-cycle, as the DMA would
+    wave.skip(options.seed % 97);
+
+    double expected = wave.acRms();
+    double worstRms = 0, worstDc = 0, lastRms = 0, lastCrest = 0;
+    int windows = 0;
+    while (windows < options.windows) {
+      wave.fill(block, ADC_DMA_BUFFER_LEN);
+      size_t pos = 0;
+      while (pos < ADC_DMA_BUFFER_LEN) {
+        pos += window.add(block + pos, ADC_DMA_BUFFER_LEN - pos);
+        if (window.available()) {
+          WindowResult result = window.take();
+          lastRms = result.rms;
+          lastCrest = result.rms > 0 ? result.peak / result.rms : 0;
+          worstRms = std::max(worstRms, fabs(result.rms - expected) / expected);
+          worstDc = std::max(worstDc, fabs(result.mean - c.wave.dcLevel) / c.wave.amplitude);
+          windows++;
+        }
+      }
+    }
+
+    double legacy = legacyWorstError(c.wave, 200, options.seed);
+    bool ok = worstRms <= CHECK_RMS_TOLERANCE && worstDc <= CHECK_DC_TOLERANCE;
+    printf("%-30s %9.2f %9.2f %9.3f %9.3f %7.3f %7.3f %10.2f %s\n", c.name, lastRms, expected, worstRms * 100,
+           worstDc * 100, lastCrest, expectedCrest(wave), legacy * 100, ok ? "" : "FAIL");
+    if (!ok) {
+      failures++;
+    }
+  }
+
+  failures += checkPower(options);
+  failures += checkHarmonics(options);
+
+  printf("\n%d case(s) out of tolerance (rms %.1f%%, dc %.1f%% of peak, power %.1f%% of VA, PF %.2f, %.2f Hz,\n"
+         "harmonics %.1f%% of the fundamental, THD %.0f points)\n",
+         failures, CHECK_RMS_TOLERANCE * 100, CHECK_DC_TOLERANCE * 100, CHECK_POWER_TOLERANCE * 100,
+         CHECK_PF_TOLERANCE, CHECK_FREQ_TOLERANCE, CHECK_HARMONIC_TOLERANCE * 100, CHECK_THD_TOLERANCE * 100);
+  return failures ? 1 : 0;
+}
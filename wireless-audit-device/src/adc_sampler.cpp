@@ -0,0 +1,135 @@
+#include "adc_sampler.h"
+#include <driver/adc.h>
+#include <driver/i2s.h>
+
+#define ADC_I2S_PORT I2S_NUM_0
+
+static bool isAdc1Channel(int channel) {
+  return channel >= 0 && channel < ADC1_CHANNEL_MAX;
+}
+
+AdcSampler::AdcSampler(int adcPin, uint32_t rate, int secondPin) {
+  channels[0] = digitalPinToAnalogChannel(adcPin);
+  channels[1] = secondPin >= 0 ? digitalPinToAnalogChannel(secondPin) : -1;
+  sampleRate = rate;
+  running = false;
+  pendingFirst = -1;
+}
+
+bool AdcSampler::begin() {
+  if (running) {
+    return true;
+  }
+  if (!isAdc1Channel(channels[0]) || (channels[1] >= 0 && !isAdc1Channel(channels[1]))) {
+    Serial.println("✗ ADC DMA needs ADC1 pins (GPIO32-39)");
+    return false;
+  }
+  int channelCount = dualChannel() ? 2 : 1;
+
+  i2s_config_t config = {};
+  config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+  config.sample_rate = sampleRate * channelCount;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  config.intr_alloc_flags = ESP_INTR_FLAG_LEVEL1;
+  config.dma_buf_count = ADC_DMA_BUFFER_COUNT;
+  config.dma_buf_len = ADC_DMA_BUFFER_LEN;
+  config.use_apll = false;
+
+  if (i2s_driver_install(ADC_I2S_PORT, &config, 0, NULL) != ESP_OK) {
+    Serial.println("✗ I2S driver install failed");
+    return false;
+  }
+
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  for (int c = 0; c < channelCount; c++) {
+    adc1_config_channel_atten((adc1_channel_t)channels[c], ADC_ATTEN_DB_11);
+  }
+  i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)channels[0]);
+
+  if (channelCount == 2) {
+    // Replace the single-entry pattern i2s_set_adc_mode() installed
+    static adc_digi_pattern_table_t pattern[2];
+    for (int c = 0; c < 2; c++) {
+      pattern[c].atten = ADC_ATTEN_DB_11;
+      pattern[c].bit_width = ADC_WIDTH_BIT_12;
+      pattern[c].channel = channels[c];
+    }
+    adc_digi_config_t digi = {};
+    digi.conv_limit_en = false;
+    digi.conv_limit_num = 255;
+    digi.adc1_pattern_len = 2;
+    digi.adc1_pattern = pattern;
+    digi.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    digi.format = ADC_DIGI_FORMAT_12BIT;
+    adc_digi_controller_config(&digi);
+  }
+
+  if (i2s_adc_enable(ADC_I2S_PORT) != ESP_OK) {
+    i2s_driver_uninstall(ADC_I2S_PORT);
+    Serial.println("✗ I2S ADC enable failed");
+    return false;
+  }
+
+  pendingFirst = -1;
+  running = true;
+  return true;
+}
+
+void AdcSampler::end() {
+  if (!running) {
+    return;
+  }
+  i2s_adc_disable(ADC_I2S_PORT);
+  i2s_driver_uninstall(ADC_I2S_PORT);
+  running = false;
+}
+
+size_t AdcSampler::read(uint16_t* first, uint16_t* second, size_t maxSamples, uint32_t waitMs) {
+  if (!running || (dualChannel() && !second)) {
+    return 0;
+  }
+  size_t words = maxSamples * (dualChannel() ? 2 : 1);
+  if (words > ADC_DMA_BUFFER_LEN) {
+    words = ADC_DMA_BUFFER_LEN;
+  }
+  words &= ~(size_t)1;  // Whole sample pairs, see below
+
+  size_t bytesRead = 0;
+  i2s_read(ADC_I2S_PORT, raw, words * sizeof(uint16_t), &bytesRead, pdMS_TO_TICKS(waitMs));
+  size_t count = bytesRead / sizeof(uint16_t);
+
+  // Each 32-bit DMA word holds two samples with the later one first, and
+  // every sample carries its channel in the top 4 bits
+  size_t out = 0;
+  for (size_t i = 0; i + 1 < count; i += 2) {
+    uint16_t pair[2] = {raw[i + 1], raw[i]};
+    for (int k = 0; k < 2; k++) {
+      int channel = pair[k] >> 12;
+      uint16_t value = pair[k] & 0x0FFF;
+      if (!dualChannel()) {
+        if (channel == channels[0]) {
+          first[out++] = value;
+        }
+      } else if (channel == channels[0]) {
+        pendingFirst = value;
+      } else if (channel == channels[1] && pendingFirst >= 0) {
+        // Pair each second-channel sample with the one taken just before
+        first[out] = pendingFirst;
+        second[out++] = value;
+        pendingFirst = -1;
+      }
+    }
+  }
+  return out;
+}
+
+void AdcSampler::flush() {
+  if (running) {
+    size_t bytesRead;
+    while (i2s_read(ADC_I2S_PORT, raw, sizeof(raw), &bytesRead, 0) == ESP_OK && bytesRead > 0) {
+    }
+    pendingFirst = -1;
+  }
+}
@@ -1,107 +1,145 @@
 #include "current_sensor.h"
 #include "config.h"
 
-CurrentSensor::CurrentSensor(int sensorPin, float burden, float ratio, float vref, float resolution) {
+CurrentSensor::CurrentSensor(int sensorPin, float burden, float ratio, float vref, float resolution,
+                             int voltagePin, float voltageCalibration)
+    : sampler(sensorPin, ADC_SAMPLE_RATE, voltagePin), window(ADC_SAMPLE_RATE, MAINS_FREQUENCY, WINDOW_CYCLES) {
   pin = sensorPin;
   burdenResistor = burden;
   currentRatio = ratio;
   adcVref = vref;
   adcResolution = resolution;
+  
+  // Convert ADC counts to voltage, then voltage to current
+  // SCT-013 outputs current proportional to line current
+  // With burden resistor, voltage = I_line / ratio * burden_resistor
+  // So: I_line = (voltage / burden_resistor) * ratio
+  ampsPerCount = (adcVref / adcResolution) / burdenResistor * currentRatio;
+  voltsPerCount = voltageCalibration;
+  latest = {};
 }
 
-void CurrentSensor::begin() {
-  pinMode(pin, INPUT);
-  delay(100);
-  calibrateOffset();
-}
-
-void CurrentSensor::calibrateOffset() {
-  // Take multiple samples with no load to find DC offset
-  float sum = 0;
-  int samples = 1000;
-  
-  for (int i = 0; i < samples; i++) {
-    int raw = analogRead(pin);
-    sum += raw;
-    delayMicroseconds(100);
+void CurrentSensor::begin(bool settle) {
+  if (!sampler.begin() || !settle) {
+    return;
   }
   
-  offset = (sum / samples) - (adcResolution / 2.0);
-  Serial.print("Calibrated offset: ");
-  Serial.println(offset);
+  // The first window seeds the offset tracker: over whole mains cycles its
+  // mean is the DC bias, so the load does not need to be off
+  unsigned long start = millis();
+  while (!fresh && millis() - start < 1000) {
+    update(100);
+  }
+  fresh = false;
+  Serial.print("DC offset: ");
+  Serial.println(window.getOffset());
+}
+
+void CurrentSensor::end() {
+  sampler.end();
+  fresh = false;
 }
 
 void CurrentSensor::calibrate() {
-  calibrateOffset();
+  window.resetOffset();
 }
 
-float CurrentSensor::calculateRMS(float* samples, int count) {
-  float sumSquares = 0;
+bool CurrentSensor::update(uint32_t waitMs) {
+  bool completed = false;
   
-  for (int i = 0; i < count; i++) {
-    sumSquares += samples[i] * samples[i];
+  // First read may wait for the DMA; then drain whatever else is ready
+  uint16_t* volts = sampler.dualChannel() ? voltageBlock : nullptr;
+  size_t n = sampler.read(block, volts, ADC_DMA_BUFFER_LEN, waitMs);
+  while (n > 0) {
+    size_t pos = 0;
+    while (pos < n) {
+      pos += window.add(block + pos, volts ? volts + pos : nullptr, n - pos);
+      if (window.available()) {
+        latest = window.take();
+        fresh = true;
+        completed = true;
+      }
+    }
+    n = sampler.read(block, volts, ADC_DMA_BUFFER_LEN, 0);
   }
   
-  return sqrt(sumSquares / count);
+  return completed;
 }
 
-float CurrentSensor::readCurrent() {
-  // Sample AC waveform
-  float samples[SAMPLES_PER_CYCLE];
-  unsigned long startTime = micros();
-  
-  for (int i = 0; i < SAMPLES_PER_CYCLE; i++) {
-    int raw = analogRead(pin);
-    
-    // Convert to voltage (remove offset)
-    float voltage = ((raw - offset) / adcResolution) * adcVref;
-    
-    // Convert voltage to current
-    // SCT-013 outputs current proportional to line current
-    // With burden resistor, voltage = I_line / ratio * burden_resistor
-    // So: I_line = (voltage / burden_resistor) * ratio
-    float current = (voltage / burdenResistor) * currentRatio;
-    
-    samples[i] = current;
-    
-    // Maintain sampling rate
-    while (micros() - startTime < (i * (1000000.0 / SAMPLING_FREQUENCY))) {
-      delayMicroseconds(10);
-    }
+bool CurrentSensor::measure(Measurement& result, float assumedVoltage) {
+  // Wait (CPU idle on the DMA) for a window completed after the last read
+  unsigned long windowMs = 1000UL * WINDOW_CYCLES / MAINS_FREQUENCY;
+  unsigned long start = millis();
+  while (!fresh && millis() - start < 2 * windowMs + 100) {
+    update(windowMs);
+  }
+  if (!fresh) {
+    return false;  // Sampler not running
   }
+  fresh = false;
   
-  // Calculate RMS current
-  float rmsCurrent = calculateRMS(samples, SAMPLES_PER_CYCLE);
+  // Every value comes from the same window, so they agree with each other
+  result.samples = latest.samples;
+  result.current = latest.rms * ampsPerCount;
+  result.crestFactor = latest.rms > 0 ? latest.peak / latest.rms : 0;
+  
+  result.voltageMeasured = latest.hasVoltage;
   
   // Filter out noise (ignore very small currents)
-  if (rmsCurrent < 0.05) {
-    rmsCurrent = 0.0;
+  bool noise = result.current < 0.05;
+  if (noise) {
+    result.current = 0.0;
+    result.crestFactor = 0.0;
+  }
+  
+  if (result.voltageMeasured) {
+    // Real power is the mean of v*i; its sign only says which way the CT
+    // is clamped
+    result.voltage = latest.voltageRms * voltsPerCount;
+    result.frequency = latest.frequency;
+    result.apparentPower = result.voltage * result.current;
+    result.power = noise ? 0.0 : fabsf(latest.realPower) * ampsPerCount * voltsPerCount;
+    result.powerFactor = result.apparentPower > 0 ? min(1.0f, result.power / result.apparentPower) : 0.0;
+  } else {
+    result.voltage = assumedVoltage;
+    result.frequency = 0.0;
+    result.apparentPower = result.current * assumedVoltage;
+    result.powerFactor = estimatePowerFactor(result.current, result.crestFactor);
+    result.power = result.apparentPower * result.powerFactor;
   }
   
-  return rmsCurrent;
+  result.harmonicsMeasured = latest.hasHarmonics;
+  for (int h = 0; h < CYCLE_WINDOW_HARMONICS; h++) {
+    result.harmonics[h] = noise ? 0.0 : latest.harmonics[h] * ampsPerCount;
+  }
+  result.thd = noise ? 0.0 : latest.thd;
+  return true;
 }
 
-float CurrentSensor::readPower(float voltage, float powerFactor) {
-  float current = readCurrent();
-  return current * voltage * powerFactor;
+float CurrentSensor::readCurrent() {
+  Measurement result;
+  return measure(result) ? result.current : 0.0;
 }
 
-float CurrentSensor::readPowerFactor() {
+float CurrentSensor::estimatePowerFactor(float current, float crestFactor) {
   // Simplified power factor estimation
   // In a real implementation, you'd analyze the phase relationship
   // between voltage and current waveforms
-  // For now, return a default value or estimate based on current waveform shape
-  
-  float current = readCurrent();
   
   // Very rough estimation: lower current might indicate lower PF
+  float pf;
   if (current < 0.5) {
-    return 0.75;  // Lower PF for small loads
+    pf = 0.75;  // Lower PF for small loads
   } else if (current < 2.0) {
-    return 0.85;  // Medium PF
+    pf = 0.85;  // Medium PF
   } else {
-    return 0.90;  // Higher PF for larger loads
+    pf = 0.90;  // Higher PF for larger loads
+  }
+  
+  // A peaky current (rectifier front ends) cannot have a PF above roughly
+  // sqrt(2) / crest factor, whatever its size
+  if (crestFactor > 1.6) {
+    pf = min(pf, max(0.4f, 1.414f / crestFactor));
   }
+  return pf;
 }
-
-
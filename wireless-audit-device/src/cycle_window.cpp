@@ -0,0 +1,269 @@
+#include "cycle_window.h"
+#include <math.h>
+
+static void clearSums(ChannelSums& channel) {
+  channel.sum = 0;
+  channel.rawSum = 0;
+  channel.sumSquares = 0;
+}
+
+// n^2 * variance, exact in 64 bits: removes the residual DC the tracker
+// has not followed
+static int64_t spread(const ChannelSums& channel, uint32_t n) {
+  return (int64_t)n * channel.sumSquares - (int64_t)channel.sum * channel.sum;
+}
+
+CycleWindow::CycleWindow(uint32_t rate, uint32_t mainsHz, uint32_t cycles, bool harmonics) {
+  // Rounded when the rate is not a multiple of the mains frequency; pick
+  // ADC_SAMPLE_RATE so it is (12 kHz divides evenly for 50 and 60 Hz)
+  sampleRate = rate;
+  windowLength = (sampleRate * cycles + mainsHz / 2) / mainsHz;
+  if (windowLength == 0) {
+    windowLength = 1;
+  }
+  complete = false;
+  result = {};
+  
+  cycleSamples = 0;
+  uint32_t perCycle = windowLength / cycles;
+  if (harmonics && cycles > 0 && perCycle * cycles == windowLength && perCycle % 4 == 0 &&
+      perCycle <= CYCLE_WINDOW_MAX_CYCLE_SAMPLES) {
+    cycleSamples = perCycle;
+    quarterCycle = perCycle / 4;
+    buildSineTable();
+  }
+  for (int h = 0; h < CYCLE_WINDOW_HARMONICS; h++) {
+    phase[h] = 0;
+  }
+  resetOffset();
+}
+
+void CycleWindow::buildSineTable() {
+  // First quarter computed, the rest mirrored so the table sums to exactly
+  // zero over any whole cycle, at every order: a constant (the DC bias)
+  // then contributes nothing to any bin
+  for (uint16_t n = 0; n <= quarterCycle; n++) {
+    int16_t value = (int16_t)lroundf(32767.0f * sinf(6.2831853f * n / cycleSamples));
+    sineTable[n] = value;
+    sineTable[2 * quarterCycle - n] = value;
+    sineTable[2 * quarterCycle + n] = -value;
+    if (n > 0) {
+      sineTable[cycleSamples - n] = -value;
+    }
+  }
+  // Extra quarter so cos(x) = sineTable[index + quarterCycle] needs no wrap
+  for (uint16_t n = 0; n < quarterCycle; n++) {
+    sineTable[cycleSamples + n] = sineTable[n];
+  }
+}
+
+void CycleWindow::resetOffset() {
+  current.biasQ16 = 2048 << 16;  // Mid-scale until the first window
+  voltage.biasQ16 = 4096 << 16;  // Same, in half-counts
+  biasSeeded = false;
+  voltagePrimed = false;
+  lastAligned = 0;
+  restart();
+}
+
+void CycleWindow::restart() {
+  count = 0;
+  clearSums(current);
+  minSample = 0xFFFF;
+  maxSample = 0;
+  
+  clearSums(voltage);
+  crossSum = 0;
+  voltageCount = 0;
+  crossings = 0;
+  crossingArmed = false;
+  
+  for (int h = 0; h < CYCLE_WINDOW_HARMONICS; h++) {
+    harmonicCos[h] = 0;
+    harmonicSin[h] = 0;
+  }
+}
+
+size_t CycleWindow::add(const uint16_t* samples, const uint16_t* volts, size_t n) {
+  if (complete) {
+    return 0;
+  }
+
+  size_t take = windowLength - count;
+  if (take > n) {
+    take = n;
+  }
+
+  if (volts) {
+    addWithVoltage(samples, volts, take);
+  } else {
+    addCurrent(samples, take);
+  }
+  if (cycleSamples > 0) {
+    addHarmonics(samples, take);
+  }
+  count += take;
+
+  if (count == windowLength) {
+    finish();
+  }
+  return take;
+}
+
+void CycleWindow::addCurrent(const uint16_t* samples, size_t n) {
+  int32_t bias = current.biasQ16;
+  int32_t windowSum = current.sum;
+  int32_t windowRaw = current.rawSum;
+  int64_t windowSquares = current.sumSquares;
+  uint16_t low = minSample;
+  uint16_t high = maxSample;
+  for (size_t i = 0; i < n; i++) {
+    int32_t s = samples[i];
+    int32_t d = s - (bias >> 16);
+    windowSum += d;
+    windowRaw += s;
+    windowSquares += d * d;
+    if (biasSeeded) {
+      bias += ((s << 16) - bias) >> CYCLE_WINDOW_BIAS_SHIFT;
+    }
+    if (s < low) low = s;
+    if (s > high) high = s;
+  }
+  current.biasQ16 = bias;
+  current.sum = windowSum;
+  current.rawSum = windowRaw;
+  current.sumSquares = windowSquares;
+  minSample = low;
+  maxSample = high;
+}
+
+void CycleWindow::addWithVoltage(const uint16_t* samples, const uint16_t* volts, size_t n) {
+  ChannelSums i = current;
+  ChannelSums v = voltage;
+  int64_t cross = crossSum;
+  uint16_t low = minSample;
+  uint16_t high = maxSample;
+  uint16_t previous = voltagePrimed ? lastVoltage : volts[0];
+  int32_t lastDv = lastAligned;
+  
+  for (size_t k = 0; k < n; k++) {
+    int32_t s = samples[k];
+    int32_t di = s - (i.biasQ16 >> 16);
+    i.sum += di;
+    i.rawSum += s;
+    i.sumSquares += di * di;
+    
+    // V re-centred on this I sample, in half-counts
+    int32_t va = previous + volts[k];
+    previous = volts[k];
+    int32_t dv = va - (v.biasQ16 >> 16);
+    v.sum += dv;
+    v.rawSum += va;
+    v.sumSquares += dv * dv;
+    cross += di * dv;
+    
+    if (biasSeeded) {
+      i.biasQ16 += ((s << 16) - i.biasQ16) >> CYCLE_WINDOW_BIAS_SHIFT;
+      v.biasQ16 += ((va << 16) - v.biasQ16) >> CYCLE_WINDOW_BIAS_SHIFT;
+    }
+    if (s < low) low = s;
+    if (s > high) high = s;
+    
+    // Rising zero crossing, once per cycle thanks to the hysteresis
+    if (dv < -CYCLE_WINDOW_ZC_HYSTERESIS) {
+      crossingArmed = true;
+    } else if (crossingArmed && dv >= 0 && lastDv < 0 && (count + k) > 0) {
+      float at = (count + k - 1) + (float)-lastDv / (dv - lastDv);
+      if (crossings == 0) {
+        firstCrossing = at;
+      }
+      lastCrossing = at;
+      crossings++;
+      crossingArmed = false;
+    }
+    lastDv = dv;
+  }
+  
+  current = i;
+  voltage = v;
+  crossSum = cross;
+  minSample = low;
+  maxSample = high;
+  lastVoltage = previous;
+  lastAligned = lastDv;
+  voltagePrimed = true;
+  voltageCount += n;
+}
+
+void CycleWindow::addHarmonics(const uint16_t* samples, size_t n) {
+  // One order at a time keeps each inner loop to two multiply-adds; the
+  // table index of order h advances by h per sample
+  for (int h = 0; h < CYCLE_WINDOW_HARMONICS; h++) {
+    uint16_t order = 2 * h + 1;
+    uint16_t index = phase[h];
+    int64_t re = harmonicCos[h];
+    int64_t im = harmonicSin[h];
+    for (size_t k = 0; k < n; k++) {
+      int32_t s = samples[k];
+      re += s * sineTable[index + quarterCycle];
+      im += s * sineTable[index];
+      index += order;
+      if (index >= cycleSamples) {
+        index -= cycleSamples;
+      }
+    }
+    harmonicCos[h] = re;
+    harmonicSin[h] = im;
+    phase[h] = index;
+  }
+}
+
+void CycleWindow::finish() {
+  int64_t currentSpread = spread(current, count);
+  result.samples = count;
+  result.mean = (float)current.rawSum / count;
+  result.rms = currentSpread > 0 ? sqrtf((float)currentSpread) / count : 0;
+  result.peak = fmaxf(maxSample - result.mean, result.mean - minSample);
+  
+  result.hasVoltage = voltageCount == count;
+  if (result.hasVoltage) {
+    // Half-counts back to counts: /2 for V, /2 for v*i
+    int64_t voltageSpread = spread(voltage, count);
+    int64_t powerSpread = (int64_t)count * crossSum - (int64_t)current.sum * voltage.sum;
+    result.voltageRms = voltageSpread > 0 ? sqrtf((float)voltageSpread) / count / 2 : 0;
+    result.realPower = (float)powerSpread / ((float)count * count) / 2;
+    result.frequency = crossings >= 2 ? (crossings - 1) * (float)sampleRate / (lastCrossing - firstCrossing) : 0;
+  } else {
+    result.voltageRms = 0;
+    result.realPower = 0;
+    result.frequency = 0;
+  }
+  
+  result.hasHarmonics = cycleSamples > 0;
+  float distortion = 0;
+  for (int h = 0; h < CYCLE_WINDOW_HARMONICS; h++) {
+    // |X| = N/2 * peak * 32767, so RMS = sqrt(2) |X| / (N * 32767)
+    float re = (float)harmonicCos[h];
+    float im = (float)harmonicSin[h];
+    result.harmonics[h] = result.hasHarmonics ? sqrtf(re * re + im * im) * (1.4142136f / 32767.0f) / count : 0;
+    if (h > 0) {
+      distortion += result.harmonics[h] * result.harmonics[h];
+    }
+  }
+  result.thd = result.harmonics[0] > 0 ? sqrtf(distortion) / result.harmonics[0] : 0;
+  complete = true;
+
+  if (!biasSeeded) {
+    current.biasQ16 = (int32_t)lroundf(result.mean * 65536.0f);
+    if (result.hasVoltage) {
+      voltage.biasQ16 = (int32_t)lroundf((float)voltage.rawSum / count * 65536.0f);
+    }
+    biasSeeded = true;
+  }
+  restart();
+}
+
+WindowResult CycleWindow::take() {
+  complete = false;
+  return result;
+}
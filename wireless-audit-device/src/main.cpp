@@ -1,27 +1,61 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <esp_now.h>
-#include <ArduinoJson.h>
 #include "config.h"
+#include <esp_sleep.h>
+#include <sys/time.h>
 #include "current_sensor.h"
+#include "telemetry_frame.h"
+#include "sample_batch.h"
+#include "power_model.h"
+
+#if BATCH_SIZE < 1 || BATCH_SIZE > SAMPLE_BATCH_MAX + 1
+#error "BATCH_SIZE must be between 1 and SAMPLE_BATCH_MAX + 1"
+#endif
 
 // Current sensor
 CurrentSensor sensor(SCT013_PIN, SCT013_BURDEN_RESISTOR, SCT013_CURRENT_RATIO, 
-                     ADC_VREF, ADC_RESOLUTION);
+                     ADC_VREF, ADC_RESOLUTION, VOLTAGE_SENSE_PIN, VOLTAGE_CALIBRATION);
 
 // ESP-NOW peer info
 uint8_t masterMacAddr[] = MASTER_MAC_ADDR;
 
+// Telemetry
+const uint32_t nodeHash = TelemetryCodec::hashNodeId(NODE_ID);
+
+// Continuous mode: sent measurements held until the master acknowledges
+// them (the retransmit buffer)
+SampleBatch pending;
+
+// Latest acknowledgement from the Wi-Fi task: ACK_VALID | sequence, or 0
+#define ACK_VALID 0x10000UL
+volatile uint32_t ackReceived = 0;
+
 // Timing
 unsigned long lastTransmit = 0;
 
+// Low-power mode: measurements held across deep sleep
+RTC_DATA_ATTR SampleBatch batch;
+volatile int8_t sendStatus = -1;  // Last send callback: -1 pending, 1 delivered, 0 failed
+
 // Function prototypes
-void initESPNOW();
+bool initESPNOW();
 void onDataSent(const uint8_t* mac_addr, esp_now_send_status_t status);
-void sendDataToMaster(float current, float power, float powerFactor);
+void onDataReceived(const uint8_t* mac_addr, const uint8_t* data, int len);
+void applyAcknowledgement();
+void buildFrame(const Measurement& measurement, TelemetryFrame& frame);
+void sendDataToMaster(const Measurement& measurement);
+void runLowPowerCycle();
+bool sendBatch(const TelemetryFrame& newest);
+uint32_t nodeClockMs();
+void printPowerEstimate();
 
 void setup() {
   Serial.begin(115200);
+  
+#if LOW_POWER_MODE
+  runLowPowerCycle();  // Ends in deep sleep; the next wake starts here again
+#endif
   delay(1000);
   
   Serial.println("\n=== Wireless Energy Audit Node ===");
@@ -36,13 +70,15 @@ void setup() {
   // Initialize current sensor
   Serial.println("Initializing current sensor...");
   sensor.begin();
-  Serial.println("✓ Current sensor ready");
+  Serial.println(sensor.hasVoltageSense() ? "✓ Current and voltage sensing ready" : "✓ Current sensor ready");
   
-  // Initialize ESP-NOW
+  // Initialize ESP-NOW; numbering starts at random (see telemetry_frame.h)
+  pending.reset(esp_random(), esp_random());
   initESPNOW();
   
   Serial.println("\n=== Node Ready ===");
   Serial.println("Sending data every " + String(TRANSMIT_INTERVAL_MS / 1000) + " seconds");
+  printPowerEstimate();
 }
 
 void loop() {
@@ -50,43 +86,58 @@ void loop() {
   
   // Read sensor and transmit periodically
   if (now - lastTransmit >= TRANSMIT_INTERVAL_MS) {
-    // Read current
-    float current = sensor.readCurrent();
-    
-    // Calculate power
-    float powerFactor = sensor.readPowerFactor();
-    float power = sensor.readPower(LINE_VOLTAGE, powerFactor);
-    
-    // Send data to master
-    sendDataToMaster(current, power, powerFactor);
-    
-    // Print to serial for debugging
-    Serial.print("Current: ");
-    Serial.print(current, 2);
-    Serial.print(" A | Power: ");
-    Serial.print(power, 2);
-    Serial.print(" W | PF: ");
-    Serial.print(powerFactor, 2);
-    Serial.println();
+    // Current, power, PF and crest factor from one sample window
+    Measurement measurement;
+    if (sensor.measure(measurement)) {
+      // Send data to master
+      sendDataToMaster(measurement);
+      
+      // Print to serial for debugging
+      Serial.print("Current: ");
+      Serial.print(measurement.current, 2);
+      Serial.print(" A | Power: ");
+      Serial.print(measurement.power, 2);
+      Serial.print(" W | PF: ");
+      Serial.print(measurement.powerFactor, 2);
+      Serial.print(" | Crest: ");
+      Serial.print(measurement.crestFactor, 2);
+      if (measurement.voltageMeasured) {
+        Serial.print(" | ");
+        Serial.print(measurement.voltage, 1);
+        Serial.print(" V ");
+        Serial.print(measurement.frequency, 2);
+        Serial.print(" Hz");
+      }
+      if (measurement.harmonicsMeasured && measurement.current > 0) {
+        Serial.print(" | THD: ");
+        Serial.print(measurement.thd * 100, 1);
+        Serial.print("%");
+      }
+      Serial.println();
+    }
     
     lastTransmit = now;
   }
   
-  // Small delay to prevent watchdog issues
-  delay(100);
+  // Reduce captured DMA buffers into sample windows; blocks (CPU idle)
+  // until the next buffer completes, which also paces the loop
+  sensor.update(100);
 }
 
-void initESPNOW() {
+bool initESPNOW() {
   Serial.println("Initializing ESP-NOW...");
   
   if (esp_now_init() != ESP_OK) {
     Serial.println("✗ ESP-NOW initialization failed");
-    ESP.restart();
-    return;
+    if (!LOW_POWER_MODE) {
+      ESP.restart();
+    }
+    return false;
   }
   
-  // Register send callback
+  // Register send and acknowledgement callbacks
   esp_now_register_send_cb(onDataSent);
+  esp_now_register_recv_cb(onDataReceived);
   
   // Add peer (master)
   esp_now_peer_info_t peerInfo;
@@ -96,7 +147,7 @@ void initESPNOW() {
   
   if (esp_now_add_peer(&peerInfo) != ESP_OK) {
     Serial.println("✗ Failed to add peer");
-    return;
+    return false;
   }
   
   Serial.println("✓ ESP-NOW initialized");
@@ -106,9 +157,11 @@ void initESPNOW() {
     if (i < 5) Serial.print(":");
   }
   Serial.println();
+  return true;
 }
 
 void onDataSent(const uint8_t* mac_addr, esp_now_send_status_t status) {
+  sendStatus = status == ESP_NOW_SEND_SUCCESS ? 1 : 0;
   if (status == ESP_NOW_SEND_SUCCESS) {
     Serial.println("✓ Data sent successfully");
   } else {
@@ -116,23 +169,66 @@ void onDataSent(const uint8_t* mac_addr, esp_now_send_status_t status) {
   }
 }
 
-void sendDataToMaster(float current, float power, float powerFactor) {
-  // Create JSON packet
-  StaticJsonDocument<200> doc;
-  doc["id"] = NODE_ID;
-  doc["i"] = current;
-  doc["p"] = power;
-  doc["pf"] = powerFactor;
-  doc["t"] = millis();
+void onDataReceived(const uint8_t* mac_addr, const uint8_t* data, int len) {
+  // Runs in the Wi-Fi task; acknowledgements are cumulative, so keeping
+  // only the latest is enough
+  TelemetryAck ack;
+  if (TelemetryCodec::decodeAck(data, len, ack) && ack.nodeHash == nodeHash) {
+    ackReceived = ACK_VALID | ack.sequence;
+  }
+}
+
+void applyAcknowledgement() {
+  // One arriving between the read and the reset is lost; its samples are
+  // then sent once more and the master drops the repeats
+  uint32_t ack = ackReceived;
+  if (ack & ACK_VALID) {
+    ackReceived = 0;
+    pending.acknowledge(ack & 0xFFFF);
+  }
+}
+
+void buildFrame(const Measurement& measurement, TelemetryFrame& frame) {
+  // Binary telemetry frame (scaled integers, see telemetry_frame.h); the
+  // caller numbers it
+  frame.flags = measurement.voltageMeasured ? TELEMETRY_FLAG_VOLTAGE : TELEMETRY_FLAG_PF_ESTIMATED;
+  if (measurement.harmonicsMeasured) {
+    frame.flags |= TELEMETRY_FLAG_HARMONICS;
+  }
+  frame.powerFactor = (uint8_t)(measurement.powerFactor * 100 + 0.5);
+  frame.nodeHash = nodeHash;
+  frame.batchCount = 0;
+  frame.currentMa = (uint32_t)(measurement.current * 1000 + 0.5);
+  frame.powerDeciWatts = (uint32_t)(measurement.power * 10 + 0.5);
+  frame.voltageDeciVolts = (uint16_t)(measurement.voltage * 10 + 0.5);
+  frame.frequencyCentiHz = (uint16_t)(measurement.frequency * 100 + 0.5);
   
-  // Serialize to string
-  String jsonString;
-  serializeJson(doc, jsonString);
+  // Harmonics relative to the fundamental, 0.1%
+  float fundamental = measurement.harmonics[0];
+  frame.fundamentalMa = (uint32_t)(fundamental * 1000 + 0.5);
+  for (int i = 0; i < 3; i++) {
+    float ratio = fundamental > 0 ? measurement.harmonics[i + 1] / fundamental : 0;
+    frame.harmonicPermille[i] = (uint16_t)min(65535.0f, ratio * 1000 + 0.5f);
+  }
+  frame.thdPermille = (uint16_t)min(65535.0f, measurement.thd * 1000 + 0.5f);
+}
+
+void sendDataToMaster(const Measurement& measurement) {
+  applyAcknowledgement();
   
-  // Convert to byte array
-  uint8_t data[200];
-  int len = jsonString.length();
-  jsonString.getBytes(data, len + 1);
+  TelemetryFrame frame;
+  buildFrame(measurement, frame);
+  frame.sequence = pending.takeSequence();
+  frame.flags |= TELEMETRY_FLAG_LINK;
+  frame.transmission = pending.takeTransmission();
+  
+  // Unacknowledged measurements ride along in the batch
+  uint32_t now = nodeClockMs();
+  uint8_t data[TELEMETRY_FRAME_MAX];
+  size_t len = pending.encode(frame, now, data, sizeof(data));
+  if (pending.size() > 0) {
+    Serial.println("Resending " + String(pending.size()) + " unacknowledged measurements");
+  }
   
   // Send via ESP-NOW
   esp_err_t result = esp_now_send(masterMacAddr, data, len);
@@ -141,4 +237,98 @@ void sendDataToMaster(float current, float power, float powerFactor) {
     Serial.print("✗ ESP-NOW send error: ");
     Serial.println(result);
   }
-}
\ No newline at end of file
+  pending.push(frame, now);  // Until acknowledged
+}
+
+void runLowPowerCycle() {
+  unsigned long wokeAt = millis();
+  if (!batch.valid()) {
+    // Power-on or reset rather than a timer wake
+    batch.reset(esp_random(), esp_random());
+    Serial.println("\n=== Wireless Energy Audit Node (low-power) ===");
+    Serial.print("Node ID: ");
+    Serial.println(NODE_ID);
+    Serial.println("Measuring every " + String(SAMPLE_INTERVAL_MS / 1000) + " s, sending every " +
+                   String(BATCH_SIZE) + " measurements");
+    printPowerEstimate();
+  }
+  
+  // One window with the radio off; it is exact without a settled offset
+  Measurement measurement;
+  sensor.begin(false);
+  bool measured = sensor.measure(measurement);
+  sensor.end();
+  
+  if (measured) {
+    TelemetryFrame frame;
+    buildFrame(measurement, frame);
+    frame.sequence = batch.takeSequence();
+    
+    // Held samples stay for the next wake if the send fails (the oldest
+    // are dropped once the batch is full)
+    if (batch.size() + 1 < BATCH_SIZE || !sendBatch(frame)) {
+      batch.push(frame, nodeClockMs());
+    }
+  }
+  
+  unsigned long awakeMs = millis() - wokeAt;
+  uint64_t sleepMs = awakeMs < SAMPLE_INTERVAL_MS ? SAMPLE_INTERVAL_MS - awakeMs : 1;
+  Serial.flush();
+  esp_sleep_enable_timer_wakeup(sleepMs * 1000ULL);
+  esp_deep_sleep_start();
+}
+
+bool sendBatch(const TelemetryFrame& newest) {
+  WiFi.mode(WIFI_STA);
+  bool delivered = false;
+  if (initESPNOW()) {
+    TelemetryFrame frame = newest;
+    frame.flags |= TELEMETRY_FLAG_LINK;
+    frame.transmission = batch.takeTransmission();
+    
+    uint8_t data[TELEMETRY_FRAME_MAX];
+    size_t len = batch.encode(frame, nodeClockMs(), data, sizeof(data));
+    sendStatus = -1;
+    ackReceived = 0;
+    if (len > 0 && esp_now_send(masterMacAddr, data, len) == ESP_OK) {
+      // Wait for the master's acknowledgement before the radio goes down;
+      // the MAC-layer result alone says nothing with a broadcast address
+      unsigned long start = millis();
+      while (!(ackReceived & ACK_VALID) && sendStatus != 0 && millis() - start < ACK_TIMEOUT_MS) {
+        delay(1);
+      }
+    }
+    uint32_t ack = ackReceived;
+    delivered = (ack & ACK_VALID) && (uint16_t)ack == newest.sequence;
+    esp_now_deinit();
+  }
+  WiFi.mode(WIFI_OFF);
+  
+  if (delivered) {
+    Serial.println("✓ Sent " + String(batch.size() + 1) + " measurements");
+    batch.clear();
+  }
+  return delivered;
+}
+
+uint32_t nodeClockMs() {
+  // System time keeps running through deep sleep (RTC timer), unlike millis()
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (uint32_t)(now.tv_sec * 1000ULL + now.tv_usec / 1000);
+}
+
+void printPowerEstimate() {
+  PowerProfile profile = {POWER_SUPPLY_VOLTS, POWER_BOOT_MS, POWER_BOOT_MA, POWER_SAMPLE_MS, POWER_SAMPLE_MA,
+                          POWER_RADIO_MS, POWER_RADIO_MA, POWER_SLEEP_UA, POWER_ALWAYS_ON_MA};
+  PowerEstimate estimate = LOW_POWER_MODE
+    ? estimateDutyCycle(profile, SAMPLE_INTERVAL_MS, BATCH_SIZE, BATTERY_CAPACITY_MAH)
+    : estimateAlwaysOn(profile, TRANSMIT_INTERVAL_MS, BATTERY_CAPACITY_MAH);
+  Serial.print("Estimated ");
+  Serial.print(estimate.perSampleMj, 1);
+  Serial.print(" mJ per measurement, ");
+  Serial.print(estimate.averageMa, 2);
+  Serial.print(" mA average, ");
+  Serial.print(estimate.batteryDays, 1);
+  Serial.println(" days on " + String(BATTERY_CAPACITY_MAH) + " mAh");
+}
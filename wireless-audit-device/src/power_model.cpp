@@ -0,0 +1,35 @@
+#include "power_model.h"
+
+// Charge in mA*ms to energy in mJ
+static float millijoules(const PowerProfile& profile, float charge) {
+  return profile.supplyVolts * charge / 1000.0f;
+}
+
+static PowerEstimate fromCharge(const PowerProfile& profile, float chargePerSample, float radioCharge,
+                                uint32_t intervalMs, float batteryMah) {
+  PowerEstimate estimate;
+  estimate.perSampleMj = millijoules(profile, chargePerSample);
+  estimate.radioMj = millijoules(profile, radioCharge);
+  estimate.averageMa = chargePerSample / intervalMs;
+  estimate.batteryDays = estimate.averageMa > 0 ? batteryMah / estimate.averageMa / 24.0f : 0;
+  return estimate;
+}
+
+PowerEstimate estimateDutyCycle(const PowerProfile& profile, uint32_t intervalMs, uint32_t batchSize,
+                                float batteryMah) {
+  if (batchSize == 0) {
+    batchSize = 1;
+  }
+  float radioCharge = profile.radioMs * profile.radioMa;
+  float awakeMs = profile.bootMs + profile.sampleMs + profile.radioMs / batchSize;
+  float sleepMs = intervalMs > awakeMs ? intervalMs - awakeMs : 0;
+  float charge = profile.bootMs * profile.bootMa + profile.sampleMs * profile.sampleMa + radioCharge / batchSize +
+                 sleepMs * profile.sleepUa / 1000.0f;
+  return fromCharge(profile, charge, radioCharge, intervalMs, batteryMah);
+}
+
+PowerEstimate estimateAlwaysOn(const PowerProfile& profile, uint32_t intervalMs, float batteryMah) {
+  // Send airtime is negligible next to the idle current
+  float charge = intervalMs * profile.alwaysOnMa;
+  return fromCharge(profile, charge, 0, intervalMs, batteryMah);
+}
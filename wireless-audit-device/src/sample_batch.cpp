@@ -0,0 +1,50 @@
+#include "sample_batch.h"
+#include <string.h>
+
+void SampleBatch::reset(uint16_t firstSequence, uint16_t firstTransmission) {
+  magic = SAMPLE_BATCH_MAGIC;
+  nextSequence = firstSequence;
+  nextTransmission = firstTransmission;
+  count = 0;
+}
+
+void SampleBatch::push(const TelemetryFrame& sample, uint32_t takenAtMs) {
+  if (count == SAMPLE_BATCH_MAX) {
+    memmove(samples, samples + 1, (SAMPLE_BATCH_MAX - 1) * sizeof(BatchedSample));
+    count--;
+  }
+  BatchedSample& slot = samples[count++];
+  slot.takenAtMs = takenAtMs;
+  slot.powerFactor = sample.powerFactor;
+  slot.currentMa = sample.currentMa;
+  slot.powerDeciWatts = sample.powerDeciWatts;
+}
+
+size_t SampleBatch::encode(const TelemetryFrame& newest, uint32_t nowMs, uint8_t* buffer, size_t capacity) const {
+  TelemetryFrame frame = newest;
+  if (count > 0) {
+    frame.flags |= TELEMETRY_FLAG_BATCH;
+  }
+  frame.batchCount = count;
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t age = (nowMs - samples[i].takenAtMs + 50) / 100;
+    frame.batch[i].ageDeciSeconds = age > 0xFFFF ? 0xFFFF : age;
+    frame.batch[i].powerFactor = samples[i].powerFactor;
+    frame.batch[i].currentMa = samples[i].currentMa;
+    frame.batch[i].powerDeciWatts = samples[i].powerDeciWatts;
+  }
+  return TelemetryCodec::encode(frame, buffer, capacity);
+}
+
+uint8_t SampleBatch::acknowledge(uint16_t sequence) {
+  // Held samples run up to nextSequence - 1; a stale or foreign
+  // acknowledgement lands outside them and drops nothing
+  uint16_t oldest = nextSequence - count;
+  int16_t covered = (int16_t)(uint16_t)(sequence - oldest) + 1;
+  if (covered <= 0 || covered > count) {
+    return 0;
+  }
+  memmove(samples, samples + covered, (count - covered) * sizeof(BatchedSample));
+  count -= covered;
+  return covered;
+}